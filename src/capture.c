@@ -0,0 +1,422 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Implementation of the lossless display and sound capture.
+ *
+ *		The video core hands every frame to capture_video() along
+ *		with the lines that changed, and the sound core hands over
+ *		each mixed buffer. Only the changed lines are copied on the
+ *		emulation thread; they are queued, in order with the sound,
+ *		for a writer thread which keeps the full picture, encodes it
+ *		against the previous frame and writes the file.
+ *
+ *		The queue is bounded. When it is full the frame or sound is
+ *		dropped and counted, and the lines of a dropped frame are
+ *		carried over to the next one so the picture stays correct.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/video.h>
+#include <86box/capture.h>
+
+
+#define CAPTURE_QUEUE		32	/* must be a power of 2 */
+#define CAPTURE_KEY_INTERVAL	250	/* frames between key frames */
+
+
+typedef struct {
+    uint32_t	type;
+    int		w, h, y1, y2;
+    int		len;			/* audio sample frames */
+    uint64_t	audio_pos;
+    void	*data;
+} capture_item_t;
+
+
+static struct {
+    FILE	*fp;
+
+    thread_t	*thread;
+    event_t	*wake, *done;
+    mutex_t	*mutex;
+
+    uint32_t	head, tail;
+    capture_item_t queue[CAPTURE_QUEUE];
+
+    /* Only touched by the emulation thread. */
+    uint64_t	audio_pos;
+    int		pend_y1, pend_y2;
+    int		last_x, last_y, last_w, last_h;
+
+    /* Only touched by the writer thread. */
+    uint32_t	*cur, *prev;
+    uint8_t	*out;
+    int		w, h, since_key;
+}		cap;
+
+volatile int	capture_on = 0;
+uint64_t	capture_frames = 0,
+		capture_frames_dropped = 0,
+		capture_audio_dropped = 0;
+
+
+#ifdef ENABLE_CAPTURE_LOG
+int capture_do_log = ENABLE_CAPTURE_LOG;
+
+
+static void
+capture_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (capture_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define capture_log(fmt, ...)
+#endif
+
+
+static uint8_t *
+capture_put32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+    p[2] = (val >> 16) & 0xff;
+    p[3] = (val >> 24) & 0xff;
+
+    return p + 4;
+}
+
+
+static void
+capture_chunk(uint32_t type, const uint8_t *data, uint32_t len)
+{
+    uint8_t hdr[8];
+
+    capture_put32(capture_put32(hdr, type), len);
+    fwrite(hdr, 1, 8, cap.fp);
+    fwrite(data, 1, len, cap.fp);
+}
+
+
+/* Encode the picture in cap.cur against cap.prev, only lines y1 to y2 - 1 can differ. */
+static void
+capture_write_frame(capture_item_t *item)
+{
+    uint8_t *p = cap.out;
+    uint32_t *cur, *prev;
+    uint32_t c, n, skip, end;
+    int key;
+
+    key = (cap.since_key == 0);
+    if (++cap.since_key == CAPTURE_KEY_INTERVAL)
+	cap.since_key = 0;
+
+    p = capture_put32(p, item->audio_pos & 0xffffffff);
+    p = capture_put32(p, item->audio_pos >> 32);
+    p = capture_put32(p, cap.w);
+    p = capture_put32(p, cap.h);
+    p = capture_put32(p, key ? CAPTURE_KEY : CAPTURE_DELTA);
+
+    end = cap.w * cap.h;
+    if (key) {
+	for (c = 0; c < end; c++)
+		p = capture_put32(p, cap.cur[c] & 0xffffff);
+    } else {
+	cur = cap.cur;
+	prev = cap.prev;
+	skip = 0;
+	c = item->y1 * cap.w;
+	end = item->y2 * cap.w;
+
+	while (c < end) {
+		while ((c < end) && (cur[c] == prev[c]))
+			c++;
+		if (c == end)
+			break;
+		p = capture_put32(p, c - skip);
+
+		n = c;
+		while ((c < end) && (cur[c] != prev[c]))
+			c++;
+		p = capture_put32(p, 0x80000000 | (c - n));
+		for (; n < c; n++)
+			p = capture_put32(p, cur[n] & 0xffffff);
+		skip = c;
+	}
+    }
+
+    capture_chunk(CAPTURE_FRAME, cap.out, p - cap.out);
+
+    memcpy(&cap.prev[item->y1 * cap.w], &cap.cur[item->y1 * cap.w],
+	   (item->y2 - item->y1) * cap.w * sizeof(uint32_t));
+}
+
+
+static void
+capture_do(capture_item_t *item)
+{
+    int size;
+
+    if (item->type == CAPTURE_AUDIO) {
+	capture_chunk(CAPTURE_AUDIO, (uint8_t *) item->data, item->len * 2 * sizeof(int16_t));
+	return;
+    }
+
+    if ((item->w != cap.w) || (item->h != cap.h)) {
+	/* New resolution, the emulation thread sent the whole picture. */
+	size = item->w * item->h;
+	free(cap.cur);
+	free(cap.prev);
+	free(cap.out);
+	cap.cur = (uint32_t *) calloc(size, sizeof(uint32_t));
+	cap.prev = (uint32_t *) calloc(size, sizeof(uint32_t));
+	/* Worst case is alternating one kept and one literal pixel. */
+	cap.out = (uint8_t *) malloc((size * 8) + 64);
+	cap.w = item->w;
+	cap.h = item->h;
+	cap.since_key = 0;
+    }
+
+    memcpy(&cap.cur[item->y1 * cap.w], item->data, (item->y2 - item->y1) * cap.w * sizeof(uint32_t));
+    capture_write_frame(item);
+}
+
+
+static void
+capture_thread(void *param)
+{
+    capture_item_t item;
+
+    while (1) {
+	thread_wait_mutex(cap.mutex);
+	if (cap.head == cap.tail) {
+		thread_release_mutex(cap.mutex);
+		thread_wait_event(cap.wake, -1);
+		continue;
+	}
+	item = cap.queue[cap.tail & (CAPTURE_QUEUE - 1)];
+	thread_release_mutex(cap.mutex);
+
+	capture_do(&item);
+	free(item.data);
+
+	thread_wait_mutex(cap.mutex);
+	cap.tail++;
+	thread_release_mutex(cap.mutex);
+
+	thread_set_event(cap.done);
+    }
+}
+
+
+/* Returns a free queue slot, or NULL if the writer is behind. */
+static capture_item_t *
+capture_slot(void)
+{
+    capture_item_t *item = NULL;
+
+    thread_wait_mutex(cap.mutex);
+    if ((cap.head - cap.tail) < CAPTURE_QUEUE)
+	item = &cap.queue[cap.head & (CAPTURE_QUEUE - 1)];
+    thread_release_mutex(cap.mutex);
+
+    return item;
+}
+
+
+static void
+capture_queue(void)
+{
+    thread_wait_mutex(cap.mutex);
+    cap.head++;
+    thread_release_mutex(cap.mutex);
+
+    thread_set_event(cap.wake);
+}
+
+
+void
+capture_video(int x, int y, int y1, int y2, int w, int h)
+{
+    capture_item_t *item;
+    uint32_t *p;
+    int yy;
+
+    if ((w <= 0) || (h <= 0))
+	return;
+
+    /* The writer needs the whole picture whenever the rectangle changes. */
+    if ((x != cap.last_x) || (y != cap.last_y) || (w != cap.last_w) || (h != cap.last_h)) {
+	cap.last_x = x;
+	cap.last_y = y;
+	cap.last_w = w;
+	cap.last_h = h;
+	y1 = 0;
+	y2 = h;
+    }
+
+    /* Lines of frames that were dropped have to go out with this one. */
+    if (cap.pend_y1 < cap.pend_y2) {
+	if ((y1 >= y2) || (cap.pend_y1 < y1))
+		y1 = cap.pend_y1;
+	if (cap.pend_y2 > y2)
+		y2 = cap.pend_y2;
+    }
+    if (y1 < 0)
+	y1 = 0;
+    if (y2 > h)
+	y2 = h;
+    if (y1 >= y2)
+	y1 = y2 = 0;
+
+    item = capture_slot();
+    if (item == NULL) {
+	capture_frames_dropped++;
+	cap.pend_y1 = y1;
+	cap.pend_y2 = y2;
+	return;
+    }
+    cap.pend_y1 = cap.pend_y2 = 0;
+
+    p = (uint32_t *) malloc(((y2 - y1) * w * sizeof(uint32_t)) + 1);
+    for (yy = y1; yy < y2; yy++) {
+	if (((y + yy) >= 0) && ((y + yy) < buffer32->h))
+		memcpy(&p[(yy - y1) * w], &(buffer32->line[y + yy][x]), w << 2);
+	else
+		memset(&p[(yy - y1) * w], 0x00, w << 2);
+    }
+
+    item->type = CAPTURE_FRAME;
+    item->w = w;
+    item->h = h;
+    item->y1 = y1;
+    item->y2 = y2;
+    item->audio_pos = cap.audio_pos;
+    item->data = p;
+    capture_queue();
+
+    capture_frames++;
+}
+
+
+void
+capture_audio(int32_t *buffer, int len)
+{
+    capture_item_t *item;
+    int16_t *p;
+    int c;
+
+    item = capture_slot();
+    if (item == NULL) {
+	capture_audio_dropped += len;
+	return;
+    }
+
+    p = (int16_t *) malloc(len * 2 * sizeof(int16_t));
+    for (c = 0; c < (len * 2); c++) {
+	if (buffer[c] > 32767)
+		p[c] = 32767;
+	else if (buffer[c] < -32768)
+		p[c] = -32768;
+	else
+		p[c] = buffer[c];
+    }
+
+    item->type = CAPTURE_AUDIO;
+    item->len = len;
+    item->data = p;
+    capture_queue();
+
+    cap.audio_pos += len;
+}
+
+
+int
+capture_start(wchar_t *fn)
+{
+    uint8_t hdr[20];
+
+    if (capture_on)
+	capture_stop();
+
+    cap.fp = plat_fopen(fn, L"wb");
+    if (cap.fp == NULL) {
+	capture_log("Capture: unable to create '%ls'\n", fn);
+	return(-1);
+    }
+
+    memcpy(hdr, CAPTURE_MAGIC, 8);
+    capture_put32(capture_put32(capture_put32(&hdr[8], CAPTURE_VERSION), 48000), 2);
+    fwrite(hdr, 1, sizeof(hdr), cap.fp);
+
+    cap.head = cap.tail = 0;
+    cap.audio_pos = 0;
+    cap.pend_y1 = cap.pend_y2 = 0;
+    cap.w = cap.h = 0;
+    cap.last_w = cap.last_h = 0;
+
+    cap.mutex = thread_create_mutex();
+    cap.wake = thread_create_event();
+    cap.done = thread_create_event();
+    cap.thread = thread_create(capture_thread, NULL);
+
+    capture_on = 1;
+
+    capture_log("Capture: writing to '%ls'\n", fn);
+
+    return(0);
+}
+
+
+void
+capture_stop(void)
+{
+    if (!capture_on)
+	return;
+
+    capture_on = 0;
+
+    /* Let the writer finish what is queued. */
+    thread_wait_mutex(cap.mutex);
+    while (cap.head != cap.tail) {
+	thread_release_mutex(cap.mutex);
+	thread_wait_event(cap.done, -1);
+	thread_wait_mutex(cap.mutex);
+    }
+    thread_release_mutex(cap.mutex);
+
+    thread_kill(cap.thread);
+    thread_close_mutex(cap.mutex);
+    thread_destroy_event(cap.done);
+    thread_destroy_event(cap.wake);
+
+    fclose(cap.fp);
+    cap.fp = NULL;
+
+    free(cap.cur);
+    free(cap.prev);
+    free(cap.out);
+    cap.cur = cap.prev = NULL;
+    cap.out = NULL;
+
+    pclog("Capture: %" PRIu64 " frames written, %" PRIu64 " dropped, %" PRIu64 " sound samples dropped\n",
+	  capture_frames, capture_frames_dropped, capture_audio_dropped);
+}
@@ -27,6 +27,7 @@
 #include <86box/mem.h>
 #include <86box/port_92.h>
 #include <86box/chipset.h>
+#include <86box/snapshot.h>
 
 #define enabled_shadow (MEM_READ_INTERNAL | ((dev->regs[0x02] & 0x20) ? MEM_WRITE_DISABLED : MEM_WRITE_INTERNAL))
 #define disabled_shadow (MEM_READ_EXTANY | MEM_WRITE_EXTANY)
@@ -77,6 +78,29 @@ acc2168_read(uint16_t addr, void *p)
     return dev->regs[dev->reg_idx];
 }
 
+/* The shadow RAM state is restored with the rest of the memory state. */
+static void
+acc2168_save_state(void *priv, snapshot_t *s)
+{
+    acc2168_t *dev = (acc2168_t *) priv;
+
+    snapshot_put(s, dev->reg_idx);
+    snapshot_put(s, dev->regs);
+}
+
+
+static int
+acc2168_load_state(void *priv, snapshot_t *s)
+{
+    acc2168_t *dev = (acc2168_t *) priv;
+
+    snapshot_get(s, dev->reg_idx);
+    snapshot_get(s, dev->regs);
+
+    return 0;
+}
+
+
 static void
 acc2168_close(void *priv)
 {
@@ -107,5 +131,6 @@ const device_t acc2168_device = {
     0,
     acc2168_init, acc2168_close, NULL,
     { NULL }, NULL, NULL,
-    NULL
+    NULL,
+    acc2168_save_state, acc2168_load_state
 };
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -16,8 +17,6 @@
 #include "codegen_ops.h"
 #include "codegen_ops_helpers.h"
 
-#define MAX_INSTRUCTION_COUNT 50
-
 static struct
 {
         uint32_t pc;
@@ -693,6 +692,8 @@ generate_call:
                 {
                         if (new_pc != -1)
                                 uop_MOV_IMM(ir, IREG_pc, new_pc);
+                        if (codegen_trace_pending)
+                                codegen_trace_commit(block, new_pc);
 
                         codegen_endpc = (cs + cpu_state.pc) + 8;
 
@@ -703,6 +704,8 @@ generate_call:
 
                         return;
                 }
+                /*Handled by the interpreter after all, so the branch ends the block*/
+                codegen_trace_pending = 0;
         }
 
 // codegen_skip:
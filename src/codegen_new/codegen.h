@@ -30,6 +30,13 @@
   same page).
 */
 
+/*Number of chainable exits per block. Exit 0 is the end of the block, the rest
+  are handed out to taken branches in the order they are recompiled*/
+#define CODEBLOCK_CHAIN_EXITS 4
+
+/*Maximum number of x86 instructions in a block*/
+#define MAX_INSTRUCTION_COUNT 50
+
 typedef struct codeblock_t
 {
         uint32_t pc;
@@ -39,6 +46,9 @@ typedef struct codeblock_t
         uint16_t flags;
         uint8_t ins;
         uint8_t TOP;
+        /*Set whenever the block is entered, and cleared as the eviction clock
+          passes it. Blocks with this set are given a second chance*/
+        uint8_t used;
 
         /*Pointers for codeblock tree, used to search for blocks when hash lookup
           fails.*/
@@ -58,9 +68,32 @@ typedef struct codeblock_t
         /*First mem_block_t used by this block. Any subsequent mem_block_ts
           will be in the list starting at head_mem_block->next.*/
         struct mem_block_t *head_mem_block;
+
+        /*Block chaining. Each chainable exit remembers the block it last
+          continued into (chain_target) and the MMU flush generation the link
+          was made in (chain_gen). Links into this block are kept on a list
+          starting at chain_in and continuing through chain_next[] of the source
+          block, so they can be broken when this block goes away.*/
+        uint16_t chain_target[CODEBLOCK_CHAIN_EXITS];
+        uint32_t chain_next[CODEBLOCK_CHAIN_EXITS];
+        uint32_t chain_gen[CODEBLOCK_CHAIN_EXITS];
+        uint32_t chain_in;
+        /*Offset of code following the prologue register saves. Chained exits
+          jump here, reusing the stack frame of the first block in the chain.*/
+        uint16_t chain_entry;
+        uint8_t chain_exits;
+
+        /*Trace formation. trace_exits is a mask of the chained exits that are
+          trace side exits. trace_runs counts chained exits from this block, and
+          trace_misses those that were side exits*/
+        uint8_t trace_exits;
+        uint16_t trace_runs, trace_misses;
 } codeblock_t;
 
 extern codeblock_t *codeblock;
+/*Number of entries in codeblock[], at least BLOCK_SIZE. Set by
+  codegen_allocator_init() to match the size of the code arena*/
+extern int codegen_block_nr;
 
 extern uint16_t *codeblock_hash;
 
@@ -82,8 +115,13 @@ extern uint8_t *block_write_data;
 #define CODEBLOCK_IN_DIRTY_LIST 0x40
 /*Code block is not inlining immediate parameters, parameters must be fetched from memory*/
 #define CODEBLOCK_NO_IMMEDIATES 0x80
+/*Code block must not follow taken branches, as its traces were mispredicted*/
+#define CODEBLOCK_NO_TRACE 0x100
 
 #define BLOCK_PC_INVALID 0xffffffff
+/*Chained exits are identified by block number and exit number. Block 0 holds
+  the backend helper routines and is never a source, so 0 is not a valid ID*/
+#define CODEGEN_CHAIN_EXIT_ID(block, exit) ((get_block_nr(block) << 2) | (exit))
 
 #define BLOCK_INVALID 0
 
@@ -321,6 +359,7 @@ void codegen_block_init(uint32_t phys_addr);
 void codegen_block_remove();
 void codegen_block_start_recompile(codeblock_t *block);
 void codegen_block_end_recompile(codeblock_t *block);
+void codegen_block_end_cached(codeblock_t *block);
 void codegen_block_end();
 void codegen_delete_block(codeblock_t *block);
 void codegen_generate_call(uint8_t opcode, OpFn op, uint32_t fetchdat, uint32_t new_pc, uint32_t old_pc);
@@ -333,10 +372,25 @@ x86seg *codegen_generate_ea(struct ir_data_t *ir, x86seg *op_ea_seg, uint32_t fe
 void codegen_check_seg_read(codeblock_t *block, struct ir_data_t *ir, x86seg *seg);
 void codegen_check_seg_write(codeblock_t *block, struct ir_data_t *ir, x86seg *seg);
 
+/*Exit ID of the last chainable exit taken without a link, or 0. The dispatcher
+  links it to the next block it runs*/
+extern uint32_t codegen_chain_pending;
+void codegen_chain_link(codeblock_t *target);
+void *codegen_chain_next(uint32_t exit_id);
+int exec386_dynarec_can_chain(void);
+
+/*Set by the recompiler when the current instruction is a taken branch that the
+  block follows, so the dispatcher does not end the block at it*/
+extern int codegen_trace_pending;
+extern uint32_t codegen_trace_pc;
+extern uint64_t codegen_traces_formed, codegen_traces_dropped;
+
 int codegen_purge_purgable_list();
-/*Delete a random code block to free memory. This is obviously quite expensive, and
-  will only be called when the allocator is out of memory*/
-void codegen_delete_random_block(int required_mem_block);
+/*Delete the least recently used code block, to free a block or (if
+  required_mem_block is set) memory. This is obviously quite expensive, and will
+  only be called when the free lists are empty and the allocator can not grow*/
+void codegen_delete_lru_block(int required_mem_block);
+extern uint64_t codegen_blocks_evicted;
 
 extern int cpu_block_end;
 extern uint32_t codegen_endpc;
@@ -9,12 +9,14 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
 
 #include "codegen.h"
 #include "codegen_allocator.h"
+#include "codegen_backend.h"
 
 typedef struct mem_block_t
 {
@@ -23,32 +25,99 @@ typedef struct mem_block_t
         uint16_t code_block;
 } mem_block_t;
 
-static mem_block_t mem_blocks[MEM_BLOCK_NR];
+static mem_block_t *mem_blocks;
 static uint32_t mem_block_free_list;
 static uint8_t *mem_block_alloc = NULL;
+/*Number of mem_blocks with memory committed behind them, and the most that may
+  be committed*/
+static int mem_block_committed, mem_block_limit;
 
 int codegen_allocator_usage = 0;
+int codegen_allocator_size = 0;
+int codegen_block_nr = BLOCK_SIZE;
+
+/*Commit memory for the next MEM_BLOCK_GROW mem_blocks, and add them to the free
+  list. Returns 0 if the arena is already at its limit*/
+static int codegen_allocator_grow()
+{
+        int start = mem_block_committed;
+        int end = start + MEM_BLOCK_GROW;
+        int c;
+
+        if (start >= mem_block_limit)
+                return 0;
+        if (end > mem_block_limit)
+                end = mem_block_limit;
+
+#if defined WIN32 || defined _WIN32 || defined _WIN32
+        if (!VirtualAlloc(&mem_block_alloc[start * MEM_BLOCK_SIZE], (end - start) * MEM_BLOCK_SIZE, MEM_COMMIT, PAGE_EXECUTE_READWRITE))
+                return 0;
+#else
+        if (mprotect(&mem_block_alloc[start * MEM_BLOCK_SIZE], (end - start) * MEM_BLOCK_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC))
+                return 0;
+#endif
+
+        for (c = start; c < end; c++)
+        {
+                mem_blocks[c].next = (c < end-1) ? c+2 : mem_block_free_list;
+                mem_blocks[c].code_block = BLOCK_INVALID;
+        }
+        mem_block_free_list = start+1;
+        mem_block_committed = end;
+        codegen_allocator_size = ((uint64_t) end * MEM_BLOCK_SIZE) >> 10;
+
+        return 1;
+}
 
 void codegen_allocator_init()
 {
+        uint64_t block_nr;
         int c;
 
+        if (cpu_dynarec_cache > 0)
+        {
+                block_nr = ((uint64_t) cpu_dynarec_cache << 20) / MEM_BLOCK_SIZE;
+                if (block_nr < MEM_BLOCK_GROW)
+                        block_nr = MEM_BLOCK_GROW;
+                if (block_nr > MEM_BLOCK_MAX)
+                        block_nr = MEM_BLOCK_MAX;
+        }
+        else
+                block_nr = MEM_BLOCK_NR;
+        mem_block_limit = block_nr;
+
+        /*Keep the number of code blocks in proportion to the arena, within
+          what a 16-bit block number can address*/
+        block_nr = ((uint64_t) BLOCK_SIZE * mem_block_limit) / MEM_BLOCK_NR;
+        if (block_nr < BLOCK_SIZE)
+                block_nr = BLOCK_SIZE;
+        if (block_nr > 0x10000)
+                block_nr = 0x10000;
+        codegen_block_nr = block_nr;
+
+        /*Reserve the address space for the whole arena up front, so that it
+          stays contiguous as it grows, and only commit memory as it is used*/
 #if defined WIN32 || defined _WIN32 || defined _WIN32
-        mem_block_alloc = VirtualAlloc(NULL, MEM_BLOCK_NR * MEM_BLOCK_SIZE, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+        mem_block_alloc = VirtualAlloc(NULL, (size_t) mem_block_limit * MEM_BLOCK_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+        if (!mem_block_alloc)
 #else
-        mem_block_alloc = mmap(0, MEM_BLOCK_NR * MEM_BLOCK_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_ANON|MAP_PRIVATE, 0, 0);
+        mem_block_alloc = mmap(0, (size_t) mem_block_limit * MEM_BLOCK_SIZE, PROT_NONE, MAP_ANON|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+        if (mem_block_alloc == MAP_FAILED)
 #endif
+                fatal("codegen_allocator_init: unable to reserve %i kB for code\n", (int) (((uint64_t) mem_block_limit * MEM_BLOCK_SIZE) >> 10));
 
-        for (c = 0; c < MEM_BLOCK_NR; c++)
+        mem_blocks = malloc(mem_block_limit * sizeof(mem_block_t));
+        for (c = 0; c < mem_block_limit; c++)
         {
                 mem_blocks[c].offset = c * MEM_BLOCK_SIZE;
                 mem_blocks[c].code_block = BLOCK_INVALID;
-                if (c < MEM_BLOCK_NR-1)
-                        mem_blocks[c].next = c+2;
-                else
-                        mem_blocks[c].next = 0;
+                mem_blocks[c].next = 0;
         }
-        mem_block_free_list = 1;
+        mem_block_free_list = 0;
+        mem_block_committed = 0;
+
+        if (!codegen_allocator_grow())
+                fatal("codegen_allocator_init: unable to allocate code memory\n");
 }
 
 mem_block_t *codegen_allocator_allocate(mem_block_t *parent, int code_block)
@@ -58,12 +127,10 @@ mem_block_t *codegen_allocator_allocate(mem_block_t *parent, int code_block)
         
         while (!mem_block_free_list)
         {
-                /*Pick a random memory block and free the owning code block*/
-                block_nr = rand() & MEM_BLOCK_MASK;
-                block = &mem_blocks[block_nr];
-                
-                if (block->code_block && block->code_block != code_block)
-                        codegen_delete_block(&codeblock[block->code_block]);
+                /*Grow the arena if allowed, otherwise free the memory of the
+                  least recently used code block*/
+                if (!codegen_allocator_grow())
+                        codegen_delete_lru_block(1);
         }
 
         /*Remove from free list*/
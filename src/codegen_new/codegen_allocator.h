@@ -12,15 +12,33 @@
   
   Due to the chaining, the total memory size is limited by the range of a jump
   instruction. ARMv7 is restricted to +/- 32 MB, ARMv8 to +/- 128 MB, x86 to
-  +/- 2GB. As a result, total memory size is limited to 32 MB on ARMv7*/
+  +/- 2GB. As a result, total memory size is limited to 32 MB on ARMv7.
+
+  The arena size is set by cpu_dynarec_cache (in MB), or is MEM_BLOCK_NR blocks
+  if that is 0, and can not exceed MEM_BLOCK_MAX blocks. Its address space is
+  reserved at startup, but memory is only committed MEM_BLOCK_GROW blocks at a
+  time as the cache fills. Once the arena is full, the least recently used code
+  blocks are evicted*/
+#define MEM_BLOCK_SIZE 0x3c0
+
 #if defined __ARM_EABI__ || _ARM_
 #define MEM_BLOCK_NR 32768
+#define MEM_BLOCK_MAX 32768
+#elif defined __aarch64__ || defined _M_ARM64
+#define MEM_BLOCK_NR 131072
+#define MEM_BLOCK_MAX ((128 << 20) / MEM_BLOCK_SIZE)
+#elif defined __amd64__ || defined _M_X64
+#define MEM_BLOCK_NR 131072
+/*Well inside the range of a 32-bit displacement*/
+#define MEM_BLOCK_MAX ((1 << 30) / MEM_BLOCK_SIZE)
 #else
 #define MEM_BLOCK_NR 131072
+/*Address space is scarce in a 32-bit process*/
+#define MEM_BLOCK_MAX 131072
 #endif
 
-#define MEM_BLOCK_MASK (MEM_BLOCK_NR-1)
-#define MEM_BLOCK_SIZE 0x3c0
+/*Must be a multiple of 64, so that each step is a whole number of 4 kB pages*/
+#define MEM_BLOCK_GROW 4096
 
 void codegen_allocator_init();
 /*Allocate a mem_block_t, and the associated backing memory.
@@ -35,5 +53,7 @@ uint8_t *codeblock_allocator_get_ptr(struct mem_block_t *block);
 void codegen_allocator_clean_blocks(struct mem_block_t *block);
 
 extern int codegen_allocator_usage;
+/*Committed size of the arena, in kB*/
+extern int codegen_allocator_size;
 
 #endif
@@ -16,6 +16,12 @@
 void codegen_backend_init();
 void codegen_backend_prologue(codeblock_t *block);
 void codegen_backend_epilogue(codeblock_t *block);
+#ifdef CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+/*Emit a chainable exit. State must already have been written back*/
+void codegen_backend_chain_exit(codeblock_t *block, uint32_t exit_id);
+
+extern void *codegen_chain_rout;
+#endif
 
 struct ir_data_t;
 struct uop_t;
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -294,13 +295,13 @@ void codegen_backend_init()
 	codeblock_t *block;
         int c;
 
-	codeblock = malloc(BLOCK_SIZE * sizeof(codeblock_t));
+	codeblock = malloc(codegen_block_nr * sizeof(codeblock_t));
         codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
 
-        memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
+        memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
         memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
 
-        for (c = 0; c < BLOCK_SIZE; c++)
+        for (c = 0; c < codegen_block_nr; c++)
                 codeblock[c].pc = BLOCK_PC_INVALID;
 
         block_current = 0;
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -42,6 +43,7 @@ void *codegen_fp_round_quad;
 
 void *codegen_gpf_rout;
 void *codegen_exit_rout;
+void *codegen_chain_rout;
 
 host_reg_def_t codegen_host_reg_list[CODEGEN_HOST_REGS] =
 {
@@ -91,7 +93,7 @@ static void build_load_routine(codeblock_t *block, int size, int is_float)
 	  LDP X29, X30, [SP, #-16]
 	  RET
 	*/
-	codegen_alloc(block, 80);
+	codegen_alloc(block, 120);
 	host_arm64_MOV_REG_LSR(block, REG_W1, REG_W0, 12);
 	host_arm64_MOVX_IMM(block, REG_X2, (uint64_t)readlookup2);
 	host_arm64_LDRX_REG_LSL3(block, REG_X1, REG_X2, REG_X1);
@@ -160,7 +162,7 @@ static void build_store_routine(codeblock_t *block, int size, int is_float)
 	  LDP X29, X30, [SP, #-16]
 	  RET
 	*/
-	codegen_alloc(block, 80);
+	codegen_alloc(block, 120);
 	host_arm64_MOV_REG_LSR(block, REG_W2, REG_W0, 12);
 	host_arm64_MOVX_IMM(block, REG_X3, (uint64_t)writelookup2);
 	host_arm64_LDRX_REG_LSL3(block, REG_X2, REG_X3, REG_X2);
@@ -240,7 +242,7 @@ static void build_fp_round_routine(codeblock_t *block, int is_quad)
 {
 	uint64_t *jump_table;
 
-	codegen_alloc(block, 80);
+	codegen_alloc(block, 120);
 	host_arm64_LDR_IMM_W(block, REG_TEMP, REG_CPUSTATE, (uintptr_t)&cpu_state.new_fp_control - (uintptr_t)&cpu_state);
 	host_arm64_ADR(block, REG_TEMP2, 12);
 	host_arm64_LDR_REG_X(block, REG_TEMP2, REG_TEMP2, REG_TEMP);
@@ -289,13 +291,13 @@ void codegen_backend_init()
 	long pagemask = ~(pagesize - 1);
 #endif
 
-	codeblock = malloc(BLOCK_SIZE * sizeof(codeblock_t));
+	codeblock = malloc(codegen_block_nr * sizeof(codeblock_t));
         codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
 
-        memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
+        memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
         memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
 
-        for (c = 0; c < BLOCK_SIZE; c++)
+        for (c = 0; c < codegen_block_nr; c++)
 	{
                 codeblock[c].pc = BLOCK_PC_INVALID;
 	}
@@ -313,7 +315,7 @@ void codegen_backend_init()
         codegen_fp_round_quad = &block_write_data[block_pos];
 	build_fp_round_routine(block, 1);
 
-	codegen_alloc(block, 80);
+	codegen_alloc(block, 120);
         codegen_gpf_rout = &block_write_data[block_pos];
 	host_arm64_mov_imm(block, REG_ARG0, 0);
 	host_arm64_mov_imm(block, REG_ARG1, 0);
@@ -328,6 +330,12 @@ void codegen_backend_init()
 	host_arm64_LDP_POSTIDX_X(block, REG_X29, REG_X30, REG_XSP, 16);
 	host_arm64_RET(block, REG_X30);
 
+	/*In - X0 = chained exit ID. codegen_chain_next() returns either the
+	  successor's chain entry point or codegen_exit_rout*/
+        codegen_chain_rout = &block_write_data[block_pos];
+	host_arm64_call(block, (void *)codegen_chain_next);
+	host_arm64_BR(block, REG_X0);
+
         block_write_data = NULL;
 
 	codegen_allocator_clean_blocks(block->head_mem_block);
@@ -357,6 +365,7 @@ void codegen_backend_prologue(codeblock_t *block)
 	host_arm64_STP_PREIDX_X(block, REG_X23, REG_X24, REG_XSP, -16);
 	host_arm64_STP_PREIDX_X(block, REG_X21, REG_X22, REG_XSP, -16);
 	host_arm64_STP_PREIDX_X(block, REG_X19, REG_X20, REG_XSP, -64);
+	block->chain_entry = block_pos;
 
 	host_arm64_MOVX_IMM(block, REG_CPUSTATE, (uint64_t)&cpu_state);
 
@@ -381,4 +390,10 @@ void codegen_backend_epilogue(codeblock_t *block)
 	codegen_allocator_clean_blocks(block->head_mem_block);
 }
 
+void codegen_backend_chain_exit(codeblock_t *block, uint32_t exit_id)
+{
+	host_arm64_mov_imm(block, REG_ARG0, exit_id);
+	host_arm64_jump(block, (uintptr_t)codegen_chain_rout);
+}
+
 #endif
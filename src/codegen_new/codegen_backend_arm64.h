@@ -11,6 +11,8 @@
 
 #define BLOCK_MAX 0x3c0
 
+#define CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+
 
 void host_arm64_BLR(codeblock_t *block, int addr_reg);
 void host_arm64_CBNZ(codeblock_t *block, int reg, uintptr_t dest);
@@ -1,6 +1,7 @@
 #if defined __ARM_EABI__ || defined _ARM_
 
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -1,6 +1,7 @@
 #ifdef __amd64__
 
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -38,6 +39,7 @@ void *codegen_mem_store_double;
 
 void *codegen_gpf_rout;
 void *codegen_exit_rout;
+void *codegen_chain_rout;
 
 host_reg_def_t codegen_host_reg_list[CODEGEN_HOST_REGS] =
 {
@@ -299,13 +301,13 @@ void codegen_backend_init()
 	long pagemask = ~(pagesize - 1);
 #endif
 
-        codeblock = malloc(BLOCK_SIZE * sizeof(codeblock_t));
+        codeblock = malloc(codegen_block_nr * sizeof(codeblock_t));
         codeblock_hash = malloc(HASH_SIZE * sizeof(codeblock_t *));
 
-        memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
+        memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
         memset(codeblock_hash, 0, HASH_SIZE * sizeof(codeblock_t *));
 
-        for (c = 0; c < BLOCK_SIZE; c++)
+        for (c = 0; c < codegen_block_nr; c++)
                 codeblock[c].pc = BLOCK_PC_INVALID;
 
         block_current = 0;
@@ -338,6 +340,12 @@ void codegen_backend_init()
         host_x86_POP(block, REG_RDX);
         host_x86_RET(block);
 
+        /*In - ECX/EDI = chained exit ID. codegen_chain_next() returns either the
+          successor's chain entry point or codegen_exit_rout*/
+        codegen_chain_rout = &codeblock[block_current].data[block_pos];
+        host_x86_CALL(block, (void *)codegen_chain_next);
+        host_x86_JMP_REG(block, REG_RAX);
+
         block_write_data = NULL;
 
         asm(
@@ -364,6 +372,7 @@ void codegen_backend_prologue(codeblock_t *block)
         host_x86_PUSH(block, REG_R14);
         host_x86_PUSH(block, REG_R15);
         host_x86_SUB64_REG_IMM(block, REG_RSP, 0x38);
+        block->chain_entry = block_pos;
         host_x86_MOV64_REG_IMM(block, REG_RBP, ((uintptr_t)&cpu_state) + 128);
         if (block->flags & CODEBLOCK_HAS_FPU)
         {
@@ -388,4 +397,14 @@ void codegen_backend_epilogue(codeblock_t *block)
         host_x86_POP(block, REG_RDX);
         host_x86_RET(block);
 }
+
+void codegen_backend_chain_exit(codeblock_t *block, uint32_t exit_id)
+{
+#if WIN64
+        host_x86_MOV32_REG_IMM(block, REG_ECX, exit_id);
+#else
+        host_x86_MOV32_REG_IMM(block, REG_EDI, exit_id);
+#endif
+        host_x86_JMP(block, codegen_chain_rout);
+}
 #endif
@@ -11,4 +11,6 @@
 
 #define BLOCK_MAX 0x3c0
 
+#define CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+
 #define CODEGEN_BACKEND_HAS_MOV_IMM
@@ -1,6 +1,7 @@
 #ifdef __amd64__
 
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -331,6 +332,20 @@ void host_x86_JMP(codeblock_t *block, void *p)
         jmp(block, (uintptr_t)p);
 }
 
+void host_x86_JMP_REG(codeblock_t *block, int src_reg)
+{
+        if (src_reg & 8)
+        {
+                codegen_alloc_bytes(block, 3);
+                codegen_addbyte3(block, 0x41, 0xff, 0xe0 | (src_reg & 7)); /*JMP src_reg*/
+        }
+        else
+        {
+                codegen_alloc_bytes(block, 2);
+                codegen_addbyte2(block, 0xff, 0xe0 | src_reg); /*JMP src_reg*/
+        }
+}
+
 void host_x86_JNZ(codeblock_t *block, void *p)
 {
         codegen_alloc_bytes(block, 6);
@@ -1,6 +1,7 @@
 #ifdef __amd64__
 
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -1,6 +1,7 @@
 #ifdef __amd64__
 
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -845,6 +846,13 @@ static int codegen_JMP(codeblock_t *block, uop_t *uop)
         return 0;
 }
 
+static int codegen_JMP_CHAIN(codeblock_t *block, uop_t *uop)
+{
+        codegen_backend_chain_exit(block, uop->imm_data);
+
+        return 0;
+}
+
 static int codegen_LOAD_FUNC_ARG0(codeblock_t *block, uop_t *uop)
 {
         int src_reg = HOST_REG_GET(uop->src_reg_a_real);
@@ -2826,6 +2834,7 @@ const uOpFn uop_handlers[UOP_MAX] =
         [UOP_CALL_INSTRUCTION_FUNC & UOP_MASK] = codegen_CALL_INSTRUCTION_FUNC,
 
         [UOP_JMP & UOP_MASK] = codegen_JMP,
+        [UOP_JMP_CHAIN & UOP_MASK] = codegen_JMP_CHAIN,
 
         [UOP_LOAD_SEG & UOP_MASK] = codegen_LOAD_SEG,
 
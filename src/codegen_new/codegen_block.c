@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -17,6 +18,7 @@
 #include "codegen_allocator.h"
 #include "codegen_backend.h"
 #include "codegen_ir.h"
+#include "codegen_cache.h"
 #include "codegen_reg.h"
 
 uint8_t *block_write_data = NULL;
@@ -55,6 +57,155 @@ static uint16_t block_free_list;
 static void delete_block(codeblock_t *block);
 static void delete_dirty_block(codeblock_t *block);
 
+/*Block chaining.
+
+  Blocks normally return to the dispatcher in exec386_dynarec_dyn(), which then
+  redoes the physical address translation, hash lookup and validation before
+  running the next block. Chainable exits instead call codegen_chain_next(),
+  which only has to check the block that followed this exit last time.
+
+  Links are only a prediction - the target is fully revalidated every time a
+  chained exit is taken, and anything unexpected drops back to the dispatcher.
+  A link made before the last MMU flush (CR3 write, paging change, INVLPG) is
+  treated as absent, as the linear to physical mapping it relied on may have
+  changed.*/
+uint32_t codegen_chain_pending = 0;
+static uint32_t codegen_chain_generation = 0;
+
+/*Traces.
+
+  When the recompiler reaches a taken forward branch whose target lies further
+  on in the same page, it keeps compiling at the target instead of ending the
+  block, and the not-taken path becomes a chained side exit. The direction seen
+  while recompiling is the only profile used, so each block counts how often its
+  side exits are taken. If they are taken too often the block is thrown away and
+  rebuilt with CODEBLOCK_NO_TRACE set.*/
+#define TRACE_WINDOW 256
+
+int codegen_trace_pending = 0;
+uint32_t codegen_trace_pc;
+
+uint64_t codegen_traces_formed = 0, codegen_traces_dropped = 0;
+
+static void chain_unlink_exit(codeblock_t *block, int exit)
+{
+        uint32_t exit_id = CODEGEN_CHAIN_EXIT_ID(block, exit);
+        uint32_t *link;
+
+        if (!block->chain_target[exit])
+                return;
+
+        link = &codeblock[block->chain_target[exit]].chain_in;
+        while (*link)
+        {
+                if (*link == exit_id)
+                {
+                        *link = block->chain_next[exit];
+                        break;
+                }
+                link = &codeblock[*link >> 2].chain_next[*link & 3];
+        }
+
+        block->chain_target[exit] = BLOCK_INVALID;
+        block->chain_next[exit] = 0;
+}
+
+/*Break all links into and out of a block. Must be called whenever a block's
+  code is freed or regenerated*/
+static void chain_unlink_block(codeblock_t *block)
+{
+        int c;
+
+        for (c = 0; c < CODEBLOCK_CHAIN_EXITS; c++)
+                chain_unlink_exit(block, c);
+
+        while (block->chain_in)
+        {
+                uint32_t exit_id = block->chain_in;
+                codeblock_t *src_block = &codeblock[exit_id >> 2];
+
+                block->chain_in = src_block->chain_next[exit_id & 3];
+                src_block->chain_target[exit_id & 3] = BLOCK_INVALID;
+                src_block->chain_next[exit_id & 3] = 0;
+        }
+
+        if ((codegen_chain_pending >> 2) == get_block_nr(block))
+                codegen_chain_pending = 0;
+}
+
+void codegen_chain_link(codeblock_t *target)
+{
+        uint32_t exit_id = codegen_chain_pending;
+        codeblock_t *block = &codeblock[exit_id >> 2];
+        int exit = exit_id & 3;
+
+        codegen_chain_pending = 0;
+
+        if (block->chain_target[exit] != get_block_nr(target))
+        {
+                chain_unlink_exit(block, exit);
+                block->chain_target[exit] = get_block_nr(target);
+                block->chain_next[exit] = target->chain_in;
+                target->chain_in = exit_id;
+        }
+        block->chain_gen[exit] = codegen_chain_generation;
+}
+
+/*Called from chained exits, with IREG_pc and all other state written back.
+  Returns the address to continue execution at - either the successor block, or
+  codegen_exit_rout to return to the dispatcher*/
+void *codegen_chain_next(uint32_t exit_id)
+{
+        codeblock_t *block = &codeblock[exit_id >> 2];
+        int exit = exit_id & 3;
+        codeblock_t *target;
+
+        if (block->trace_exits)
+        {
+                if (block->trace_exits & (1 << exit))
+                        block->trace_misses++;
+                if (++block->trace_runs == TRACE_WINDOW)
+                {
+                        if (block->trace_misses > TRACE_WINDOW/4)
+                        {
+                                block->flags |= CODEBLOCK_NO_TRACE;
+                                block->flags &= ~CODEBLOCK_WAS_RECOMPILED;
+                                block->trace_exits = 0;
+                                codegen_traces_dropped++;
+                                return codegen_exit_rout;
+                        }
+                        block->trace_runs = block->trace_misses = 0;
+                }
+        }
+
+        if (!block->chain_target[exit] || block->chain_gen[exit] != codegen_chain_generation)
+        {
+                codegen_chain_pending = exit_id;
+                return codegen_exit_rout;
+        }
+        if (!exec386_dynarec_can_chain())
+                return codegen_exit_rout;
+
+        /*Same checks as the dispatcher, minus the address translation*/
+        target = &codeblock[block->chain_target[exit]];
+        if (target->pc != cs + cpu_state.pc || target->_cs != cs ||
+            ((target->status ^ cpu_cur_status) & CPU_STATUS_FLAGS) ||
+            ((target->status & cpu_cur_status & CPU_STATUS_MASK) != (cpu_cur_status & CPU_STATUS_MASK)) ||
+            (target->flags & (CODEBLOCK_WAS_RECOMPILED | CODEBLOCK_IN_DIRTY_LIST)) != CODEBLOCK_WAS_RECOMPILED ||
+            (target->page_mask & *target->dirty_mask) ||
+            (target->page_mask2 && (target->page_mask2 & *target->dirty_mask2)) ||
+            ((target->flags & CODEBLOCK_STATIC_TOP) && target->TOP != (cpu_state.TOP & 7)))
+        {
+                codegen_chain_pending = exit_id;
+                return codegen_exit_rout;
+        }
+
+        cpu_ins_count += target->ins;
+        target->used = 1;
+
+        return &target->data[target->chain_entry];
+}
+
 /*Temporary list of code blocks that have recently been evicted. This allows for
   some historical state to be kept when a block is the target of self-modifying
   code.
@@ -200,7 +351,7 @@ static codeblock_t *block_free_list_get()
                 }
                 /*Free list is empty - free up a block*/
                 if (!codegen_purge_purgable_list())
-                        codegen_delete_random_block(0);
+                        codegen_delete_lru_block(0);
         }
 
         block = &codeblock[block_free_list];
@@ -218,7 +369,7 @@ void codegen_init()
         
         codegen_backend_init();
         block_free_list = 0;
-        for (c = 0; c < BLOCK_SIZE; c++)
+        for (c = 0; c < codegen_block_nr; c++)
                 block_free_list_add(&codeblock[c]);
         block_dirty_list_head = block_dirty_list_tail = 0;
         dirty_list_size = 0;
@@ -229,6 +380,8 @@ void codegen_init()
 
 void codegen_close()
 {
+        codegen_cache_close();
+
 #ifdef DEBUG_EXTRA
         pclog("Instruction counts :\n");
         while (1)
@@ -260,7 +413,7 @@ void codegen_reset()
 {
         int c;
 
-        for (c = 1; c < BLOCK_SIZE; c++)
+        for (c = 1; c < codegen_block_nr; c++)
         {
                 codeblock_t *block = &codeblock[c];
                 
@@ -272,16 +425,18 @@ void codegen_reset()
                 }
         }
 
-        memset(codeblock, 0, BLOCK_SIZE * sizeof(codeblock_t));
+        memset(codeblock, 0, codegen_block_nr * sizeof(codeblock_t));
         memset(codeblock_hash, 0, HASH_SIZE * sizeof(uint16_t));
         mem_reset_page_blocks();
+        codegen_chain_pending = 0;
 
         block_free_list = 0;
-        for (c = 0; c < BLOCK_SIZE; c++)
+        for (c = 0; c < codegen_block_nr; c++)
         {
                 codeblock[c].pc = BLOCK_PC_INVALID;
                 block_free_list_add(&codeblock[c]);
         }
+        codegen_cache_reset();
 }
 
 void dump_block()
@@ -411,6 +566,7 @@ static void invalidate_block(codeblock_t *block)
         if (block->pc == BLOCK_PC_INVALID)
                 fatal("Invalidating deleted block\n");
 #endif
+        chain_unlink_block(block);
         remove_from_block_list(block, old_pc);
         block_dirty_list_add(block);
         if (block->head_mem_block)
@@ -431,6 +587,7 @@ static void delete_block(codeblock_t *block)
 #endif
         block->pc = BLOCK_PC_INVALID;
 
+        chain_unlink_block(block);
         codeblock_tree_delete(block);
         if (block->flags & CODEBLOCK_IN_DIRTY_LIST)
                 block_dirty_list_remove(block);
@@ -453,6 +610,7 @@ static void delete_dirty_block(codeblock_t *block)
 #endif
         block->pc = BLOCK_PC_INVALID;
 
+        chain_unlink_block(block);
         codeblock_tree_delete(block);
         block_free_list_add(block);
 }
@@ -463,23 +621,37 @@ void codegen_delete_block(codeblock_t *block)
                 delete_block(block);
 }
 
-void codegen_delete_random_block(int required_mem_block)
+/*Eviction uses the clock algorithm. The hand sweeps round the block array,
+  clearing the used flag of each block it passes, and the first block found
+  that has not been entered since the hand last passed it is deleted. Blocks
+  that are run regularly therefore survive, where random eviction would throw
+  away hot blocks just as readily as dead ones.*/
+static int evict_hand = 0;
+uint64_t codegen_blocks_evicted = 0;
+
+void codegen_delete_lru_block(int required_mem_block)
 {
-        int block_nr = rand() & BLOCK_MASK;
-        
         while (1)
         {
-                if (block_nr && block_nr != block_current)
+                if (++evict_hand >= codegen_block_nr)
+                        evict_hand = 0;
+
+                if (evict_hand && evict_hand != block_current)
                 {
-                        codeblock_t *block = &codeblock[block_nr];
+                        codeblock_t *block = &codeblock[evict_hand];
 
                         if (block->pc != BLOCK_PC_INVALID && (!required_mem_block || block->head_mem_block))
                         {
-                                delete_block(block);
-                                return;
+                                if (block->used)
+                                        block->used = 0;
+                                else
+                                {
+                                        delete_block(block);
+                                        codegen_blocks_evicted++;
+                                        return;
+                                }
                         }
                 }
-                block_nr = (block_nr + 1) & BLOCK_MASK;
         }
 }
 
@@ -566,10 +738,13 @@ void codegen_block_init(uint32_t phys_addr)
         block->next_2 = block->prev_2 = BLOCK_INVALID;
         block->page_mask = block->page_mask2 = 0;
         block->flags = CODEBLOCK_STATIC_TOP;
+        block->used = 1;
         block->status = cpu_cur_status;
         
         recomp_page = block->phys & ~0xfff;
         codeblock_tree_add(block);
+
+        codegen_cache_load(block);
 }
 
 static ir_data_t *ir_data;
@@ -594,6 +769,16 @@ void codegen_block_start_recompile(codeblock_t *block)
                 fatal("Recompile to used block!\n");
 #endif
 
+        chain_unlink_block(block);
+        block->chain_exits = 1; /*Exit 0 is reserved for the end of the block*/
+        block->trace_exits = 0;
+        block->trace_runs = block->trace_misses = 0;
+        codegen_trace_pending = 0;
+
+        /*Blocks rebuilt in place (dynamic TOP, dropped traces) still own the
+          code of the previous build*/
+        if (block->head_mem_block)
+                codegen_allocator_free(block->head_mem_block);
         block->head_mem_block = codegen_allocator_allocate(NULL, block_current);
         block->data = codeblock_allocator_get_ptr(block->head_mem_block);
 
@@ -828,9 +1013,27 @@ void codegen_block_end_recompile(codeblock_t *block)
         codegen_ir_compile(ir_data, block);
 }
 
+/*Compile a block whose uOPs were loaded from the translation cache, rather
+  than generated by a recompile pass*/
+void codegen_block_end_cached(codeblock_t *block)
+{
+        if (block->flags & CODEBLOCK_IN_DIRTY_LIST)
+                block_dirty_list_remove(block);
+        else
+                remove_from_block_list(block, block->pc);
+        block->next = block->prev = BLOCK_INVALID;
+        block->next_2 = block->prev_2 = BLOCK_INVALID;
+        codegen_block_generate_end_mask_recompile();
+        add_to_block_list(block);
+
+        codegen_ir_compile(ir_data, block);
+}
+
 void codegen_flush()
 {
-        return;
+        /*Linear to physical mappings may have changed, so all chain links are
+          now suspect*/
+        codegen_chain_generation++;
 }
 
 void codegen_mark_code_present_multibyte(codeblock_t *block, uint32_t start_pc, int len)
@@ -0,0 +1,794 @@
+#if defined WIN32 || defined _WIN32
+#include <windows.h>
+#endif
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include "cpu.h"
+#include <86box/mem.h>
+#include <86box/machine.h>
+#include <86box/plat.h>
+
+#include "x86.h"
+#include "386_common.h"
+#include "codegen.h"
+#include "codegen_allocator.h"
+#include "codegen_backend.h"
+#include "codegen_ir.h"
+#include "codegen_ops_helpers.h"
+#include "codegen_reg.h"
+#include "codegen_cache.h"
+
+/*Persistent translation cache.
+
+  Blocks are saved as their uOP lists, as they stand just before optimisation
+  and register allocation, along with the block state needed to compile them
+  again. A saved block is found by its linear address, CS base and
+  cpu_cur_status, and is only used if the code it was compiled from has not
+  changed - the 64 byte chunks in its page masks are hashed, and the hash must
+  match the memory now at those addresses. The file starts with the identity of
+  the build (a hash of its code) and of the emulated CPU, and is started again
+  if either changes.
+
+  Pointers in uOPs are stored as indices into fixed tables of what blocks may
+  point at - the flag helpers, the current opcode tables, the backend routines
+  and the segment registers - so that they survive address space
+  randomisation. Blocks with any other pointer are not saved, nor are byte mask
+  blocks, which read their immediates from RAM.
+
+  The file lives in the machine directory, so everything read from it is
+  checked before it gets near the backend - uOP types, register numbers, jump
+  destinations and pointers must all be ones the recompiler could have
+  produced. A record that fails is skipped, and the block compiled normally.
+
+  The file is read the first time a block is looked up, but saved blocks are
+  only decoded when codegen_block_init() asks for one. A block found there is
+  compiled straight away, so skips both the marking and the recompiling pass.
+  Newly compiled blocks are appended to the file.*/
+
+#define CACHE_MAGIC "86BoxDRC"
+/*Bump whenever the record layout or the meaning of a uOP changes*/
+#define CACHE_VERSION 2
+
+#define CACHE_HASH_SIZE 0x10000
+#define CACHE_HASH(pc, _cs, status) (((pc) ^ ((pc) >> 16) ^ (_cs) ^ (status)) & (CACHE_HASH_SIZE-1))
+
+/*The file stops growing at this size*/
+#define CACHE_MAX_SIZE (256 << 20)
+
+/*Block flags that are part of the saved translation*/
+#define CACHE_BLOCK_FLAGS (CODEBLOCK_HAS_FPU | CODEBLOCK_STATIC_TOP | CODEBLOCK_NO_TRACE)
+
+enum
+{
+        CACHE_PTR_NONE = 0,
+        CACHE_PTR_FUNC,         /*Index into cache_funcs[]*/
+        CACHE_PTR_OPCODE,       /*Opcode table << 16 | entry*/
+        CACHE_PTR_ROUTINE,      /*Index into cache_routines[]*/
+        CACHE_PTR_SEG           /*Index into cache_segs[]*/
+};
+
+/*Functions called by CALL_FUNC and CALL_FUNC_RESULT*/
+static void *const cache_funcs[] =
+{
+        (void *)codegen_flags_rebuild, (void *)codegen_flags_rebuild_c,
+        (void *)codegen_ZF_SET, (void *)codegen_NF_SET, (void *)codegen_PF_SET,
+        (void *)codegen_VF_SET, (void *)codegen_CF_SET,
+        (void *)codegen_NF_SET_01, (void *)codegen_VF_SET_01,
+        (void *)loadcs, (void *)loadcsjmp
+};
+#define CACHE_NR_FUNCS (sizeof(cache_funcs) / sizeof(cache_funcs[0]))
+
+/*Tables that CALL_INSTRUCTION_FUNC handlers come from, with the number of
+  entries codegen_generate_call() can index. The tables themselves depend on the
+  CPU, which is part of the file identity*/
+static const struct
+{
+        const OpFn **table;
+        int size;
+} cache_opcode_tables[] =
+{
+        {&x86_dynarec_opcodes, 1024}, {&x86_dynarec_opcodes_0f, 1024},
+        {&x86_dynarec_opcodes_d8_a16, 32}, {&x86_dynarec_opcodes_d8_a32, 32},
+        {&x86_dynarec_opcodes_d9_a16, 256}, {&x86_dynarec_opcodes_d9_a32, 256},
+        {&x86_dynarec_opcodes_da_a16, 256}, {&x86_dynarec_opcodes_da_a32, 256},
+        {&x86_dynarec_opcodes_db_a16, 256}, {&x86_dynarec_opcodes_db_a32, 256},
+        {&x86_dynarec_opcodes_dc_a16, 32}, {&x86_dynarec_opcodes_dc_a32, 32},
+        {&x86_dynarec_opcodes_dd_a16, 256}, {&x86_dynarec_opcodes_dd_a32, 256},
+        {&x86_dynarec_opcodes_de_a16, 256}, {&x86_dynarec_opcodes_de_a32, 256},
+        {&x86_dynarec_opcodes_df_a16, 256}, {&x86_dynarec_opcodes_df_a32, 256},
+        {&x86_dynarec_opcodes_REPE, 1024}, {&x86_dynarec_opcodes_REPNE, 1024},
+        {&x86_dynarec_opcodes_3DNOW, 256}
+};
+#define CACHE_NR_OPCODE_TABLES (sizeof(cache_opcode_tables) / sizeof(cache_opcode_tables[0]))
+
+/*Backend routines that JMP and CMP_IMM_JZ exit to*/
+static void **const cache_routines[] =
+{
+        &codegen_exit_rout, &codegen_gpf_rout
+};
+#define CACHE_NR_ROUTINES (sizeof(cache_routines) / sizeof(cache_routines[0]))
+
+/*Segments loaded by LOAD_SEG, and used as ea_seg by MOV_PTR*/
+static x86seg *const cache_segs[] =
+{
+        &cpu_state.seg_cs, &cpu_state.seg_ds, &cpu_state.seg_es,
+        &cpu_state.seg_ss, &cpu_state.seg_fs, &cpu_state.seg_gs
+};
+#define CACHE_NR_SEGS (sizeof(cache_segs) / sizeof(cache_segs[0]))
+
+/*Every uOP type the recompiler generates, flags included*/
+static const uint32_t cache_uop_list[] =
+{
+        UOP_LOAD_FUNC_ARG_0, UOP_LOAD_FUNC_ARG_1, UOP_LOAD_FUNC_ARG_2, UOP_LOAD_FUNC_ARG_3,
+        UOP_LOAD_FUNC_ARG_0_IMM, UOP_LOAD_FUNC_ARG_1_IMM, UOP_LOAD_FUNC_ARG_2_IMM, UOP_LOAD_FUNC_ARG_3_IMM,
+        UOP_CALL_FUNC, UOP_CALL_INSTRUCTION_FUNC, UOP_STORE_P_IMM, UOP_STORE_P_IMM_8,
+        UOP_LOAD_SEG, UOP_JMP, UOP_CALL_FUNC_RESULT, UOP_JMP_DEST,
+        UOP_NOP_BARRIER, UOP_STORE_P_IMM_16, UOP_JMP_CHAIN,
+#ifdef DEBUG_EXTRA
+        UOP_LOG_INSTR,
+#endif
+        UOP_MOV_PTR, UOP_MOV_IMM, UOP_MOV, UOP_MOVZX,
+        UOP_MOVSX, UOP_MOV_DOUBLE_INT, UOP_MOV_INT_DOUBLE, UOP_MOV_INT_DOUBLE_64,
+        UOP_MOV_REG_PTR, UOP_MOVZX_REG_PTR_8, UOP_MOVZX_REG_PTR_16, UOP_ADD,
+        UOP_ADD_IMM, UOP_AND, UOP_AND_IMM, UOP_ADD_LSHIFT,
+        UOP_OR, UOP_OR_IMM, UOP_SUB, UOP_SUB_IMM,
+        UOP_XOR, UOP_XOR_IMM, UOP_ANDN, UOP_MEM_LOAD_ABS,
+        UOP_MEM_LOAD_REG, UOP_MEM_STORE_ABS, UOP_MEM_STORE_REG, UOP_MEM_STORE_IMM_8,
+        UOP_MEM_STORE_IMM_16, UOP_MEM_STORE_IMM_32, UOP_MEM_LOAD_SINGLE, UOP_CMP_IMM_JZ,
+        UOP_MEM_LOAD_DOUBLE, UOP_MEM_STORE_SINGLE, UOP_MEM_STORE_DOUBLE, UOP_CMP_JB,
+        UOP_CMP_JNBE, UOP_SAR, UOP_SAR_IMM, UOP_SHL,
+        UOP_SHL_IMM, UOP_SHR, UOP_SHR_IMM, UOP_ROL,
+        UOP_ROL_IMM, UOP_ROR, UOP_ROR_IMM, UOP_CMP_IMM_JZ_DEST,
+        UOP_CMP_IMM_JNZ_DEST, UOP_CMP_JB_DEST, UOP_CMP_JNB_DEST, UOP_CMP_JO_DEST,
+        UOP_CMP_JNO_DEST, UOP_CMP_JZ_DEST, UOP_CMP_JNZ_DEST, UOP_CMP_JL_DEST,
+        UOP_CMP_JNL_DEST, UOP_CMP_JBE_DEST, UOP_CMP_JNBE_DEST, UOP_CMP_JLE_DEST,
+        UOP_CMP_JNLE_DEST, UOP_TEST_JNS_DEST, UOP_TEST_JS_DEST, UOP_FP_ENTER,
+        UOP_FADD, UOP_FSUB, UOP_FMUL, UOP_FDIV,
+        UOP_FCOM, UOP_FABS, UOP_FCHS, UOP_FTST,
+        UOP_FSQRT, UOP_MMX_ENTER, UOP_PADDB, UOP_PADDW,
+        UOP_PADDD, UOP_PADDSB, UOP_PADDSW, UOP_PADDUSB,
+        UOP_PADDUSW, UOP_PSUBB, UOP_PSUBW, UOP_PSUBD,
+        UOP_PSUBSB, UOP_PSUBSW, UOP_PSUBUSB, UOP_PSUBUSW,
+        UOP_PSLLW_IMM, UOP_PSLLD_IMM, UOP_PSLLQ_IMM, UOP_PSRAW_IMM,
+        UOP_PSRAD_IMM, UOP_PSRAQ_IMM, UOP_PSRLW_IMM, UOP_PSRLD_IMM,
+        UOP_PSRLQ_IMM, UOP_PCMPEQB, UOP_PCMPEQW, UOP_PCMPEQD,
+        UOP_PCMPGTB, UOP_PCMPGTW, UOP_PCMPGTD, UOP_PUNPCKLBW,
+        UOP_PUNPCKLWD, UOP_PUNPCKLDQ, UOP_PUNPCKHBW, UOP_PUNPCKHWD,
+        UOP_PUNPCKHDQ, UOP_PACKSSWB, UOP_PACKSSDW, UOP_PACKUSWB,
+        UOP_PMULLW, UOP_PMULHW, UOP_PMADDWD, UOP_PFADD,
+        UOP_PFSUB, UOP_PFMUL, UOP_PFMAX, UOP_PFMIN,
+        UOP_PFCMPEQ, UOP_PFCMPGE, UOP_PFCMPGT, UOP_PF2ID,
+        UOP_PI2FD, UOP_PFRCP, UOP_PFRSQRT,
+};
+#define CACHE_NR_UOP_TYPES (sizeof(cache_uop_list) / sizeof(cache_uop_list[0]))
+
+typedef struct cache_header_t
+{
+        char magic[8];
+        uint32_t version;
+        uint32_t pad;
+        uint64_t build_id;
+        uint64_t cpu_id;
+} cache_header_t;
+
+typedef struct cache_block_t
+{
+        uint32_t pc, _cs, status;
+        uint16_t flags;
+        uint8_t ins, TOP;
+        uint64_t page_mask, page_mask2;
+        uint64_t hash;
+        uint8_t chain_exits, trace_exits;
+        uint16_t nr_uops;
+        uint32_t pad;
+} cache_block_t;
+
+typedef struct cache_uop_t
+{
+        uint32_t type;
+        uint16_t dest_reg, src_reg_a, src_reg_b, src_reg_c;
+        uint32_t imm_data;
+        uint32_t pc;
+        int32_t jump_dest_uop;
+        uint32_t p_offset;
+        uint32_t p_base;
+} cache_uop_t;
+
+typedef struct cache_entry_t
+{
+        uint32_t next;
+        uint32_t offset;
+} cache_entry_t;
+
+static struct
+{
+        int opened, loading;
+        FILE *f;
+
+        uint64_t cpu_id;
+
+        /*Full uOP type for each index, 0 where there is none*/
+        uint32_t uop_types[UOP_MAX];
+
+        /*Saved blocks, as read from the file and then appended to*/
+        uint8_t *data;
+        uint32_t size, alloc;
+
+        /*Hash chains of blocks, through entries[]. 0 ends a chain*/
+        uint32_t *hash;
+        cache_entry_t *entries;
+        uint32_t nr_entries, max_entries;
+
+        cache_uop_t uops[UOP_NR_MAX];
+} cache;
+
+uint64_t codegen_cache_loaded = 0, codegen_cache_saved = 0;
+
+static uint64_t fnv_hash(uint64_t hash, const void *p, int len)
+{
+        const uint8_t *data = p;
+
+        while (len--)
+        {
+                hash ^= *data++;
+                hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+}
+
+#define FNV_START 0xcbf29ce484222325ull
+
+/*Hash the code of the executable, so that any rebuild changes the identity of
+  the file. Returns 0 where the code can not be found, which leaves the cache
+  disabled*/
+static int cache_hash_build(uint64_t *hash)
+{
+#if defined WIN32 || defined _WIN32
+        extern IMAGE_DOS_HEADER __ImageBase;
+        IMAGE_NT_HEADERS *nt = (IMAGE_NT_HEADERS *)((uint8_t *)&__ImageBase + __ImageBase.e_lfanew);
+        IMAGE_SECTION_HEADER *section = IMAGE_FIRST_SECTION(nt);
+        int c;
+
+        *hash = fnv_hash(FNV_START, &nt->FileHeader.TimeDateStamp, sizeof(nt->FileHeader.TimeDateStamp));
+        for (c = 0; c < nt->FileHeader.NumberOfSections; c++, section++)
+        {
+                if (section->Characteristics & IMAGE_SCN_CNT_CODE)
+                        *hash = fnv_hash(*hash, (uint8_t *)&__ImageBase + section->VirtualAddress, section->Misc.VirtualSize);
+        }
+        return 1;
+#elif defined(__linux__) || defined(__FreeBSD__)
+        extern char __executable_start[], etext[];
+
+        *hash = fnv_hash(FNV_START, __executable_start, etext - __executable_start);
+        return 1;
+#else
+        return 0;
+#endif
+}
+
+static uint64_t cache_cpu_id()
+{
+        uint64_t cpu_id;
+
+        /*Cycle counts are compiled into blocks, and instruction handlers are
+          stored as opcode table entries, so anything that changes the timing
+          model or the tables changes the translations*/
+        cpu_id = fnv_hash(FNV_START, machines[machine].internal_name, strlen(machines[machine].internal_name));
+        cpu_id = fnv_hash(cpu_id, cpu_f->internal_name, strlen(cpu_f->internal_name));
+        cpu_id = fnv_hash(cpu_id, &cpu, sizeof(cpu));
+        cpu_id = fnv_hash(cpu_id, &fpu_type, sizeof(fpu_type));
+        cpu_id = fnv_hash(cpu_id, &cpu_waitstates, sizeof(cpu_waitstates));
+
+        return cpu_id;
+}
+
+static int cache_header(cache_header_t *header)
+{
+        memset(header, 0, sizeof(cache_header_t));
+        memcpy(header->magic, CACHE_MAGIC, 8);
+        header->version = CACHE_VERSION;
+        if (!cache_hash_build(&header->build_id))
+                return 0;
+        header->cpu_id = cache_cpu_id();
+
+        return 1;
+}
+
+static void cache_add_entry(uint32_t offset)
+{
+        cache_block_t *rec = (cache_block_t *)&cache.data[offset];
+        uint32_t hash = CACHE_HASH(rec->pc, rec->_cs, rec->status);
+
+        if (cache.nr_entries == cache.max_entries)
+        {
+                cache.max_entries = cache.max_entries ? cache.max_entries * 2 : 4096;
+                cache.entries = realloc(cache.entries, cache.max_entries * sizeof(cache_entry_t));
+        }
+        /*Newest first, so a block saved again after being rebuilt differently
+          is found before the old version*/
+        cache.entries[cache.nr_entries].offset = offset;
+        cache.entries[cache.nr_entries].next = cache.hash[hash];
+        cache.hash[hash] = ++cache.nr_entries;
+}
+
+static void cache_open()
+{
+        cache_header_t header, file_header;
+        wchar_t path[1024];
+        uint32_t offset;
+        long size;
+        FILE *f;
+        int c;
+
+        cache.opened = 1;
+
+        if (!cache_header(&header))
+                return;
+        cache.cpu_id = header.cpu_id;
+        for (c = 0; c < CACHE_NR_UOP_TYPES; c++)
+        {
+                if (uop_handlers[cache_uop_list[c] & UOP_MASK])
+                        cache.uop_types[cache_uop_list[c] & UOP_MASK] = cache_uop_list[c];
+        }
+
+        memset(path, 0, sizeof(path));
+        plat_append_filename(path, usr_path, L"dynarec.cache");
+
+        cache.hash = calloc(CACHE_HASH_SIZE, sizeof(uint32_t));
+
+        f = plat_fopen(path, L"rb");
+        if (f)
+        {
+                if (fread(&file_header, sizeof(cache_header_t), 1, f) == 1 && !memcmp(&header, &file_header, sizeof(cache_header_t)))
+                {
+                        fseek(f, 0, SEEK_END);
+                        size = ftell(f) - sizeof(cache_header_t);
+                        fseek(f, sizeof(cache_header_t), SEEK_SET);
+                        if (size > 0 && size <= CACHE_MAX_SIZE)
+                        {
+                                cache.alloc = size;
+                                cache.data = malloc(cache.alloc);
+                                cache.size = fread(cache.data, 1, size, f);
+                        }
+                }
+                fclose(f);
+        }
+
+        /*Index the saved blocks, dropping anything after a truncated one*/
+        offset = 0;
+        while (offset + sizeof(cache_block_t) <= cache.size)
+        {
+                cache_block_t *rec = (cache_block_t *)&cache.data[offset];
+                uint32_t len = sizeof(cache_block_t) + rec->nr_uops * sizeof(cache_uop_t);
+
+                if (!rec->nr_uops || rec->nr_uops > UOP_NR_MAX || offset + len > cache.size)
+                        break;
+                cache_add_entry(offset);
+                offset += len;
+        }
+
+        if (offset == cache.size && cache.size)
+                cache.f = plat_fopen(path, L"ab");
+        else
+        {
+                /*New, invalid or damaged file - write out what is usable*/
+                cache.size = offset;
+                cache.f = plat_fopen(path, L"wb");
+                if (cache.f)
+                {
+                        fwrite(&header, sizeof(cache_header_t), 1, cache.f);
+                        if (cache.size)
+                                fwrite(cache.data, 1, cache.size, cache.f);
+                }
+        }
+
+        pclog("Dynarec cache: %u blocks loaded from %ls\n", cache.nr_entries, path);
+}
+
+/*Hash the chunks of code at phys that are covered by mask*/
+static int cache_hash_page(uint64_t *hash, uint32_t phys, uint64_t mask)
+{
+        uint8_t *p = mem_get_exec_ptr(phys & ~0xfff);
+        int c;
+
+        if (!p)
+                return 0;
+
+        for (c = 0; c < 64; c++)
+        {
+                if (mask & ((uint64_t)1 << c))
+                        *hash = fnv_hash(*hash, &p[c << PAGE_MASK_SHIFT], 1 << PAGE_MASK_SHIFT);
+        }
+
+        return 1;
+}
+
+static int cache_hash_block(uint64_t *hash, uint32_t phys, uint64_t page_mask, uint32_t phys_2, uint64_t page_mask2)
+{
+        *hash = FNV_START;
+
+        if (!cache_hash_page(hash, phys, page_mask))
+                return 0;
+        if (page_mask2 && !cache_hash_page(hash, phys_2, page_mask2))
+                return 0;
+
+        return 1;
+}
+
+static int cache_store_pointer(cache_uop_t *cu, void *p)
+{
+        int c, d;
+
+        cu->p_base = CACHE_PTR_NONE;
+        cu->p_offset = 0;
+        if (!p)
+                return 1;
+
+        switch (cu->type)
+        {
+                case UOP_CALL_FUNC: case UOP_CALL_FUNC_RESULT:
+                for (c = 0; c < CACHE_NR_FUNCS; c++)
+                {
+                        if (p == cache_funcs[c])
+                        {
+                                cu->p_base = CACHE_PTR_FUNC;
+                                cu->p_offset = c;
+                                return 1;
+                        }
+                }
+                break;
+
+                case UOP_CALL_INSTRUCTION_FUNC:
+                for (c = 0; c < CACHE_NR_OPCODE_TABLES; c++)
+                {
+                        const OpFn *table = *cache_opcode_tables[c].table;
+
+                        if (!table)
+                                continue;
+                        for (d = 0; d < cache_opcode_tables[c].size; d++)
+                        {
+                                if (p == (void *)table[d])
+                                {
+                                        cu->p_base = CACHE_PTR_OPCODE;
+                                        cu->p_offset = (c << 16) | d;
+                                        return 1;
+                                }
+                        }
+                }
+                break;
+
+                case UOP_JMP: case UOP_CMP_IMM_JZ:
+                for (c = 0; c < CACHE_NR_ROUTINES; c++)
+                {
+                        if (p == *cache_routines[c])
+                        {
+                                cu->p_base = CACHE_PTR_ROUTINE;
+                                cu->p_offset = c;
+                                return 1;
+                        }
+                }
+                break;
+
+                case UOP_LOAD_SEG: case UOP_MOV_PTR:
+                for (c = 0; c < CACHE_NR_SEGS; c++)
+                {
+                        if (p == cache_segs[c])
+                        {
+                                cu->p_base = CACHE_PTR_SEG;
+                                cu->p_offset = c;
+                                return 1;
+                        }
+                }
+                break;
+        }
+
+        return 0;
+}
+
+/*Returns 0 if the pointer is not one that uOP type may have*/
+static int cache_load_pointer(cache_uop_t *cu, void **p)
+{
+        *p = NULL;
+
+        switch (cu->p_base)
+        {
+                case CACHE_PTR_NONE:
+                return !cu->p_offset;
+
+                case CACHE_PTR_FUNC:
+                if ((cu->type != UOP_CALL_FUNC && cu->type != UOP_CALL_FUNC_RESULT) || cu->p_offset >= CACHE_NR_FUNCS)
+                        return 0;
+                *p = cache_funcs[cu->p_offset];
+                return 1;
+
+                case CACHE_PTR_OPCODE:
+                {
+                        uint32_t table_nr = cu->p_offset >> 16, entry = cu->p_offset & 0xffff;
+                        const OpFn *table;
+
+                        if (cu->type != UOP_CALL_INSTRUCTION_FUNC || table_nr >= CACHE_NR_OPCODE_TABLES ||
+                                        entry >= cache_opcode_tables[table_nr].size)
+                                return 0;
+                        table = *cache_opcode_tables[table_nr].table;
+                        if (!table || !table[entry])
+                                return 0;
+                        *p = (void *)table[entry];
+                        return 1;
+                }
+
+                case CACHE_PTR_ROUTINE:
+                if ((cu->type != UOP_JMP && cu->type != UOP_CMP_IMM_JZ) || cu->p_offset >= CACHE_NR_ROUTINES)
+                        return 0;
+                *p = *cache_routines[cu->p_offset];
+                return 1;
+
+                case CACHE_PTR_SEG:
+                if ((cu->type != UOP_LOAD_SEG && cu->type != UOP_MOV_PTR) || cu->p_offset >= CACHE_NR_SEGS)
+                        return 0;
+                *p = cache_segs[cu->p_offset];
+                return 1;
+        }
+
+        return 0;
+}
+
+static int cache_check_reg(uint16_t reg)
+{
+        if (reg & ~(IREG_REG_MASK | IREG_SIZE_MASK) || IREG_GET_SIZE(reg) > IREG_SIZE_Q)
+                return 0;
+
+        return IREG_GET_REG(reg) < IREG_COUNT || IREG_GET_REG(reg) == IREG_INVALID;
+}
+
+/*Check that a record is one the recompiler could have produced, so that
+  replaying it stays within the register tables, jumps only forwards within the
+  block, and only calls what blocks may call*/
+static int cache_check_block(cache_block_t *rec, cache_uop_t *cu)
+{
+        uint16_t writes[IREG_COUNT], reads[IREG_COUNT];
+        int c;
+
+        if ((rec->flags & ~CACHE_BLOCK_FLAGS) || rec->TOP > 7 || rec->chain_exits > CODEBLOCK_CHAIN_EXITS ||
+                        rec->trace_exits >= (1 << CODEBLOCK_CHAIN_EXITS))
+                return 0;
+
+        memset(writes, 0, sizeof(writes));
+        memset(reads, 0, sizeof(reads));
+
+        for (c = 0; c < rec->nr_uops; c++, cu++)
+        {
+                void *p;
+
+                if ((cu->type & UOP_MASK) >= UOP_MAX || !cu->type || cache.uop_types[cu->type & UOP_MASK] != cu->type)
+                        return 0;
+                if (!cache_check_reg(cu->src_reg_a) || !cache_check_reg(cu->src_reg_b) ||
+                                !cache_check_reg(cu->src_reg_c) || !cache_check_reg(cu->dest_reg))
+                        return 0;
+                if (cu->type & UOP_TYPE_JUMP)
+                {
+                        /*Destinations are patched as they are reached, which may
+                          be the end of the block*/
+                        if (cu->jump_dest_uop <= c || cu->jump_dest_uop > rec->nr_uops)
+                                return 0;
+                }
+                else if (cu->jump_dest_uop != -1)
+                        return 0;
+                if (cu->type == UOP_JMP_CHAIN && cu->imm_data >= rec->chain_exits)
+                        return 0;
+                if (!cache_load_pointer(cu, &p))
+                        return 0;
+
+                /*reg_version[] has 256 versions of each register, with an 8 bit
+                  reference count*/
+                if (IREG_GET_REG(cu->src_reg_a) != IREG_INVALID && ++reads[IREG_GET_REG(cu->src_reg_a)] > 255)
+                        return 0;
+                if (IREG_GET_REG(cu->src_reg_b) != IREG_INVALID && ++reads[IREG_GET_REG(cu->src_reg_b)] > 255)
+                        return 0;
+                if (IREG_GET_REG(cu->src_reg_c) != IREG_INVALID && ++reads[IREG_GET_REG(cu->src_reg_c)] > 255)
+                        return 0;
+                if (IREG_GET_REG(cu->dest_reg) != IREG_INVALID)
+                {
+                        if (++writes[IREG_GET_REG(cu->dest_reg)] > 255)
+                                return 0;
+                        reads[IREG_GET_REG(cu->dest_reg)] = 0;
+                }
+        }
+
+        return 1;
+}
+
+void codegen_cache_save(ir_data_t *ir, codeblock_t *block)
+{
+        cache_block_t rec;
+        uint32_t len, offset;
+        int c;
+
+        if (!cpu_dynarec_persist || cache.loading)
+                return;
+        if (!cache.opened)
+                cache_open();
+        if (!cache.f || !cache.hash)
+                return;
+
+        if (block->flags & (CODEBLOCK_BYTE_MASK | CODEBLOCK_NO_IMMEDIATES))
+                return;
+        if (!ir->wr_pos || ir->wr_pos > UOP_NR_MAX)
+                return;
+        /*The code was written to while this block was being compiled, so the
+          translation may not match what is there now*/
+        if ((*block->dirty_mask & block->page_mask) || (block->page_mask2 && (*block->dirty_mask2 & block->page_mask2)))
+                return;
+
+        len = sizeof(cache_block_t) + ir->wr_pos * sizeof(cache_uop_t);
+        if (cache.size + len > CACHE_MAX_SIZE)
+                return;
+
+        memset(&rec, 0, sizeof(cache_block_t));
+        rec.pc = block->pc;
+        rec._cs = block->_cs;
+        rec.status = block->status;
+        rec.flags = block->flags & CACHE_BLOCK_FLAGS;
+        rec.ins = block->ins;
+        rec.TOP = block->TOP;
+        rec.page_mask = block->page_mask;
+        rec.page_mask2 = block->page_mask2;
+        rec.chain_exits = block->chain_exits;
+        rec.trace_exits = block->trace_exits;
+        rec.nr_uops = ir->wr_pos;
+        if (!cache_hash_block(&rec.hash, block->phys, block->page_mask, block->phys_2, block->page_mask2))
+                return;
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+                cache_uop_t *cu = &cache.uops[c];
+
+                cu->type = uop->type;
+                cu->dest_reg = uop->dest_reg_a.reg;
+                cu->src_reg_a = uop->src_reg_a.reg;
+                cu->src_reg_b = uop->src_reg_b.reg;
+                cu->src_reg_c = uop->src_reg_c.reg;
+                cu->imm_data = uop->imm_data;
+                cu->pc = uop->pc;
+                cu->jump_dest_uop = uop->jump_dest_uop;
+                /*Chained exit IDs contain the block number*/
+                if (uop->type == UOP_JMP_CHAIN)
+                        cu->imm_data &= 3;
+                if (!cache_store_pointer(cu, uop->p))
+                        return;
+        }
+        if (!cache_check_block(&rec, cache.uops))
+                return;
+
+        if (cache.size + len > cache.alloc)
+        {
+                cache.alloc = (cache.size + len) * 2;
+                cache.data = realloc(cache.data, cache.alloc);
+        }
+        offset = cache.size;
+        memcpy(&cache.data[offset], &rec, sizeof(cache_block_t));
+        memcpy(&cache.data[offset + sizeof(cache_block_t)], cache.uops, len - sizeof(cache_block_t));
+        cache.size += len;
+        cache_add_entry(offset);
+
+        fwrite(&cache.data[offset], 1, len, cache.f);
+        codegen_cache_saved++;
+}
+
+static void cache_replay(codeblock_t *block, cache_block_t *rec)
+{
+        cache_uop_t *cu = (cache_uop_t *)(rec + 1);
+        ir_data_t *ir;
+        int c;
+
+        codegen_block_start_recompile(block);
+        ir = codegen_get_ir_data();
+
+        block->flags = (block->flags & ~CACHE_BLOCK_FLAGS) | (rec->flags & CACHE_BLOCK_FLAGS);
+        block->TOP = rec->TOP;
+        block->ins = rec->ins;
+        block->page_mask = rec->page_mask;
+        block->page_mask2 = rec->page_mask2;
+        block->chain_exits = rec->chain_exits;
+        block->trace_exits = rec->trace_exits;
+
+        /*Rebuild the register versions in the same order as the recompiler*/
+        for (c = 0; c < rec->nr_uops; c++, cu++)
+        {
+                uop_t *uop = uop_alloc(ir, cu->type);
+
+                uop->type = cu->type;
+                if (IREG_GET_REG(cu->src_reg_a) != IREG_INVALID)
+                        uop->src_reg_a = codegen_reg_read(cu->src_reg_a);
+                if (IREG_GET_REG(cu->src_reg_b) != IREG_INVALID)
+                        uop->src_reg_b = codegen_reg_read(cu->src_reg_b);
+                if (IREG_GET_REG(cu->src_reg_c) != IREG_INVALID)
+                        uop->src_reg_c = codegen_reg_read(cu->src_reg_c);
+                if (IREG_GET_REG(cu->dest_reg) != IREG_INVALID)
+                        uop->dest_reg_a = codegen_reg_write(cu->dest_reg, ir->wr_pos - 1);
+                uop->imm_data = cu->imm_data;
+                if (cu->type == UOP_JMP_CHAIN)
+                        uop->imm_data = CODEGEN_CHAIN_EXIT_ID(block, cu->imm_data);
+                cache_load_pointer(cu, &uop->p);
+                uop->pc = cu->pc;
+                uop->jump_dest_uop = cu->jump_dest_uop;
+        }
+
+        /*The second page is found from the end of the block*/
+        codegen_endpc = rec->page_mask2 ? ((block->pc & ~0xfff) + 0x1000) : block->pc;
+
+        cache.loading = 1;
+        codegen_block_end_cached(block);
+        cache.loading = 0;
+}
+
+int codegen_cache_load(codeblock_t *block)
+{
+        uint32_t entry;
+
+        if (!cpu_dynarec_persist)
+                return 0;
+        if (!cache.opened)
+                cache_open();
+        if (!cache.hash)
+                return 0;
+
+        entry = cache.hash[CACHE_HASH(block->pc, block->_cs, block->status)];
+        while (entry)
+        {
+                cache_block_t *rec = (cache_block_t *)&cache.data[cache.entries[entry-1].offset];
+                uint32_t phys_2 = -1;
+                uint64_t hash;
+
+                entry = cache.entries[entry-1].next;
+
+                if (rec->pc != block->pc || rec->_cs != block->_cs || rec->status != block->status)
+                        continue;
+                if ((rec->flags & CODEBLOCK_STATIC_TOP) && rec->TOP != (cpu_state.TOP & 7))
+                        continue;
+                if (rec->page_mask2)
+                {
+                        phys_2 = get_phys_noabrt((block->pc & ~0xfff) + 0x1000);
+                        if (phys_2 == -1)
+                                continue;
+                }
+                if (!cache_hash_block(&hash, block->phys, rec->page_mask, phys_2, rec->page_mask2) || hash != rec->hash)
+                        continue;
+                if (!cache_check_block(rec, (cache_uop_t *)(rec + 1)))
+                        continue;
+
+                cache_replay(block, rec);
+                codegen_cache_loaded++;
+                return 1;
+        }
+
+        return 0;
+}
+
+/*The machine may have been reconfigured. Saved blocks depend on the CPU, so
+  start again with a file for the new one*/
+void codegen_cache_reset()
+{
+        if (cache.opened && cache.cpu_id != cache_cpu_id())
+                codegen_cache_close();
+}
+
+void codegen_cache_close()
+{
+        if (cache.f)
+        {
+                pclog("Dynarec cache: %" PRIu64 " blocks loaded, %" PRIu64 " saved\n", codegen_cache_loaded, codegen_cache_saved);
+                fclose(cache.f);
+        }
+        free(cache.data);
+        free(cache.hash);
+        free(cache.entries);
+        memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,13 @@
+/*Persistent translation cache, see codegen_cache.c*/
+
+/*Look for a saved translation of block, which has just been set up by
+  codegen_block_init(). If one is found it is compiled, the block is marked as
+  recompiled and 1 is returned*/
+int codegen_cache_load(codeblock_t *block);
+/*Save the uOPs of block, which is about to be compiled*/
+void codegen_cache_save(ir_data_t *ir, codeblock_t *block);
+/*Called on hard reset, closes the file if the emulated CPU has changed*/
+void codegen_cache_reset();
+void codegen_cache_close();
+
+extern uint64_t codegen_cache_loaded, codegen_cache_saved;
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -7,6 +8,7 @@
 #include "codegen_allocator.h"
 #include "codegen_backend.h"
 #include "codegen_ir.h"
+#include "codegen_cache.h"
 #include "codegen_reg.h"
 
 extern int has_ea;
@@ -80,8 +82,10 @@ void codegen_ir_compile(ir_data_t *ir, codeblock_t *block)
                 }
         }
 
+        codegen_cache_save(ir, block);
+
         codegen_reg_mark_as_required();
-        codegen_reg_process_dead_list(ir);
+        codegen_ir_optimise(ir);
         block_write_data = codeblock_allocator_get_ptr(block->head_mem_block);
         block_pos = 0;
         codegen_backend_prologue(block);
@@ -209,6 +213,9 @@ void codegen_ir_compile(ir_data_t *ir, codeblock_t *block)
                 }
         }
 
+#ifdef CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+        codegen_backend_chain_exit(block, CODEGEN_CHAIN_EXIT_ID(block, 0));
+#endif
         codegen_backend_epilogue(block);
         block_write_data = NULL;
 //        if (has_ea)
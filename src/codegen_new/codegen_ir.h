@@ -3,4 +3,5 @@
 ir_data_t *codegen_ir_init();
 
 void codegen_ir_set_unroll(int count, int start, int first_instruction);
+void codegen_ir_optimise(ir_data_t *ir);
 void codegen_ir_compile(ir_data_t *ir, codeblock_t *block);
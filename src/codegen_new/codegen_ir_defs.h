@@ -56,6 +56,8 @@
 #define UOP_JMP_DEST              (UOP_TYPE_PARAMS_IMM | UOP_TYPE_PARAMS_POINTER | 0x17 | UOP_TYPE_ORDER_BARRIER | UOP_TYPE_JUMP)
 #define UOP_NOP_BARRIER           (UOP_TYPE_BARRIER | 0x18)
 #define UOP_STORE_P_IMM_16        (UOP_TYPE_PARAMS_IMM     | 0x19)
+/*UOP_JMP_CHAIN - exit block through chainable exit imm_data, see codegen_chain_next()*/
+#define UOP_JMP_CHAIN             (UOP_TYPE_PARAMS_IMM     | 0x1a | UOP_TYPE_ORDER_BARRIER)
 
 #ifdef DEBUG_EXTRA
 /*UOP_LOG_INSTR - log non-recompiled instruction in imm_data*/
@@ -371,6 +373,7 @@ static inline uop_t *uop_alloc(ir_data_t *ir, uint32_t uop_type)
         uop->src_reg_a = invalid_ir_reg;
         uop->src_reg_b = invalid_ir_reg;
         uop->src_reg_c = invalid_ir_reg;
+        uop->p = NULL;
         
         uop->pc = cpu_state.oldpc;
         
@@ -672,6 +675,7 @@ static inline void uop_gen_reg_src2_pointer(uint32_t uop_type, ir_data_t *ir, in
 
 #define uop_JMP(ir, p)                   uop_gen_pointer(UOP_JMP, ir, p)
 #define uop_JMP_DEST(ir)                 uop_gen(UOP_JMP_DEST, ir)
+#define uop_JMP_CHAIN(ir, exit_id)       uop_gen_imm(UOP_JMP_CHAIN, ir, exit_id)
 
 #define uop_LOAD_SEG(ir, p, src_reg) uop_gen_reg_src_pointer(UOP_LOAD_SEG, ir, src_reg, p)
 
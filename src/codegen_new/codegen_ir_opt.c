@@ -0,0 +1,1037 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include "cpu.h"
+#include <86box/mem.h>
+
+#include "x86.h"
+#include "x86_flags.h"
+
+#include "codegen.h"
+#include "codegen_ir.h"
+#include "codegen_reg.h"
+
+/*IR optimisation passes. These run on the uOP list after the dead register list
+  has been processed, and before register allocation.
+
+  All passes work on regions of straight-line code. A region ends at a barrier
+  uOP (which may change any emulated register behind the IR's back) and at the
+  destination of any jump (which may be reached with different register
+  versions). Within a region every register version holds a single value, so
+  values can be propagated from one uOP to another.
+
+  Passes may only read a register version at a point where it is still the
+  latest version of that register, as the register allocator can only provide
+  the latest version from memory. Refcounts are kept exact, so that the
+  allocator and the dead code pass see the real number of pending reads.*/
+
+uint64_t codegen_ir_uops_in, codegen_ir_uops_dead;
+uint64_t codegen_ir_uops_folded, codegen_ir_uops_cse, codegen_ir_uops_forwarded, codegen_ir_uops_removed;
+uint64_t codegen_ir_flags_removed;
+
+static uint8_t opt_jump_dest[UOP_NR_MAX];
+static uint8_t opt_cur_version[IREG_COUNT];
+
+/*Known constant values of register versions. A value is valid when its
+  generation matches opt_gen, which is advanced at each region start*/
+static uint32_t opt_const_val[IREG_COUNT][256];
+static uint16_t opt_const_gen[IREG_COUNT][256];
+static uint16_t opt_gen;
+
+#define OPT_CSE_SIZE 64
+
+typedef struct
+{
+        uint32_t type;
+        ir_reg_t src_reg_a, src_reg_b;
+        uint32_t imm_data;
+        ir_reg_t dest_reg_a;
+} opt_cse_t;
+
+static opt_cse_t opt_cse[OPT_CSE_SIZE];
+static int opt_cse_nr, opt_cse_next;
+
+#define OPT_KILL_MAX 1024
+
+static uint16_t opt_kill_list[OPT_KILL_MAX];
+static int opt_kill_nr;
+
+static inline reg_version_t *get_version(ir_reg_t ir_reg)
+{
+        return &reg_version[IREG_GET_REG(ir_reg.reg)][ir_reg.version];
+}
+
+static inline int ir_reg_equal(ir_reg_t a, ir_reg_t b)
+{
+        return a.reg == b.reg && a.version == b.version;
+}
+
+/*Register is a full width 32-bit integer register*/
+static inline int is_long(ir_reg_t ir_reg)
+{
+        return !ir_reg_is_invalid(ir_reg) && IREG_GET_SIZE(ir_reg.reg) == IREG_SIZE_L && reg_is_native_size(ir_reg);
+}
+
+static inline int is_current(ir_reg_t ir_reg)
+{
+        return opt_cur_version[IREG_GET_REG(ir_reg.reg)] == ir_reg.version && !(get_version(ir_reg)->flags & REG_FLAGS_DEAD);
+}
+
+static void new_region()
+{
+        opt_gen++;
+        if (!opt_gen)
+        {
+                memset(opt_const_gen, 0, sizeof(opt_const_gen));
+                opt_gen = 1;
+        }
+        opt_cse_nr = opt_cse_next = 0;
+}
+
+static void new_pass()
+{
+        memset(opt_cur_version, 0, sizeof(opt_cur_version));
+        new_region();
+}
+
+static int is_region_start(uop_t *uop, int c)
+{
+        return (uop->type & UOP_TYPE_BARRIER) || opt_jump_dest[c];
+}
+
+static void update_version(uop_t *uop)
+{
+        if (!ir_reg_is_invalid(uop->dest_reg_a))
+                opt_cur_version[IREG_GET_REG(uop->dest_reg_a.reg)] = uop->dest_reg_a.version;
+}
+
+/*Drop a read of ir_reg. Volatile registers left with no reads are considered
+  for removal*/
+static void release_reg(ir_reg_t ir_reg)
+{
+        reg_version_t *regv = get_version(ir_reg);
+
+        regv->refcount--;
+        if (!regv->refcount && opt_kill_nr < OPT_KILL_MAX)
+                opt_kill_list[opt_kill_nr++] = ir_reg.version | (IREG_GET_REG(ir_reg.reg) << 8);
+}
+
+static int acquire_reg(ir_reg_t ir_reg)
+{
+        reg_version_t *regv = get_version(ir_reg);
+
+        if (regv->refcount >= REG_REFCOUNT_MAX)
+                return 0;
+        regv->refcount++;
+        return 1;
+}
+
+static void release_sources(uop_t *uop)
+{
+        if (!ir_reg_is_invalid(uop->src_reg_a))
+                release_reg(uop->src_reg_a);
+        if (!ir_reg_is_invalid(uop->src_reg_b))
+                release_reg(uop->src_reg_b);
+        if (!ir_reg_is_invalid(uop->src_reg_c))
+                release_reg(uop->src_reg_c);
+        uop->src_reg_a = invalid_ir_reg;
+        uop->src_reg_b = invalid_ir_reg;
+        uop->src_reg_c = invalid_ir_reg;
+}
+
+static int get_const(ir_reg_t ir_reg, uint32_t *val)
+{
+        int reg = IREG_GET_REG(ir_reg.reg);
+
+        if (ir_reg_is_invalid(ir_reg) || opt_const_gen[reg][ir_reg.version] != opt_gen)
+                return 0;
+
+        switch (IREG_GET_SIZE(ir_reg.reg))
+        {
+                case IREG_SIZE_L:
+                *val = opt_const_val[reg][ir_reg.version];
+                return 1;
+                case IREG_SIZE_W:
+                *val = opt_const_val[reg][ir_reg.version] & 0xffff;
+                return 1;
+                case IREG_SIZE_B:
+                *val = opt_const_val[reg][ir_reg.version] & 0xff;
+                return 1;
+                case IREG_SIZE_BH:
+                *val = (opt_const_val[reg][ir_reg.version] >> 8) & 0xff;
+                return 1;
+        }
+        return 0;
+}
+
+static void set_const(ir_reg_t ir_reg, uint32_t val)
+{
+        opt_const_val[IREG_GET_REG(ir_reg.reg)][ir_reg.version] = val;
+        opt_const_gen[IREG_GET_REG(ir_reg.reg)][ir_reg.version] = opt_gen;
+}
+
+static void make_mov_imm(uop_t *uop, uint32_t val)
+{
+        release_sources(uop);
+        uop->type = UOP_MOV_IMM;
+        uop->imm_data = val;
+        codegen_ir_uops_folded++;
+}
+
+static int same_reg(ir_reg_t a, ir_reg_t b)
+{
+        return IREG_GET_REG(a.reg) == IREG_GET_REG(b.reg);
+}
+
+static void make_op_imm(uop_t *uop, uint32_t type, ir_reg_t src_reg, uint32_t val)
+{
+        if (ir_reg_equal(src_reg, uop->src_reg_a))
+                release_reg(uop->src_reg_b);
+        else
+                release_reg(uop->src_reg_a);
+        uop->src_reg_a = src_reg;
+        uop->src_reg_b = invalid_ir_reg;
+        uop->type = type;
+        uop->imm_data = val;
+        codegen_ir_uops_folded++;
+}
+
+/*uOP c writes a value that the previous version of the same register already
+  holds. Make all reads of the new version read the previous one instead, and
+  remove the uOP. Memory gets the same value whenever the previous version is
+  written back, so this also applies to permanent registers.
+  Returns 0 if the reads could not all be moved*/
+static int remove_redundant_write(ir_data_t *ir, int c)
+{
+        uop_t *uop = &ir->uops[c];
+        int reg = IREG_GET_REG(uop->dest_reg_a.reg);
+        int version = uop->dest_reg_a.version;
+        reg_version_t *prev_regv = &reg_version[reg][version - 1];
+        int crossed_region = 0;
+        int reads = 0;
+        int d, end;
+
+        if (!is_long(uop->dest_reg_a) || (prev_regv->flags & REG_FLAGS_DEAD))
+                return 0;
+
+        /*Find the reads of the new version. They all come before the next
+          write, which must not be a partial write depending on this one*/
+        for (d = c + 1; d < ir->wr_pos; d++)
+        {
+                uop_t *next = &ir->uops[d];
+
+                if (is_region_start(next, d))
+                        crossed_region = 1;
+                if ((next->type & UOP_MASK) != UOP_INVALID)
+                {
+                        if (IREG_GET_REG(next->src_reg_a.reg) == reg && next->src_reg_a.version == version)
+                                reads++;
+                        if (IREG_GET_REG(next->src_reg_b.reg) == reg && next->src_reg_b.version == version)
+                                reads++;
+                        if (IREG_GET_REG(next->src_reg_c.reg) == reg && next->src_reg_c.version == version)
+                                reads++;
+                        if (reads && crossed_region)
+                                return 0;
+                }
+                if (IREG_GET_REG(next->dest_reg_a.reg) == reg)
+                {
+                        if ((next->type & UOP_MASK) != UOP_INVALID && !reg_is_native_size(next->dest_reg_a))
+                                return 0;
+                        break;
+                }
+        }
+        end = d;
+
+        if (reads != reg_version[reg][version].refcount || prev_regv->refcount + reads > REG_REFCOUNT_MAX)
+                return 0;
+
+        for (d = c + 1; d < end; d++)
+        {
+                uop_t *next = &ir->uops[d];
+
+                if ((next->type & UOP_MASK) == UOP_INVALID)
+                        continue;
+                if (IREG_GET_REG(next->src_reg_a.reg) == reg && next->src_reg_a.version == version)
+                        next->src_reg_a.version--;
+                if (IREG_GET_REG(next->src_reg_b.reg) == reg && next->src_reg_b.version == version)
+                        next->src_reg_b.version--;
+                if (IREG_GET_REG(next->src_reg_c.reg) == reg && next->src_reg_c.version == version)
+                        next->src_reg_c.version--;
+        }
+
+        prev_regv->refcount += reads;
+        reg_version[reg][version].refcount = 0;
+        reg_version[reg][version].flags |= REG_FLAGS_DEAD;
+        release_sources(uop);
+        uop->type = UOP_INVALID;
+        opt_cur_version[reg] = version - 1;
+        codegen_ir_uops_removed++;
+
+        return 1;
+}
+
+/*Evaluate uOP if all sources are known. Returns 1 and the result in val if so*/
+static int fold_uop(uop_t *uop, uint32_t *val)
+{
+        uint32_t a, b;
+        int known_a = get_const(uop->src_reg_a, &a);
+        int known_b = get_const(uop->src_reg_b, &b);
+
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_MOV & UOP_MASK):
+                case (UOP_MOVZX & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a;
+                return 1;
+
+                case (UOP_MOVSX & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                if (IREG_GET_SIZE(uop->src_reg_a.reg) == IREG_SIZE_W)
+                        *val = (uint32_t)(int32_t)(int16_t)a;
+                else if (IREG_GET_SIZE(uop->src_reg_a.reg) == IREG_SIZE_L)
+                        *val = a;
+                else
+                        *val = (uint32_t)(int32_t)(int8_t)a;
+                return 1;
+        }
+
+        /*Everything below works on full width registers only*/
+        if (!is_long(uop->src_reg_a) || (!ir_reg_is_invalid(uop->src_reg_b) && !is_long(uop->src_reg_b)))
+                return 0;
+
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_ADD_IMM & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a + uop->imm_data;
+                return 1;
+                case (UOP_SUB_IMM & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a - uop->imm_data;
+                return 1;
+                case (UOP_AND_IMM & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a & uop->imm_data;
+                return 1;
+                case (UOP_OR_IMM & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a | uop->imm_data;
+                return 1;
+                case (UOP_XOR_IMM & UOP_MASK):
+                if (!known_a)
+                        return 0;
+                *val = a ^ uop->imm_data;
+                return 1;
+                case (UOP_SHL_IMM & UOP_MASK):
+                if (!known_a || uop->imm_data > 31)
+                        return 0;
+                *val = a << uop->imm_data;
+                return 1;
+                case (UOP_SHR_IMM & UOP_MASK):
+                if (!known_a || uop->imm_data > 31)
+                        return 0;
+                *val = a >> uop->imm_data;
+                return 1;
+                case (UOP_SAR_IMM & UOP_MASK):
+                if (!known_a || uop->imm_data > 31)
+                        return 0;
+                *val = (uint32_t)((int32_t)a >> uop->imm_data);
+                return 1;
+
+                case (UOP_ADD & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a + b;
+                return 1;
+                case (UOP_SUB & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a - b;
+                return 1;
+                case (UOP_AND & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a & b;
+                return 1;
+                case (UOP_OR & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a | b;
+                return 1;
+                case (UOP_XOR & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a ^ b;
+                return 1;
+                case (UOP_ANDN & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = ~a & b;
+                return 1;
+                case (UOP_ADD_LSHIFT & UOP_MASK):
+                if (!known_a || !known_b)
+                        return 0;
+                *val = a + (b << uop->imm_data);
+                return 1;
+        }
+
+        return 0;
+}
+
+/*Replace register operands with known values by immediate forms of the same
+  uOP, where the backends have one*/
+static void fold_partial(uop_t *uop)
+{
+        uint32_t a, b;
+        int known_a = get_const(uop->src_reg_a, &a);
+        int known_b = get_const(uop->src_reg_b, &b);
+
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_MEM_LOAD_REG & UOP_MASK):
+                /*Constant address, eg a displacement only effective address*/
+                if (known_b && is_long(uop->src_reg_b) && (IREG_GET_SIZE(uop->dest_reg_a.reg) == IREG_SIZE_L || IREG_GET_SIZE(uop->dest_reg_a.reg) == IREG_SIZE_W))
+                {
+                        release_reg(uop->src_reg_b);
+                        uop->src_reg_b = invalid_ir_reg;
+                        uop->type = UOP_MEM_LOAD_ABS;
+                        uop->imm_data += b;
+                        codegen_ir_uops_folded++;
+                }
+                return;
+
+                case (UOP_MEM_STORE_REG & UOP_MASK):
+                if (known_b && is_long(uop->src_reg_b) && (IREG_GET_SIZE(uop->src_reg_c.reg) == IREG_SIZE_L || IREG_GET_SIZE(uop->src_reg_c.reg) == IREG_SIZE_W))
+                {
+                        release_reg(uop->src_reg_b);
+                        uop->src_reg_b = uop->src_reg_c;
+                        uop->src_reg_c = invalid_ir_reg;
+                        uop->type = UOP_MEM_STORE_ABS;
+                        uop->imm_data += b;
+                        codegen_ir_uops_folded++;
+                }
+                return;
+        }
+
+        if (!is_long(uop->dest_reg_a) || !is_long(uop->src_reg_a))
+                return;
+
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_ADD & UOP_MASK):
+                case (UOP_AND & UOP_MASK):
+                case (UOP_OR & UOP_MASK):
+                case (UOP_XOR & UOP_MASK):
+                case (UOP_SUB & UOP_MASK):
+                case (UOP_ADD_LSHIFT & UOP_MASK):
+                if (!is_long(uop->src_reg_b))
+                        return;
+                break;
+        }
+
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_ADD & UOP_MASK):
+                if (known_b)
+                        make_op_imm(uop, UOP_ADD_IMM, uop->src_reg_a, b);
+                else if (known_a)
+                        make_op_imm(uop, UOP_ADD_IMM, uop->src_reg_b, a);
+                return;
+                case (UOP_AND & UOP_MASK):
+                if (known_b)
+                        make_op_imm(uop, UOP_AND_IMM, uop->src_reg_a, b);
+                else if (known_a)
+                        make_op_imm(uop, UOP_AND_IMM, uop->src_reg_b, a);
+                return;
+                /*The x86 backends only have in place forms of OR_IMM and
+                  XOR_IMM, so the source must be the destination register*/
+                case (UOP_OR & UOP_MASK):
+                if (known_b && same_reg(uop->src_reg_a, uop->dest_reg_a))
+                        make_op_imm(uop, UOP_OR_IMM, uop->src_reg_a, b);
+                else if (known_a && same_reg(uop->src_reg_b, uop->dest_reg_a))
+                        make_op_imm(uop, UOP_OR_IMM, uop->src_reg_b, a);
+                return;
+                case (UOP_XOR & UOP_MASK):
+                if (known_b && same_reg(uop->src_reg_a, uop->dest_reg_a))
+                        make_op_imm(uop, UOP_XOR_IMM, uop->src_reg_a, b);
+                else if (known_a && same_reg(uop->src_reg_b, uop->dest_reg_a))
+                        make_op_imm(uop, UOP_XOR_IMM, uop->src_reg_b, a);
+                return;
+                case (UOP_SUB & UOP_MASK):
+                if (known_b)
+                        make_op_imm(uop, UOP_SUB_IMM, uop->src_reg_a, b);
+                return;
+                case (UOP_ADD_LSHIFT & UOP_MASK):
+                if (known_b)
+                        make_op_imm(uop, UOP_ADD_IMM, uop->src_reg_a, b << uop->imm_data);
+                return;
+
+                case (UOP_ADD_IMM & UOP_MASK):
+                case (UOP_SUB_IMM & UOP_MASK):
+                case (UOP_OR_IMM & UOP_MASK):
+                case (UOP_XOR_IMM & UOP_MASK):
+                case (UOP_SHL_IMM & UOP_MASK):
+                case (UOP_SHR_IMM & UOP_MASK):
+                case (UOP_SAR_IMM & UOP_MASK):
+                /*Identity operations become moves, which the allocator can
+                  usually handle with a rename*/
+                if (!uop->imm_data && IREG_GET_REG(uop->src_reg_a.reg) != IREG_GET_REG(uop->dest_reg_a.reg))
+                {
+                        uop->type = UOP_MOV;
+                        codegen_ir_uops_folded++;
+                }
+                return;
+                case (UOP_AND_IMM & UOP_MASK):
+                if (uop->imm_data == 0xffffffff && IREG_GET_REG(uop->src_reg_a.reg) != IREG_GET_REG(uop->dest_reg_a.reg))
+                {
+                        uop->type = UOP_MOV;
+                        codegen_ir_uops_folded++;
+                }
+                return;
+        }
+}
+
+/*Constant propagation and folding*/
+static void ir_opt_constants(ir_data_t *ir)
+{
+        int c;
+
+        new_pass();
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+                ir_reg_t prev_reg;
+                uint32_t val, prev_val;
+
+                if (is_region_start(uop, c))
+                        new_region();
+                if ((uop->type & UOP_MASK) == UOP_INVALID || (uop->type & UOP_TYPE_BARRIER))
+                {
+                        update_version(uop);
+                        continue;
+                }
+
+                if (is_long(uop->dest_reg_a))
+                {
+                        if ((uop->type & UOP_MASK) == (UOP_MOV_IMM & UOP_MASK))
+                                val = uop->imm_data;
+                        else if (fold_uop(uop, &val))
+                                make_mov_imm(uop, val);
+                        else
+                        {
+                                fold_partial(uop);
+                                update_version(uop);
+                                continue;
+                        }
+
+                        /*Rewriting the value the register already holds, as
+                          with flags_op for consecutive ADDs*/
+                        prev_reg = uop->dest_reg_a;
+                        prev_reg.version--;
+                        if (get_const(prev_reg, &prev_val) && prev_val == val && remove_redundant_write(ir, c))
+                                continue;
+                        set_const(uop->dest_reg_a, val);
+                }
+                else if (ir_reg_is_invalid(uop->dest_reg_a) || IREG_GET_SIZE(uop->dest_reg_a.reg) == IREG_SIZE_L || IREG_GET_SIZE(uop->dest_reg_a.reg) == IREG_SIZE_W)
+                        fold_partial(uop);
+
+                update_version(uop);
+        }
+}
+
+static int is_cse_candidate(uop_t *uop)
+{
+        switch (uop->type & UOP_MASK)
+        {
+                case (UOP_ADD & UOP_MASK):
+                case (UOP_ADD_IMM & UOP_MASK):
+                case (UOP_ADD_LSHIFT & UOP_MASK):
+                case (UOP_SUB & UOP_MASK):
+                case (UOP_SUB_IMM & UOP_MASK):
+                case (UOP_AND & UOP_MASK):
+                case (UOP_AND_IMM & UOP_MASK):
+                case (UOP_OR & UOP_MASK):
+                case (UOP_OR_IMM & UOP_MASK):
+                case (UOP_XOR & UOP_MASK):
+                case (UOP_XOR_IMM & UOP_MASK):
+                case (UOP_SHL_IMM & UOP_MASK):
+                case (UOP_SHR_IMM & UOP_MASK):
+                case (UOP_SAR_IMM & UOP_MASK):
+                case (UOP_MOVZX & UOP_MASK):
+                case (UOP_MOVSX & UOP_MASK):
+                return is_long(uop->dest_reg_a) && ir_reg_is_invalid(uop->src_reg_c);
+        }
+        return 0;
+}
+
+static void cse_key(uop_t *uop, opt_cse_t *key)
+{
+        key->type = uop->type & UOP_MASK;
+        key->src_reg_a = uop->src_reg_a;
+        key->src_reg_b = uop->src_reg_b;
+        key->imm_data = (uop->type & UOP_TYPE_PARAMS_IMM) ? uop->imm_data : 0;
+
+        /*Put operands of commutative operations in a fixed order*/
+        switch (key->type)
+        {
+                case (UOP_ADD & UOP_MASK):
+                case (UOP_AND & UOP_MASK):
+                case (UOP_OR & UOP_MASK):
+                case (UOP_XOR & UOP_MASK):
+                key->imm_data = 0;
+                if ((key->src_reg_a.reg << 16 | key->src_reg_a.version) > (key->src_reg_b.reg << 16 | key->src_reg_b.version))
+                {
+                        key->src_reg_a = uop->src_reg_b;
+                        key->src_reg_b = uop->src_reg_a;
+                }
+                break;
+        }
+}
+
+/*Common subexpression elimination. A uOP that recomputes a value that is still
+  held in the latest version of another register becomes a move from it. This
+  mostly catches effective address calculations repeated by consecutive
+  instructions*/
+static void ir_opt_cse(ir_data_t *ir)
+{
+        int c, d;
+
+        new_pass();
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+                opt_cse_t key;
+
+                if (is_region_start(uop, c))
+                        new_region();
+                if ((uop->type & UOP_MASK) == UOP_INVALID || !is_cse_candidate(uop))
+                {
+                        update_version(uop);
+                        continue;
+                }
+
+                cse_key(uop, &key);
+                for (d = 0; d < opt_cse_nr; d++)
+                {
+                        opt_cse_t *entry = &opt_cse[d];
+
+                        if (entry->type == key.type && ir_reg_equal(entry->src_reg_a, key.src_reg_a) &&
+                                        ir_reg_equal(entry->src_reg_b, key.src_reg_b) && entry->imm_data == key.imm_data)
+                                break;
+                }
+
+                if (d < opt_cse_nr)
+                {
+                        ir_reg_t src_reg = opt_cse[d].dest_reg_a;
+
+                        if (is_current(src_reg) && IREG_GET_REG(src_reg.reg) == IREG_GET_REG(uop->dest_reg_a.reg))
+                        {
+                                /*Same register, eg the effective address of
+                                  the previous instruction. Just reuse it*/
+                                if (remove_redundant_write(ir, c))
+                                {
+                                        codegen_ir_uops_cse++;
+                                        continue;
+                                }
+                        }
+                        else if (is_current(src_reg) && acquire_reg(src_reg))
+                        {
+                                release_sources(uop);
+                                uop->type = UOP_MOV;
+                                uop->src_reg_a = src_reg;
+                                codegen_ir_uops_cse++;
+                                update_version(uop);
+                                continue;
+                        }
+                        /*Value no longer available, remember the new copy instead*/
+                        key.dest_reg_a = uop->dest_reg_a;
+                        opt_cse[d] = key;
+                }
+                else
+                {
+                        key.dest_reg_a = uop->dest_reg_a;
+                        if (opt_cse_nr < OPT_CSE_SIZE)
+                                opt_cse[opt_cse_nr++] = key;
+                        else
+                        {
+                                opt_cse[opt_cse_next] = key;
+                                opt_cse_next = (opt_cse_next + 1) % OPT_CSE_SIZE;
+                        }
+                }
+
+                update_version(uop);
+        }
+}
+
+/*Forward a register read through a move, if the source of the move is still
+  available. Returns the register to read instead, or the original register*/
+static ir_reg_t forward_reg(ir_data_t *ir, ir_reg_t ir_reg, int region_start)
+{
+        reg_version_t *regv;
+        uop_t *parent;
+
+        if (!is_long(ir_reg) || !ir_reg.version)
+                return ir_reg;
+        regv = get_version(ir_reg);
+        if (regv->flags & REG_FLAGS_DEAD || regv->parent_uop < region_start)
+                return ir_reg;
+
+        parent = &ir->uops[regv->parent_uop];
+        if ((parent->type & UOP_MASK) != (UOP_MOV & UOP_MASK) || !ir_reg_equal(parent->dest_reg_a, ir_reg) ||
+                        !is_long(parent->src_reg_a) || !is_current(parent->src_reg_a))
+                return ir_reg;
+        if (!acquire_reg(parent->src_reg_a))
+                return ir_reg;
+
+        release_reg(ir_reg);
+        codegen_ir_uops_forwarded++;
+        return parent->src_reg_a;
+}
+
+/*Register to register forwarding. A read of a register that was written by a
+  move reads the source of the move directly, leaving the move to the dead code
+  pass if nothing else reads it*/
+static void ir_opt_forward(ir_data_t *ir)
+{
+        int region_start = 0;
+        int c;
+
+        new_pass();
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+
+                if (is_region_start(uop, c))
+                        region_start = c;
+                if ((uop->type & UOP_MASK) == UOP_INVALID || (uop->type & UOP_TYPE_BARRIER))
+                {
+                        update_version(uop);
+                        continue;
+                }
+
+                /*Partial register writes are merged with the previous version,
+                  so leave their operands alone*/
+                if (ir_reg_is_invalid(uop->dest_reg_a) || reg_is_native_size(uop->dest_reg_a))
+                {
+                        /*Many backend uOPs only have an in place form, so a
+                          source in the destination register must stay there*/
+                        if (!ir_reg_is_invalid(uop->src_reg_a) && !same_reg(uop->src_reg_a, uop->dest_reg_a))
+                                uop->src_reg_a = forward_reg(ir, uop->src_reg_a, region_start);
+                        if (!ir_reg_is_invalid(uop->src_reg_b))
+                                uop->src_reg_b = forward_reg(ir, uop->src_reg_b, region_start);
+                        if (!ir_reg_is_invalid(uop->src_reg_c))
+                                uop->src_reg_c = forward_reg(ir, uop->src_reg_c, region_start);
+                }
+
+                update_version(uop);
+        }
+}
+
+/*A partial write of a later version merges with, and so depends on, this
+  version. Later versions that have already been removed are skipped*/
+static int has_partial_successor(ir_data_t *ir, int reg, int version)
+{
+        int next;
+
+        for (next = version + 1; next <= reg_last_version[reg]; next++)
+        {
+                if (!reg_is_native_size(ir->uops[reg_version[reg][next].parent_uop].dest_reg_a))
+                        return 1;
+                if (!(reg_version[reg][next].flags & REG_FLAGS_DEAD))
+                        return 0;
+        }
+        return 0;
+}
+
+/*Remove the uOP that wrote a register version, if nothing depends on it*/
+static int kill_version(ir_data_t *ir, int reg, int version)
+{
+        reg_version_t *regv = &reg_version[reg][version];
+        uop_t *uop;
+
+        if (!version || regv->refcount || (regv->flags & REG_FLAGS_DEAD) || has_partial_successor(ir, reg, version))
+                return 0;
+
+        uop = &ir->uops[regv->parent_uop];
+        if ((uop->type & UOP_MASK) == UOP_INVALID || (uop->type & (UOP_TYPE_BARRIER | UOP_TYPE_ORDER_BARRIER)) ||
+                        IREG_GET_REG(uop->dest_reg_a.reg) != reg || uop->dest_reg_a.version != version)
+                return 0;
+
+        release_sources(uop);
+        uop->type = UOP_INVALID;
+        regv->flags |= REG_FLAGS_DEAD;
+        codegen_ir_uops_removed++;
+        return 1;
+}
+
+/*Flags operand elimination. flags_op1 and flags_op2 are only meaningful while
+  flags_op holds an operation that uses them, and every path that sets such an
+  operation (here or in the interpreter) writes both operands along with it.
+  Once flags_op has been set to an operation that ignores them, the operands
+  can never be observed again, so if that happens on every path from an operand
+  write before anything could see it, the write is dead. This is the case the
+  dead register list can not see, as nothing overwrites the operands.
+
+  Anything that may leave the block or look at CPU state - barriers, memory
+  accesses that may fault, and jumps - counts as a use. So does reaching a jump
+  destination, as other paths join there. The operands are always written back
+  at the end of a block, as any chained successor may instead be reached
+  through the dispatcher or the interpreter*/
+static int flags_ignore_operands(uint32_t flags_op)
+{
+        switch (flags_op)
+        {
+                case FLAGS_ZN8: case FLAGS_ZN16: case FLAGS_ZN32:
+                case FLAGS_ROL8: case FLAGS_ROL16: case FLAGS_ROL32:
+                case FLAGS_ROR8: case FLAGS_ROR16: case FLAGS_ROR32:
+                return 1;
+        }
+        return 0;
+}
+
+static void ir_opt_flags(ir_data_t *ir)
+{
+        int pending[2] = {-1, -1};
+        int c, d;
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+                int reg;
+
+                if (opt_jump_dest[c])
+                        pending[0] = pending[1] = -1;
+                if ((uop->type & UOP_MASK) == UOP_INVALID)
+                        continue;
+                if (uop->type & (UOP_TYPE_BARRIER | UOP_TYPE_ORDER_BARRIER | UOP_TYPE_JUMP))
+                        pending[0] = pending[1] = -1;
+                if (ir_reg_is_invalid(uop->dest_reg_a))
+                        continue;
+
+                reg = IREG_GET_REG(uop->dest_reg_a.reg);
+                if (reg == IREG_flags_op)
+                {
+                        if ((uop->type & UOP_MASK) != (UOP_MOV_IMM & UOP_MASK) || !reg_is_native_size(uop->dest_reg_a) ||
+                                        !flags_ignore_operands(uop->imm_data))
+                                continue;
+                        for (d = 0; d < 2; d++)
+                        {
+                                if (pending[d] != -1 && kill_version(ir, IREG_flags_op1 + d, pending[d]))
+                                        codegen_ir_flags_removed++;
+                                pending[d] = -1;
+                        }
+                }
+                else if (reg == IREG_flags_op1 || reg == IREG_flags_op2)
+                {
+                        d = reg - IREG_flags_op1;
+                        /*A full overwrite before any use also kills the
+                          previous write*/
+                        if (pending[d] != -1 && reg_is_native_size(uop->dest_reg_a) && kill_version(ir, reg, pending[d]))
+                                codegen_ir_flags_removed++;
+                        pending[d] = -1;
+                        if (reg_is_native_size(uop->dest_reg_a) && !(uop->type & (UOP_TYPE_BARRIER | UOP_TYPE_ORDER_BARRIER)))
+                                pending[d] = uop->dest_reg_a.version;
+                }
+        }
+}
+
+/*Remove uOPs writing volatile registers that are no longer read. Permanent
+  registers may be needed by code outside the block, so are left alone*/
+static void ir_opt_dead(ir_data_t *ir)
+{
+        while (opt_kill_nr)
+        {
+                int entry = opt_kill_list[--opt_kill_nr];
+                int reg = entry >> 8;
+
+                if (reg_is_volatile(reg))
+                        kill_version(ir, reg, entry & 0xff);
+        }
+}
+
+static int count_uops(ir_data_t *ir)
+{
+        int c, count = 0;
+
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                if ((ir->uops[c].type & UOP_MASK) != UOP_INVALID)
+                        count++;
+        }
+        return count;
+}
+
+void codegen_ir_optimise(ir_data_t *ir)
+{
+        int c;
+
+        codegen_reg_process_dead_list(ir);
+
+        codegen_ir_uops_in += ir->wr_pos;
+        codegen_ir_uops_dead += ir->wr_pos - count_uops(ir);
+
+        memset(opt_jump_dest, 0, ir->wr_pos);
+        for (c = 0; c < ir->wr_pos; c++)
+        {
+                uop_t *uop = &ir->uops[c];
+
+                if ((uop->type & UOP_TYPE_JUMP) && uop->jump_dest_uop >= 0 && uop->jump_dest_uop < ir->wr_pos)
+                        opt_jump_dest[uop->jump_dest_uop] = 1;
+        }
+
+        opt_kill_nr = 0;
+        ir_opt_constants(ir);
+        ir_opt_cse(ir);
+        ir_opt_forward(ir);
+        ir_opt_flags(ir);
+        ir_opt_dead(ir);
+}
+
+/*Self test. Each block is optimised and then run through a model of the
+  backends next to the original uOPs. OR_IMM and XOR_IMM are modelled as in
+  place, as the x86 backends do not read a separate source, so a pass that
+  leaves them one shows up as a wrong result.*/
+#define OPT_TEST_UOPS 3
+
+typedef struct
+{
+        uint32_t type;
+        int dest, src_a, src_b;
+        uint32_t imm;
+} opt_test_uop_t;
+
+static const struct
+{
+        const char *name;
+        opt_test_uop_t uops[OPT_TEST_UOPS];
+} opt_tests[] =
+{
+        {"mov eax,0x10 ; or eax,ebx",
+         {{UOP_MOV_IMM, IREG_EAX, 0, 0, 0x10}, {UOP_OR, IREG_EAX, IREG_EAX, IREG_EBX}}},
+        {"mov eax,0x10 ; xor eax,ebx",
+         {{UOP_MOV_IMM, IREG_EAX, 0, 0, 0x10}, {UOP_XOR, IREG_EAX, IREG_EAX, IREG_EBX}}},
+        {"mov ebx,0x10 ; or eax,ebx",
+         {{UOP_MOV_IMM, IREG_EBX, 0, 0, 0x10}, {UOP_OR, IREG_EAX, IREG_EAX, IREG_EBX}}},
+        {"mov eax,ebx ; or eax,0x10 (through a temporary)",
+         {{UOP_MOV, IREG_temp0, IREG_EBX}, {UOP_OR_IMM, IREG_temp0, IREG_temp0, 0, 0x10}, {UOP_MOV, IREG_EAX, IREG_temp0}}},
+        {"mov eax,ebx ; xor eax,0x10 (through a temporary)",
+         {{UOP_MOV, IREG_temp0, IREG_EBX}, {UOP_XOR_IMM, IREG_temp0, IREG_temp0, 0, 0x10}, {UOP_MOV, IREG_EAX, IREG_temp0}}}
+};
+
+static uop_t opt_test_uops[OPT_TEST_UOPS];
+
+static int opt_test_run(uop_t *uops, int nr, uint32_t *regs)
+{
+        int c;
+
+        for (c = 0; c < IREG_COUNT; c++)
+                regs[c] = 0x5a5a5a5a ^ (c * 0x01010101);
+
+        for (c = 0; c < nr; c++)
+        {
+                uop_t *uop = &uops[c];
+                uint32_t a = ir_reg_is_invalid(uop->src_reg_a) ? 0 : regs[IREG_GET_REG(uop->src_reg_a.reg)];
+                uint32_t b = ir_reg_is_invalid(uop->src_reg_b) ? 0 : regs[IREG_GET_REG(uop->src_reg_b.reg)];
+                uint32_t *dest = ir_reg_is_invalid(uop->dest_reg_a) ? NULL : &regs[IREG_GET_REG(uop->dest_reg_a.reg)];
+
+                switch (uop->type & UOP_MASK)
+                {
+                        case UOP_INVALID:
+                        break;
+                        case (UOP_MOV_IMM & UOP_MASK):
+                        *dest = uop->imm_data;
+                        break;
+                        case (UOP_MOV & UOP_MASK):
+                        *dest = a;
+                        break;
+                        case (UOP_OR & UOP_MASK):
+                        *dest = a | b;
+                        break;
+                        case (UOP_XOR & UOP_MASK):
+                        *dest = a ^ b;
+                        break;
+                        case (UOP_OR_IMM & UOP_MASK):
+                        *dest |= uop->imm_data;
+                        break;
+                        case (UOP_XOR_IMM & UOP_MASK):
+                        *dest ^= uop->imm_data;
+                        break;
+                        default:
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+int codegen_ir_opt_test(void)
+{
+        uint32_t ref[IREG_COUNT], regs[IREG_COUNT];
+        int c, d, nr, failed = 0;
+
+        for (c = 0; c < (int)(sizeof(opt_tests) / sizeof(opt_tests[0])); c++)
+        {
+                ir_data_t *ir = codegen_ir_init();
+
+                codegen_reg_reset();
+                for (d = 0; d < OPT_TEST_UOPS && opt_tests[c].uops[d].type; d++)
+                {
+                        const opt_test_uop_t *t = &opt_tests[c].uops[d];
+
+                        switch (t->type & UOP_MASK)
+                        {
+                                case (UOP_MOV_IMM & UOP_MASK):
+                                uop_MOV_IMM(ir, t->dest, t->imm);
+                                break;
+                                case (UOP_MOV & UOP_MASK):
+                                uop_MOV(ir, t->dest, t->src_a);
+                                break;
+                                case (UOP_OR & UOP_MASK):
+                                case (UOP_XOR & UOP_MASK):
+                                uop_gen_reg_dst_src2(t->type, ir, t->dest, t->src_a, t->src_b);
+                                break;
+                                default:
+                                uop_gen_reg_dst_src_imm(t->type, ir, t->dest, t->src_a, t->imm);
+                                break;
+                        }
+                }
+                nr = ir->wr_pos;
+                memcpy(opt_test_uops, ir->uops, nr * sizeof(uop_t));
+
+                codegen_reg_mark_as_required();
+                codegen_ir_optimise(ir);
+
+                opt_test_run(opt_test_uops, nr, ref);
+                if (!opt_test_run(ir->uops, ir->wr_pos, regs))
+                {
+                        printf("Dynarec IR: \"%s\" optimised to an unexpected uOP\n", opt_tests[c].name);
+                        failed++;
+                        continue;
+                }
+                for (d = IREG_EAX; d <= IREG_EDI; d++)
+                {
+                        if (regs[d] != ref[d])
+                        {
+                                printf("Dynarec IR: \"%s\" leaves %08x in register %i, expected %08x\n",
+                                       opt_tests[c].name, regs[d], d, ref[d]);
+                                failed++;
+                                break;
+                        }
+                }
+        }
+
+        printf("Dynarec IR:      %i blocks tested, %i optimised differently\n", c, failed);
+
+        return failed;
+}
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -14,7 +15,7 @@
 
 static inline void get_cf(ir_data_t *ir, int dest_reg)
 {
-        uop_CALL_FUNC_RESULT(ir, dest_reg, CF_SET);
+        uop_CALL_FUNC_RESULT(ir, dest_reg, codegen_CF_SET);
 }
 
 uint32_t ropADC_AL_imm(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetchdat, uint32_t op_32, uint32_t op_pc)
@@ -2406,7 +2407,7 @@ static void rebuild_c(ir_data_t *ir)
         
         if (needs_rebuild)
         {
-                uop_CALL_FUNC(ir, flags_rebuild_c);
+                uop_CALL_FUNC(ir, codegen_flags_rebuild_c);
         }
 }
 
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -13,15 +14,6 @@
 #include "codegen_ops_helpers.h"
 #include "codegen_ops_mov.h"
 
-static int NF_SET_01()
-{
-        return NF_SET() ? 1 : 0;
-}
-static int VF_SET_01()
-{
-        return VF_SET() ? 1 : 0;
-}
-
 static int ropJO_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, uint32_t next_pc)
 {
         int jump_uop;
@@ -46,12 +38,12 @@ static int ropJO_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, VF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_VF_SET);
                 jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return 0;
 }
@@ -64,7 +56,7 @@ static int ropJNO_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 case FLAGS_ZN8: case FLAGS_ZN16: case FLAGS_ZN32:
                 /*Overflow is always zero*/
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 return 0;
 
                 case FLAGS_SUB8: case FLAGS_DEC8:
@@ -81,12 +73,12 @@ static int ropJNO_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, VF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_VF_SET);
                 jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return 0;
 }
@@ -125,7 +117,7 @@ static int ropJB_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                 if (do_unroll)
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 else
@@ -133,7 +125,7 @@ static int ropJB_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, do_unroll ? next_pc : dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -147,7 +139,7 @@ static int ropJNB_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 case FLAGS_ZN8: case FLAGS_ZN16: case FLAGS_ZN32:
                 /*Carry is always zero*/
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 return 0;
 
                 case FLAGS_SUB8:
@@ -173,7 +165,7 @@ static int ropJNB_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                 if (do_unroll)
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 else
@@ -181,7 +173,7 @@ static int ropJNB_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, do_unroll ? next_pc : dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -194,7 +186,7 @@ static int ropJE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
         {
                 if (!codegen_flags_changed || !flags_res_valid())
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
@@ -202,7 +194,7 @@ static int ropJE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_flags_res, 0);
                 }
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 1;
         }
@@ -210,7 +202,7 @@ static int ropJE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
         {
                 if (!codegen_flags_changed || !flags_res_valid())
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
@@ -218,7 +210,7 @@ static int ropJE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_flags_res, 0);
                 }
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
         }
         return 0;
@@ -231,7 +223,7 @@ int ropJNE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, uint32_
         {
                 if (!codegen_flags_changed || !flags_res_valid())
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
@@ -239,7 +231,7 @@ int ropJNE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, uint32_
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_flags_res, 0);
                 }
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 1;
         }
@@ -247,7 +239,7 @@ int ropJNE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, uint32_
         {
                 if (!codegen_flags_changed || !flags_res_valid())
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
@@ -255,7 +247,7 @@ int ropJNE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, uint32_
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_flags_res, 0);
                 }
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
         }
         return 0;
@@ -299,16 +291,16 @@ static int ropJBE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 default:
                 if (do_unroll)
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 }
                 break;
@@ -316,7 +308,7 @@ static int ropJBE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
         if (do_unroll)
         {
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
@@ -327,7 +319,7 @@ static int ropJBE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 0;
         }
@@ -370,16 +362,16 @@ static int ropJNBE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 default:
                 if (do_unroll)
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 }
                 else
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, CF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_CF_SET);
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 }
                 break;
@@ -389,14 +381,14 @@ static int ropJNBE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 1;
         }
         else
         {
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
@@ -455,7 +447,7 @@ static int ropJS_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET);
                 if (do_unroll)
                         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
                 else
@@ -463,7 +455,7 @@ static int ropJS_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, do_unroll ? next_pc : dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -518,7 +510,7 @@ static int ropJNS_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET);
                 if (do_unroll)
                         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
                 else
@@ -526,7 +518,7 @@ static int ropJNS_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 break;
         }
         uop_MOV_IMM(ir, IREG_pc, do_unroll ? next_pc : dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -535,10 +527,10 @@ static int ropJP_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
 {
         int jump_uop;
 
-        uop_CALL_FUNC_RESULT(ir, IREG_temp0, PF_SET);
+        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_PF_SET);
         jump_uop = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return 0;
 }
@@ -546,10 +538,10 @@ static int ropJNP_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
 {
         int jump_uop;
 
-        uop_CALL_FUNC_RESULT(ir, IREG_temp0, PF_SET);
+        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_PF_SET);
         jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return 0;
 }
@@ -602,8 +594,8 @@ static int ropJL_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                 if (do_unroll)
                         jump_uop = uop_CMP_JNZ_DEST(ir, IREG_temp0, IREG_temp1);
                 else
@@ -614,7 +606,7 @@ static int ropJL_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr, u
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
         else
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -666,8 +658,8 @@ static int ropJNL_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
 
                 case FLAGS_UNKNOWN:
                 default:
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                 if (do_unroll)
                         jump_uop = uop_CMP_JZ_DEST(ir, IREG_temp0, IREG_temp1);
                 else
@@ -678,7 +670,7 @@ static int ropJNL_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
         else
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
         return do_unroll ? 1 : 0;
 }
@@ -713,18 +705,18 @@ static int ropJLE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 default:
                 if (do_unroll)
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                         jump_uop = uop_CMP_JNZ_DEST(ir, IREG_temp0, IREG_temp1);
                 }
                 else
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                         jump_uop = uop_CMP_JZ_DEST(ir, IREG_temp0, IREG_temp1);
                 }
                 break;
@@ -732,7 +724,7 @@ static int ropJLE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
         if (do_unroll)
         {
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
@@ -743,7 +735,7 @@ static int ropJLE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 0;
         }
@@ -778,18 +770,18 @@ static int ropJNLE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 default:
                 if (do_unroll)
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                         jump_uop = uop_CMP_JZ_DEST(ir, IREG_temp0, IREG_temp1);
                 }
                 else
                 {
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                         jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, NF_SET_01);
-                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, VF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_NF_SET_01);
+                        uop_CALL_FUNC_RESULT(ir, IREG_temp1, codegen_VF_SET_01);
                         jump_uop = uop_CMP_JNZ_DEST(ir, IREG_temp0, IREG_temp1);
                 }
                 break;
@@ -799,14 +791,14 @@ static int ropJNLE_common(codeblock_t *block, ir_data_t *ir, uint32_t dest_addr,
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
                 uop_MOV_IMM(ir, IREG_pc, next_pc);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 return 1;
         }
         else
         {
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
-                uop_JMP(ir, codegen_exit_rout);
+                JMP_EXIT(block, ir);
                 uop_set_jump_dest(ir, jump_uop);
                 if (jump_uop2 != -1)
                         uop_set_jump_dest(ir, jump_uop2);
@@ -883,7 +875,7 @@ uint32_t ropJCXZ(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
         else
                 jump_uop = uop_CMP_IMM_JNZ_DEST(ir, IREG_CX, 0);
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
 
         codegen_mark_code_present(block, cs+op_pc, 1);
@@ -931,7 +923,7 @@ uint32_t ropLOOP(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                 uop_MOV_IMM(ir, IREG_pc, dest_addr);
                 ret_addr = op_pc+1;
         }
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_set_jump_dest(ir, jump_uop);
 
         codegen_mark_code_present(block, cs+op_pc, 1);
@@ -959,7 +951,7 @@ uint32_t ropLOOPE(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fe
         }
         if (!codegen_flags_changed || !flags_res_valid())
         {
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                 jump_uop2 = uop_CMP_IMM_JZ_DEST(ir, IREG_temp0, 0);
         }
         else
@@ -967,7 +959,7 @@ uint32_t ropLOOPE(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fe
                 jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_flags_res, 0);
         }
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_NOP_BARRIER(ir);
         uop_set_jump_dest(ir, jump_uop);
         uop_set_jump_dest(ir, jump_uop2);
@@ -996,7 +988,7 @@ uint32_t ropLOOPNE(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t f
         }
         if (!codegen_flags_changed || !flags_res_valid())
         {
-                uop_CALL_FUNC_RESULT(ir, IREG_temp0, ZF_SET);
+                uop_CALL_FUNC_RESULT(ir, IREG_temp0, codegen_ZF_SET);
                 jump_uop2 = uop_CMP_IMM_JNZ_DEST(ir, IREG_temp0, 0);
         }
         else
@@ -1004,7 +996,7 @@ uint32_t ropLOOPNE(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t f
                 jump_uop2 = uop_CMP_IMM_JZ_DEST(ir, IREG_flags_res, 0);
         }
         uop_MOV_IMM(ir, IREG_pc, dest_addr);
-        uop_JMP(ir, codegen_exit_rout);
+        JMP_EXIT(block, ir);
         uop_NOP_BARRIER(ir);
         uop_set_jump_dest(ir, jump_uop);
         uop_set_jump_dest(ir, jump_uop2);
@@ -1,16 +1,58 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
 
 #include "x86.h"
 #include "386_common.h"
+#include "x86_flags.h"
 #include "codegen.h"
 #include "codegen_ir.h"
 #include "codegen_ir_defs.h"
 #include "codegen_reg.h"
 #include "codegen_ops_helpers.h"
 
+/*Flag helpers called from blocks. x86_flags.h only has static copies, so
+  blocks call these instead, giving each helper one address that the
+  translation cache can name*/
+void codegen_flags_rebuild()
+{
+        flags_rebuild();
+}
+void codegen_flags_rebuild_c()
+{
+        flags_rebuild_c();
+}
+int codegen_ZF_SET()
+{
+        return ZF_SET();
+}
+int codegen_NF_SET()
+{
+        return NF_SET();
+}
+int codegen_PF_SET()
+{
+        return PF_SET();
+}
+int codegen_VF_SET()
+{
+        return VF_SET();
+}
+int codegen_CF_SET()
+{
+        return CF_SET();
+}
+int codegen_NF_SET_01()
+{
+        return NF_SET() ? 1 : 0;
+}
+int codegen_VF_SET_01()
+{
+        return VF_SET() ? 1 : 0;
+}
+
 void LOAD_IMMEDIATE_FROM_RAM_16_unaligned(codeblock_t *block, ir_data_t *ir, int dest_reg, uint32_t addr)
 {
         /*Word access that crosses two pages. Perform reads from both pages, shift and combine*/
@@ -73,3 +115,66 @@ int codegen_can_unroll_full(codeblock_t *block, ir_data_t *ir, uint32_t next_pc,
 
         return 1;
 }
+
+/*Trace formation. A forward branch that was taken while recompiling is followed
+  within the block rather than ending it, and the path not taken becomes a side
+  exit. Blocks are recompiled on their second execution, so this follows the
+  path the code has just taken; codegen_chain_next() counts how often the side
+  exits are taken afterwards and has the block rebuilt without traces if they
+  are taken too often.
+
+  Only forward branches are followed, so no instruction is compiled twice. The
+  destination must be in the first page of the block, and the block must not
+  have reached the second page yet - the second page is found from the end of
+  the block, so the block can only continue into the page that follows the
+  first.*/
+static int codegen_trace_exit;
+
+int codegen_can_trace(codeblock_t *block, uint32_t next_pc, uint32_t dest_addr, int side_exit)
+{
+#ifdef CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+        if (block->flags & (CODEBLOCK_BYTE_MASK | CODEBLOCK_NO_TRACE))
+                return 0;
+        if (dest_addr <= next_pc)
+                return 0;
+        if (block->page_mask2 || (((cs + next_pc) ^ block->pc) & ~0xfff) || (((cs + dest_addr) ^ block->pc) & ~0xfff))
+                return 0;
+        /*This instruction must not be the last one in the block*/
+        if (block->ins + 1 >= MAX_INSTRUCTION_COUNT)
+                return 0;
+
+        if (side_exit)
+        {
+                /*Side exits must be chained, so that they can be counted*/
+                if (block->chain_exits >= CODEBLOCK_CHAIN_EXITS)
+                        return 0;
+                codegen_trace_exit = block->chain_exits;
+        }
+        else
+                codegen_trace_exit = 0;
+
+        codegen_trace_pending = 1;
+        codegen_trace_pc = dest_addr;
+
+        return 1;
+#else
+        return 0;
+#endif
+}
+
+/*Called once the branch has been compiled. The trace is only kept if the branch
+  went to the destination, having emitted the side exit that was reserved for
+  it*/
+void codegen_trace_commit(codeblock_t *block, uint32_t new_pc)
+{
+        if (new_pc != codegen_trace_pc ||
+            (codegen_trace_exit && block->chain_exits != codegen_trace_exit + 1))
+        {
+                codegen_trace_pending = 0;
+                return;
+        }
+
+        if (codegen_trace_exit)
+                block->trace_exits |= (1 << codegen_trace_exit);
+        codegen_traces_formed++;
+}
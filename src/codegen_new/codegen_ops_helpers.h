@@ -49,6 +49,21 @@ static inline void SUB_SP(ir_data_t *ir, int offset)
                 uop_SUB_IMM(ir, IREG_SP, IREG_SP, offset);
 }
 
+/*Exit the block, with IREG_pc already holding the successor. Uses a chainable
+  exit where the backend has them and the block has one free*/
+static inline void JMP_EXIT(codeblock_t *block, ir_data_t *ir)
+{
+#ifdef CODEGEN_BACKEND_HAS_BLOCK_CHAIN
+        if (block->chain_exits < CODEBLOCK_CHAIN_EXITS)
+        {
+                uop_JMP_CHAIN(ir, CODEGEN_CHAIN_EXIT_ID(block, block->chain_exits));
+                block->chain_exits++;
+                return;
+        }
+#endif
+        uop_JMP(ir, codegen_exit_rout);
+}
+
 static inline void fpu_POP(codeblock_t *block, ir_data_t *ir)
 {
         if (block->flags & CODEBLOCK_STATIC_TOP)
@@ -110,7 +125,22 @@ static inline void LOAD_IMMEDIATE_FROM_RAM_32(codeblock_t *block, ir_data_t *ir,
                 uop_MOV_REG_PTR(ir, dest_reg, get_ram_ptr(addr));
 }
 
+void codegen_flags_rebuild();
+void codegen_flags_rebuild_c();
+int codegen_ZF_SET();
+int codegen_NF_SET();
+int codegen_PF_SET();
+int codegen_VF_SET();
+int codegen_CF_SET();
+int codegen_NF_SET_01();
+int codegen_VF_SET_01();
+
 int codegen_can_unroll_full(codeblock_t *block, ir_data_t *ir, uint32_t next_pc, uint32_t dest_addr);
+int codegen_can_trace(codeblock_t *block, uint32_t next_pc, uint32_t dest_addr, int side_exit);
+void codegen_trace_commit(codeblock_t *block, uint32_t new_pc);
+/*Returns non-zero if a taken branch should be followed within the block, either
+  by unrolling a loop or by continuing a trace at a forward destination. The
+  caller must then make the not taken path the exit*/
 static inline int codegen_can_unroll(codeblock_t *block, ir_data_t *ir, uint32_t next_pc, uint32_t dest_addr)
 {
         if (block->flags & CODEBLOCK_BYTE_MASK)
@@ -118,7 +148,7 @@ static inline int codegen_can_unroll(codeblock_t *block, ir_data_t *ir, uint32_t
 
         /*Is dest within block?*/
         if (dest_addr > next_pc)
-                return 0;
+                return codegen_can_trace(block, next_pc, dest_addr, 1);
         if ((cs+dest_addr) < block->pc)
                 return 0;
 
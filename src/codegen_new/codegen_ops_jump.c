@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -21,6 +22,8 @@ uint32_t ropJMP_r8(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t f
 
         if (offset < 0)
                 codegen_can_unroll(block, ir, op_pc+1, dest_addr);
+        else
+                codegen_can_trace(block, op_pc+1, dest_addr, 0);
         codegen_mark_code_present(block, cs+op_pc, 1);
         return dest_addr;
 }
@@ -33,6 +36,8 @@ uint32_t ropJMP_r16(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t
 
         if (offset < 0)
                 codegen_can_unroll(block, ir, op_pc+1, dest_addr);
+        else
+                codegen_can_trace(block, op_pc+1, dest_addr, 0);
         codegen_mark_code_present(block, cs+op_pc, 2);
         return dest_addr;
 }
@@ -43,6 +48,8 @@ uint32_t ropJMP_r32(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t
         
         if (offset < 0)
                 codegen_can_unroll(block, ir, op_pc+1, dest_addr);
+        else
+                codegen_can_trace(block, op_pc+1, dest_addr, 0);
         codegen_mark_code_present(block, cs+op_pc, 4);
         return dest_addr;
 }
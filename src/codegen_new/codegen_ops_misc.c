@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -266,7 +267,7 @@ static void rebuild_c(ir_data_t *ir)
 
         if (needs_rebuild)
         {
-                uop_CALL_FUNC(ir, flags_rebuild_c);
+                uop_CALL_FUNC(ir, codegen_flags_rebuild_c);
         }
 }
 
@@ -568,19 +569,19 @@ ropLxS(LSS, &cpu_state.seg_ss)
 
 uint32_t ropCLC(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetchdat, uint32_t op_32, uint32_t op_pc)
 {
-        uop_CALL_FUNC(ir, flags_rebuild);
+        uop_CALL_FUNC(ir, codegen_flags_rebuild);
         uop_AND_IMM(ir, IREG_flags, IREG_flags, ~C_FLAG);
         return op_pc;
 }
 uint32_t ropCMC(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetchdat, uint32_t op_32, uint32_t op_pc)
 {
-        uop_CALL_FUNC(ir, flags_rebuild);
+        uop_CALL_FUNC(ir, codegen_flags_rebuild);
         uop_XOR_IMM(ir, IREG_flags, IREG_flags, C_FLAG);
         return op_pc;
 }
 uint32_t ropSTC(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetchdat, uint32_t op_32, uint32_t op_pc)
 {
-        uop_CALL_FUNC(ir, flags_rebuild);
+        uop_CALL_FUNC(ir, codegen_flags_rebuild);
         uop_OR_IMM(ir, IREG_flags, IREG_flags, C_FLAG);
         return op_pc;
 }
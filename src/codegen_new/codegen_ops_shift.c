@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -22,14 +23,14 @@ static uint32_t shift_common_8(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc,
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_8(dest_reg), IREG_8(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL8);
                         uop_MOVZX(ir, IREG_flags_res, IREG_8(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_8(dest_reg), IREG_8(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR8);
                         uop_MOVZX(ir, IREG_flags_res, IREG_8(dest_reg));
@@ -68,7 +69,7 @@ static uint32_t shift_common_8(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc,
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_temp0_B, IREG_temp0_B, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_B);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL8);
@@ -76,7 +77,7 @@ static uint32_t shift_common_8(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc,
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_temp0_B, IREG_temp0_B, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_B);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR8);
@@ -128,14 +129,14 @@ static uint32_t shift_common_16(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_16(dest_reg), IREG_16(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL16);
                         uop_MOVZX(ir, IREG_flags_res, IREG_16(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_16(dest_reg), IREG_16(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR16);
                         uop_MOVZX(ir, IREG_flags_res, IREG_16(dest_reg));
@@ -174,7 +175,7 @@ static uint32_t shift_common_16(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_temp0_W, IREG_temp0_W, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_W);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL16);
@@ -182,7 +183,7 @@ static uint32_t shift_common_16(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_temp0_W, IREG_temp0_W, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_W);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR16);
@@ -233,14 +234,14 @@ static uint32_t shift_common_32(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_32(dest_reg), IREG_32(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_32(dest_reg), IREG_32(dest_reg), count);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
@@ -279,7 +280,7 @@ static uint32_t shift_common_32(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL_IMM(ir, IREG_temp0, IREG_temp0, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
@@ -287,7 +288,7 @@ static uint32_t shift_common_32(ir_data_t *ir, uint32_t fetchdat, uint32_t op_pc
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR_IMM(ir, IREG_temp0, IREG_temp0, count);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
@@ -339,14 +340,14 @@ static uint32_t shift_common_variable_32(ir_data_t *ir, uint32_t fetchdat, uint3
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_32(dest_reg), IREG_32(dest_reg), count_reg);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_32(dest_reg), IREG_32(dest_reg), count_reg);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
@@ -385,7 +386,7 @@ static uint32_t shift_common_variable_32(ir_data_t *ir, uint32_t fetchdat, uint3
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_temp0, IREG_temp0, count_reg);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
@@ -393,7 +394,7 @@ static uint32_t shift_common_variable_32(ir_data_t *ir, uint32_t fetchdat, uint3
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_temp0, IREG_temp0, count_reg);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
@@ -596,14 +597,14 @@ uint32_t ropD2(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetch
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_8(dest_reg), IREG_8(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL8);
                         uop_MOVZX(ir, IREG_flags_res, IREG_8(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_8(dest_reg), IREG_8(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR8);
                         uop_MOVZX(ir, IREG_flags_res, IREG_8(dest_reg));
@@ -649,7 +650,7 @@ uint32_t ropD2(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetch
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_temp0_B, IREG_temp0_B, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_B);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL8);
@@ -657,7 +658,7 @@ uint32_t ropD2(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fetch
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_temp0_B, IREG_temp0_B, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_B);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR8);
@@ -718,14 +719,14 @@ uint32_t ropD3_w(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_16(dest_reg), IREG_16(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL16);
                         uop_MOVZX(ir, IREG_flags_res, IREG_16(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_16(dest_reg), IREG_16(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR16);
                         uop_MOVZX(ir, IREG_flags_res, IREG_16(dest_reg));
@@ -771,7 +772,7 @@ uint32_t ropD3_w(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_temp0_W, IREG_temp0_W, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_W);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL16);
@@ -779,7 +780,7 @@ uint32_t ropD3_w(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_temp0_W, IREG_temp0_W, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0_W);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR16);
@@ -840,14 +841,14 @@ uint32_t ropD3_l(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_32(dest_reg), IREG_32(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_32(dest_reg), IREG_32(dest_reg), IREG_temp2);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
                         uop_MOV(ir, IREG_flags_res, IREG_32(dest_reg));
@@ -893,7 +894,7 @@ uint32_t ropD3_l(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                 switch (fetchdat & 0x38)
                 {
                         case 0x00: /*ROL*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROL(ir, IREG_temp0, IREG_temp0, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROL32);
@@ -901,7 +902,7 @@ uint32_t ropD3_l(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fet
                         break;
 
                         case 0x08: /*ROR*/
-                        uop_CALL_FUNC(ir, flags_rebuild);
+                        uop_CALL_FUNC(ir, codegen_flags_rebuild);
                         uop_ROR(ir, IREG_temp0, IREG_temp0, IREG_temp2);
                         uop_MEM_STORE_REG(ir, ireg_seg_base(target_seg), IREG_eaaddr, IREG_temp0);
                         uop_MOV_IMM(ir, IREG_flags_op, FLAGS_ROR32);
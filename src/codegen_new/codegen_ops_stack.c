@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -380,7 +381,7 @@ uint32_t ropPUSHF(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t fe
                 return 0;
 
         uop_MOV_IMM(ir, IREG_oldpc, cpu_state.oldpc);
-        uop_CALL_FUNC(ir, flags_rebuild);
+        uop_CALL_FUNC(ir, codegen_flags_rebuild);
         sp_reg = LOAD_SP_WITH_OFFSET(ir, -2);
         uop_MEM_STORE_REG(ir, IREG_SS_base, sp_reg, IREG_flags);
         SUB_SP(ir, 2);
@@ -395,7 +396,7 @@ uint32_t ropPUSHFD(codeblock_t *block, ir_data_t *ir, uint8_t opcode, uint32_t f
                 return 0;
 
         uop_MOV_IMM(ir, IREG_oldpc, cpu_state.oldpc);
-        uop_CALL_FUNC(ir, flags_rebuild);
+        uop_CALL_FUNC(ir, codegen_flags_rebuild);
 
         if (cpu_CR4_mask & CR4_VME)
                 uop_AND_IMM(ir, IREG_temp0_W, IREG_eflags, 0x3c);
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <wchar.h>
 #include <86box/86box.h>
 #include "cpu.h"
 #include <86box/mem.h>
@@ -224,6 +225,11 @@ int reg_is_native_size(ir_reg_t ir_reg)
         return 0;
 }
 
+int reg_is_volatile(int reg)
+{
+        return (ireg_data[IREG_GET_REG(reg)].is_volatile == REG_VOLATILE);
+}
+
 void codegen_reg_reset()
 {
         int c;
@@ -644,6 +644,14 @@ load_machine(void)
 
     cpu_use_dynarec = !!config_get_int(cat, "cpu_use_dynarec", 0);
 
+    cpu_hlt_fastfwd = !!config_get_int(cat, "hlt_fast_forward", 0);
+
+    cpu_dynarec_cache = config_get_int(cat, "dynarec_cache_size", 0);
+    if (cpu_dynarec_cache < 0)
+	cpu_dynarec_cache = 0;
+
+    cpu_dynarec_persist = !!config_get_int(cat, "dynarec_persistent_cache", 0);
+
     p = config_get_string(cat, "time_sync", NULL);
     if (p != NULL) {        
 	if (!strcmp(p, "disabled"))
@@ -1862,6 +1870,21 @@ save_machine(void)
 
     config_set_int(cat, "cpu_use_dynarec", cpu_use_dynarec);
 
+    if (cpu_hlt_fastfwd == 0)
+	config_delete_var(cat, "hlt_fast_forward");
+      else
+	config_set_int(cat, "hlt_fast_forward", cpu_hlt_fastfwd);
+
+    if (cpu_dynarec_cache == 0)
+	config_delete_var(cat, "dynarec_cache_size");
+      else
+	config_set_int(cat, "dynarec_cache_size", cpu_dynarec_cache);
+
+    if (cpu_dynarec_persist == 0)
+	config_delete_var(cat, "dynarec_persistent_cache");
+      else
+	config_set_int(cat, "dynarec_persistent_cache", cpu_dynarec_persist);
+
     if (time_sync & TIME_SYNC_ENABLED)
 	if (time_sync & TIME_SYNC_UTC)
 		config_set_string(cat, "time_sync", "utc");
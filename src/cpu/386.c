@@ -245,6 +245,7 @@ exec386(int cycs)
 
 			cpu_state.pc++;
 			x86_opcodes[(opcode | cpu_state.op32) & 0x3ff](fetchdat);
+			cpu_ins_count++;
 			if (x86_was_reset)
 				break;
 		}
@@ -284,6 +285,9 @@ exec386(int cycs)
 		ins_cycles -= cycles;
 		tsc += ins_cycles;
 
+		if (cpu_hlt_idle)
+			cpu_hlt_fast_forward();
+
 		cycdiff = oldcyc - cycles;
 
 		if (smi_line)
@@ -1175,6 +1175,36 @@ enter_smm(int in_hlt)
 }
 
 
+/* Called by the CPU loops after a HLT that found no interrupt pending. Rather
+   than spinning on the HLT until something happens, jump straight to the next
+   timer event - or the end of the current frame, if that comes first. Returns
+   the number of cycles skipped. */
+int
+cpu_hlt_fast_forward(void)
+{
+    int32_t skip;
+
+    cpu_hlt_idle = 0;
+
+    if (!cpu_hlt_fastfwd || (cycles <= 0))
+	return 0;
+    if (smi_line || (nmi && nmi_enable && nmi_mask) || ((cpu_state.flags & I_FLAG) && pic.int_pending))
+	return 0;
+
+    skip = (int32_t) (timer_target - (uint32_t) tsc);
+    if (skip <= 0)
+	return 0;
+    if (skip > cycles)
+	skip = cycles;
+
+    tsc += skip;
+    cycles -= skip;
+    cpu_hlt_skipped += skip;
+
+    return skip;
+}
+
+
 void
 enter_smm_check(int in_hlt)
 {
@@ -1766,7 +1796,7 @@ sysexit(uint32_t fetchdat)
 
 
 int
-syscall(uint32_t fetchdat)
+syscall_op(uint32_t fetchdat)
 {
 #ifdef ENABLE_386_COMMON_LOG
     x386_common_log("SYSCALL called\n");
@@ -308,6 +308,36 @@ update_tsc(void)
 }
 
 
+#ifdef USE_NEW_DYNAREC
+/* Called from chained block exits. Returns 0 if anything that exec386_dynarec()
+   would handle between two blocks is due, in which case the block must return
+   to the dispatcher instead of jumping straight to its successor. */
+int
+exec386_dynarec_can_chain(void)
+{
+    int cycdiff;
+    uint64_t delta;
+
+    if ((cycles <= 0) || cpu_state.abrt || smi_line || cpu_hlt_idle || !CACHE_ON())
+	return 0;
+    if (nmi && nmi_enable && nmi_mask)
+	return 0;
+    if ((cpu_state.flags & I_FLAG) && pic.int_pending)
+	return 0;
+
+    cycdiff = cycles_old - cycles;
+    delta = tsc - tsc_old;
+    if (delta > 0)
+	cycdiff -= delta;
+
+    if ((cycdiff > 0) && TIMER_VAL_LESS_THAN_VAL(timer_target, (uint32_t)(tsc + cycdiff)))
+	return 0;
+
+    return 1;
+}
+#endif
+
+
 static __inline void
 exec386_dynarec_int(void)
 {
@@ -339,6 +369,7 @@ exec386_dynarec_int(void)
 
 		cpu_state.pc++;
 		x86_opcodes[(opcode | cpu_state.op32) & 0x3ff](fetchdat);
+		cpu_ins_count++;
 	}
 
 #ifndef USE_NEW_DYNAREC
@@ -513,7 +544,14 @@ exec386_dynarec_dyn(void)
 
 #ifndef USE_NEW_DYNAREC
 	codeblock_hash[hash] = block;
+#else
+	if (codegen_chain_pending)
+		codegen_chain_link(block);
+	block->used = 1;
 #endif
+	/* Counts the whole block even if it is left early. */
+	cpu_ins_count += block->ins;
+
 	inrecomp = 1;
 	code();
 #ifdef USE_ACYCS
@@ -526,6 +564,7 @@ exec386_dynarec_dyn(void)
 #endif
     } else if (valid_block && !cpu_state.abrt) {
 #ifdef USE_NEW_DYNAREC
+	codegen_chain_pending = 0;
 	start_pc = cs + cpu_state.pc;
 	const int max_block_size = (block->flags & CODEBLOCK_BYTE_MASK) ? ((128 - 25) - (start_pc & 0x3f)) : 1000;
 #else
@@ -537,6 +576,7 @@ exec386_dynarec_dyn(void)
 
 	codegen_block_start_recompile(block);
 	codegen_in_recompile = 1;
+	cpu_recomp_blocks++;
 
 	while (!cpu_block_end) {
 #ifndef USE_NEW_DYNAREC
@@ -564,6 +604,16 @@ exec386_dynarec_dyn(void)
 			codegen_generate_call(opcode, x86_opcodes[(opcode | cpu_state.op32) & 0x3ff], fetchdat, cpu_state.pc, cpu_state.pc-1);
 
 			x86_opcodes[(opcode | cpu_state.op32) & 0x3ff](fetchdat);
+			cpu_ins_count++;
+
+#ifdef USE_NEW_DYNAREC
+			/* A taken branch the recompiler followed does not end the block. */
+			if (codegen_trace_pending) {
+				if ((cpu_state.pc == codegen_trace_pc) && !cpu_state.abrt)
+					cpu_block_end = 0;
+				codegen_trace_pending = 0;
+			}
+#endif
 
 			if (x86_was_reset)
 				break;
@@ -619,6 +669,7 @@ exec386_dynarec_dyn(void)
     } else if (!cpu_state.abrt) {
 	/* Mark block but do not recompile */
 #ifdef USE_NEW_DYNAREC
+	codegen_chain_pending = 0;
 	start_pc = cs + cpu_state.pc;
 	const int max_block_size = (block->flags & CODEBLOCK_BYTE_MASK) ? ((128 - 25) - (start_pc & 0x3f)) : 1000;
 #else
@@ -629,6 +680,11 @@ exec386_dynarec_dyn(void)
 	x86_was_reset = 0;
 
 	codegen_block_init(phys_addr);
+#ifdef USE_NEW_DYNAREC
+	/* The block was loaded from the translation cache and is ready to run. */
+	if (codeblock[block_current].flags & CODEBLOCK_WAS_RECOMPILED)
+		return;
+#endif
 
 	while (!cpu_block_end) {
 #ifndef USE_NEW_DYNAREC
@@ -656,6 +712,7 @@ exec386_dynarec_dyn(void)
 			cpu_state.pc++;
 
 			x86_opcodes[(opcode | cpu_state.op32) & 0x3ff](fetchdat);
+			cpu_ins_count++;
 
 			if (x86_was_reset)
 				break;
@@ -708,8 +765,10 @@ exec386_dynarec_dyn(void)
 		codegen_reset();
     }
 #ifdef USE_NEW_DYNAREC
-    else
+    else {
+	codegen_chain_pending = 0;
 	cpu_state.oldpc = cpu_state.pc;
+    }
 #endif
 }
 
@@ -749,6 +808,9 @@ exec386_dynarec(int cycs)
 		tsc_old = tsc;
 		if (!CACHE_ON()) /*Interpret block*/
 		{
+#ifdef USE_NEW_DYNAREC
+			codegen_chain_pending = 0;
+#endif
 			exec386_dynarec_int();
 		}
 		else
@@ -769,6 +831,17 @@ exec386_dynarec(int cycs)
 			tsc += cycdiff;
 		}
 
+		if (cpu_hlt_idle)
+			cycdiff += cpu_hlt_fast_forward();
+
+#ifdef USE_NEW_DYNAREC
+		/* Only link blocks that followed each other without the dispatcher
+		   stepping in. */
+		if (cpu_state.abrt || smi_line || (nmi && nmi_enable && nmi_mask) ||
+		    ((cpu_state.flags & I_FLAG) && pic.int_pending))
+			codegen_chain_pending = 0;
+#endif
+
 		if (cpu_state.abrt) {
 			flags_rebuild();
 			tempi = cpu_state.abrt & ABRT_MASK;
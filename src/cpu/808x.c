@@ -2960,5 +2960,6 @@ execx86(int cycs)
 	}
 
 	ins++;
+	cpu_ins_count++;
     }
 }
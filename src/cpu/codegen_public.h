@@ -53,6 +53,18 @@
 extern void	codegen_init();
 #ifdef USE_NEW_DYNAREC
 extern void	codegen_close();
+
+/* uOP counts from the IR optimiser, for benchmarking. */
+extern uint64_t	codegen_ir_uops_in, codegen_ir_uops_dead;
+extern uint64_t	codegen_ir_uops_folded, codegen_ir_uops_cse,
+		codegen_ir_uops_forwarded, codegen_ir_uops_removed;
+extern uint64_t	codegen_ir_flags_removed;
+extern uint64_t	codegen_traces_formed, codegen_traces_dropped;
+extern uint64_t	codegen_blocks_evicted;
+extern int	codegen_allocator_size;
+extern uint64_t	codegen_cache_loaded, codegen_cache_saved;
+
+extern int	codegen_ir_opt_test(void);
 #endif
 extern void	codegen_flush();
 
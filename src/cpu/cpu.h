@@ -195,6 +195,7 @@ typedef struct {
 #define CR4_PVI		(1 << 1)
 #define CR4_PSE		(1 << 4)
 #define CR4_PAE		(1 << 5)
+#define CR4_PGE		(1 << 7)
 
 #define CPL ((cpu_state.seg_cs.access>>5)&3)
 
@@ -403,6 +404,10 @@ extern int	hasfpu;
 extern uint32_t	cpu_features;
 
 extern int	in_smm, smi_line, smi_latched, smm_in_hlt;
+extern int	cpu_hlt_idle;		/* HLT found nothing to do */
+extern uint64_t	cpu_hlt_skipped;	/* cycles skipped while halted */
+extern uint64_t	cpu_ins_count;		/* instructions executed */
+extern uint64_t	cpu_recomp_blocks;	/* blocks handed to the recompiler */
 extern int	smi_block;
 extern uint32_t	smbase;
 
@@ -528,6 +533,7 @@ extern int	divl(uint32_t val);
 extern void	execx86(int cycs);
 extern void	enter_smm(int in_hlt);
 extern void	enter_smm_check(int in_hlt);
+extern int	cpu_hlt_fast_forward(void);
 extern void	leave_smm(void);
 extern void	exec386(int cycs);
 extern void	exec386_dynarec(int cycs);
@@ -572,7 +578,7 @@ extern void	update_tsc(void);
 
 extern int	sysenter(uint32_t fetchdat);
 extern int	sysexit(uint32_t fetchdat);
-extern int	syscall(uint32_t fetchdat);
+extern int	syscall_op(uint32_t fetchdat);
 extern int	sysret(uint32_t fetchdat);
 
 extern cpu_family_t *cpu_get_family(const char *internal_name);
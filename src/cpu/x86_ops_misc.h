@@ -618,7 +618,10 @@ static int opHLT(uint32_t fetchdat)
         {
                 CLOCK_CYCLES_ALWAYS(100);
 		if (!((cpu_state.flags & I_FLAG) && pic.int_pending))
+		{
                 	cpu_state.pc--;
+			cpu_hlt_idle = 1;
+		}
         }
         else
                 CLOCK_CYCLES(5);
@@ -905,7 +908,7 @@ static int opLOADALL386(uint32_t fetchdat)
 	loadall_load_segment(la_addr + 0xb4, &cpu_state.seg_cs);
 	loadall_load_segment(la_addr + 0xc0, &cpu_state.seg_es);
 
-	if (CPL==3 && oldcpl!=3) flushmmucache_cr3();
+	if (CPL==3 && oldcpl!=3) flushmmucache_user();
 	oldcpl = CPL;
 
 	CLOCK_CYCLES(350);
@@ -569,7 +569,7 @@ loadcs(uint16_t seg)
 		do_seg_load(&cpu_state.seg_cs, segdat);
 		use32 = (segdat[3] & 0x40) ? 0x300 : 0;
 		if ((CPL == 3) && (oldcpl != 3))
-			flushmmucache_cr3();
+			flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 		oldcpl = CPL;
 #endif
@@ -598,7 +598,7 @@ loadcs(uint16_t seg)
 	cpu_state.seg_cs.access = (cpu_state.eflags & VM_FLAG) ? 0xe2 : 0x82;
 	cpu_state.seg_cs.ar_high = 0x10;
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -663,7 +663,7 @@ loadcsjmp(uint16_t seg, uint32_t old_pc)
 
 		do_seg_load(&cpu_state.seg_cs, segdat);
 		if ((CPL == 3) && (oldcpl != 3))
-			flushmmucache_cr3();
+			flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 		oldcpl = CPL;
 #endif
@@ -735,7 +735,7 @@ loadcsjmp(uint16_t seg, uint32_t old_pc)
 						CS = seg2;
 						do_seg_load(&cpu_state.seg_cs, segdat);
 						if ((CPL == 3) && (oldcpl != 3))
-							flushmmucache_cr3();
+							flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 						oldcpl = CPL;
 #endif
@@ -778,7 +778,7 @@ loadcsjmp(uint16_t seg, uint32_t old_pc)
 	cpu_state.seg_cs.access = (cpu_state.eflags & VM_FLAG) ? 0xe2 : 0x82;
 	cpu_state.seg_cs.ar_high = 0x10;
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -944,7 +944,7 @@ void loadcscall(uint16_t seg)
 			CS = seg;
 			do_seg_load(&cpu_state.seg_cs, segdat);
 			if ((CPL == 3) && (oldcpl != 3))
-				flushmmucache_cr3();
+				flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 			oldcpl = CPL;
 #endif
@@ -1084,7 +1084,7 @@ void loadcscall(uint16_t seg)
 								CS = seg2;
 								do_seg_load(&cpu_state.seg_cs, segdat);
 								if ((CPL == 3) && (oldcpl != 3))
-									flushmmucache_cr3();
+									flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 								oldcpl = CPL;
 #endif
@@ -1163,7 +1163,7 @@ void loadcscall(uint16_t seg)
 						CS = seg2;
 						do_seg_load(&cpu_state.seg_cs, segdat);
 						if ((CPL == 3) && (oldcpl != 3))
-							flushmmucache_cr3();
+							flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 						oldcpl = CPL;
 #endif
@@ -1208,7 +1208,7 @@ void loadcscall(uint16_t seg)
 	cpu_state.seg_cs.access = (cpu_state.eflags & VM_FLAG) ? 0xe2 : 0x82;
 	cpu_state.seg_cs.ar_high = 0x10;
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -1308,7 +1308,7 @@ pmoderetf(int is32, uint16_t off)
 	do_seg_load(&cpu_state.seg_cs, segdat);
 	cpu_state.seg_cs.access = (cpu_state.seg_cs.access & ~(3 << 5)) | ((CS & 3) << 5);
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -1415,7 +1415,7 @@ pmoderetf(int is32, uint16_t off)
 	CS = seg;
 	do_seg_load(&cpu_state.seg_cs, segdat);
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -1659,7 +1659,7 @@ pmodeint(int num, int soft)
 		CS = (seg & 0xfffc) | new_cpl;
 		cpu_state.seg_cs.access = (cpu_state.seg_cs.access & ~0x60) | (new_cpl << 5);
 		if ((CPL == 3) && (oldcpl != 3))
-			flushmmucache_cr3();
+			flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 		oldcpl = CPL;
 #endif
@@ -1826,7 +1826,7 @@ pmodeiret(int is32)
 		cpu_state.seg_cs.access = 0xe2;
 		cpu_state.seg_cs.ar_high = 0x10;
 		if ((CPL == 3) && (oldcpl != 3))
-			flushmmucache_cr3();
+			flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 		oldcpl = CPL;
 #endif
@@ -1905,7 +1905,7 @@ pmodeiret(int is32)
 	do_seg_load(&cpu_state.seg_cs, segdat);
 	cpu_state.seg_cs.access = (cpu_state.seg_cs.access & ~0x60) | ((CS & 0x0003) << 5);
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -1994,7 +1994,7 @@ pmodeiret(int is32)
 	do_seg_load(&cpu_state.seg_cs, segdat);
 	cpu_state.seg_cs.access = (cpu_state.seg_cs.access & ~0x60) | ((CS & 3) << 5);
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -2127,7 +2127,7 @@ taskswitch286(uint16_t seg, uint16_t *segdat, int is32)
 	cr0 |= 8;
 
 	cr3 = new_cr3;
-	flushmmucache();
+	flushmmucache_noglobal();
 
 	cpu_state.pc = new_pc;
 	cpu_state.flags = new_flags;
@@ -2185,7 +2185,7 @@ taskswitch286(uint16_t seg, uint16_t *segdat, int is32)
 		CS = new_cs;
 		do_seg_load(&cpu_state.seg_cs, segdat2);
 		if ((CPL == 3) && (oldcpl != 3))
-			flushmmucache_cr3();
+			flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 		oldcpl = CPL;
 #endif
@@ -2347,7 +2347,7 @@ taskswitch286(uint16_t seg, uint16_t *segdat, int is32)
 	CS = new_cs;
 	do_seg_load(&cpu_state.seg_cs, segdat2);
 	if ((CPL == 3) && (oldcpl != 3))
-		flushmmucache_cr3();
+		flushmmucache_user();
 #ifdef USE_NEW_DYNAREC
 	oldcpl = CPL;
 #endif
@@ -49,6 +49,8 @@
 #include <86box/device.h>
 #include <86box/machine.h>
 #include <86box/sound.h>
+#include <86box/timer.h>
+#include <86box/snapshot.h>
 
 
 #define DEVICE_MAX	256			/* max # of devices */
@@ -305,6 +307,84 @@ device_get_priv(const device_t *d)
 }
 
 
+/* Name of the snapshot section of device c. Devices added more than once
+   get their instance appended, in the order they were added - which is the
+   same for the same configuration. */
+static void
+device_state_name(int c, char *name, int len)
+{
+    int i, inst = 0;
+
+    for (i = 0; i < c; i++) {
+	if ((devices[i] != NULL) && !strcmp(devices[i]->name, devices[c]->name))
+		inst++;
+    }
+
+    if (inst)
+	snprintf(name, len, "dev:%s #%i", devices[c]->name, inst);
+    else
+	snprintf(name, len, "dev:%s", devices[c]->name);
+}
+
+
+/* Name of the first attached device without snapshot support, or NULL
+   if the state of every device can be saved and restored. */
+const char *
+device_state_unsupported(void)
+{
+    int c;
+
+    for (c = 0; c < DEVICE_MAX; c++) {
+	if ((devices[c] != NULL) &&
+	    ((devices[c]->save_state == NULL) || (devices[c]->load_state == NULL)))
+		return devices[c]->name;
+    }
+
+    return NULL;
+}
+
+
+/* Give every device its own section. The caller has made sure they all
+   have snapshot support. */
+void
+device_save_state(snapshot_t *s)
+{
+    char temp[SNAPSHOT_NAME_LEN];
+    int c;
+
+    for (c = 0; c < DEVICE_MAX; c++) {
+	if ((devices[c] == NULL) || (devices[c]->save_state == NULL))
+		continue;
+
+	device_state_name(c, temp, sizeof(temp));
+	snapshot_section_begin(s, temp);
+	devices[c]->save_state(device_priv[c], s);
+	snapshot_section_end(s);
+    }
+}
+
+
+int
+device_load_state(snapshot_t *s, const char *name)
+{
+    char temp[SNAPSHOT_NAME_LEN];
+    int c;
+
+    for (c = 0; c < DEVICE_MAX; c++) {
+	if ((devices[c] == NULL) || (devices[c]->load_state == NULL))
+		continue;
+
+	device_state_name(c, temp, sizeof(temp));
+	if (!strcmp(temp, name))
+		return devices[c]->load_state(device_priv[c], s);
+    }
+
+    device_log("DEVICE: no device for snapshot section '%s'\n", name);
+
+    return -1;
+}
+
+
 int
 device_available(const device_t *d)
 {
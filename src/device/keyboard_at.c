@@ -18,6 +18,7 @@
  *		Copyright 2016-2020 Miran Grca.
  *		Copyright 2017-2020 Fred N. van Kempen.
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -43,6 +44,7 @@
 #include <86box/snd_speaker.h>
 #include <86box/video.h>
 #include <86box/keyboard.h>
+#include <86box/snapshot.h>
 
 
 #define STAT_PARITY		0x80
@@ -2167,6 +2169,62 @@ kbd_reset(void *priv)
 }
 
 
+/* The timers and vendor handlers are set up by kbd_init(), only save
+   everything before them, along with the queues and the keyboard mode. */
+static void
+kbd_save_state(void *priv, snapshot_t *s)
+{
+    atkbd_t *dev = (atkbd_t *)priv;
+
+    snapshot_write(s, dev, offsetof(atkbd_t, refresh_time));
+    snapshot_write_timer(s, &dev->refresh_time);
+    snapshot_write_timer(s, &dev->pulse_cb);
+    snapshot_write_timer(s, &dev->send_delay_timer);
+
+    snapshot_put(s, kbc_queue_pos);
+    snapshot_put(s, kbc_queue);
+    snapshot_put(s, channel_queue_pos);
+    snapshot_put(s, channel_queue);
+    snapshot_put(s, kbd_last_scan_code);
+    snapshot_put(s, sc_or);
+    snapshot_put(s, keyboard_mode);
+    snapshot_put(s, keyboard_set3_flags);
+    snapshot_put(s, keyboard_set3_all_repeat);
+    snapshot_put(s, keyboard_set3_all_break);
+    snapshot_put(s, keyboard_scan);
+    snapshot_put(s, mouse_scan);
+}
+
+
+static int
+kbd_load_state(void *priv, snapshot_t *s)
+{
+    atkbd_t *dev = (atkbd_t *)priv;
+
+    snapshot_read(s, dev, offsetof(atkbd_t, refresh_time));
+    snapshot_read_timer(s, &dev->refresh_time);
+    snapshot_read_timer(s, &dev->pulse_cb);
+    snapshot_read_timer(s, &dev->send_delay_timer);
+
+    snapshot_get(s, kbc_queue_pos);
+    snapshot_get(s, kbc_queue);
+    snapshot_get(s, channel_queue_pos);
+    snapshot_get(s, channel_queue);
+    snapshot_get(s, kbd_last_scan_code);
+    snapshot_get(s, sc_or);
+    snapshot_get(s, keyboard_mode);
+    snapshot_get(s, keyboard_set3_flags);
+    snapshot_get(s, keyboard_set3_all_repeat);
+    snapshot_get(s, keyboard_set3_all_break);
+    snapshot_get(s, keyboard_scan);
+    snapshot_get(s, mouse_scan);
+
+    set_scancode_map(dev);
+
+    return 0;
+}
+
+
 /* Reset the AT keyboard - this is needed for the PCI TRC and is done
    until a better solution is found. */
 void
@@ -2268,7 +2326,8 @@ const device_t keyboard_at_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_at_ami_device = {
@@ -2278,7 +2337,8 @@ const device_t keyboard_at_ami_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_at_toshiba_device = {
@@ -2288,7 +2348,8 @@ const device_t keyboard_at_toshiba_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_device = {
@@ -2298,7 +2359,8 @@ const device_t keyboard_ps2_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_ps2_device = {
@@ -2308,7 +2370,8 @@ const device_t keyboard_ps2_ps2_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_ps1_device = {
@@ -2318,7 +2381,8 @@ const device_t keyboard_ps2_ps1_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_ps1_pci_device = {
@@ -2328,7 +2392,8 @@ const device_t keyboard_ps2_ps1_pci_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_xi8088_device = {
@@ -2338,7 +2403,8 @@ const device_t keyboard_ps2_xi8088_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_ami_device = {
@@ -2348,7 +2414,8 @@ const device_t keyboard_ps2_ami_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_mca_device = {
@@ -2358,7 +2425,8 @@ const device_t keyboard_ps2_mca_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_mca_2_device = {
@@ -2368,7 +2436,8 @@ const device_t keyboard_ps2_mca_2_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_quadtel_device = {
@@ -2378,7 +2447,8 @@ const device_t keyboard_ps2_quadtel_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_pci_device = {
@@ -2388,7 +2458,8 @@ const device_t keyboard_ps2_pci_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_ami_pci_device = {
@@ -2398,7 +2469,8 @@ const device_t keyboard_ps2_ami_pci_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_intel_ami_pci_device = {
@@ -2408,7 +2480,8 @@ const device_t keyboard_ps2_intel_ami_pci_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 const device_t keyboard_ps2_acer_pci_device = {
@@ -2418,7 +2491,8 @@ const device_t keyboard_ps2_acer_pci_device = {
     kbd_init,
     kbd_close,
     kbd_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    kbd_save_state, kbd_load_state
 };
 
 
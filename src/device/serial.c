@@ -21,6 +21,7 @@
  *		Copyright 2017-2020 Fred N. van Kempen.
  */
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -37,6 +38,7 @@
 #include <86box/rom.h>
 #include <86box/serial.h>
 #include <86box/mouse.h>
+#include <86box/snapshot.h>
 
 
 enum
@@ -658,6 +660,46 @@ serial_speed_changed(void *priv)
 }
 
 
+/* The registers and FIFOs come before the timers. A port moved by the
+   guest since power-on is moved again. */
+static void
+serial_save_state(void *priv, snapshot_t *s)
+{
+    serial_t *dev = (serial_t *) priv;
+
+    snapshot_write(s, dev, offsetof(serial_t, transmit_timer));
+    snapshot_write_timer(s, &dev->transmit_timer);
+    snapshot_write_timer(s, &dev->timeout_timer);
+    snapshot_put(s, dev->clock_src);
+    snapshot_put(s, dev->transmit_period);
+}
+
+
+static int
+serial_load_state(void *priv, snapshot_t *s)
+{
+    serial_t *dev = (serial_t *) priv;
+    uint16_t base = dev->base_address, addr;
+
+    snapshot_read(s, dev, offsetof(serial_t, transmit_timer));
+    snapshot_read_timer(s, &dev->transmit_timer);
+    snapshot_read_timer(s, &dev->timeout_timer);
+    snapshot_get(s, dev->clock_src);
+    snapshot_get(s, dev->transmit_period);
+
+    if (dev->base_address != base) {
+	addr = dev->base_address;
+	dev->base_address = base;
+	if (addr != 0x0000)
+		serial_setup(dev, addr, dev->irq);
+	else
+		serial_remove(dev);
+    }
+
+    return 0;
+}
+
+
 static void
 serial_close(void *priv)
 {
@@ -740,7 +782,8 @@ const device_t i8250_device = {
     SERIAL_8250,
     serial_init, serial_close, NULL,
     { NULL }, serial_speed_changed, NULL,
-    NULL
+    NULL,
+    serial_save_state, serial_load_state
 };
 
 const device_t i8250_pcjr_device = {
@@ -749,7 +792,8 @@ const device_t i8250_pcjr_device = {
     SERIAL_8250_PCJR,
     serial_init, serial_close, NULL,
     { NULL }, serial_speed_changed, NULL,
-    NULL
+    NULL,
+    serial_save_state, serial_load_state
 };
 
 const device_t ns16450_device = {
@@ -758,7 +802,8 @@ const device_t ns16450_device = {
     SERIAL_NS16450,
     serial_init, serial_close, NULL,
     { NULL }, serial_speed_changed, NULL,
-    NULL
+    NULL,
+    serial_save_state, serial_load_state
 };
 
 const device_t ns16550_device = {
@@ -767,5 +812,6 @@ const device_t ns16550_device = {
     SERIAL_NS16550,
     serial_init, serial_close, NULL,
     { NULL }, serial_speed_changed, NULL,
-    NULL
+    NULL,
+    serial_save_state, serial_load_state
 };
@@ -98,6 +98,12 @@ typedef struct {
     uint16_t	buffer[256];
     int		irqstat;
 
+    uint8_t	sector_buffer[256 << 9];
+    int		sector_pos;
+    off64_t	write_addr;
+    int		write_count;
+    int		write_hdd;
+
     pc_timer_t	callback_timer;
 
     drive_t	drives[2];
@@ -216,6 +222,83 @@ next_sector(esdi_t *esdi)
 }
 
 
+/*
+ * Read all the sectors of a read or verify command into the sector buffer,
+ * one image transfer per run of consecutive sectors. Translation leaves a
+ * spare sector per track, so there the runs end at each track. The read
+ * stops at the first sector that is not found, the command reports that
+ * one when it gets there.
+ */
+static void
+read_sectors(esdi_t *esdi)
+{
+    drive_t *drive = &esdi->drives[esdi->drive_sel];
+    int sector = esdi->sector, head = esdi->head, cylinder = esdi->cylinder;
+    int current_cylinder = drive->current_cylinder;
+    int count = esdi->secount ? esdi->secount : 256;
+    off64_t addr, start = 0;
+    int c, run = 0;
+
+    for (c = 0; c < count; c++) {
+	if (get_sector(esdi, &addr))
+		break;
+
+	if (run && (addr != (start + run))) {
+		hdd_image_read(drive->hdd_num, start, run, &esdi->sector_buffer[(c - run) << 9]);
+		run = 0;
+	}
+	if (! run)
+		start = addr;
+	run++;
+
+	next_sector(esdi);
+    }
+
+    if (run)
+	hdd_image_read(drive->hdd_num, start, run, &esdi->sector_buffer[(c - run) << 9]);
+
+    esdi->sector = sector;
+    esdi->head = head;
+    esdi->cylinder = cylinder;
+    drive->current_cylinder = current_cylinder;
+}
+
+
+/* Write out the sectors collected so far. */
+static void
+write_flush(esdi_t *esdi)
+{
+    if (esdi->write_count) {
+	hdd_image_write(esdi->write_hdd, esdi->write_addr, esdi->write_count, esdi->sector_buffer);
+	esdi->write_count = 0;
+    }
+}
+
+
+/*
+ * Written sectors are collected in the sector buffer and go to the image
+ * in one transfer once a run of consecutive sectors ends, or the command
+ * is done.
+ */
+static void
+write_sector(esdi_t *esdi, off64_t addr)
+{
+    drive_t *drive = &esdi->drives[esdi->drive_sel];
+
+    if (esdi->write_count && ((addr != (esdi->write_addr + esdi->write_count)) ||
+	(esdi->write_hdd != drive->hdd_num)))
+	write_flush(esdi);
+
+    if (! esdi->write_count) {
+	esdi->write_addr = addr;
+	esdi->write_hdd = drive->hdd_num;
+    }
+
+    memcpy(&esdi->sector_buffer[esdi->write_count << 9], esdi->buffer, 512);
+    esdi->write_count++;
+}
+
+
 static void
 esdi_writew(uint16_t port, uint16_t val, void *priv)
 {
@@ -282,6 +365,7 @@ esdi_write(uint16_t port, uint8_t val, void *priv)
 
 	case 0x1f7:	/* command register */
 		irq_lower(esdi);
+		write_flush(esdi);
 		esdi->command = val;
 		esdi->error = 0;
 
@@ -318,6 +402,7 @@ esdi_write(uint16_t port, uint8_t val, void *priv)
 
 					case 0xa0:
 						esdi->status = STAT_BUSY;
+						esdi->sector_pos = 0;
 						timer_set_delay_u64(&esdi->callback_timer, 200 * HDC_TIME);
 						break;
 
@@ -336,6 +421,7 @@ esdi_write(uint16_t port, uint8_t val, void *priv)
 					case CMD_VERIFY+1:
 						esdi->command &= ~0x01;
 						esdi->status = STAT_BUSY;
+						esdi->sector_pos = 0;
 						timer_set_delay_u64(&esdi->callback_timer, 200 * HDC_TIME);
 						break;
 
@@ -481,6 +567,8 @@ esdi_callback(void *priv)
     off64_t addr;
 
     if (esdi->reset) {
+	write_flush(esdi);
+
 	esdi->status = STAT_READY|STAT_DSC;
 	esdi->error = 1;
 	esdi->secount = 1;
@@ -529,7 +617,9 @@ esdi_callback(void *priv)
 				break;
 			}
 			
-			hdd_image_read(drive->hdd_num, addr, 1, (uint8_t *)esdi->buffer);
+			if (! esdi->sector_pos)
+				read_sectors(esdi);
+			memcpy(esdi->buffer, &esdi->sector_buffer[esdi->sector_pos++ << 9], 512);
 			esdi->pos = 0;
 			esdi->status = STAT_DRQ|STAT_READY|STAT_DSC;
 			irq_raise(esdi);
@@ -545,21 +635,24 @@ esdi_callback(void *priv)
 			break;
 		} else {
 			if (get_sector(esdi, &addr)) {
+				write_flush(esdi);
 				esdi->error = ERR_ID_NOT_FOUND;
 				esdi->status = STAT_READY|STAT_DSC|STAT_ERR;
 				irq_raise(esdi);
 				break;
 			}
 			
-			hdd_image_write(drive->hdd_num, addr, 1, (uint8_t *)esdi->buffer);
-			irq_raise(esdi);
+			write_sector(esdi, addr);
 			esdi->secount = (esdi->secount - 1) & 0xff;
 			if (esdi->secount) {
 				esdi->status = STAT_DRQ|STAT_READY|STAT_DSC;
 				esdi->pos = 0;
 				next_sector(esdi);
-			} else
+			} else {
+				write_flush(esdi);
 				esdi->status = STAT_READY|STAT_DSC;
+			}
+			irq_raise(esdi);
 			ui_sb_update_icon(SB_HDD|HDD_BUS_ESDI, 1);
 		}
 		break;
@@ -578,7 +671,8 @@ esdi_callback(void *priv)
 				break;
 			}
 
-			hdd_image_read(drive->hdd_num, addr, 1, (uint8_t *)esdi->buffer);
+			if (! esdi->sector_pos++)
+				read_sectors(esdi);
 			ui_sb_update_icon(SB_HDD|HDD_BUS_ESDI, 1);
 			next_sector(esdi);
 			esdi->secount = (esdi->secount - 1) & 0xff;
@@ -825,6 +919,8 @@ wd1007vse1_close(void *priv)
     drive_t *drive;
     int d;
 
+    write_flush(esdi);
+
     for (d=0; d<2; d++) {
 	drive = &esdi->drives[d];
 
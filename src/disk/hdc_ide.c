@@ -21,6 +21,7 @@
 #define _LARGEFILE_SOURCE
 #define _LARGEFILE64_SOURCE
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -47,6 +48,7 @@
 #include <86box/hdd.h>
 #include <86box/zip.h>
 #include <86box/version.h>
+#include <86box/snapshot.h>
 
 
 /* Bits of 'atastat' */
@@ -656,6 +658,20 @@ ide_get_sector(ide_t *ide)
 }
 
 
+/**
+ * Start reading the sectors of a read command in the background, the
+ * callback waits for them once the command's seek time has passed.
+ */
+static void
+ide_hdd_start_read(ide_t *ide)
+{
+    uint32_t count = ide->secount ? ide->secount : 256;
+
+    hdd_async_wait(ide->hdd_num, ide->read_ticket);
+    ide->read_ticket = hdd_async_read(ide->hdd_num, ide_get_sector(ide), count, ide->sector_buffer);
+}
+
+
 /**
  * Move to the next sector using CHS addressing
  */
@@ -1583,6 +1599,8 @@ ide_writeb(uint16_t addr, uint8_t val, void *priv)
 				} else
 					ide_set_callback(ide, 200.0 * IDE_TIME);
 				ide->do_initial_read = 1;
+				if ((ide->type == IDE_HDD) && (ide->lba || ide->cfg_spt))
+					ide_hdd_start_read(ide);
 				return;
 
 			case WIN_WRITE_MULTIPLE:
@@ -2109,10 +2127,8 @@ ide_callback(void *priv)
 		if (ide->do_initial_read) {
 			ide->do_initial_read = 0;
 			ide->sector_pos = 0;
-			if (ide->secount)
-				hdd_image_read(ide->hdd_num, ide_get_sector(ide), ide->secount, ide->sector_buffer);
-			else
-				hdd_image_read(ide->hdd_num, ide_get_sector(ide), 256, ide->sector_buffer);
+			if (hdd_async_wait(ide->hdd_num, ide->read_ticket))
+				goto data_error;
 		}
 
 		memcpy(ide->buffer, &ide->sector_buffer[ide->sector_pos*512], 512);
@@ -2143,7 +2159,8 @@ ide_callback(void *priv)
 			ide->sector_pos = ide->secount;
 		else
 			ide->sector_pos = 256;
-		hdd_image_read(ide->hdd_num, ide_get_sector(ide), ide->sector_pos, ide->sector_buffer);
+		if (hdd_async_wait(ide->hdd_num, ide->read_ticket))
+			goto data_error;
 
 		ide->pos=0;
 
@@ -2191,10 +2208,8 @@ ide_callback(void *priv)
 		if (ide->do_initial_read) {
 			ide->do_initial_read = 0;
 			ide->sector_pos = 0;
-			if (ide->secount)
-				hdd_image_read(ide->hdd_num, ide_get_sector(ide), ide->secount, ide->sector_buffer);
-			else
-				hdd_image_read(ide->hdd_num, ide_get_sector(ide), 256, ide->sector_buffer);
+			if (hdd_async_wait(ide->hdd_num, ide->read_ticket))
+				goto data_error;
 		}
 
 		memcpy(ide->buffer, &ide->sector_buffer[ide->sector_pos*512], 512);
@@ -2216,7 +2231,7 @@ ide_callback(void *priv)
 			goto abort_cmd;
 		if (!ide->lba && (ide->cfg_spt == 0))
 			goto id_not_found;
-		hdd_image_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
+		hdd_async_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
 		ide_irq_raise(ide);
 		ide->secount = (ide->secount - 1) & 0xff;
 		if (ide->secount) {
@@ -2247,6 +2262,8 @@ ide_callback(void *priv)
 			else
 				ide->sector_pos = 256;
 
+			if (hdd_async_wait(ide->hdd_num, ide->read_ticket))
+				goto data_error;
 			ret = ide_bm[ide->board]->dma(ide->board,
 						      ide->sector_buffer, ide->sector_pos * 512,
 						      1, ide_bm[ide->board]->priv);
@@ -2260,7 +2277,7 @@ ide_callback(void *priv)
 				/*DMA successful*/
 				ide_log("IDE %i: DMA write successful\n", ide->channel);
 
-				hdd_image_write(ide->hdd_num, ide_get_sector(ide), ide->sector_pos, ide->sector_buffer);
+				hdd_async_write(ide->hdd_num, ide_get_sector(ide), ide->sector_pos, ide->sector_buffer);
 
 				ide->atastat = DRDY_STAT | DSC_STAT;
 
@@ -2283,7 +2300,7 @@ ide_callback(void *priv)
 			goto abort_cmd;
 		if (!ide->lba && (ide->cfg_spt == 0))
 			goto id_not_found;
-		hdd_image_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
+		hdd_async_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
 		ide->blockcount++;
 		if (ide->blockcount >= ide->blocksize || ide->secount == 1) {
 			ide->blockcount = 0;
@@ -2317,7 +2334,7 @@ ide_callback(void *priv)
 			goto abort_cmd;
 		if (!ide->lba && (ide->cfg_spt == 0))
 			goto id_not_found;
-		hdd_image_zero(ide->hdd_num, ide_get_sector(ide), ide->secount);
+		hdd_async_zero(ide->hdd_num, ide_get_sector(ide), ide->secount);
 
 		ide->atastat = DRDY_STAT | DSC_STAT;
 		ide_irq_raise(ide);
@@ -2426,6 +2443,15 @@ id_not_found:
     ide->error = IDNF_ERR;
     ide->pos = 0;
     ide_irq_raise(ide);
+    return;
+
+data_error:
+    /* The image could not be read or written. */
+    ide->atastat = DRDY_STAT | ERR_STAT | DSC_STAT;
+    ide->error = UNC_ERR;
+    ide->pos = 0;
+    ide_irq_raise(ide);
+    ui_sb_update_icon(SB_HDD | hdd[ide->hdd_num].bus, 0);
 }
 
 
@@ -2796,6 +2822,9 @@ ide_drive_reset(int d)
 
     ide_set_signature(ide_drives[d]);
 
+    if ((ide_drives[d]->type == IDE_HDD) && (ide_drives[d]->hdd_num != -1))
+	hdd_async_wait(ide_drives[d]->hdd_num, ide_drives[d]->read_ticket);
+
     if (ide_drives[d]->sector_buffer)
 	memset(ide_drives[d]->sector_buffer, 0, 256*512);
 
@@ -2821,6 +2850,130 @@ ide_board_reset(int board)
 }
 
 
+/* The I/O handlers are set up by the board's owner and stay where they
+   are, so only the selected drive and the timer are saved for the board.
+   The drives' own state runs up to their buffers. ATAPI devices keep the
+   rest of their state in the SCSI layer, which has no snapshot support. */
+static void
+ide_board_save_state(int board, snapshot_t *s)
+{
+    ide_t *ide;
+    int d;
+
+    if (ide_boards[board] == NULL)
+	return;
+
+    snapshot_put(s, ide_boards[board]->cur_dev);
+    snapshot_put(s, ide_boards[board]->diag);
+    snapshot_write_timer(s, &ide_boards[board]->timer);
+
+    for (d = 0; d < 2; d++) {
+	ide = ide_drives[(board << 1) + d];
+
+	if (ide->type == IDE_ATAPI) {
+		snapshot_unsupported(s, "ATAPI device");
+		return;
+	}
+
+	/* Have the sector buffer filled before it is saved. */
+	if ((ide->type == IDE_HDD) && (ide->hdd_num != -1))
+		hdd_async_wait(ide->hdd_num, ide->read_ticket);
+
+	snapshot_write(s, ide, offsetof(ide_t, buffer));
+	if (ide->buffer)
+		snapshot_write(s, ide->buffer, 65536 * sizeof(uint16_t));
+	if (ide->sector_buffer)
+		snapshot_write(s, ide->sector_buffer, 256 * 512);
+	snapshot_write_timer(s, &ide->timer);
+    }
+}
+
+
+static int
+ide_board_load_state(int board, snapshot_t *s)
+{
+    ide_t *ide, temp;
+    int d;
+
+    if (ide_boards[board] == NULL)
+	return 0;
+
+    snapshot_get(s, ide_boards[board]->cur_dev);
+    snapshot_get(s, ide_boards[board]->diag);
+    snapshot_read_timer(s, &ide_boards[board]->timer);
+
+    for (d = 0; d < 2; d++) {
+	ide = ide_drives[(board << 1) + d];
+
+	if (ide->type == IDE_ATAPI)
+		return -1;
+
+	snapshot_read(s, &temp, offsetof(ide_t, buffer));
+	if ((temp.type != ide->type) || (temp.hdd_num != ide->hdd_num))
+		return -1;
+	memcpy(ide, &temp, offsetof(ide_t, buffer));
+
+	if (ide->buffer)
+		snapshot_read(s, ide->buffer, 65536 * sizeof(uint16_t));
+	if (ide->sector_buffer)
+		snapshot_read(s, ide->sector_buffer, 256 * 512);
+	snapshot_read_timer(s, &ide->timer);
+
+	/* The saved ticket was already complete, and means nothing now. */
+	if ((ide->type == IDE_HDD) && (ide->hdd_num != -1))
+		ide->read_ticket = hdd_async_ticket(ide->hdd_num);
+    }
+
+    return 0;
+}
+
+
+static void
+ide_save_state(void *priv, snapshot_t *s)
+{
+    ide_board_save_state(0, s);
+    ide_board_save_state(1, s);
+}
+
+
+static int
+ide_load_state(void *priv, snapshot_t *s)
+{
+    if (ide_board_load_state(0, s))
+	return -1;
+
+    return ide_board_load_state(1, s);
+}
+
+
+static void
+ide_ter_save_state(void *priv, snapshot_t *s)
+{
+    ide_board_save_state(2, s);
+}
+
+
+static int
+ide_ter_load_state(void *priv, snapshot_t *s)
+{
+    return ide_board_load_state(2, s);
+}
+
+
+static void
+ide_qua_save_state(void *priv, snapshot_t *s)
+{
+    ide_board_save_state(3, s);
+}
+
+
+static int
+ide_qua_load_state(void *priv, snapshot_t *s)
+{
+    return ide_board_load_state(3, s);
+}
+
+
 /* Reset a standalone IDE unit. */
 static void
 ide_reset(void *p)
@@ -2848,7 +3001,8 @@ const device_t ide_isa_device = {
     DEVICE_ISA | DEVICE_AT,
     0,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 const device_t ide_isa_2ch_device = {
@@ -2856,7 +3010,8 @@ const device_t ide_isa_2ch_device = {
     DEVICE_ISA | DEVICE_AT,
     1,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 const device_t ide_vlb_device = {
@@ -2864,7 +3019,8 @@ const device_t ide_vlb_device = {
     DEVICE_VLB | DEVICE_AT,
     2,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 const device_t ide_vlb_2ch_device = {
@@ -2872,7 +3028,8 @@ const device_t ide_vlb_2ch_device = {
     DEVICE_VLB | DEVICE_AT,
     3,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 const device_t ide_pci_device = {
@@ -2880,7 +3037,8 @@ const device_t ide_pci_device = {
     DEVICE_PCI | DEVICE_AT,
     4,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 const device_t ide_pci_2ch_device = {
@@ -2888,7 +3046,8 @@ const device_t ide_pci_2ch_device = {
     DEVICE_PCI | DEVICE_AT,
     5,
     ide_init, ide_close, ide_reset,
-    { NULL }, NULL, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    ide_save_state, ide_load_state
 };
 
 static const device_config_t ide_ter_config[] =
@@ -2981,7 +3140,8 @@ const device_t ide_ter_device = {
     0,
     ide_ter_init, ide_ter_close, NULL,
     { NULL }, NULL, NULL,
-    ide_ter_config
+    ide_ter_config,
+    ide_ter_save_state, ide_ter_load_state
 };
 
 const device_t ide_qua_device = {
@@ -2990,5 +3150,6 @@ const device_t ide_qua_device = {
     0,
     ide_qua_init, ide_qua_close, NULL,
     { NULL }, NULL, NULL,
-    ide_qua_config
+    ide_qua_config,
+    ide_qua_save_state, ide_qua_load_state
 };
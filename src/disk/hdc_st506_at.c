@@ -116,12 +116,19 @@ typedef struct {
 
     uint16_t	buffer[256];		/* data buffer (16b wide) */
 
+    uint8_t	sector_buffer[256 << 9];	/* sectors of the whole command */
+    int		sector_pos;		/* next sector of a read in there */
+    off64_t	write_addr;		/* first sector of collected writes */
+    int		write_count,		/* number of collected writes */
+		write_hdd;		/* drive they are for */
+
     drive_t	drives[MFM_NUM];	/* attached drives */
 } mfm_t;
 
 
 static uint8_t		mfm_read(uint16_t port, void *priv);
 static void		mfm_write(uint16_t port, uint8_t val, void *priv);
+static void		do_seek(mfm_t *mfm);
 
 
 #ifdef ENABLE_ST506_AT_LOG
@@ -242,6 +249,84 @@ next_sector(mfm_t *mfm)
 }
 
 
+/*
+ * Read all the sectors of a read command into the sector buffer, one
+ * image transfer per run of consecutive sectors. The read stops at the
+ * first sector that is not found, the command reports that one when it
+ * gets there.
+ */
+static void
+read_sectors(mfm_t *mfm)
+{
+    drive_t *drive = &mfm->drives[mfm->drvsel];
+    uint8_t sector = mfm->sector, head = mfm->head;
+    uint16_t cylinder = mfm->cylinder;
+    int16_t curcyl = drive->curcyl;
+    int count = mfm->secount ? mfm->secount : 256;
+    off64_t addr, start = 0;
+    int c, run = 0;
+
+    for (c = 0; c < count; c++) {
+	do_seek(mfm);
+	if (get_sector(mfm, &addr))
+		break;
+
+	if (run && (addr != (start + run))) {
+		hdd_image_read(drive->hdd_num, start, run, &mfm->sector_buffer[(c - run) << 9]);
+		run = 0;
+	}
+	if (! run)
+		start = addr;
+	run++;
+
+	next_sector(mfm);
+    }
+
+    if (run)
+	hdd_image_read(drive->hdd_num, start, run, &mfm->sector_buffer[(c - run) << 9]);
+
+    mfm->sector = sector;
+    mfm->head = head;
+    mfm->cylinder = cylinder;
+    drive->curcyl = curcyl;
+}
+
+
+/* Write out the sectors collected so far. */
+static void
+write_flush(mfm_t *mfm)
+{
+    if (mfm->write_count) {
+	hdd_image_write(mfm->write_hdd, mfm->write_addr, mfm->write_count, mfm->sector_buffer);
+	mfm->write_count = 0;
+    }
+}
+
+
+/*
+ * Written sectors are collected in the sector buffer and go to the image
+ * in one transfer once a run of consecutive sectors ends, or the command
+ * is done.
+ */
+static void
+write_sector(mfm_t *mfm, off64_t addr)
+{
+    drive_t *drive = &mfm->drives[mfm->drvsel];
+
+    if (mfm->write_count && ((addr != (mfm->write_addr + mfm->write_count)) ||
+	(mfm->write_hdd != drive->hdd_num)))
+	write_flush(mfm);
+
+    if (! mfm->write_count) {
+	mfm->write_addr = addr;
+	mfm->write_hdd = drive->hdd_num;
+    }
+
+    memcpy(&mfm->sector_buffer[mfm->write_count << 9], mfm->buffer, 512);
+    mfm->write_count++;
+}
+
+
 static void
 mfm_cmd(mfm_t *mfm, uint8_t val)
 {
@@ -293,6 +378,7 @@ mfm_cmd(mfm_t *mfm, uint8_t val)
 				if (val & 2)
 					fatal("WD1003: READ with ECC\n");
 				mfm->status = STAT_BUSY;
+				mfm->sector_pos = 0;
 				timer_set_delay_u64(&mfm->callback_timer, 200 * MFM_TIME);
 				break;
 
@@ -435,6 +521,7 @@ mfm_write(uint16_t port, uint8_t val, void *priv)
 		return;
 
 	case 0x01f7:	/* command register */
+		write_flush(mfm);
 		mfm_cmd(mfm, val);
 		break;
 
@@ -567,6 +654,8 @@ do_callback(void *priv)
     if (mfm->reset) {
 	st506_at_log("WD1003(%d) reset\n", mfm->drvsel);
 
+	write_flush(mfm);
+
 	mfm->status = STAT_READY|STAT_DSC;
 	mfm->error = 1;
 	mfm->secount = 1;
@@ -604,7 +693,9 @@ do_callback(void *priv)
 			break;
 		}
 
-		hdd_image_read(drive->hdd_num, addr, 1, (uint8_t *)mfm->buffer);
+		if (! mfm->sector_pos)
+			read_sectors(mfm);
+		memcpy(mfm->buffer, &mfm->sector_buffer[mfm->sector_pos++ << 9], 512);
 
 		mfm->pos = 0;
 		mfm->status = STAT_DRQ|STAT_READY|STAT_DSC;
@@ -617,14 +708,14 @@ do_callback(void *priv)
 			     mfm->drvsel, mfm->cylinder, mfm->head, mfm->sector);
 		do_seek(mfm);
 		if (get_sector(mfm, &addr)) {
+			write_flush(mfm);
 			mfm->error = ERR_ID_NOT_FOUND;
 			mfm->status = STAT_READY|STAT_DSC|STAT_ERR;
 			irq_raise(mfm);
 			break;
 		}
 
-		hdd_image_write(drive->hdd_num, addr, 1,(uint8_t *)mfm->buffer);
-		irq_raise(mfm);
+		write_sector(mfm, addr);
 		mfm->secount = (mfm->secount - 1) & 0xff;
 
 		mfm->status = STAT_READY|STAT_DSC;
@@ -634,8 +725,11 @@ do_callback(void *priv)
 			mfm->pos = 0;
 			next_sector(mfm);
 			ui_sb_update_icon(SB_HDD|HDD_BUS_MFM, 1);
-		} else
+		} else {
+			write_flush(mfm);
 			ui_sb_update_icon(SB_HDD|HDD_BUS_MFM, 0);
+		}
+		irq_raise(mfm);
 		break;
 
 	case CMD_VERIFY:
@@ -756,6 +850,8 @@ mfm_close(void *priv)
     mfm_t *mfm = (mfm_t *)priv;
     int d;
 
+    write_flush(mfm);
+
     for (d=0; d<2; d++) {
 	drive_t *drive = &mfm->drives[d];
 
@@ -272,6 +272,13 @@ typedef struct {
     drive_t	drives[MFM_NUM];	/* the attached drives */
     uint8_t	scratch[64];		/* ST-11 scratchpad RAM */
     uint8_t	buff[SECTOR_SIZE + 4];	/* sector buffer RAM (+ ECC bytes) */
+
+    uint8_t	sectors[256 * SECTOR_SIZE];	/* sectors read or written ahead */
+    int		sector_pos,		/* next sector of a read in there */
+		sector_cnt;		/* number of sectors read ahead */
+    off64_t	write_addr;		/* first sector of collected writes */
+    int		write_count;		/* number of collected writes */
+    uint8_t	write_hdd;		/* drive they are for */
 } hdc_t;
 
 
@@ -310,9 +317,22 @@ st506_xt_log(const char *fmt, ...)
 #endif
 
 
+/* Write out the sectors collected so far. */
+static void
+st506_write_flush(hdc_t *dev)
+{
+    if (dev->write_count) {
+	hdd_image_write(dev->write_hdd, dev->write_addr, dev->write_count, dev->sectors);
+	dev->write_count = 0;
+    }
+}
+
+
 static void
 st506_complete(hdc_t *dev)
 {
+    st506_write_flush(dev);
+
     dev->status = STAT_REQ | STAT_CD | STAT_IO | STAT_BSY;
     dev->state = STATE_COMPLETION_BYTE;
 
@@ -395,6 +415,81 @@ next_sector(hdc_t *dev, drive_t *drive)
 }
 
 
+/*
+ * Read the sectors left in a read command, up to 256 of them, into the
+ * sector buffer with one image transfer per run of consecutive sectors.
+ * The read stops at the first sector that is not found, the command
+ * reports that one when it gets there.
+ */
+static void
+st506_read_ahead(hdc_t *dev, drive_t *drive)
+{
+    int sector = dev->sector, head = dev->head, cylinder = dev->cylinder;
+    uint16_t drive_cyl = drive->cylinder;
+    int count = ((dev->count > 0) && (dev->count < 256)) ? dev->count : 256;
+    off64_t addr, start = 0;
+    int c, run = 0;
+
+    for (c = 0; c < count; c++) {
+	if (! get_sector(dev, drive, &addr))
+		break;
+
+	if (run && (addr != (start + run))) {
+		hdd_image_read(drive->hdd_num, start, run, &dev->sectors[(c - run) * SECTOR_SIZE]);
+		run = 0;
+	}
+	if (! run)
+		start = addr;
+	run++;
+
+	next_sector(dev, drive);
+    }
+
+    if (run)
+	hdd_image_read(drive->hdd_num, start, run, &dev->sectors[(c - run) * SECTOR_SIZE]);
+
+    dev->sector = sector;
+    dev->head = head;
+    dev->cylinder = cylinder;
+    drive->cylinder = drive_cyl;
+
+    dev->sector_pos = 0;
+    dev->sector_cnt = c;
+}
+
+
+/* Get the next sector of a read command into the sector buffer RAM. */
+static void
+st506_read_sector(hdc_t *dev, drive_t *drive)
+{
+    if (dev->sector_pos >= dev->sector_cnt)
+	st506_read_ahead(dev, drive);
+
+    memcpy(dev->buff, &dev->sectors[dev->sector_pos++ * SECTOR_SIZE], SECTOR_SIZE);
+}
+
+
+/*
+ * Written sectors are collected and go to the image in one transfer once
+ * a run of consecutive sectors ends, or the command is done.
+ */
+static void
+st506_write_sector(hdc_t *dev, drive_t *drive, off64_t addr)
+{
+    if (dev->write_count && ((addr != (dev->write_addr + dev->write_count)) ||
+	(dev->write_hdd != drive->hdd_num) || (dev->write_count == 256)))
+	st506_write_flush(dev);
+
+    if (! dev->write_count) {
+	dev->write_addr = addr;
+	dev->write_hdd = drive->hdd_num;
+    }
+
+    memcpy(&dev->sectors[dev->write_count * SECTOR_SIZE], dev->buff, SECTOR_SIZE);
+    dev->write_count++;
+}
+
+
 /* Extract the CHS info from a command block. */
 static int
 get_chs(hdc_t *dev, drive_t *drive)
@@ -647,8 +742,8 @@ st506_callback(void *priv)
 				ui_sb_update_icon(SB_HDD | HDD_BUS_MFM, 1);
 
 				/* Read data from the image. */
-				hdd_image_read(drive->hdd_num, addr, 1,
-					       (uint8_t *)dev->buff);
+				dev->sector_pos = dev->sector_cnt = 0;
+				st506_read_sector(dev, drive);
 
 				/* Set up the data transfer. */
 				dev->buff_pos = 0;
@@ -697,8 +792,7 @@ st506_callback(void *priv)
 				}
 
 				/* Read data from the image. */
-				hdd_image_read(drive->hdd_num, addr, 1,
-					       (uint8_t *)dev->buff);
+				st506_read_sector(dev, drive);
 
 				/* Set up the data transfer. */
 				dev->buff_pos = 0;
@@ -784,8 +878,7 @@ st506_callback(void *priv)
 				}
 
 				/* Write data to image. */
-				hdd_image_write(drive->hdd_num, addr, 1,
-						(uint8_t *)dev->buff);
+				st506_write_sector(dev, drive, addr);
 
 				if (--dev->count == 0) {
 					ui_sb_update_icon(SB_HDD | HDD_BUS_MFM, 0);
@@ -1183,10 +1276,12 @@ st506_write(uint16_t port, uint8_t val, void *priv)
 		break;
 
 	case 1:		/* controller reset */
+		st506_write_flush(dev);
 		dev->status = 0x00;
 		break;
 
 	case 2:		/* generate controller-select-pulse */
+		st506_write_flush(dev);
 		dev->status = STAT_BSY | STAT_CD | STAT_REQ;
 		dev->buff_pos = 0;
 		dev->buff_cnt = sizeof(dev->command);
@@ -1562,6 +1657,8 @@ st506_close(void *priv)
     drive_t *drive;
     int d;
 
+    st506_write_flush(dev);
+
     for (d = 0; d < MFM_NUM; d++) {
 	drive = &dev->drives[d];
 
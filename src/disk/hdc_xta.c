@@ -277,6 +277,13 @@ typedef struct {
 
     uint8_t	data[512];		/* data buffer */
     uint8_t	sector_buf[512];	/* sector buffer */
+
+    uint8_t	sectors[256 * 512];	/* sectors read or written ahead */
+    int		sector_pos,		/* next sector of a read in there */
+		sector_cnt;		/* number of sectors read ahead */
+    off64_t	write_addr;		/* first sector of collected writes */
+    int		write_count;		/* number of collected writes */
+    int8_t	write_hdd;		/* drive they are for */
 } hdc_t;
 
 
@@ -300,9 +307,22 @@ xta_log(const char *fmt, ...)
 #endif
 
 
+/* Write out the sectors collected so far. */
+static void
+write_flush(hdc_t *dev)
+{
+    if (dev->write_count) {
+	hdd_image_write(dev->write_hdd, dev->write_addr, dev->write_count, dev->sectors);
+	dev->write_count = 0;
+    }
+}
+
+
 static void
 set_intr(hdc_t *dev)
 {
+    write_flush(dev);
+
     dev->status = STAT_REQ|STAT_CD|STAT_IO|STAT_BSY;
     dev->state = STATE_COMPL;
 
@@ -358,6 +378,81 @@ next_sector(hdc_t *dev, drive_t *drive)
     }
 }
 
+/*
+ * Read the sectors left in a read command into the sector buffer, with
+ * one image transfer per run of consecutive sectors. The read stops at
+ * the first sector that is not found, the command reports that one when
+ * it gets there.
+ */
+static void
+read_ahead(hdc_t *dev, drive_t *drive)
+{
+    uint16_t track = dev->track, cur_cyl = drive->cur_cyl;
+    uint8_t head = dev->head, sector = dev->sector;
+    int count = (dev->count < 256) ? dev->count : 256;
+    off64_t addr, start = 0;
+    int c, run = 0;
+
+    for (c = 0; c < count; c++) {
+	if (get_sector(dev, drive, &addr))
+		break;
+
+	if (run && (addr != (start + run))) {
+		hdd_image_read(drive->hdd_num, start, run, &dev->sectors[(c - run) << 9]);
+		run = 0;
+	}
+	if (! run)
+		start = addr;
+	run++;
+
+	next_sector(dev, drive);
+    }
+
+    if (run)
+	hdd_image_read(drive->hdd_num, start, run, &dev->sectors[(c - run) << 9]);
+
+    dev->track = track;
+    dev->head = head;
+    dev->sector = sector;
+    drive->cur_cyl = cur_cyl;
+
+    dev->sector_pos = 0;
+    dev->sector_cnt = c;
+}
+
+
+/* Get the next sector of a read command into the sector buffer. */
+static void
+read_sector(hdc_t *dev, drive_t *drive)
+{
+    if (dev->sector_pos >= dev->sector_cnt)
+	read_ahead(dev, drive);
+
+    memcpy(dev->sector_buf, &dev->sectors[dev->sector_pos++ << 9], 512);
+}
+
+
+/*
+ * Written sectors are collected and go to the image in one transfer once
+ * a run of consecutive sectors ends, or the command is done.
+ */
+static void
+write_sector(hdc_t *dev, drive_t *drive, off64_t addr)
+{
+    if (dev->write_count && ((addr != (dev->write_addr + dev->write_count)) ||
+	(dev->write_hdd != drive->hdd_num) || (dev->write_count == 256)))
+	write_flush(dev);
+
+    if (! dev->write_count) {
+	dev->write_addr = addr;
+	dev->write_hdd = drive->hdd_num;
+    }
+
+    memcpy(&dev->sectors[dev->write_count << 9], dev->sector_buf, 512);
+    dev->write_count++;
+}
+
+
 static void
 xta_set_callback(hdc_t *dev, uint64_t callback)
 {
@@ -440,8 +535,7 @@ do_fmt:
 				if (get_sector(dev, drive, &addr)) break;
 
 				/* Write the block to the image. */
-				hdd_image_write(drive->hdd_num, addr, 1,
-						(uint8_t *)dev->sector_buf);
+				write_sector(dev, drive, addr);
 			}
 		}
 
@@ -452,6 +546,8 @@ do_fmt:
 		goto do_fmt;
     }
 
+    write_flush(dev);
+
     /* De-activate the status icon. */
     ui_sb_update_icon(SB_HDD|HDD_BUS_XTA, 0);
 }
@@ -541,6 +637,7 @@ hdc_callback(void *priv)
 				if (dev->count == 0)
 					dev->count = 256;
 				dev->buf_len = 512;
+				dev->sector_pos = dev->sector_cnt = 0;
 
 				dev->state = STATE_SEND;
 				/*FALLTHROUGH*/
@@ -559,8 +656,7 @@ do_send:
 				}
 
 				/* Read the block from the image. */
-				hdd_image_read(drive->hdd_num, addr, 1,
-					       (uint8_t *)dev->sector_buf);
+				read_sector(dev, drive);
 
 				/* Ready to transfer the data out. */
 				dev->state = STATE_SDATA;
@@ -708,8 +804,7 @@ do_recv:
 				}
 
 				/* Write the block to the image. */
-				hdd_image_write(drive->hdd_num, addr, 1,
-						(uint8_t *)dev->sector_buf);
+				write_sector(dev, drive, addr);
 
 				dev->buf_idx = 0;
 				if (--dev->count == 0) {
@@ -963,11 +1058,14 @@ hdc_write(uint16_t port, uint8_t val, void *priv)
 		break;
 
 	case 1:		/* RESET register */
+		write_flush(dev);
 		dev->sense = 0x00;
 		dev->state = STATE_IDLE;
 		break;
 
 	case 2:		/* "controller-select" */
+		write_flush(dev);
+
 		/* Reset the DCB buffer. */
 		dev->buf_idx = 0;
 		dev->buf_len = sizeof(dcb_t);
@@ -1091,6 +1189,7 @@ xta_close(void *priv)
 		     hdc_read,NULL,NULL, hdc_write,NULL,NULL, dev);
 
     /* Close all disks and their images. */
+    write_flush(dev);
     for (d = 0; d < XTA_NUM; d++) {
 	drive = &dev->drives[d];
 
@@ -0,0 +1,413 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Asynchronous hard disk image I/O.
+ *
+ *		Requests are handed to a small pool of worker threads, each
+ *		image always being served by the same worker so that its
+ *		requests complete in order. Every request returns a ticket;
+ *		the controller issues the request when the command starts
+ *		and waits for the ticket from its timer callback, once the
+ *		modelled seek and transfer time has passed. The guest thus
+ *		sees the same timing as before, and the host only stalls if
+ *		the image is slower than the emulated drive.
+ *
+ *		Writes are copied and completed in the background. After a
+ *		read that follows on from the previous one, the worker reads
+ *		ahead so that the next sequential read is served from memory.
+ *
+ *		A request that fails is recorded against its ticket, and
+ *		the wait that covers it returns an error for the controller
+ *		to report to the guest. For a write that is whichever wait
+ *		on the image comes next, like a deferred error from a drive's
+ *		write cache.
+ *
+ *		Images that have requests outstanding must not be accessed
+ *		through the synchronous hdd_image_*() calls until they have
+ *		been waited for with hdd_async_sync().
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/hdd.h>
+
+
+#define HDD_ASYNC_WORKERS	2
+#define HDD_ASYNC_QUEUE		64	/* must be a power of 2 */
+#define HDD_ASYNC_RA_SECTORS	256
+
+#define HDD_ASYNC_READ		0
+#define HDD_ASYNC_WRITE		1
+#define HDD_ASYNC_ZERO		2
+
+
+typedef struct {
+    uint8_t	id, op;
+    uint32_t	sector, count,
+		ticket;
+    uint8_t	*buffer;
+} hdd_async_req_t;
+
+typedef struct {
+    thread_t	*thread;
+    event_t	*wake, *done;
+    mutex_t	*mutex;
+
+    int		quit;
+    uint32_t	head, tail;
+    hdd_async_req_t queue[HDD_ASYNC_QUEUE];
+} hdd_async_worker_t;
+
+typedef struct {
+    /* Written by the emulation thread only. */
+    uint32_t	submitted;
+
+    /* Written by the worker, under its mutex. */
+    uint32_t	completed,
+		failed;		/* ticket of the last failed request */
+    int		error;		/* set until a wait has reported it */
+
+    /* Only touched by the worker. */
+    uint32_t	next_sector,
+		ra_sector, ra_count;
+    uint8_t	*ra_buf;
+} hdd_async_image_t;
+
+
+static hdd_async_worker_t	workers[HDD_ASYNC_WORKERS];
+static hdd_async_image_t	images[HDD_NUM];
+static int			started;
+
+
+#ifdef ENABLE_HDD_ASYNC_LOG
+int hdd_async_do_log = ENABLE_HDD_ASYNC_LOG;
+
+
+static void
+hdd_async_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (hdd_async_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define hdd_async_log(fmt, ...)
+#endif
+
+
+static hdd_async_worker_t *
+hdd_async_worker(uint8_t id)
+{
+    return &workers[id % HDD_ASYNC_WORKERS];
+}
+
+
+static int
+hdd_async_do_read(hdd_async_req_t *req)
+{
+    hdd_async_image_t *img = &images[req->id];
+    uint32_t last = hdd_image_get_last_sector(req->id);
+    uint32_t n;
+    int sequential, ret = 0;
+
+    sequential = (req->sector == img->next_sector);
+    img->next_sector = req->sector + req->count;
+
+    if (img->ra_count && (req->sector >= img->ra_sector) &&
+	((req->sector + req->count) <= (img->ra_sector + img->ra_count))) {
+	hdd_async_log("HDD async %i: %i sectors at %08X from read-ahead\n",
+		      req->id, req->count, req->sector);
+	memcpy(req->buffer, img->ra_buf + ((req->sector - img->ra_sector) << 9), req->count << 9);
+    } else
+	ret = hdd_image_try_read(req->id, req->sector, req->count, req->buffer);
+
+    if (ret || !sequential || (img->next_sector > last))
+	return ret;
+
+    /* Nothing to do if the read-ahead already covers what comes next. */
+    if (img->ra_count && (img->next_sector >= img->ra_sector) &&
+	((img->next_sector + HDD_ASYNC_RA_SECTORS) <= (img->ra_sector + img->ra_count)))
+	return 0;
+
+    n = last - img->next_sector + 1;
+    if (n > HDD_ASYNC_RA_SECTORS)
+	n = HDD_ASYNC_RA_SECTORS;
+
+    if (img->ra_buf == NULL)
+	img->ra_buf = (uint8_t *) malloc(HDD_ASYNC_RA_SECTORS << 9);
+
+    /* A failed read-ahead is not an error, the read itself will find out. */
+    img->ra_sector = img->next_sector;
+    img->ra_count = 0;
+    if (hdd_image_try_read(req->id, img->ra_sector, n, img->ra_buf) == 0)
+	img->ra_count = n;
+
+    return 0;
+}
+
+
+/* Carries out a request, returns -1 if the image could not be accessed. */
+static int
+hdd_async_do(hdd_async_req_t *req)
+{
+    hdd_async_image_t *img = &images[req->id];
+    int ret = 0;
+
+    switch (req->op) {
+	case HDD_ASYNC_READ:
+		ret = hdd_async_do_read(req);
+		break;
+
+	case HDD_ASYNC_WRITE:
+	case HDD_ASYNC_ZERO:
+		if (img->ra_count && (req->sector < (img->ra_sector + img->ra_count)) &&
+		    ((req->sector + req->count) > img->ra_sector))
+			img->ra_count = 0;
+
+		if (req->op == HDD_ASYNC_WRITE) {
+			ret = hdd_image_try_write(req->id, req->sector, req->count, req->buffer);
+			free(req->buffer);
+		} else
+			ret = hdd_image_try_zero(req->id, req->sector, req->count);
+		break;
+    }
+
+    return ret;
+}
+
+
+static void
+hdd_async_thread(void *param)
+{
+    hdd_async_worker_t *w = (hdd_async_worker_t *) param;
+    hdd_async_req_t req;
+    int ret;
+
+    while (1) {
+	thread_wait_mutex(w->mutex);
+	if (w->head == w->tail) {
+		if (w->quit) {
+			thread_release_mutex(w->mutex);
+			break;
+		}
+		thread_release_mutex(w->mutex);
+		thread_wait_event(w->wake, -1);
+		continue;
+	}
+	req = w->queue[w->tail & (HDD_ASYNC_QUEUE - 1)];
+	thread_release_mutex(w->mutex);
+
+	ret = hdd_async_do(&req);
+	if (ret)
+		pclog("HDD async %i: %s of %i sectors at %08X failed\n", req.id,
+		      (req.op == HDD_ASYNC_READ) ? "read" : "write", req.count, req.sector);
+
+	thread_wait_mutex(w->mutex);
+	w->tail++;
+	images[req.id].completed = req.ticket;
+	if (ret) {
+		images[req.id].failed = req.ticket;
+		images[req.id].error = 1;
+	}
+	thread_release_mutex(w->mutex);
+
+	thread_set_event(w->done);
+    }
+}
+
+
+static uint32_t
+hdd_async_submit(uint8_t id, int op, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    hdd_async_worker_t *w = hdd_async_worker(id);
+    hdd_async_req_t *req;
+
+    if (!count)
+	return images[id].submitted;
+
+    thread_wait_mutex(w->mutex);
+    while ((w->head - w->tail) >= HDD_ASYNC_QUEUE) {
+	thread_release_mutex(w->mutex);
+	thread_wait_event(w->done, -1);
+	thread_wait_mutex(w->mutex);
+    }
+
+    req = &w->queue[w->head & (HDD_ASYNC_QUEUE - 1)];
+    req->id = id;
+    req->op = op;
+    req->sector = sector;
+    req->count = count;
+    req->buffer = buffer;
+    req->ticket = ++images[id].submitted;
+    w->head++;
+    thread_release_mutex(w->mutex);
+
+    thread_set_event(w->wake);
+
+    return images[id].submitted;
+}
+
+
+uint32_t
+hdd_async_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    return hdd_async_submit(id, HDD_ASYNC_READ, sector, count, buffer);
+}
+
+
+uint32_t
+hdd_async_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    uint8_t *copy;
+
+    if (!count)
+	return images[id].submitted;
+
+    copy = (uint8_t *) malloc(count << 9);
+    memcpy(copy, buffer, count << 9);
+
+    return hdd_async_submit(id, HDD_ASYNC_WRITE, sector, count, copy);
+}
+
+
+uint32_t
+hdd_async_zero(uint8_t id, uint32_t sector, uint32_t count)
+{
+    return hdd_async_submit(id, HDD_ASYNC_ZERO, sector, count, NULL);
+}
+
+
+/* Waits until the request with the given ticket, and everything issued
+   for the same image before it, has completed. Returns -1 if any of those
+   failed and no earlier wait has reported that yet. */
+int
+hdd_async_wait(uint8_t id, uint32_t ticket)
+{
+    hdd_async_worker_t *w = hdd_async_worker(id);
+    hdd_async_image_t *img = &images[id];
+    uint32_t completed;
+    int ret = 0;
+
+    if (!started)
+	return 0;
+
+    while (1) {
+	thread_wait_mutex(w->mutex);
+	completed = img->completed;
+	if ((int32_t) (completed - ticket) >= 0) {
+		if (img->error && ((int32_t) (ticket - img->failed) >= 0)) {
+			img->error = 0;
+			ret = -1;
+		}
+		thread_release_mutex(w->mutex);
+		break;
+	}
+	thread_release_mutex(w->mutex);
+
+	hdd_async_log("HDD async %i: waiting for ticket %i (at %i)\n",
+		      id, ticket, completed);
+	thread_wait_event(w->done, -1);
+    }
+
+    return ret;
+}
+
+
+int
+hdd_async_sync(uint8_t id)
+{
+    return hdd_async_wait(id, images[id].submitted);
+}
+
+
+/* The ticket of the last request issued for the image. */
+uint32_t
+hdd_async_ticket(uint8_t id)
+{
+    return images[id].submitted;
+}
+
+
+/* Waits for the image and drops its read-ahead, for when it is closed. */
+void
+hdd_async_reset(uint8_t id)
+{
+    hdd_async_sync(id);
+
+    images[id].next_sector = 0xffffffff;
+    images[id].ra_count = 0;
+    images[id].error = 0;
+}
+
+
+void
+hdd_async_init(void)
+{
+    int c;
+
+    if (!started) {
+	for (c = 0; c < HDD_ASYNC_WORKERS; c++) {
+		workers[c].mutex = thread_create_mutex();
+		workers[c].wake = thread_create_event();
+		workers[c].done = thread_create_event();
+		workers[c].thread = thread_create(hdd_async_thread, &workers[c]);
+	}
+	started = 1;
+    }
+
+    for (c = 0; c < HDD_NUM; c++)
+	hdd_async_reset(c);
+}
+
+
+/* Lets the workers finish what is queued, then stops them. */
+void
+hdd_async_close(void)
+{
+    hdd_async_worker_t *w;
+    int c;
+
+    if (!started)
+	return;
+
+    for (c = 0; c < HDD_ASYNC_WORKERS; c++) {
+	w = &workers[c];
+
+	thread_wait_mutex(w->mutex);
+	w->quit = 1;
+	thread_release_mutex(w->mutex);
+	thread_set_event(w->wake);
+
+	thread_wait(w->thread, -1);
+	w->thread = NULL;
+
+	thread_close_mutex(w->mutex);
+	thread_destroy_event(w->done);
+	thread_destroy_event(w->wake);
+	w->quit = 0;
+	w->head = w->tail = 0;
+    }
+
+    for (c = 0; c < HDD_NUM; c++) {
+	free(images[c].ra_buf);
+	images[c].ra_buf = NULL;
+	images[c].ra_count = 0;
+    }
+
+    started = 0;
+}
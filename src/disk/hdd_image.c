@@ -40,6 +40,12 @@
 #define HDD_IMAGE_HDX 2
 #define HDD_IMAGE_VHD 3
 
+#define HDD_IO_NONE 0
+#define HDD_IO_READ 1
+#define HDD_IO_WRITE 2
+
+#define HDD_ZERO_SECTORS 128
+
 typedef struct
 {
 	FILE *file; /* Used for HDD_IMAGE_RAW, HDD_IMAGE_HDI, and HDD_IMAGE_HDX. */ 
@@ -48,12 +54,15 @@ typedef struct
 	uint32_t pos, last_sector;
 	uint8_t type; /* HDD_IMAGE_RAW, HDD_IMAGE_HDI, HDD_IMAGE_HDX, or HDD_IMAGE_VHD */
 	uint8_t loaded;
+	uint8_t last_io; /* HDD_IO_NONE if the file position is not known. */
+	uint64_t file_pos;
 } hdd_image_t;
 
 
 hdd_image_t hdd_images[HDD_NUM];
 
 static char empty_sector[512];
+static uint8_t empty_sectors[HDD_ZERO_SECTORS << 9];
 static char *empty_sector_1mb;
 
 #ifdef ENABLE_HDD_IMAGE_LOG
@@ -251,6 +260,8 @@ hdd_image_init(void)
 {
 	int i;
 
+	hdd_async_init();
+
 	for (i = 0; i < HDD_NUM; i++)
 		memset(&hdd_images[i], 0, sizeof(hdd_image_t));
 }
@@ -272,6 +283,7 @@ hdd_image_load(int id)
 	int vhd_error = 0; 
 
 	memset(empty_sector, 0, sizeof(empty_sector));
+	hdd_images[id].last_io = HDD_IO_NONE;
 
 	hdd_images[id].base = 0;
 
@@ -500,36 +512,83 @@ hdd_image_seek(uint8_t id, uint32_t sector)
 	off64_t addr = sector;
 	addr = (uint64_t)sector << 9LL;
 
+	hdd_async_sync(id);
+
 	hdd_images[id].pos = sector;
 	if (hdd_images[id].type != HDD_IMAGE_VHD) {
 		if (fseeko64(hdd_images[id].file, addr + hdd_images[id].base, SEEK_SET) == -1)
 			fatal("hdd_image_seek(): Error seeking\n");
+		hdd_images[id].last_io = HDD_IO_NONE;
 	}
 }
 
 
-void
-hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+/* Transfers a whole run of sectors of a raw, HDI or HDX image with a single
+   stdio call. The seek is skipped when the file is already positioned at the
+   requested sector from a transfer in the same direction, so controllers that
+   go through the disk one sector at a time keep the stdio read-ahead. Returns
+   -1 if the seek or the transfer failed; running into the end of the image
+   is not an error. */
+static int
+hdd_image_raw_io(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer, int io)
+{
+	hdd_image_t *img = &hdd_images[id];
+	uint64_t addr = ((uint64_t)(sector) << 9LL) + img->base;
+	size_t done;
+
+	if (!count)
+		return 0;
+
+	if ((img->last_io != io) || (img->file_pos != addr)) {
+		img->last_io = HDD_IO_NONE;
+		if (fseeko64(img->file, addr, SEEK_SET) == -1)
+			return -1;
+	}
+
+	if (io == HDD_IO_WRITE)
+		done = fwrite(buffer, 512, count, img->file);
+	else
+		done = fread(buffer, 512, count, img->file);
+
+	img->pos = sector + (done ? (done - 1) : 0);
+
+	if (done < count) {
+		/* Position is no longer known. */
+		img->last_io = HDD_IO_NONE;
+		if (ferror(img->file)) {
+			clearerr(img->file);
+			return -1;
+		}
+		clearerr(img->file);
+	} else {
+		img->last_io = io;
+		img->file_pos = addr + ((uint64_t) done << 9LL);
+	}
+
+	return 0;
+}
+
+
+/* Reads sectors, returns -1 instead of giving up if the image could not be
+   read. For callers that report the error to the guest. */
+int
+hdd_image_try_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 {
 	if (hdd_images[id].type == HDD_IMAGE_VHD) {
 		int non_transferred_sectors = mvhd_read_sectors(hdd_images[id].vhd, sector, count, buffer);
 		hdd_images[id].pos = sector + count - non_transferred_sectors - 1;
-	} else {
-		int i;
+		return 0;
+	}
 
-		if (fseeko64(hdd_images[id].file, ((uint64_t)(sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1) {
-			fatal("Hard disk image %i: Read error during seek\n", id);
-			return;
-		}
+	return hdd_image_raw_io(id, sector, count, buffer, HDD_IO_READ);
+}
 
-		for (i = 0; i < count; i++) {
-			if (feof(hdd_images[id].file))
-				break;
 
-			hdd_images[id].pos = sector + i;
-			fread(buffer + (i << 9), 1, 512, hdd_images[id].file);
-		}
-	}
+void
+hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+	if (hdd_image_try_read(id, sector, count, buffer) == -1)
+		fatal("Hard disk image %i: Read error\n", id);
 }
 
 
@@ -539,6 +598,7 @@ hdd_sectors(uint8_t id)
 	if (hdd_images[id].type == HDD_IMAGE_VHD) {
 		return (uint32_t) (hdd_images[id].vhd->footer.curr_sz >> 9);
 	} else {
+		hdd_images[id].last_io = HDD_IO_NONE;
 		fseeko64(hdd_images[id].file, 0, SEEK_END);
 		return (uint32_t)((ftello64(hdd_images[id].file) - hdd_images[id].base) >> 9);
 	}
@@ -562,28 +622,24 @@ hdd_image_read_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 }
 
 
-void
-hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+int
+hdd_image_try_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 {
 	if (hdd_images[id].type == HDD_IMAGE_VHD) {
 		int non_transferred_sectors = mvhd_write_sectors(hdd_images[id].vhd, sector, count, buffer);
 		hdd_images[id].pos = sector + count - non_transferred_sectors - 1;
-	} else {
-		int i;
+		return 0;
+	}
 
-		if (fseeko64(hdd_images[id].file, ((uint64_t)(sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1) {
-			fatal("Hard disk image %i: Write error during seek\n", id);
-			return;
-		}
+	return hdd_image_raw_io(id, sector, count, buffer, HDD_IO_WRITE);
+}
 
-		for (i = 0; i < count; i++) {
-			if (feof(hdd_images[id].file))
-				break;
 
-			hdd_images[id].pos = sector + i;
-			fwrite(buffer + (i << 9), 512, 1, hdd_images[id].file);
-		}
-	}
+void
+hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+	if (hdd_image_try_write(id, sector, count, buffer) == -1)
+		fatal("Hard disk image %i: Write error\n", id);
 }
 
 
@@ -604,30 +660,35 @@ hdd_image_write_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 }
 
 
-void
-hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count)
+int
+hdd_image_try_zero(uint8_t id, uint32_t sector, uint32_t count)
 {
+	uint32_t i, n;
+
 	if (hdd_images[id].type == HDD_IMAGE_VHD) {
 		int non_transferred_sectors = mvhd_format_sectors(hdd_images[id].vhd, sector, count);
 		hdd_images[id].pos = sector + count - non_transferred_sectors - 1;
-	} else {
-		uint32_t i = 0;
+		return 0;
+	}
 
-		memset(empty_sector, 0, 512);
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > HDD_ZERO_SECTORS)
+			n = HDD_ZERO_SECTORS;
 
-		if (fseeko64(hdd_images[id].file, ((uint64_t)(sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1) {
-			fatal("Hard disk image %i: Zero error during seek\n", id);
-			return;
-		}
+		if (hdd_image_raw_io(id, sector + i, n, empty_sectors, HDD_IO_WRITE) == -1)
+			return -1;
+	}
+
+	return 0;
+}
 
-		for (i = 0; i < count; i++) {
-			if (feof(hdd_images[id].file))
-				break;
 
-			hdd_images[id].pos = sector + i;
-			fwrite(empty_sector, 512, 1, hdd_images[id].file);
-		}
-	}
+void
+hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count)
+{
+	if (hdd_image_try_zero(id, sector, count) == -1)
+		fatal("Hard disk image %i: Zero error\n", id);
 }
 
 
@@ -675,6 +736,8 @@ hdd_image_unload(uint8_t id, int fn_preserve)
 	if (wcslen(hdd[id].fn) == 0)
 		return;
 
+	hdd_async_reset(id);
+
 	if (hdd_images[id].loaded) {
 		if (hdd_images[id].file != NULL) {
 			fclose(hdd_images[id].file);
@@ -687,6 +750,7 @@ hdd_image_unload(uint8_t id, int fn_preserve)
 	}
 
 	hdd_images[id].last_sector = -1;
+	hdd_images[id].last_io = HDD_IO_NONE;
 
 	memset(hdd[id].prev_fn, 0, sizeof(hdd[id].prev_fn));
 	if (fn_preserve)
@@ -703,6 +767,8 @@ hdd_image_close(uint8_t id)
 	if (!hdd_images[id].loaded)
 		return;
 
+	hdd_async_reset(id);
+
 	if (hdd_images[id].file != NULL) {
 		fclose(hdd_images[id].file);
 		hdd_images[id].file = NULL;
@@ -1048,6 +1048,7 @@ mo_format(mo_t *dev)
     fseek(dev->drv->f, 0, SEEK_END);
     size = (uint32_t) ftello64(dev->drv->f);
 
+#ifdef _WIN32
     HANDLE fh;
     LARGE_INTEGER liSize;
 
@@ -1084,6 +1085,23 @@ mo_format(mo_t *dev)
 	mo_log("MO %i: Failed to truncate image file to %llu\n", dev->id, size);
 	return;
     }
+#else
+    fd = fileno(dev->drv->f);
+
+    ret = ftruncate(fd, 0);
+
+    if (ret) {
+	mo_log("MO %i: Failed to truncate image file to 0\n", dev->id);
+	return;
+    }
+
+    ret = ftruncate(fd, size);
+
+    if (ret) {
+	mo_log("MO %i: Failed to truncate image file to %llu\n", dev->id, size);
+	return;
+    }
+#endif
 }
 
 static int
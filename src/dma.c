@@ -31,6 +31,8 @@
 #include <86box/io.h>
 #include <86box/pic.h>
 #include <86box/dma.h>
+#include <86box/timer.h>
+#include <86box/snapshot.h>
 
 
 dma_t		dma[8];
@@ -1620,17 +1622,15 @@ dma_mode(int channel)
 void
 dma_bm_read(uint32_t PhysAddress, uint8_t *DataRead, uint32_t TotalSize, int TransferSize)
 {
-    uint32_t i = 0, n, n2;
+    uint32_t n, n2;
     uint8_t bytes[4] = { 0, 0, 0, 0 };
 
     n = TotalSize & ~(TransferSize - 1);
     n2 = TotalSize - n;
 
     /* Do the divisible block, if there is one. */
-    if (n) {
-	for (i = 0; i < n; i += TransferSize)
-		mem_read_phys((void *) &(DataRead[i]), PhysAddress + i, TransferSize);
-    }
+    if (n)
+	mem_read_phys_span((void *) DataRead, PhysAddress, n, TransferSize);
 
     /* Do the non-divisible block, if there is one. */
     if (n2) {
@@ -1643,17 +1643,15 @@ dma_bm_read(uint32_t PhysAddress, uint8_t *DataRead, uint32_t TotalSize, int Tra
 void
 dma_bm_write(uint32_t PhysAddress, const uint8_t *DataWrite, uint32_t TotalSize, int TransferSize)
 {
-    uint32_t i = 0, n, n2;
+    uint32_t n, n2;
     uint8_t bytes[4] = { 0, 0, 0, 0 };
 
     n = TotalSize & ~(TransferSize - 1);
     n2 = TotalSize - n;
 
     /* Do the divisible block, if there is one. */
-    if (n) {
-	for (i = 0; i < n; i += TransferSize)
-		mem_write_phys((void *) &(DataWrite[i]), PhysAddress + i, TransferSize);
-    }
+    if (n)
+	mem_write_phys_span((const void *) DataWrite, PhysAddress, n, TransferSize);
 
     /* Do the non-divisible block, if there is one. */
     if (n2) {
@@ -1662,3 +1660,40 @@ dma_bm_write(uint32_t PhysAddress, const uint8_t *DataWrite, uint32_t TotalSize,
 	mem_write_phys((void *) bytes, PhysAddress + n, TransferSize);
     }
 }
+
+
+void
+dma_save_state(snapshot_t *s)
+{
+    snapshot_put(s, dma);
+    snapshot_put(s, dma_e);
+    snapshot_put(s, dmaregs);
+    snapshot_put(s, dma_wp);
+    snapshot_put(s, dma_m);
+    snapshot_put(s, dma_stat);
+    snapshot_put(s, dma_stat_rq);
+    snapshot_put(s, dma_stat_rq_pc);
+    snapshot_put(s, dma_command);
+    snapshot_put(s, dma_req_is_soft);
+    snapshot_put(s, dma_ps2);
+}
+
+
+int
+dma_load_state(snapshot_t *s)
+{
+    snapshot_get(s, dma);
+    snapshot_get(s, dma_e);
+    snapshot_get(s, dmaregs);
+    snapshot_get(s, dma_wp);
+    snapshot_get(s, dma_m);
+    snapshot_get(s, dma_stat);
+    snapshot_get(s, dma_stat_rq);
+    snapshot_get(s, dma_stat_rq_pc);
+    snapshot_get(s, dma_command);
+    snapshot_get(s, dma_req_is_soft);
+    snapshot_get(s, dma_ps2);
+
+    return 0;
+}
+
@@ -17,6 +17,7 @@
  *		Copyright 2008-2020 Sarah Walker.
  *		Copyright 2016-2020 Miran Grca.
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 #include <86box/fdd.h>
 #include <86box/fdc.h>
 #include <86box/fdc_ext.h>
+#include <86box/snapshot.h>
 
 
 extern uint64_t motoron[FDD_NUM];
@@ -2269,6 +2271,35 @@ fdc_reset(void *priv)
 }
 
 
+/* The timers come last, everything before them is plain state. */
+static void
+fdc_save_state(void *priv, snapshot_t *s)
+{
+    fdc_t *fdc = (fdc_t *) priv;
+
+    snapshot_write(s, fdc, offsetof(fdc_t, timer));
+    snapshot_write_timer(s, &fdc->timer);
+    snapshot_write_timer(s, &fdc->watchdog_timer);
+    snapshot_put(s, current_drive);
+
+    fdd_save_state(s);
+}
+
+
+static int
+fdc_load_state(void *priv, snapshot_t *s)
+{
+    fdc_t *fdc = (fdc_t *) priv;
+
+    snapshot_read(s, fdc, offsetof(fdc_t, timer));
+    snapshot_read_timer(s, &fdc->timer);
+    snapshot_read_timer(s, &fdc->watchdog_timer);
+    snapshot_get(s, current_drive);
+
+    return fdd_load_state(s);
+}
+
+
 static void
 fdc_close(void *priv)
 {
@@ -2329,7 +2360,8 @@ const device_t fdc_xt_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_xt_t1x00_device = {
@@ -2339,7 +2371,8 @@ const device_t fdc_xt_t1x00_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_xt_amstrad_device = {
@@ -2349,7 +2382,8 @@ const device_t fdc_xt_amstrad_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 
@@ -2360,7 +2394,8 @@ const device_t fdc_pcjr_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_device = {
@@ -2370,7 +2405,8 @@ const device_t fdc_at_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_actlow_device = {
@@ -2380,7 +2416,8 @@ const device_t fdc_at_actlow_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_ps1_device = {
@@ -2390,7 +2427,8 @@ const device_t fdc_at_ps1_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_smc_device = {
@@ -2400,7 +2438,8 @@ const device_t fdc_at_smc_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_winbond_device = {
@@ -2410,7 +2449,8 @@ const device_t fdc_at_winbond_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_at_nsc_device = {
@@ -2420,7 +2460,8 @@ const device_t fdc_at_nsc_device = {
     fdc_init,
     fdc_close,
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
 
 const device_t fdc_dp8473_device = {
@@ -2430,5 +2471,6 @@ const device_t fdc_dp8473_device = {
     fdc_init,
     fdc_close, 
     fdc_reset,
-    { NULL }, NULL, NULL
+    { NULL }, NULL, NULL, NULL,
+    fdc_save_state, fdc_load_state
 };
@@ -37,6 +37,7 @@
 #include <86box/fdd_mfm.h>
 #include <86box/fdd_td0.h>
 #include <86box/fdc.h>
+#include <86box/snapshot.h>
 
 
 /* Flags:
@@ -634,6 +635,41 @@ fdd_reset(void)
 }
 
 
+/* Saved by the FDC, along with its own state. Only the head positions and
+   motors are kept, the image handlers' bit-level state is not, so an
+   operation running when the snapshot was taken does not complete. */
+void
+fdd_save_state(snapshot_t *s)
+{
+    int i;
+
+    for (i = 0; i < FDD_NUM; i++) {
+	snapshot_put(s, fdd[i].track);
+	snapshot_put(s, fdd[i].densel);
+	snapshot_put(s, fdd[i].head);
+	snapshot_put(s, motoron[i]);
+	snapshot_write_timer(s, &fdd_poll_time[i]);
+    }
+}
+
+
+int
+fdd_load_state(snapshot_t *s)
+{
+    int i;
+
+    for (i = 0; i < FDD_NUM; i++) {
+	snapshot_get(s, fdd[i].track);
+	snapshot_get(s, fdd[i].densel);
+	snapshot_get(s, fdd[i].head);
+	snapshot_get(s, motoron[i]);
+	snapshot_read_timer(s, &fdd_poll_time[i]);
+    }
+
+    return 0;
+}
+
+
 void
 fdd_readsector(int drive, int sector, int track, int side, int density, int sector_size)
 {
@@ -68,6 +68,9 @@ extern int	video_fps;			/* (O) render speed in fps */
 #endif
 extern int	settings_only;			/* (O) show only the settings dialog */
 extern int	confirm_exit_cmdl;		/* (O) do not ask for confirmation on quit if set to 0 */
+extern int	benchmark_secs;			/* (O) benchmark for N emulated seconds */
+extern int	selftest;			/* (O) run the self tests and exit */
+extern int	turbo_mode;			/* (O) run as fast as the host allows */
 #ifdef _WIN32
 extern uint64_t	unique_id;
 extern uint64_t	source_hwnd;
@@ -106,6 +109,9 @@ extern int	cpu,				/* (C) cpu type */
 		cpu_use_dynarec,		/* (C) cpu uses/needs Dyna */
 		fpu_type;			/* (C) fpu type */
 extern int	time_sync;			/* (C) enable time sync */
+extern int	cpu_hlt_fastfwd;		/* (C) skip idle time in HLT */
+extern int	cpu_dynarec_cache;		/* (C) dynarec code cache limit, MB */
+extern int	cpu_dynarec_persist;		/* (C) keep dynarec translations on disk */
 extern int	network_type;			/* (C) net provider type */
 extern int	network_card;			/* (C) net interface num */
 extern char	network_host[522];		/* (C) host network intf */
@@ -166,7 +172,10 @@ extern void	pc_speed_changed(void);
 extern void	pc_send_cad(void);
 extern void	pc_send_cae(void);
 extern void	pc_send_cab(void);
+extern void	pc_snapshot_save(void);
 extern void	pc_thread(void *param);
+extern void	pc_benchmark(void);
+extern int	pc_selftest(void);
 extern void	pc_start(void);
 extern void	pc_onesec(void);
 
@@ -0,0 +1,65 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Definitions for the lossless display and sound capture.
+ *
+ *		A capture file is a header followed by a stream of chunks,
+ *		all values little endian. The header is the magic, then the
+ *		version, sample rate and channel count as 32-bit values.
+ *		Every chunk starts with a 32-bit type and a 32-bit payload
+ *		length:
+ *
+ *		CAPTURE_AUDIO:	signed 16-bit interleaved stereo samples,
+ *				as mixed by the sound core.
+ *		CAPTURE_FRAME:	the number of audio sample frames written
+ *				before it (for syncing), 64 bits; width,
+ *				height and encoding, 32 bits each; then
+ *				the picture as 0x00RRGGBB pixels.
+ *
+ *		Encoding 0 is a key frame of width * height pixels. Encoding
+ *		1 is a delta against the previous frame: a sequence of 32-bit
+ *		run headers, each either a count of pixels to keep, or (with
+ *		bit 31 set) a count of pixels that follow literally. Pixels
+ *		after the last run are unchanged.
+ */
+#ifndef EMU_CAPTURE_H
+# define EMU_CAPTURE_H
+
+
+#define CAPTURE_MAGIC		"86BoxCAP"
+#define CAPTURE_VERSION		1
+
+#define CAPTURE_AUDIO		0x53445541	/* "AUDS" */
+#define CAPTURE_FRAME		0x46444956	/* "VIDF" */
+
+#define CAPTURE_KEY		0
+#define CAPTURE_DELTA		1
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile int	capture_on;
+extern uint64_t		capture_frames,
+			capture_frames_dropped,
+			capture_audio_dropped;
+
+extern int	capture_start(wchar_t *fn);
+extern void	capture_stop(void);
+
+/* Called by the video and sound cores while capture_on is set. */
+extern void	capture_video(int x, int y, int y1, int y2, int w, int h);
+extern void	capture_audio(int32_t *buffer, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	/*EMU_CAPTURE_H*/
@@ -91,6 +91,8 @@ typedef struct {
     const device_config_selection_t selection[16];
 } device_config_t;
 
+struct _snapshot_;
+
 typedef struct _device_ {
     const char	*name;
     uint32_t	flags;		/* system flags */
@@ -108,6 +110,10 @@ typedef struct _device_ {
     void	(*force_redraw)(void *priv);
 
     const device_config_t *config;
+
+    /* Optional machine snapshot support, see snapshot.h. */
+    void	(*save_state)(void *priv, struct _snapshot_ *s);
+    int		(*load_state)(void *priv, struct _snapshot_ *s);
 } device_t;
 
 typedef struct {
@@ -45,7 +45,8 @@ typedef struct ide_s {
 	     drive, cylprecomp,
 	     cfg_spt, cfg_hpc,
 	     lba_addr, tracks,
-	     spt, hpc;
+	     spt, hpc,
+	     read_ticket;
 
     uint16_t *buffer;
     uint8_t *sector_buffer;
@@ -115,10 +115,13 @@ extern void	hdd_image_init(void);
 extern int	hdd_image_load(int id);
 extern void	hdd_image_seek(uint8_t id, uint32_t sector);
 extern void	hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern int	hdd_image_try_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern int	hdd_image_read_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern void	hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern int	hdd_image_try_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern int	hdd_image_write_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern void	hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count);
+extern int	hdd_image_try_zero(uint8_t id, uint32_t sector, uint32_t count);
 extern int	hdd_image_zero_ex(uint8_t id, uint32_t sector, uint32_t count);
 extern uint32_t	hdd_image_get_last_sector(uint8_t id);
 extern uint32_t	hdd_image_get_pos(uint8_t id);
@@ -127,6 +130,16 @@ extern void	hdd_image_unload(uint8_t id, int fn_preserve);
 extern void	hdd_image_close(uint8_t id);
 extern void	hdd_image_calc_chs(uint32_t *c, uint32_t *h, uint32_t *s, uint32_t size);
 
+extern void	hdd_async_init(void);
+extern void	hdd_async_close(void);
+extern uint32_t	hdd_async_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern uint32_t	hdd_async_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern uint32_t	hdd_async_zero(uint8_t id, uint32_t sector, uint32_t count);
+extern int	hdd_async_wait(uint8_t id, uint32_t ticket);
+extern int	hdd_async_sync(uint8_t id);
+extern uint32_t	hdd_async_ticket(uint8_t id);
+extern void	hdd_async_reset(uint8_t id);
+
 extern int	image_is_hdi(const wchar_t *s);
 extern int	image_is_hdx(const wchar_t *s, int check_signature);
 extern int	image_is_vhd(const wchar_t *s, int check_signature);
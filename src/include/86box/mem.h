@@ -67,6 +67,12 @@
 
 #define MEM_STATE_SMM_SHIFT	16
 
+/* Page permissions of the last translation, as kept in mmu_perm and
+   the readlookupp/writelookupp tables. */
+#define MMU_PERM_WRITE		0x0002
+#define MMU_PERM_USER		0x0004
+#define MMU_PERM_GLOBAL		0x0100
+
 /* #define's for memory granularity, currently 16k, but may
    change in the future - 4k works, less does not because of
    internal 4k pages. */
@@ -226,6 +232,10 @@ extern int		memspeed[11];
 extern int		mmu_perm,
 			use_phys_exec;
 
+extern uint64_t		mmu_tlb_hits,
+			mmu_tlb_misses,
+			mmu_tlb_flushes;
+
 extern int		mem_a20_state,
 			mem_a20_alt,
 			mem_a20_key;
@@ -263,6 +273,7 @@ extern void	writememql(uint32_t addr, uint64_t val);
 #endif
 
 extern uint8_t	*getpccache(uint32_t a);
+extern uint8_t	*mem_get_exec_ptr(uint32_t addr);
 extern uint64_t	mmutranslatereal(uint32_t addr, int rw);
 extern uint32_t	mmutranslatereal32(uint32_t addr, int rw);
 extern void	addreadlookup(uint32_t virt, uint32_t phys);
@@ -312,6 +323,8 @@ extern void	mem_writeb_phys(uint32_t addr, uint8_t val);
 extern void	mem_writew_phys(uint32_t addr, uint16_t val);
 extern void	mem_writel_phys(uint32_t addr, uint32_t val);
 extern void	mem_write_phys(void *src, uint32_t addr, int tranfer_size);
+extern void	mem_read_phys_span(void *dest, uint32_t addr, uint32_t len, int transfer_size);
+extern void	mem_write_phys_span(const void *src, uint32_t addr, uint32_t len, int transfer_size);
 
 extern uint8_t	mem_read_ram(uint32_t addr, void *priv);
 extern uint16_t	mem_read_ramw(uint32_t addr, void *priv);
@@ -347,7 +360,10 @@ extern void	mem_reset_page_blocks(void);
 extern void     flushmmucache(void);
 extern void     flushmmucache_cr3(void);
 extern void	flushmmucache_nopc(void);
+extern void	flushmmucache_noglobal(void);
+extern void	flushmmucache_user(void);
 extern void     mmu_invalidate(uint32_t addr);
+extern void	mmu_tlb_flush(void);
 
 extern void	mem_a20_init(void);
 extern void	mem_a20_recalc(void);
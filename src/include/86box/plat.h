@@ -30,6 +30,8 @@
 #ifdef _WIN32
 # define wcscasecmp	_wcsicmp
 # define strcasecmp	_stricmp
+#else
+# define wcsnicmp	wcsncasecmp
 #endif
 
 #if defined(UNIX) && defined(FREEBSD)
@@ -97,6 +99,7 @@ extern int	plat_dir_create(wchar_t *path);
 extern uint64_t	plat_timer_read(void);
 extern uint32_t	plat_get_ticks(void);
 extern void	plat_delay_ms(uint32_t count);
+extern int	plat_get_cpu_count(void);
 extern void	plat_pause(int p);
 extern void	plat_mouse_capture(int on);
 extern int	plat_vidapi(char *name);
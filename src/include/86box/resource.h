@@ -285,6 +285,8 @@
 #define IDM_ACTION_EXIT		40014
 #define IDM_ACTION_CTRL_ALT_ESC 40015
 #define IDM_ACTION_PAUSE	40016
+#define IDM_ACTION_SNAPSHOT	40017
+#define IDM_ACTION_TURBO	40018
 #define IDM_CONFIG		40020
 #define IDM_CONFIG_LOAD		40021
 #define IDM_CONFIG_SAVE		40022
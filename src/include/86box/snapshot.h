@@ -0,0 +1,79 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Definitions for the machine state snapshot module.
+ *
+ *		A snapshot file is a small header identifying the machine
+ *		configuration it was taken from, followed by a list of named,
+ *		length-prefixed sections. Each section is produced by one
+ *		module or device, and is handed back to the same module or
+ *		device on restore. Sections nobody claims are skipped.
+ *
+ *		Snapshots are only restored onto a machine freshly created
+ *		from the same configuration, so mappings, timers and devices
+ *		exist already and only their state needs to be reloaded.
+ *		Machines with a device that has no snapshot support can be
+ *		neither saved nor restored, as part of their state would be
+ *		silently lost. The same goes for devices that support it in
+ *		some configurations only, their handlers refuse the others.
+ */
+#ifndef EMU_SNAPSHOT_H
+# define EMU_SNAPSHOT_H
+
+
+#define SNAPSHOT_MAGIC		"86BoxSNP"
+#define SNAPSHOT_VERSION	1
+
+#define SNAPSHOT_NAME_LEN	64
+
+
+typedef struct _snapshot_ snapshot_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int	snapshot_save(wchar_t *fn);
+extern int	snapshot_load(wchar_t *fn);
+
+/* Helpers for the state handlers. Reads past the end of a section
+   return zeroes and mark the snapshot as bad. */
+extern void	snapshot_write(snapshot_t *s, const void *data, uint32_t len);
+extern void	snapshot_read(snapshot_t *s, void *data, uint32_t len);
+extern int	snapshot_error(snapshot_t *s);
+extern void	snapshot_unsupported(snapshot_t *s, const char *what);
+extern void	snapshot_write_timer(snapshot_t *s, pc_timer_t *timer);
+extern void	snapshot_read_timer(snapshot_t *s, pc_timer_t *timer);
+
+#define snapshot_put(s, v)	snapshot_write((s), &(v), sizeof(v))
+#define snapshot_get(s, v)	snapshot_read((s), &(v), sizeof(v))
+
+/* State handlers of the core modules. */
+extern void	mem_save_state(snapshot_t *s);
+extern int	mem_load_state(snapshot_t *s);
+extern void	pic_save_state(snapshot_t *s);
+extern int	pic_load_state(snapshot_t *s);
+extern void	dma_save_state(snapshot_t *s);
+extern int	dma_load_state(snapshot_t *s);
+extern void	fdd_save_state(snapshot_t *s);
+extern int	fdd_load_state(snapshot_t *s);
+extern const char *device_state_unsupported(void);
+extern void	device_save_state(snapshot_t *s);
+extern int	device_load_state(snapshot_t *s, const char *name);
+
+/* Used by device_save_state(). */
+extern void	snapshot_section_begin(snapshot_t *s, const char *name);
+extern void	snapshot_section_end(snapshot_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	/*EMU_SNAPSHOT_H*/
@@ -46,14 +46,13 @@ typedef struct pc_timer_t
 #else
     ts_t	ts;
 #endif
-    int		flags, pad;		/* The flags are defined above. */
+    int		flags;			/* The flags are defined above. */
+    int		heap_pos;		/* Position in the timer heap when enabled. */
     double	period;			/* This is used for large period timers to count
 					   the microseconds and split the period. */
 
     void	(*callback)(void *p);
     void	*p;
-
-    struct	pc_timer_t *prev, *next;
 } pc_timer_t;
 
 /*Timestamp of nearest enabled timer. CPU emulation must call timer_process()
@@ -190,26 +189,16 @@ extern void	timer_on_auto(pc_timer_t *timer, double period);
 extern void	timer_remove_head(void);
 
 
-extern pc_timer_t *	timer_head;
-extern int		timer_inited;
+/*Arm/disarm trace for the benchmark mode, see timer_bench.c*/
+extern int	timer_tracing;
+extern void	timer_trace_start(void);
+extern void	timer_trace_add(pc_timer_t *timer, int enable);
+extern void	timer_trace_replay(void);
 
 
-static __inline void
-timer_remove_head_inline(void)
-{
-    pc_timer_t *timer;
-
-    if (timer_inited && timer_head) {
-	timer = timer_head;
-	timer_head = timer->next;
-	if (timer_head) {
-		timer_head->prev = NULL;
-		timer->next->prev = NULL;
-	}
-	timer->next = timer->prev = NULL;
-	timer->flags &= ~TIMER_ENABLED;
-    }
-}
+extern pc_timer_t **	timer_heap;
+extern int		timer_heap_count;
+extern int		timer_inited;
 
 
 static __inline void
@@ -217,16 +206,16 @@ timer_process_inline(void)
 {
     pc_timer_t *timer;
 
-    if (!timer_inited || !timer_head)
+    if (!timer_inited || !timer_heap_count)
 	return;
 
-    while(1) {
-	timer = timer_head;
+    while (timer_heap_count) {
+	timer = timer_heap[0];
 
 	if (!TIMER_LESS_THAN_VAL(timer, (uint32_t)tsc))
 		break;
 
-	timer_remove_head_inline();
+	timer_remove_head();
 
 	if (timer->flags & TIMER_SPLIT)
 		timer_advance_ex(timer, 0);	/* We're splitting a > 1 s period into multiple <= 1 s periods. */
@@ -234,7 +223,8 @@ timer_process_inline(void)
 		timer->callback(timer->p);
     }
 
-    timer_target = timer_head->ts.ts32.integer;
+    if (timer_heap_count)
+	timer_target = timer_heap[0]->ts.ts32.integer;
 }
 
 #endif /*_TIMER_H_*/
@@ -56,6 +56,7 @@ typedef struct svga_t
 	con, cursoron, blink, scrollcache, char_width,
 	firstline, lastline, firstline_draw, lastline_draw,
 	displine, fullchange, x_add, y_add, pan,
+	damage_y1, damage_y2,
 	vram_display_mask, vidclock,
 	hwcursor_on, dac_hwcursor_on, overlay_on, set_override;
 
@@ -76,7 +77,7 @@ typedef struct svga_t
 	     write_bank, read_bank,
 	     extra_banks[2],
 	     banked_mask,
-	     ca, overscan_color,
+	     ca, overscan_color, overscan_color_blit,
 	     *map8, pallook[512];
 
     PALETTE vgapal;
@@ -61,3 +61,14 @@ void svga_render_RGBA8888_lowres(svga_t *svga);
 void svga_render_RGBA8888_highres(svga_t *svga);
 
 extern void (*svga_render)(svga_t *svga);
+
+extern void (*svga_render_line_8bpp)(uint32_t *p, const uint8_t *src, int count, const uint32_t *pal);
+extern void (*svga_render_line_15bpp)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_render_line_16bpp)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_render_line_24bpp)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_render_line_32bpp)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_render_line_ABGR8888)(uint32_t *p, const uint8_t *src, int count);
+extern void (*svga_render_line_RGBA8888)(uint32_t *p, const uint8_t *src, int count);
+
+extern void svga_render_init(void);
+extern int svga_render_test(void);
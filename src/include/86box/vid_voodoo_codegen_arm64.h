@@ -0,0 +1,1479 @@
+/*Registers :
+
+  X0  - voodoo_state
+  X1  - voodoo_params
+  W2  - x
+  W3  - real_y
+  X4  - state->fb_mem
+  X5  - state->aux_mem
+  W6  - state->x2
+  W7  - LOD fraction of last texture fetch
+  W12 - LOD of last texture fetch
+  W14 - w_depth
+  W15 - new_depth
+  W16 - x_tiled
+  X17 - address scratch
+
+  V0  - TMU0 output (B, G, R, A as 32-bit lanes)
+  V1  - TMU1 output
+  V2  - clocal
+  V4  - colour combine output
+  V16 - clamped iterated colour
+  V17 - TMU1 raw blend factors
+  V29 - 1 in each lane
+  V30 - 0xff in each lane
+  V31 - 0
+
+  Everything else is scratch. X19-X24 are saved on entry and restored on
+  exit; no calls are made out of the generated code.
+*/
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__APPLE__)
+#include <pthread.h>
+#endif
+#if _WIN32
+#define BITMAP windows_BITMAP
+#include <windows.h>
+#undef BITMAP
+#endif
+
+#define BLOCK_NUM 8
+#define BLOCK_MASK (BLOCK_NUM-1)
+#define BLOCK_SIZE 8192
+
+#define LOD_MASK (LOD_TMIRROR_S | LOD_TMIRROR_T)
+
+typedef struct voodoo_arm64_data_t
+{
+        uint32_t code_block[BLOCK_SIZE / 4];
+        int xdir;
+        uint32_t alphaMode;
+        uint32_t fbzMode;
+        uint32_t fogMode;
+        uint32_t fbzColorPath;
+        uint32_t textureMode[2];
+        uint32_t tLOD[2];
+        uint32_t trexInit1;
+        int is_tiled;
+} voodoo_arm64_data_t;
+
+static int last_block[VOODOO_MAX_RENDER_THREADS];
+static int next_block_to_write[VOODOO_MAX_RENDER_THREADS];
+
+#define addlong(val)                                            \
+        do {                                                    \
+                code_block[block_pos++] = val;                  \
+                if (block_pos >= (BLOCK_SIZE / 4))              \
+                        fatal("Over!\n");                       \
+        } while (0)
+
+#define REG_STATE     0
+#define REG_PARAMS    1
+#define REG_X         2
+#define REG_REAL_Y    3
+#define REG_FB_MEM    4
+#define REG_AUX_MEM   5
+#define REG_X2        6
+#define REG_LOD_FRAC  7
+#define REG_LOD      12
+#define REG_W_DEPTH  14
+#define REG_NEW_DEPTH 15
+#define REG_X_TILED  16
+#define REG_ADDR     17
+#define REG_SP       31
+#define REG_ZR       31
+
+#define V_TEX0    0
+#define V_TEX1    1
+#define V_CLOCAL  2
+#define V_COTHER  3
+#define V_SRC     4
+#define V_ITER   16
+#define V_FACTOR1 17
+#define V_ONE    29
+#define V_FF     30
+#define V_ZERO   31
+
+#define COND_EQ 0x0
+#define COND_NE 0x1
+#define COND_GE 0xa
+#define COND_LT 0xb
+#define COND_GT 0xc
+#define COND_LE 0xd
+
+#define SHIFT_LSL 0
+#define SHIFT_LSR 1
+#define SHIFT_ASR 2
+
+#define Rd(x)  (x)
+#define Rn(x)  ((x) << 5)
+#define Rm(x)  ((x) << 16)
+#define Ra(x)  ((x) << 10)
+
+/*Integer instructions*/
+#define ARM64_MOVZ_W(d, imm, hw)        (0x52800000 | ((hw) << 21) | (((imm) & 0xffff) << 5) | Rd(d))
+#define ARM64_MOVK_W(d, imm, hw)        (0x72800000 | ((hw) << 21) | (((imm) & 0xffff) << 5) | Rd(d))
+#define ARM64_MOVZ_X(d, imm, hw)        (0xd2800000 | ((hw) << 21) | (((imm) & 0xffff) << 5) | Rd(d))
+#define ARM64_MOVK_X(d, imm, hw)        (0xf2800000 | ((hw) << 21) | (((imm) & 0xffff) << 5) | Rd(d))
+#define ARM64_ADD_IMM_W(d, n, imm)      (0x11000000 | ((imm) << 10) | Rn(n) | Rd(d))
+#define ARM64_ADD_IMM_X(d, n, imm)      (0x91000000 | ((imm) << 10) | Rn(n) | Rd(d))
+#define ARM64_ADD_IMM12_X(d, n, imm)    (0x91400000 | ((imm) << 10) | Rn(n) | Rd(d))
+#define ARM64_SUB_IMM_W(d, n, imm)      (0x51000000 | ((imm) << 10) | Rn(n) | Rd(d))
+#define ARM64_SUB_IMM12_W(d, n, imm)    (0x51400000 | ((imm) << 10) | Rn(n) | Rd(d))
+#define ARM64_CMP_IMM_W(n, imm)         (0x71000000 | ((imm) << 10) | Rn(n) | Rd(REG_ZR))
+#define ARM64_CMP_IMM_X(n, imm)         (0xf1000000 | ((imm) << 10) | Rn(n) | Rd(REG_ZR))
+#define ARM64_ADD_W(d, n, m, sh, amt)   (0x0b000000 | ((sh) << 22) | Rm(m) | ((amt) << 10) | Rn(n) | Rd(d))
+#define ARM64_ADD_X(d, n, m, sh, amt)   (0x8b000000 | ((sh) << 22) | Rm(m) | ((amt) << 10) | Rn(n) | Rd(d))
+#define ARM64_SUB_W(d, n, m)            (0x4b000000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_SUB_X(d, n, m)            (0xcb000000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_CMP_W(n, m)               (0x6b000000 | Rm(m) | Rn(n) | Rd(REG_ZR))
+#define ARM64_SUBS_W(d, n, m)           (0x6b000000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_AND_W(d, n, m)            (0x0a000000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_BICS_W(d, n, m)           (0x6a200000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_ORR_W(d, n, m, sh, amt)   (0x2a000000 | ((sh) << 22) | Rm(m) | ((amt) << 10) | Rn(n) | Rd(d))
+#define ARM64_MOV_W(d, m)               ARM64_ORR_W(d, REG_ZR, m, SHIFT_LSL, 0)
+#define ARM64_MVN_W(d, m)               (0x2a200000 | Rm(m) | Rn(REG_ZR) | Rd(d))
+#define ARM64_LSLV_W(d, n, m)           (0x1ac02000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_LSRV_W(d, n, m)           (0x1ac02400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_ASRV_W(d, n, m)           (0x1ac02800 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_LSLV_X(d, n, m)           (0x9ac02000 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_LSRV_X(d, n, m)           (0x9ac02400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_UBFM_W(d, n, immr, imms)  (0x53000000 | ((immr) << 16) | ((imms) << 10) | Rn(n) | Rd(d))
+#define ARM64_UBFM_X(d, n, immr, imms)  (0xd3400000 | ((immr) << 16) | ((imms) << 10) | Rn(n) | Rd(d))
+#define ARM64_SBFM_W(d, n, immr, imms)  (0x13000000 | ((immr) << 16) | ((imms) << 10) | Rn(n) | Rd(d))
+#define ARM64_SBFM_X(d, n, immr, imms)  (0x93400000 | ((immr) << 16) | ((imms) << 10) | Rn(n) | Rd(d))
+#define ARM64_LSL_IMM_W(d, n, sh)       ARM64_UBFM_W(d, n, (32 - (sh)) & 31, 31 - (sh))
+#define ARM64_LSR_IMM_W(d, n, sh)       ARM64_UBFM_W(d, n, sh, 31)
+#define ARM64_ASR_IMM_W(d, n, sh)       ARM64_SBFM_W(d, n, sh, 31)
+#define ARM64_ASR_IMM_X(d, n, sh)       ARM64_SBFM_X(d, n, sh, 63)
+#define ARM64_UBFX_W(d, n, lsb, width)  ARM64_UBFM_W(d, n, lsb, (lsb) + (width) - 1)
+#define ARM64_UBFX_X(d, n, lsb, width)  ARM64_UBFM_X(d, n, lsb, (lsb) + (width) - 1)
+#define ARM64_SXTH_W(d, n)              ARM64_SBFM_W(d, n, 0, 15)
+#define ARM64_MUL_W(d, n, m)            (0x1b000000 | Rm(m) | Ra(REG_ZR) | Rn(n) | Rd(d))
+#define ARM64_MUL_X(d, n, m)            (0x9b000000 | Rm(m) | Ra(REG_ZR) | Rn(n) | Rd(d))
+#define ARM64_UDIV_X(d, n, m)           (0x9ac00800 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_CLZ_X(d, n)               (0xdac01000 | Rn(n) | Rd(d))
+#define ARM64_CLZ_W(d, n)               (0x5ac01000 | Rn(n) | Rd(d))
+#define ARM64_CSEL_W(d, n, m, cond)     (0x1a800000 | Rm(m) | ((cond) << 12) | Rn(n) | Rd(d))
+#define ARM64_CSEL_X(d, n, m, cond)     (0x9a800000 | Rm(m) | ((cond) << 12) | Rn(n) | Rd(d))
+
+/*Loads and stores. Immediate offsets are scaled by the access size*/
+#define ARM64_LDR_IMM_W(t, n, off)      (0xb9400000 | (((off) >> 2) << 10) | Rn(n) | Rd(t))
+#define ARM64_LDR_IMM_X(t, n, off)      (0xf9400000 | (((off) >> 3) << 10) | Rn(n) | Rd(t))
+#define ARM64_STR_IMM_W(t, n, off)      (0xb9000000 | (((off) >> 2) << 10) | Rn(n) | Rd(t))
+#define ARM64_STR_IMM_X(t, n, off)      (0xf9000000 | (((off) >> 3) << 10) | Rn(n) | Rd(t))
+#define ARM64_LDRB_IMM(t, n, off)       (0x39400000 | ((off) << 10) | Rn(n) | Rd(t))
+#define ARM64_LDR_IMM_S(t, n, off)      (0xbd400000 | (((off) >> 2) << 10) | Rn(n) | Rd(t))
+#define ARM64_LDR_SXTW_W(t, n, m)       (0xb8600800 | Rm(m) | (6 << 13) | (1 << 12) | Rn(n) | Rd(t))
+#define ARM64_LDR_SXTW_X(t, n, m)       (0xf8600800 | Rm(m) | (6 << 13) | (1 << 12) | Rn(n) | Rd(t))
+#define ARM64_LDR_SXTW_S(t, n, m)       (0xbc600800 | Rm(m) | (6 << 13) | (1 << 12) | Rn(n) | Rd(t))
+#define ARM64_LDRH_SXTW(t, n, m)        (0x78600800 | Rm(m) | (6 << 13) | (1 << 12) | Rn(n) | Rd(t))
+#define ARM64_STRH_SXTW(t, n, m)        (0x78200800 | Rm(m) | (6 << 13) | (1 << 12) | Rn(n) | Rd(t))
+#define ARM64_LDRB_REG(t, n, m)         (0x38600800 | Rm(m) | (3 << 13) | Rn(n) | Rd(t))
+#define ARM64_STP_PREIDX_X(t, t2, n, off) (0xa9800000 | ((((off) >> 3) & 0x7f) << 15) | ((t2) << 10) | Rn(n) | Rd(t))
+#define ARM64_LDP_POSTIDX_X(t, t2, n, off) (0xa8c00000 | ((((off) >> 3) & 0x7f) << 15) | ((t2) << 10) | Rn(n) | Rd(t))
+
+/*Branches. Offsets are patched in later where a target is not yet known*/
+#define ARM64_B(offset)                 (0x14000000 | ((offset) & 0x3ffffff))
+#define ARM64_BCOND(cond, offset)       (0x54000000 | (((offset) & 0x7ffff) << 5) | (cond))
+#define ARM64_TBZ(t, bit, offset)       (0x36000000 | (((bit) & 0x20) << 26) | (((bit) & 0x1f) << 19) | (((offset) & 0x3fff) << 5) | Rd(t))
+#define ARM64_TBNZ(t, bit, offset)      (0x37000000 | (((bit) & 0x20) << 26) | (((bit) & 0x1f) << 19) | (((offset) & 0x3fff) << 5) | Rd(t))
+#define ARM64_RET                       0xd65f03c0
+
+/*NEON instructions, all operating on four 32-bit lanes unless noted*/
+#define ARM64_ADD_V4S(d, n, m)          (0x4ea08400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_SUB_V4S(d, n, m)          (0x6ea08400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_ADD_V2D(d, n, m)          (0x4ee08400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_SUB_V2D(d, n, m)          (0x6ee08400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_MUL_V4S(d, n, m)          (0x4ea09c00 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_MLA_V4S(d, n, m)          (0x4ea09400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_NEG_V4S(d, n)             (0x6ea0b800 | Rn(n) | Rd(d))
+#define ARM64_SMAX_V4S(d, n, m)         (0x4ea06400 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_SMIN_V4S(d, n, m)         (0x4ea06c00 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_AND_V(d, n, m)            (0x4e201c00 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_EOR_V(d, n, m)            (0x6e201c00 | Rm(m) | Rn(n) | Rd(d))
+#define ARM64_MOV_V(d, n)               (0x4ea01c00 | Rm(n) | Rn(n) | Rd(d))
+#define ARM64_SSHR_V4S(d, n, sh)        (0x4f000400 | ((64 - (sh)) << 16) | Rn(n) | Rd(d))
+#define ARM64_USHR_V4S(d, n, sh)        (0x6f000400 | ((64 - (sh)) << 16) | Rn(n) | Rd(d))
+#define ARM64_UXTL_V8H(d, n)            (0x2f08a400 | Rn(n) | Rd(d))
+#define ARM64_UXTL_V4S(d, n)            (0x2f10a400 | Rn(n) | Rd(d))
+#define ARM64_XTN_V4H(d, n)             (0x0e612800 | Rn(n) | Rd(d))
+#define ARM64_XTN_V8B(d, n)             (0x0e212800 | Rn(n) | Rd(d))
+#define ARM64_MOVI_V4S(d, imm)          (0x4f000400 | (((imm) >> 5) << 16) | (((imm) & 0x1f) << 5) | Rd(d))
+#define ARM64_DUP_V4S(d, n)             (0x4e040c00 | Rn(n) | Rd(d))
+#define ARM64_DUP_ELEM_V4S(d, n, i)     (0x4e000400 | ((((i) << 3) | 4) << 16) | Rn(n) | Rd(d))
+#define ARM64_INS_S(d, i, n)            (0x4e001c00 | ((((i) << 3) | 4) << 16) | Rn(n) | Rd(d))
+#define ARM64_INS_ELEM_S(d, i, n, j)    (0x6e000400 | ((((i) << 3) | 4) << 16) | ((j) << 13) | Rn(n) | Rd(d))
+#define ARM64_UMOV_S(d, n, i)           (0x0e003c00 | ((((i) << 3) | 4) << 16) | Rn(n) | Rd(d))
+#define ARM64_LD1_V4S(t, n)             (0x4c407800 | Rn(n) | Rd(t))
+#define ARM64_ST1_V4S(t, n)             (0x4c007800 | Rn(n) | Rd(t))
+#define ARM64_LD1_V2D(t, n)             (0x4c407c00 | Rn(n) | Rd(t))
+#define ARM64_ST1_V2D(t, n)             (0x4c007c00 | Rn(n) | Rd(t))
+
+static inline int codegen_mov_imm_w(uint32_t *code_block, int block_pos, int reg, uint32_t imm)
+{
+        addlong(ARM64_MOVZ_W(reg, imm & 0xffff, 0));
+        if (imm >> 16)
+                addlong(ARM64_MOVK_W(reg, imm >> 16, 1));
+
+        return block_pos;
+}
+
+static inline int codegen_mov_imm_x(uint32_t *code_block, int block_pos, int reg, uint64_t imm)
+{
+        int c;
+
+        addlong(ARM64_MOVZ_X(reg, imm & 0xffff, 0));
+        for (c = 1; c < 4; c++)
+        {
+                if ((imm >> (c * 16)) & 0xffff)
+                        addlong(ARM64_MOVK_X(reg, (imm >> (c * 16)) & 0xffff, c));
+        }
+
+        return block_pos;
+}
+
+/*Rd = Rn + offset, for forming structure member addresses*/
+static inline int codegen_add_offset(uint32_t *code_block, int block_pos, int rd, int rn, int offset)
+{
+        if (offset < (1 << 12))
+                addlong(ARM64_ADD_IMM_X(rd, rn, offset));
+        else if (offset < (1 << 24))
+        {
+                addlong(ARM64_ADD_IMM12_X(rd, rn, offset >> 12));
+                if (offset & 0xfff)
+                        addlong(ARM64_ADD_IMM_X(rd, rd, offset & 0xfff));
+        }
+        else
+                fatal("codegen_add_offset: offset out of range %x\n", offset);
+
+        return block_pos;
+}
+
+/*Load or store a structure member. Offsets too large for the scaled
+  immediate form go through the address scratch register*/
+#define LDST_LDR_W  0
+#define LDST_LDR_X  1
+#define LDST_STR_W  2
+#define LDST_STR_X  3
+#define LDST_LDRB   4
+#define LDST_LDR_S  5
+
+static inline int codegen_ldst(uint32_t *code_block, int block_pos, int type, int rt, int rn, int offset)
+{
+        int shift = (type == LDST_LDR_X || type == LDST_STR_X) ? 3 : ((type == LDST_LDRB) ? 0 : 2);
+
+        if ((offset & ((1 << shift) - 1)) || (offset >> shift) >= (1 << 12))
+        {
+                block_pos = codegen_add_offset(code_block, block_pos, REG_ADDR, rn, offset);
+                rn = REG_ADDR;
+                offset = 0;
+        }
+
+        switch (type)
+        {
+                case LDST_LDR_W:
+                addlong(ARM64_LDR_IMM_W(rt, rn, offset));
+                break;
+                case LDST_LDR_X:
+                addlong(ARM64_LDR_IMM_X(rt, rn, offset));
+                break;
+                case LDST_STR_W:
+                addlong(ARM64_STR_IMM_W(rt, rn, offset));
+                break;
+                case LDST_STR_X:
+                addlong(ARM64_STR_IMM_X(rt, rn, offset));
+                break;
+                case LDST_LDRB:
+                addlong(ARM64_LDRB_IMM(rt, rn, offset));
+                break;
+                case LDST_LDR_S:
+                addlong(ARM64_LDR_IMM_S(rt, rn, offset));
+                break;
+        }
+
+        return block_pos;
+}
+
+/*Point a previously emitted branch at target*/
+static inline void codegen_patch_branch(uint32_t *code_block, int pos, int target)
+{
+        int offset = target - pos;
+        uint32_t op = code_block[pos];
+
+        if ((op & 0xfc000000) == 0x14000000) /*B*/
+                code_block[pos] = (op & 0xfc000000) | (offset & 0x3ffffff);
+        else if ((op & 0x7e000000) == 0x36000000) /*TBZ/TBNZ*/
+                code_block[pos] = (op & ~(0x3fff << 5)) | ((offset & 0x3fff) << 5);
+        else /*B.cond, CBZ, CBNZ*/
+                code_block[pos] = (op & ~(0x7ffff << 5)) | ((offset & 0x7ffff) << 5);
+}
+
+/*Unpack four bytes (B, G, R, A) held in the low word of Vn to 32-bit lanes*/
+static inline int codegen_unpack_bytes(uint32_t *code_block, int block_pos, int vd, int vn)
+{
+        addlong(ARM64_UXTL_V8H(vd, vn));
+        addlong(ARM64_UXTL_V4S(vd, vd));
+
+        return block_pos;
+}
+
+static inline int codegen_clamp_v(uint32_t *code_block, int block_pos, int vd)
+{
+        addlong(ARM64_SMAX_V4S(vd, vd, V_ZERO));
+        addlong(ARM64_SMIN_V4S(vd, vd, V_FF));
+
+        return block_pos;
+}
+
+/*Wd = CLAMP(Wd), with Wtmp used for the 0xff constant*/
+static inline int codegen_clamp_w(uint32_t *code_block, int block_pos, int wd, int wtmp)
+{
+        addlong(ARM64_CMP_IMM_W(wd, 0));
+        addlong(ARM64_CSEL_W(wd, REG_ZR, wd, COND_LT));
+        addlong(ARM64_MOVZ_W(wtmp, 0xff, 0));
+        addlong(ARM64_CMP_W(wd, wtmp));
+        addlong(ARM64_CSEL_W(wd, wtmp, wd, COND_GT));
+
+        return block_pos;
+}
+
+/*Wd = CLAMP16(Wd), with Wtmp used for the 0xffff constant*/
+static inline int codegen_clamp16_w(uint32_t *code_block, int block_pos, int wd, int wtmp)
+{
+        addlong(ARM64_CMP_IMM_W(wd, 0));
+        addlong(ARM64_CSEL_W(wd, REG_ZR, wd, COND_LT));
+        addlong(ARM64_MOVZ_W(wtmp, 0xffff, 0));
+        addlong(ARM64_CMP_W(wd, wtmp));
+        addlong(ARM64_CSEL_W(wd, wtmp, wd, COND_GT));
+
+        return block_pos;
+}
+
+/*Vd = mask with 0xff in the colour lanes if rgb is set and in the alpha
+  lane if a is set. W8 is used as scratch*/
+static inline int codegen_lane_mask(uint32_t *code_block, int block_pos, int vd, int rgb, int a)
+{
+        addlong(ARM64_MOV_V(vd, rgb ? V_FF : V_ZERO));
+        if ((rgb ? 1 : 0) != (a ? 1 : 0))
+        {
+                if (a)
+                        addlong(ARM64_MOVZ_W(8, 0xff, 0));
+                addlong(ARM64_INS_S(vd, 3, a ? 8 : REG_ZR));
+        }
+
+        return block_pos;
+}
+
+/*W8 = detail blend factor for tmu, given the LOD in REG_LOD. W9 is scratch*/
+static inline int codegen_detail_factor(uint32_t *code_block, int block_pos, int tmu)
+{
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_PARAMS, offsetof(voodoo_params_t, detail_bias[tmu]));
+        addlong(ARM64_SUB_W(8, 8, REG_LOD));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 9, REG_PARAMS, offsetof(voodoo_params_t, detail_scale[tmu]));
+        addlong(ARM64_LSLV_W(8, 8, 9));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 9, REG_PARAMS, offsetof(voodoo_params_t, detail_max[tmu]));
+        addlong(ARM64_CMP_W(8, 9));
+        addlong(ARM64_CSEL_W(8, 9, 8, COND_GT));
+
+        return block_pos;
+}
+
+/*Wrap or clamp texture coordinate Wv against Wmask, as tex_read() does.
+  W13 is scratch*/
+static inline int codegen_tex_coord(uint32_t *code_block, int block_pos, int wv, int wmask, int clamp)
+{
+        if (clamp)
+        {
+                addlong(ARM64_CMP_IMM_W(wv, 0));
+                addlong(ARM64_CSEL_W(13, REG_ZR, wv, COND_LT));
+                addlong(ARM64_CMP_W(13, wmask));
+                addlong(ARM64_CSEL_W(13, wmask, 13, COND_GT));
+                addlong(ARM64_BICS_W(REG_ZR, wv, wmask));
+                addlong(ARM64_CSEL_W(wv, 13, wv, COND_NE));
+        }
+        else
+                addlong(ARM64_AND_W(wv, wv, wmask));
+
+        return block_pos;
+}
+
+/*Sample one TMU into Vd, leaving the LOD in W12 and LOD fraction in W7.
+  Follows voodoo_tmu_fetch()*/
+static inline int codegen_texture_fetch(uint32_t *code_block, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int block_pos, int tmu, int vd)
+{
+        int off_s = tmu ? offsetof(voodoo_state_t, tmu1_s) : offsetof(voodoo_state_t, tmu0_s);
+        int off_t = tmu ? offsetof(voodoo_state_t, tmu1_t) : offsetof(voodoo_state_t, tmu0_t);
+        int off_w = tmu ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w);
+        int clamp_s = params->textureMode[tmu] & TEXTUREMODE_TCLAMPS;
+        int clamp_t = params->textureMode[tmu] & TEXTUREMODE_TCLAMPT;
+
+        if (params->textureMode[tmu] & 1)
+        {
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, off_w);
+                addlong(ARM64_MOVZ_X(9, 1, 3));         /*MOV X9, #1 << 48*/
+                addlong(ARM64_UDIV_X(9, 9, 8));         /*X9 = _w, 0 if W is 0*/
+                addlong(ARM64_MOVZ_X(19, 0x2000, 1));   /*MOV X19, #1 << 29*/
+
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 10, REG_STATE, off_s);
+                addlong(ARM64_ADD_IMM12_X(10, 10, 2));  /*ADD X10, X10, #1 << 13*/
+                addlong(ARM64_ASR_IMM_X(10, 10, 14));
+                addlong(ARM64_MUL_X(10, 10, 9));
+                addlong(ARM64_ADD_X(10, 10, 19, SHIFT_LSL, 0));
+                addlong(ARM64_ASR_IMM_X(10, 10, 30));   /*W10 = tex_s*/
+
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 11, REG_STATE, off_t);
+                addlong(ARM64_ADD_IMM12_X(11, 11, 2));
+                addlong(ARM64_ASR_IMM_X(11, 11, 14));
+                addlong(ARM64_MUL_X(11, 11, 9));
+                addlong(ARM64_ADD_X(11, 11, 19, SHIFT_LSL, 0));
+                addlong(ARM64_ASR_IMM_X(11, 11, 30));   /*W11 = tex_t*/
+
+                /*W13 = fastlog(_w)*/
+                addlong(ARM64_CLZ_X(13, 9));
+                addlong(ARM64_MOVZ_W(8, 63, 0));
+                addlong(ARM64_SUB_W(13, 8, 13));        /*W13 = exponent*/
+                addlong(ARM64_SUB_IMM_W(8, 13, 8));
+                addlong(ARM64_LSRV_X(19, 9, 8));
+                addlong(ARM64_SUB_W(20, REG_ZR, 8));
+                addlong(ARM64_LSLV_X(20, 9, 20));
+                addlong(ARM64_CMP_IMM_W(8, 0));
+                addlong(ARM64_CSEL_X(19, 19, 20, COND_GE));
+                addlong(ARM64_UBFX_W(19, 19, 0, 8));
+                block_pos = codegen_mov_imm_x(code_block, block_pos, 20, (uintptr_t)logtable);
+                addlong(ARM64_LDRB_REG(19, 20, 19));
+                addlong(ARM64_ORR_W(13, 19, 13, SHIFT_LSL, 8));
+                addlong(ARM64_MOVZ_W(19, 0x8000, 1));
+                addlong(ARM64_CMP_IMM_X(9, 0));
+                addlong(ARM64_CSEL_W(13, 19, 13, COND_EQ));
+
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, REG_LOD, REG_STATE, offsetof(voodoo_state_t, tmu[tmu].lod));
+                addlong(ARM64_ADD_W(REG_LOD, REG_LOD, 13, SHIFT_LSL, 0));
+                addlong(ARM64_SUB_IMM12_W(REG_LOD, REG_LOD, (19 << 8) >> 12));
+                addlong(ARM64_SUB_IMM_W(REG_LOD, REG_LOD, (19 << 8) & 0xfff));
+        }
+        else
+        {
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 10, REG_STATE, off_s);
+                addlong(ARM64_ASR_IMM_X(10, 10, 28));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 11, REG_STATE, off_t);
+                addlong(ARM64_ASR_IMM_X(11, 11, 28));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, REG_LOD, REG_STATE, offsetof(voodoo_state_t, tmu[tmu].lod));
+        }
+
+        /*Clamp LOD to [lod_min, lod_max], checking lod_min first*/
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, lod_min[tmu]));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 13, REG_STATE, offsetof(voodoo_state_t, lod_max[tmu]));
+        addlong(ARM64_CMP_W(REG_LOD, 13));
+        addlong(ARM64_CSEL_W(19, 13, REG_LOD, COND_GT));
+        addlong(ARM64_CMP_W(REG_LOD, 8));
+        addlong(ARM64_CSEL_W(REG_LOD, 8, 19, COND_LT));
+        addlong(ARM64_UBFX_W(REG_LOD_FRAC, REG_LOD, 0, 8));
+        addlong(ARM64_ASR_IMM_W(REG_LOD, REG_LOD, 8));
+
+        /*W13 = tex_lod, W20 = w_mask, W21 = h_mask, X22 = texture data,
+          W23 = tex_shift*/
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, tex_lod[tmu]));
+        addlong(ARM64_LDR_SXTW_W(13, 8, REG_LOD));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, tex_w_mask[tmu]));
+        addlong(ARM64_LDR_SXTW_W(20, 8, REG_LOD));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, tex_h_mask[tmu]));
+        addlong(ARM64_LDR_SXTW_W(21, 8, REG_LOD));
+        block_pos = codegen_add_offset(code_block, block_pos, 8, REG_STATE, offsetof(voodoo_state_t, tex[tmu]));
+        addlong(ARM64_LDR_SXTW_X(22, 8, REG_LOD));
+        addlong(ARM64_MOVZ_W(8, 8, 0));
+        addlong(ARM64_SUB_W(23, 8, 13));
+
+        if (params->tLOD[tmu] & LOD_TMIRROR_S)
+        {
+                addlong(ARM64_TBZ(10, 12, 2));
+                addlong(ARM64_MVN_W(10, 10));
+        }
+        if (params->tLOD[tmu] & LOD_TMIRROR_T)
+        {
+                addlong(ARM64_TBZ(11, 12, 2));
+                addlong(ARM64_MVN_W(11, 11));
+        }
+
+        if (voodoo->bilinear_enabled && (params->textureMode[tmu] & 6))
+        {
+                addlong(ARM64_ADD_IMM_W(8, 13, 3));
+                addlong(ARM64_MOVZ_W(9, 1, 0));
+                addlong(ARM64_LSLV_W(9, 9, 8));
+                addlong(ARM64_SUB_W(10, 10, 9));
+                addlong(ARM64_SUB_W(11, 11, 9));
+                addlong(ARM64_ASRV_W(10, 10, 13));
+                addlong(ARM64_ASRV_W(11, 11, 13));
+                addlong(ARM64_UBFX_W(8, 10, 0, 4));     /*W8 = ds*/
+                addlong(ARM64_UBFX_W(9, 11, 0, 4));     /*W9 = dt*/
+                addlong(ARM64_ASR_IMM_W(10, 10, 4));
+                addlong(ARM64_ASR_IMM_W(11, 11, 4));
+
+                /*Bilinear weights to V5, V6, V7 and V18*/
+                addlong(ARM64_MOVZ_W(19, 16, 0));
+                addlong(ARM64_SUB_W(24, 19, 8));        /*W24 = 16 - ds*/
+                addlong(ARM64_SUB_W(19, 19, 9));        /*W19 = 16 - dt*/
+                addlong(ARM64_MUL_W(13, 24, 19));
+                addlong(ARM64_DUP_V4S(5, 13));
+                addlong(ARM64_MUL_W(13, 8, 19));
+                addlong(ARM64_DUP_V4S(6, 13));
+                addlong(ARM64_MUL_W(13, 24, 9));
+                addlong(ARM64_DUP_V4S(7, 13));
+                addlong(ARM64_MUL_W(13, 8, 9));
+                addlong(ARM64_DUP_V4S(18, 13));
+
+                addlong(ARM64_ADD_IMM_W(8, 10, 1));
+                addlong(ARM64_ADD_IMM_W(9, 11, 1));
+                block_pos = codegen_tex_coord(code_block, block_pos, 10, 20, clamp_s);
+                block_pos = codegen_tex_coord(code_block, block_pos, 8, 20, clamp_s);
+                block_pos = codegen_tex_coord(code_block, block_pos, 11, 21, clamp_t);
+                block_pos = codegen_tex_coord(code_block, block_pos, 9, 21, clamp_t);
+                addlong(ARM64_LSLV_W(19, 11, 23));
+                addlong(ARM64_LSLV_W(24, 9, 23));
+
+                addlong(ARM64_ADD_W(13, 10, 19, SHIFT_LSL, 0));
+                addlong(ARM64_LDR_SXTW_S(19, 22, 13));
+                addlong(ARM64_ADD_W(13, 8, 19, SHIFT_LSL, 0));
+                addlong(ARM64_LDR_SXTW_S(20, 22, 13));
+                addlong(ARM64_ADD_W(13, 10, 24, SHIFT_LSL, 0));
+                addlong(ARM64_LDR_SXTW_S(21, 22, 13));
+                addlong(ARM64_ADD_W(13, 8, 24, SHIFT_LSL, 0));
+                addlong(ARM64_LDR_SXTW_S(22, 22, 13));
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 19, 19);
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 20, 20);
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 21, 21);
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 22, 22);
+
+                addlong(ARM64_MUL_V4S(vd, 19, 5));
+                addlong(ARM64_MLA_V4S(vd, 20, 6));
+                addlong(ARM64_MLA_V4S(vd, 21, 7));
+                addlong(ARM64_MLA_V4S(vd, 22, 18));
+                addlong(ARM64_USHR_V4S(vd, vd, 8));
+        }
+        else
+        {
+                addlong(ARM64_ADD_IMM_W(8, 13, 4));
+                addlong(ARM64_ASRV_W(10, 10, 8));
+                addlong(ARM64_ASRV_W(11, 11, 8));
+                block_pos = codegen_tex_coord(code_block, block_pos, 10, 20, clamp_s);
+                block_pos = codegen_tex_coord(code_block, block_pos, 11, 21, clamp_t);
+                addlong(ARM64_LSLV_W(13, 11, 23));
+                addlong(ARM64_ADD_W(13, 13, 10, SHIFT_LSL, 0));
+                addlong(ARM64_LDR_SXTW_S(vd, 22, 13));
+                block_pos = codegen_unpack_bytes(code_block, block_pos, vd, vd);
+        }
+
+        return block_pos;
+}
+
+/*Colour (lanes 0-2) and alpha (lane 3) blend factor selection for the TMU
+  combine units, into Vd. ALOCAL/CLOCAL come from v_local, AOTHER from
+  v_other (V_ZERO for TMU1). Unhandled selections keep the previous factor,
+  which is held in v_prev*/
+static inline int codegen_tmu_factor(uint32_t *code_block, int block_pos, int vd, int mselect, int a_mselect, int do_rgb, int do_a, int v_local, int v_other, int v_prev, int tmu)
+{
+        if (do_rgb)
+        {
+                switch (mselect)
+                {
+                        case TC_MSELECT_ZERO:
+                        addlong(ARM64_MOV_V(vd, V_ZERO));
+                        break;
+                        case TC_MSELECT_CLOCAL:
+                        addlong(ARM64_MOV_V(vd, v_local));
+                        break;
+                        case TC_MSELECT_AOTHER:
+                        addlong(ARM64_DUP_ELEM_V4S(vd, v_other, 3));
+                        break;
+                        case TC_MSELECT_ALOCAL:
+                        addlong(ARM64_DUP_ELEM_V4S(vd, v_local, 3));
+                        break;
+                        case TC_MSELECT_DETAIL:
+                        block_pos = codegen_detail_factor(code_block, block_pos, tmu);
+                        addlong(ARM64_DUP_V4S(vd, 8));
+                        break;
+                        case TC_MSELECT_LOD_FRAC:
+                        addlong(ARM64_DUP_V4S(vd, REG_LOD_FRAC));
+                        break;
+                        default:
+                        addlong(ARM64_MOV_V(vd, v_prev));
+                        break;
+                }
+        }
+        else
+                addlong(ARM64_MOV_V(vd, v_prev));
+
+        if (do_a)
+        {
+                switch (a_mselect)
+                {
+                        case TCA_MSELECT_ZERO:
+                        addlong(ARM64_INS_S(vd, 3, REG_ZR));
+                        break;
+                        case TCA_MSELECT_CLOCAL:
+                        case TCA_MSELECT_ALOCAL:
+                        addlong(ARM64_INS_ELEM_S(vd, 3, v_local, 3));
+                        break;
+                        case TCA_MSELECT_AOTHER:
+                        addlong(ARM64_INS_ELEM_S(vd, 3, v_other, 3));
+                        break;
+                        case TCA_MSELECT_DETAIL:
+                        block_pos = codegen_detail_factor(code_block, block_pos, tmu);
+                        addlong(ARM64_INS_S(vd, 3, 8));
+                        break;
+                        case TCA_MSELECT_LOD_FRAC:
+                        addlong(ARM64_INS_S(vd, 3, REG_LOD_FRAC));
+                        break;
+                        default:
+                        addlong(ARM64_INS_ELEM_S(vd, 3, v_prev, 3));
+                        break;
+                }
+        }
+        else
+                addlong(ARM64_INS_ELEM_S(vd, 3, v_prev, 3));
+
+        return block_pos;
+}
+
+/*Vd = reversal mask for a TMU combine unit. When trilinear filtering is
+  enabled the colour and alpha reversals swap on odd LODs, so both masks
+  are generated and selected on bit 0 of the LOD*/
+static inline int codegen_tmu_reverse_mask(uint32_t *code_block, int block_pos, int vd, int trilinear, int rgb_even, int a_even)
+{
+        if (trilinear)
+        {
+                int branch_pos, end_pos;
+
+                branch_pos = block_pos;
+                addlong(ARM64_TBZ(REG_LOD, 0, 0));
+                block_pos = codegen_lane_mask(code_block, block_pos, vd, !rgb_even, !a_even);
+                end_pos = block_pos;
+                addlong(ARM64_B(0));
+                codegen_patch_branch(code_block, branch_pos, block_pos);
+                block_pos = codegen_lane_mask(code_block, block_pos, vd, rgb_even, a_even);
+                codegen_patch_branch(code_block, end_pos, block_pos);
+        }
+        else
+                block_pos = codegen_lane_mask(code_block, block_pos, vd, rgb_even, a_even);
+
+        return block_pos;
+}
+
+/*Vd = colour lanes from v_rgb (or replicated alpha of v_rgb if rgb_alpha is
+  set), alpha lane from lane 3 of v_a. Either may be V_ZERO*/
+static inline int codegen_build_add(uint32_t *code_block, int block_pos, int vd, int v_rgb, int rgb_alpha, int v_a)
+{
+        if (rgb_alpha)
+                addlong(ARM64_DUP_ELEM_V4S(vd, v_rgb, 3));
+        else
+                addlong(ARM64_MOV_V(vd, v_rgb));
+        addlong(ARM64_INS_ELEM_S(vd, 3, v_a, 3));
+
+        return block_pos;
+}
+
+/*Sample and combine both TMUs into V0, following voodoo_tmu_fetch_and_blend()*/
+static inline int codegen_tmu_fetch_and_blend(uint32_t *code_block, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int block_pos)
+{
+        int tmu1_sub = tc_sub_clocal_1 ? 1 : 0;
+        int tmu1_a_sub = tca_sub_clocal_1 ? 1 : 0;
+
+        block_pos = codegen_texture_fetch(code_block, voodoo, params, state, block_pos, 1, V_TEX1);
+
+        addlong(ARM64_MOV_V(V_FACTOR1, V_ZERO));
+        if (tmu1_sub || tmu1_a_sub)
+        {
+                block_pos = codegen_tmu_factor(code_block, block_pos, V_FACTOR1, tc_mselect_1, tca_mselect_1, tmu1_sub, tmu1_a_sub, V_TEX1, V_ZERO, V_ZERO, 1);
+
+                block_pos = codegen_tmu_reverse_mask(code_block, block_pos, 5, params->textureMode[1] & TEXTUREMODE_TRILINEAR, !tc_reverse_blend_1, !tca_reverse_blend_1);
+                addlong(ARM64_EOR_V(6, V_FACTOR1, 5));
+                addlong(ARM64_ADD_V4S(6, 6, V_ONE));
+                addlong(ARM64_NEG_V4S(18, V_TEX1));
+                addlong(ARM64_MUL_V4S(18, 18, 6));
+                addlong(ARM64_SSHR_V4S(18, 18, 8));
+
+                if (tc_add_clocal_1 || tc_add_alocal_1 || tca_add_clocal_1 || tca_add_alocal_1)
+                {
+                        block_pos = codegen_build_add(code_block, block_pos, 5, (tc_add_clocal_1 || tc_add_alocal_1) ? V_TEX1 : V_ZERO,
+                                                        !tc_add_clocal_1 && tc_add_alocal_1,
+                                                        (tca_add_clocal_1 || tca_add_alocal_1) ? V_TEX1 : V_ZERO);
+                        addlong(ARM64_ADD_V4S(18, 18, 5));
+                }
+                block_pos = codegen_clamp_v(code_block, block_pos, 18);
+
+                if (tmu1_sub && tmu1_a_sub)
+                        addlong(ARM64_MOV_V(V_TEX1, 18));
+                else if (tmu1_sub)
+                {
+                        addlong(ARM64_INS_ELEM_S(18, 3, V_TEX1, 3));
+                        addlong(ARM64_MOV_V(V_TEX1, 18));
+                }
+                else
+                        addlong(ARM64_INS_ELEM_S(V_TEX1, 3, 18, 3));
+        }
+
+        block_pos = codegen_texture_fetch(code_block, voodoo, params, state, block_pos, 0, V_TEX0);
+
+        /*V18 = other - local*/
+        addlong(ARM64_MOV_V(18, tc_zero_other ? V_ZERO : V_TEX1));
+        addlong(ARM64_INS_ELEM_S(18, 3, tca_zero_other ? V_ZERO : V_TEX1, 3));
+        if (tc_sub_clocal || tca_sub_clocal)
+        {
+                block_pos = codegen_build_add(code_block, block_pos, 5, tc_sub_clocal ? V_TEX0 : V_ZERO, 0, tca_sub_clocal ? V_TEX0 : V_ZERO);
+                addlong(ARM64_SUB_V4S(18, 18, 5));
+        }
+
+        block_pos = codegen_tmu_factor(code_block, block_pos, 6, tc_mselect, tca_mselect, 1, 1, V_TEX0, V_TEX1, V_FACTOR1, 0);
+        block_pos = codegen_tmu_reverse_mask(code_block, block_pos, 5, params->textureMode[0] & TEXTUREMODE_TRILINEAR, !tc_reverse_blend, !tca_reverse_blend);
+        addlong(ARM64_EOR_V(6, 6, 5));
+        addlong(ARM64_ADD_V4S(6, 6, V_ONE));
+        addlong(ARM64_MUL_V4S(18, 18, 6));
+        addlong(ARM64_SSHR_V4S(18, 18, 8));
+
+        if (tc_add_clocal || tc_add_alocal || tca_add_clocal || tca_add_alocal)
+        {
+                block_pos = codegen_build_add(code_block, block_pos, 5, (tc_add_clocal || tc_add_alocal) ? V_TEX0 : V_ZERO,
+                                                !tc_add_clocal && tc_add_alocal,
+                                                (tca_add_clocal || tca_add_alocal) ? V_TEX0 : V_ZERO);
+                addlong(ARM64_ADD_V4S(18, 18, 5));
+        }
+        block_pos = codegen_clamp_v(code_block, block_pos, 18);
+
+        if (tc_invert_output || tca_invert_output)
+        {
+                block_pos = codegen_lane_mask(code_block, block_pos, 5, tc_invert_output, tca_invert_output);
+                addlong(ARM64_EOR_V(18, 18, 5));
+        }
+        addlong(ARM64_MOV_V(V_TEX0, 18));
+
+        return block_pos;
+}
+
+/*V5 = dest * Vm / 255, for products of two values in 0-255. The division
+  is done as a multiply by 0x8081 and shift by 23, which is exact over that
+  range. V28 holds the multiplier*/
+static inline int codegen_blend_mul(uint32_t *code_block, int block_pos, int vd, int vn, int vm)
+{
+        addlong(ARM64_MUL_V4S(vd, vn, vm));
+        addlong(ARM64_MUL_V4S(vd, vd, 28));
+        addlong(ARM64_USHR_V4S(vd, vd, 23));
+
+        return block_pos;
+}
+
+static inline void voodoo_generate(uint32_t *code_block, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int depthop)
+{
+        int block_pos = 0;
+        int skip_pos[16];
+        int nr_skip = 0;
+        int loop_pos;
+        int fb_x = params->col_tiled ? REG_X_TILED : REG_X;
+        int aux_x = params->aux_tiled ? REG_X_TILED : REG_X;
+        int texture = params->fbzColorPath & FBZCP_TEXTURE_ENABLED;
+        int trex_init = voodoo->trexInit1[0] & (1 << 18);
+        int fog_table = (params->fogMode & FOG_ENABLE) && !(params->fogMode & FOG_CONSTANT) && !(params->fogMode & (FOG_Z|FOG_ALPHA));
+        int tex_used = cc_localselect_override || _rgb_sel == CC_LOCALSELECT_TEX || a_sel == A_SEL_TEX ||
+                        cc_mselect == CC_MSELECT_TEX || cc_mselect == CC_MSELECT_TEXRGB || cca_mselect == CCA_MSELECT_TEX;
+        int c;
+
+        addlong(ARM64_STP_PREIDX_X(23, 24, REG_SP, -16));
+        addlong(ARM64_STP_PREIDX_X(21, 22, REG_SP, -16));
+        addlong(ARM64_STP_PREIDX_X(19, 20, REG_SP, -16));
+
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, REG_FB_MEM, REG_STATE, offsetof(voodoo_state_t, fb_mem));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, REG_AUX_MEM, REG_STATE, offsetof(voodoo_state_t, aux_mem));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, REG_X2, REG_STATE, offsetof(voodoo_state_t, x2));
+        addlong(ARM64_MOVI_V4S(V_ONE, 1));
+        addlong(ARM64_MOVI_V4S(V_FF, 0xff));
+        addlong(ARM64_MOVI_V4S(V_ZERO, 0));
+        if (params->alphaMode & (1 << 4))
+        {
+                addlong(ARM64_MOVZ_W(8, 0x8081, 0));
+                addlong(ARM64_DUP_V4S(28, 8));
+        }
+
+        loop_pos = block_pos;
+
+        if (params->col_tiled || params->aux_tiled)
+        {
+                /*x_tiled = (x & 63) | ((x >> 6) * 128*32/2)*/
+                addlong(ARM64_UBFX_W(REG_X_TILED, REG_X, 0, 6));
+                addlong(ARM64_ASR_IMM_W(8, REG_X, 6));
+                addlong(ARM64_ORR_W(REG_X_TILED, REG_X_TILED, 8, SHIFT_LSL, 11));
+        }
+
+        if (fog_table || ((params->fbzMode & FBZ_W_BUFFER) && (params->fbzMode & FBZ_DEPTH_ENABLE)))
+        {
+                int zero_pos, f001_pos, end_pos, end_pos2;
+
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, w));
+                addlong(ARM64_UBFX_X(9, 8, 32, 16));
+                zero_pos = block_pos;
+                addlong(0xb5000000 | Rd(9));            /*CBNZ X9, zero*/
+                addlong(ARM64_UBFX_W(9, 8, 16, 16));
+                f001_pos = block_pos;
+                addlong(0x34000000 | Rd(9));            /*CBZ W9, f001*/
+
+                addlong(ARM64_CLZ_W(10, 9));
+                addlong(ARM64_SUB_IMM_W(10, 10, 16));   /*W10 = exp*/
+                addlong(ARM64_MOVZ_W(11, 19, 0));
+                addlong(ARM64_SUB_W(11, 11, 10));
+                addlong(ARM64_MVN_W(REG_W_DEPTH, 8));
+                addlong(ARM64_LSRV_W(REG_W_DEPTH, REG_W_DEPTH, 11));
+                addlong(ARM64_UBFX_W(REG_W_DEPTH, REG_W_DEPTH, 0, 12));
+                addlong(ARM64_ADD_W(REG_W_DEPTH, REG_W_DEPTH, 10, SHIFT_LSL, 12));
+                addlong(ARM64_ADD_IMM_W(REG_W_DEPTH, REG_W_DEPTH, 1));
+                addlong(ARM64_MOVZ_W(11, 0xffff, 0));
+                addlong(ARM64_CMP_W(REG_W_DEPTH, 11));
+                addlong(ARM64_CSEL_W(REG_W_DEPTH, 11, REG_W_DEPTH, COND_GT));
+                end_pos = block_pos;
+                addlong(ARM64_B(0));
+
+                codegen_patch_branch(code_block, zero_pos, block_pos);
+                addlong(ARM64_MOV_W(REG_W_DEPTH, REG_ZR));
+                end_pos2 = block_pos;
+                addlong(ARM64_B(0));
+
+                codegen_patch_branch(code_block, f001_pos, block_pos);
+                addlong(ARM64_MOVZ_W(REG_W_DEPTH, 0xf001, 0));
+
+                codegen_patch_branch(code_block, end_pos, block_pos);
+                codegen_patch_branch(code_block, end_pos2, block_pos);
+        }
+
+        if (params->fbzMode & FBZ_DEPTH_ENABLE)
+        {
+                if (params->fbzMode & FBZ_W_BUFFER)
+                        addlong(ARM64_MOV_W(REG_NEW_DEPTH, REG_W_DEPTH));
+                else
+                {
+                        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, REG_NEW_DEPTH, REG_STATE, offsetof(voodoo_state_t, z));
+                        addlong(ARM64_ASR_IMM_W(REG_NEW_DEPTH, REG_NEW_DEPTH, 12));
+                        block_pos = codegen_clamp16_w(code_block, block_pos, REG_NEW_DEPTH, 8);
+                }
+
+                if (params->fbzMode & FBZ_DEPTH_BIAS)
+                {
+                        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_PARAMS, offsetof(voodoo_params_t, zaColor));
+                        addlong(ARM64_SXTH_W(8, 8));
+                        addlong(ARM64_ADD_W(REG_NEW_DEPTH, REG_NEW_DEPTH, 8, SHIFT_LSL, 0));
+                        block_pos = codegen_clamp16_w(code_block, block_pos, REG_NEW_DEPTH, 8);
+                }
+
+                if (depthop == DEPTHOP_NEVER)
+                {
+                        skip_pos[nr_skip++] = block_pos;
+                        addlong(ARM64_B(0));
+                }
+                else if (depthop != DEPTHOP_ALWAYS)
+                {
+                        static const int depth_fail[8] = {0, COND_GE, COND_NE, COND_GT, COND_LE, COND_EQ, COND_LT, 0};
+                        int comp = REG_NEW_DEPTH;
+
+                        addlong(ARM64_LDRH_SXTW(9, REG_AUX_MEM, aux_x));
+                        if (params->fbzMode & FBZ_DEPTH_SOURCE)
+                        {
+                                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_PARAMS, offsetof(voodoo_params_t, zaColor));
+                                addlong(ARM64_UBFX_W(8, 8, 0, 16));
+                                comp = 8;
+                        }
+                        addlong(ARM64_CMP_W(comp, 9));
+                        skip_pos[nr_skip++] = block_pos;
+                        addlong(ARM64_BCOND(depth_fail[depthop], 0));
+                }
+        }
+
+        if (texture)
+        {
+                if ((params->textureMode[0] & TEXTUREMODE_LOCAL_MASK) == TEXTUREMODE_LOCAL || !voodoo->dual_tmus)
+                {
+                        /*TMU0 only sampling local colour or only one TMU, only sample TMU0*/
+                        block_pos = codegen_texture_fetch(code_block, voodoo, params, state, block_pos, 0, V_TEX0);
+                }
+                else if ((params->textureMode[0] & TEXTUREMODE_MASK) == TEXTUREMODE_PASSTHROUGH)
+                {
+                        /*TMU0 in pass-through mode, only sample TMU1*/
+                        block_pos = codegen_texture_fetch(code_block, voodoo, params, state, block_pos, 1, V_TEX0);
+                }
+                else
+                        block_pos = codegen_tmu_fetch_and_blend(code_block, voodoo, params, state, block_pos);
+
+                if (params->fbzMode & FBZ_CHROMAKEY)
+                {
+                        addlong(ARM64_XTN_V4H(5, V_TEX0));
+                        addlong(ARM64_XTN_V8B(5, 5));
+                        addlong(ARM64_UMOV_S(8, 5, 0));
+                        addlong(ARM64_UBFX_W(8, 8, 0, 24));
+                        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 9, REG_PARAMS, offsetof(voodoo_params_t, chromaKey));
+                        addlong(ARM64_CMP_W(8, 9));
+                        skip_pos[nr_skip++] = block_pos;
+                        addlong(ARM64_BCOND(COND_EQ, 0));
+                }
+        }
+        else if (tex_used || trex_init)
+        {
+                /*Texture output is left over from the last textured pixel*/
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_b[0]));
+                addlong(ARM64_INS_S(V_TEX0, 0, 8));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_g[0]));
+                addlong(ARM64_INS_S(V_TEX0, 1, 8));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_r[0]));
+                addlong(ARM64_INS_S(V_TEX0, 2, 8));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_a[0]));
+                addlong(ARM64_INS_S(V_TEX0, 3, 8));
+        }
+
+        if (trex_init)
+        {
+                block_pos = codegen_mov_imm_x(code_block, block_pos, REG_ADDR, (uintptr_t)&voodoo->tmuConfig);
+                addlong(ARM64_LDR_IMM_W(8, REG_ADDR, 0));
+                addlong(ARM64_INS_S(V_TEX0, 0, 8));
+                addlong(ARM64_INS_S(V_TEX0, 1, REG_ZR));
+                addlong(ARM64_INS_S(V_TEX0, 2, REG_ZR));
+        }
+
+        if (texture || trex_init)
+        {
+                /*Keep the texture output in the state, as later triangles
+                  with texturing disabled can still select it*/
+                addlong(ARM64_UMOV_S(8, V_TEX0, 0));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_b[0]));
+                addlong(ARM64_UMOV_S(8, V_TEX0, 1));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_g[0]));
+                addlong(ARM64_UMOV_S(8, V_TEX0, 2));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_r[0]));
+                addlong(ARM64_UMOV_S(8, V_TEX0, 3));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, tex_a[0]));
+        }
+
+        /*V16 = CLAMP(ib, ig, ir, ia >> 12)*/
+        block_pos = codegen_add_offset(code_block, block_pos, REG_ADDR, REG_STATE, offsetof(voodoo_state_t, ib));
+        addlong(ARM64_LD1_V4S(V_ITER, REG_ADDR));
+        addlong(ARM64_SSHR_V4S(V_ITER, V_ITER, 12));
+        block_pos = codegen_clamp_v(code_block, block_pos, V_ITER);
+
+        /*clocal*/
+        if (cc_localselect_override || cc_localselect)
+        {
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_S, 5, REG_PARAMS, offsetof(voodoo_params_t, color0));
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 5, 5);
+        }
+        if (cc_localselect_override)
+        {
+                addlong(ARM64_UMOV_S(8, V_TEX0, 3));
+                addlong(ARM64_MOV_V(V_CLOCAL, V_ITER));
+                addlong(ARM64_TBZ(8, 7, 2));
+                addlong(ARM64_MOV_V(V_CLOCAL, 5));
+        }
+        else
+                addlong(ARM64_MOV_V(V_CLOCAL, cc_localselect ? 5 : V_ITER));
+
+        /*W10 = alocal*/
+        switch (cca_localselect)
+        {
+                case CCA_LOCALSELECT_ITER_A:
+                addlong(ARM64_UMOV_S(10, V_ITER, 3));
+                break;
+
+                case CCA_LOCALSELECT_COLOR0:
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDRB, 10, REG_PARAMS, offsetof(voodoo_params_t, color0) + 3);
+                break;
+
+                case CCA_LOCALSELECT_ITER_Z:
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 10, REG_STATE, offsetof(voodoo_state_t, z));
+                addlong(ARM64_ASR_IMM_W(10, 10, 20));
+                block_pos = codegen_clamp_w(code_block, block_pos, 10, 8);
+                break;
+
+                default:
+                addlong(ARM64_MOVZ_W(10, 0xff, 0));
+                break;
+        }
+
+        /*W11 = aother*/
+        switch (a_sel)
+        {
+                case A_SEL_ITER_A:
+                addlong(ARM64_UMOV_S(11, V_ITER, 3));
+                break;
+                case A_SEL_TEX:
+                addlong(ARM64_UMOV_S(11, V_TEX0, 3));
+                addlong(ARM64_UBFX_W(11, 11, 0, 8));
+                break;
+                case A_SEL_COLOR1:
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDRB, 11, REG_PARAMS, offsetof(voodoo_params_t, color1) + 3);
+                break;
+                default:
+                addlong(ARM64_MOV_W(11, REG_ZR));
+                break;
+        }
+
+        /*V4 = other*/
+        if (cc_zero_other)
+                addlong(ARM64_MOV_V(V_SRC, V_ZERO));
+        else
+        {
+                switch (_rgb_sel)
+                {
+                        case CC_LOCALSELECT_ITER_RGB:
+                        addlong(ARM64_MOV_V(V_SRC, V_ITER));
+                        break;
+                        case CC_LOCALSELECT_TEX:
+                        addlong(ARM64_AND_V(V_SRC, V_TEX0, V_FF));
+                        break;
+                        case CC_LOCALSELECT_COLOR1:
+                        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_S, V_SRC, REG_PARAMS, offsetof(voodoo_params_t, color1));
+                        block_pos = codegen_unpack_bytes(code_block, block_pos, V_SRC, V_SRC);
+                        break;
+                        case CC_LOCALSELECT_LFB:
+                        addlong(ARM64_MOV_V(V_SRC, V_ZERO));
+                        break;
+                }
+        }
+        addlong(ARM64_INS_S(V_SRC, 3, cca_zero_other ? REG_ZR : 11));
+
+        if (cc_sub_clocal || cca_sub_clocal)
+        {
+                addlong(ARM64_MOV_V(5, cc_sub_clocal ? V_CLOCAL : V_ZERO));
+                addlong(ARM64_INS_S(5, 3, cca_sub_clocal ? 10 : REG_ZR));
+                addlong(ARM64_SUB_V4S(V_SRC, V_SRC, 5));
+        }
+
+        /*V6 = msel*/
+        switch (cc_mselect)
+        {
+                case CC_MSELECT_CLOCAL:
+                addlong(ARM64_MOV_V(6, V_CLOCAL));
+                break;
+                case CC_MSELECT_AOTHER:
+                addlong(ARM64_DUP_V4S(6, 11));
+                break;
+                case CC_MSELECT_ALOCAL:
+                addlong(ARM64_DUP_V4S(6, 10));
+                break;
+                case CC_MSELECT_TEX:
+                addlong(ARM64_DUP_ELEM_V4S(6, V_TEX0, 3));
+                break;
+                case CC_MSELECT_TEXRGB:
+                addlong(ARM64_MOV_V(6, V_TEX0));
+                break;
+                default:
+                addlong(ARM64_MOV_V(6, V_ZERO));
+                break;
+        }
+        switch (cca_mselect)
+        {
+                case CCA_MSELECT_ALOCAL:
+                case CCA_MSELECT_ALOCAL2:
+                addlong(ARM64_INS_S(6, 3, 10));
+                break;
+                case CCA_MSELECT_AOTHER:
+                addlong(ARM64_INS_S(6, 3, 11));
+                break;
+                case CCA_MSELECT_TEX:
+                addlong(ARM64_INS_ELEM_S(6, 3, V_TEX0, 3));
+                break;
+                default:
+                addlong(ARM64_INS_S(6, 3, REG_ZR));
+                break;
+        }
+        if (!cc_reverse_blend || !cca_reverse_blend)
+        {
+                block_pos = codegen_lane_mask(code_block, block_pos, 5, !cc_reverse_blend, !cca_reverse_blend);
+                addlong(ARM64_EOR_V(6, 6, 5));
+        }
+        addlong(ARM64_ADD_V4S(6, 6, V_ONE));
+        addlong(ARM64_MUL_V4S(V_SRC, V_SRC, 6));
+        addlong(ARM64_SSHR_V4S(V_SRC, V_SRC, 8));
+
+        if (cc_add == CC_ADD_CLOCAL || cc_add == CC_ADD_ALOCAL || cca_add)
+        {
+                if (cc_add == CC_ADD_CLOCAL)
+                        addlong(ARM64_MOV_V(5, V_CLOCAL));
+                else if (cc_add == CC_ADD_ALOCAL)
+                        addlong(ARM64_DUP_V4S(5, 10));
+                else
+                        addlong(ARM64_MOV_V(5, V_ZERO));
+                addlong(ARM64_INS_S(5, 3, cca_add ? 10 : REG_ZR));
+                addlong(ARM64_ADD_V4S(V_SRC, V_SRC, 5));
+        }
+        block_pos = codegen_clamp_v(code_block, block_pos, V_SRC);
+
+        if (cc_invert_output || cca_invert_output)
+        {
+                block_pos = codegen_lane_mask(code_block, block_pos, 5, cc_invert_output, cca_invert_output);
+                addlong(ARM64_EOR_V(V_SRC, V_SRC, 5));
+        }
+
+        if (params->fogMode & FOG_ENABLE)
+        {
+                addlong(ARM64_UMOV_S(13, V_SRC, 3));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_S, 5, REG_PARAMS, offsetof(voodoo_params_t, fogColor));
+                block_pos = codegen_unpack_bytes(code_block, block_pos, 5, 5);
+
+                if (params->fogMode & FOG_CONSTANT)
+                        addlong(ARM64_ADD_V4S(V_SRC, V_SRC, 5));
+                else
+                {
+                        if (params->fogMode & FOG_ADD)
+                                addlong(ARM64_MOV_V(5, V_ZERO));
+                        if (!(params->fogMode & FOG_MULT))
+                                addlong(ARM64_SUB_V4S(5, 5, V_SRC));
+
+                        /*W8 = fog_a*/
+                        switch (params->fogMode & (FOG_Z|FOG_ALPHA))
+                        {
+                                case 0:
+                                addlong(ARM64_UBFX_W(9, REG_W_DEPTH, 10, 6));
+                                block_pos = codegen_add_offset(code_block, block_pos, REG_ADDR, REG_PARAMS, offsetof(voodoo_params_t, fogTable));
+                                addlong(ARM64_ADD_X(REG_ADDR, REG_ADDR, 9, SHIFT_LSL, 1));
+                                addlong(ARM64_LDRB_IMM(8, REG_ADDR, 0));
+                                addlong(ARM64_LDRB_IMM(9, REG_ADDR, 1));
+                                addlong(ARM64_UBFX_W(11, REG_W_DEPTH, 2, 8));
+                                addlong(ARM64_MUL_W(9, 9, 11));
+                                addlong(ARM64_ADD_W(8, 8, 9, SHIFT_ASR, 10));
+                                break;
+                                case FOG_Z:
+                                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, z));
+                                addlong(ARM64_UBFX_W(8, 8, 20, 8));
+                                break;
+                                case FOG_ALPHA:
+                                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, ia));
+                                addlong(ARM64_ASR_IMM_W(8, 8, 12));
+                                block_pos = codegen_clamp_w(code_block, block_pos, 8, 9);
+                                break;
+                                case FOG_W:
+                                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, w));
+                                addlong(ARM64_UBFX_X(8, 8, 32, 8));
+                                break;
+                        }
+                        addlong(ARM64_ADD_IMM_W(8, 8, 1));
+                        addlong(ARM64_DUP_V4S(6, 8));
+                        addlong(ARM64_MUL_V4S(5, 5, 6));
+                        addlong(ARM64_SSHR_V4S(5, 5, 8));
+
+                        if (params->fogMode & FOG_MULT)
+                                addlong(ARM64_MOV_V(V_SRC, 5));
+                        else
+                                addlong(ARM64_ADD_V4S(V_SRC, V_SRC, 5));
+                }
+
+                block_pos = codegen_clamp_v(code_block, block_pos, V_SRC);
+                addlong(ARM64_INS_S(V_SRC, 3, 13));
+        }
+
+        if (params->alphaMode & 1)
+        {
+                int a_ref_val = params->alphaMode >> 24;
+
+                switch (alpha_func)
+                {
+                        case AFUNC_NEVER:
+                        skip_pos[nr_skip++] = block_pos;
+                        addlong(ARM64_B(0));
+                        break;
+                        case AFUNC_ALWAYS:
+                        break;
+                        default:
+                        {
+                                static const int alpha_fail[8] = {0, COND_GE, COND_NE, COND_GT, COND_LE, COND_EQ, COND_LT, 0};
+
+                                addlong(ARM64_UMOV_S(8, V_SRC, 3));
+                                addlong(ARM64_CMP_IMM_W(8, a_ref_val));
+                                skip_pos[nr_skip++] = block_pos;
+                                addlong(ARM64_BCOND(alpha_fail[alpha_func], 0));
+                        }
+                        break;
+                }
+        }
+
+        if (params->alphaMode & (1 << 4))
+        {
+                /*V5 = dest (B, G, R, 0xff)*/
+                addlong(ARM64_LDRH_SXTW(8, REG_FB_MEM, fb_x));
+                addlong(ARM64_UBFX_W(9, 8, 11, 5));
+                addlong(ARM64_LSL_IMM_W(13, 9, 3));
+                addlong(ARM64_ORR_W(9, 13, 9, SHIFT_LSR, 2));
+                addlong(ARM64_UBFX_W(10, 8, 5, 6));
+                addlong(ARM64_LSL_IMM_W(13, 10, 2));
+                addlong(ARM64_ORR_W(10, 13, 10, SHIFT_LSR, 4));
+                addlong(ARM64_UBFX_W(11, 8, 0, 5));
+                addlong(ARM64_LSL_IMM_W(13, 11, 3));
+                addlong(ARM64_ORR_W(11, 13, 11, SHIFT_LSR, 2));
+                addlong(ARM64_DUP_V4S(5, 11));
+                addlong(ARM64_INS_S(5, 1, 10));
+                addlong(ARM64_INS_S(5, 2, 9));
+                addlong(ARM64_MOVZ_W(13, 0xff, 0));
+                addlong(ARM64_INS_S(5, 3, 13));
+
+                /*V7 = src_a, V19 = 255 - src_a*/
+                addlong(ARM64_DUP_ELEM_V4S(7, V_SRC, 3));
+                addlong(ARM64_SUB_V4S(19, V_FF, 7));
+
+                /*V6 = newdest*/
+                switch (dest_afunc)
+                {
+                        case AFUNC_ASRC_ALPHA:
+                        block_pos = codegen_blend_mul(code_block, block_pos, 6, 5, 7);
+                        break;
+                        case AFUNC_A_COLOR:
+                        block_pos = codegen_blend_mul(code_block, block_pos, 6, 5, V_SRC);
+                        break;
+                        case AFUNC_ADST_ALPHA:
+                        case AFUNC_AONE:
+                        addlong(ARM64_MOV_V(6, 5));
+                        break;
+                        case AFUNC_AOMSRC_ALPHA:
+                        block_pos = codegen_blend_mul(code_block, block_pos, 6, 5, 19);
+                        break;
+                        case AFUNC_AOM_COLOR:
+                        addlong(ARM64_SUB_V4S(20, V_FF, V_SRC));
+                        block_pos = codegen_blend_mul(code_block, block_pos, 6, 5, 20);
+                        break;
+                        case AFUNC_ASATURATE:
+                        /*MIN(src_a, 1-dest_a) is always -254 as dest_a is 0xff*/
+                        addlong(ARM64_MOVI_V4S(20, 254));
+                        block_pos = codegen_blend_mul(code_block, block_pos, 6, 5, 20);
+                        addlong(ARM64_NEG_V4S(6, 6));
+                        break;
+                        default:
+                        addlong(ARM64_MOV_V(6, V_ZERO));
+                        break;
+                }
+
+                switch (src_afunc)
+                {
+                        case AFUNC_AZERO:
+                        case AFUNC_AOMDST_ALPHA:
+                        addlong(ARM64_MOV_V(V_SRC, V_ZERO));
+                        break;
+                        case AFUNC_ASRC_ALPHA:
+                        block_pos = codegen_blend_mul(code_block, block_pos, V_SRC, V_SRC, 7);
+                        break;
+                        case AFUNC_A_COLOR:
+                        block_pos = codegen_blend_mul(code_block, block_pos, V_SRC, V_SRC, 5);
+                        break;
+                        case AFUNC_AOMSRC_ALPHA:
+                        block_pos = codegen_blend_mul(code_block, block_pos, V_SRC, V_SRC, 19);
+                        break;
+                        case AFUNC_AOM_COLOR:
+                        addlong(ARM64_SUB_V4S(20, V_FF, 5));
+                        block_pos = codegen_blend_mul(code_block, block_pos, V_SRC, V_SRC, 20);
+                        break;
+                }
+
+                addlong(ARM64_ADD_V4S(V_SRC, V_SRC, 6));
+                block_pos = codegen_clamp_v(code_block, block_pos, V_SRC);
+        }
+
+        if (params->fbzMode & FBZ_RGB_WMASK)
+        {
+                addlong(ARM64_UMOV_S(8, V_SRC, 2));
+                addlong(ARM64_UMOV_S(9, V_SRC, 1));
+                addlong(ARM64_UMOV_S(10, V_SRC, 0));
+
+                if (dither)
+                {
+                        /*W13 = position within the dither matrix*/
+                        if (dither2x2)
+                        {
+                                addlong(ARM64_UBFX_W(13, REG_REAL_Y, 0, 1));
+                                addlong(ARM64_UBFX_W(11, REG_X, 0, 1));
+                                addlong(ARM64_ORR_W(13, 11, 13, SHIFT_LSL, 1));
+                        }
+                        else
+                        {
+                                addlong(ARM64_UBFX_W(13, REG_REAL_Y, 0, 2));
+                                addlong(ARM64_UBFX_W(11, REG_X, 0, 2));
+                                addlong(ARM64_ORR_W(13, 11, 13, SHIFT_LSL, 2));
+                        }
+                        block_pos = codegen_mov_imm_x(code_block, block_pos, 11, dither2x2 ? (uintptr_t)dither_rb2x2 : (uintptr_t)dither_rb);
+                        block_pos = codegen_mov_imm_x(code_block, block_pos, 19, dither2x2 ? (uintptr_t)dither_g2x2 : (uintptr_t)dither_g);
+                        addlong(ARM64_ADD_W(8, 13, 8, SHIFT_LSL, dither2x2 ? 2 : 4));
+                        addlong(ARM64_ADD_W(9, 13, 9, SHIFT_LSL, dither2x2 ? 2 : 4));
+                        addlong(ARM64_ADD_W(10, 13, 10, SHIFT_LSL, dither2x2 ? 2 : 4));
+                        addlong(ARM64_LDRB_REG(8, 11, 8));
+                        addlong(ARM64_LDRB_REG(9, 19, 9));
+                        addlong(ARM64_LDRB_REG(10, 11, 10));
+                }
+                else
+                {
+                        addlong(ARM64_LSR_IMM_W(8, 8, 3));
+                        addlong(ARM64_LSR_IMM_W(9, 9, 2));
+                        addlong(ARM64_LSR_IMM_W(10, 10, 3));
+                }
+
+                addlong(ARM64_ORR_W(10, 10, 9, SHIFT_LSL, 5));
+                addlong(ARM64_ORR_W(10, 10, 8, SHIFT_LSL, 11));
+                addlong(ARM64_STRH_SXTW(10, REG_FB_MEM, fb_x));
+        }
+
+        if ((params->fbzMode & (FBZ_DEPTH_WMASK | FBZ_DEPTH_ENABLE)) == (FBZ_DEPTH_WMASK | FBZ_DEPTH_ENABLE))
+                addlong(ARM64_STRH_SXTW(REG_NEW_DEPTH, REG_AUX_MEM, aux_x));
+
+        for (c = 0; c < nr_skip; c++)
+                codegen_patch_branch(code_block, skip_pos[c], block_pos);
+
+        /*Step iterators*/
+        block_pos = codegen_add_offset(code_block, block_pos, REG_ADDR, REG_STATE, offsetof(voodoo_state_t, ib));
+        block_pos = codegen_add_offset(code_block, block_pos, 9, REG_PARAMS, offsetof(voodoo_params_t, dBdX));
+        addlong(ARM64_LD1_V4S(5, REG_ADDR));
+        addlong(ARM64_LD1_V4S(6, 9));
+        if (state->xdir > 0)
+                addlong(ARM64_ADD_V4S(5, 5, 6));
+        else
+                addlong(ARM64_SUB_V4S(5, 5, 6));
+        addlong(ARM64_ST1_V4S(5, REG_ADDR));
+
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, z));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 9, REG_PARAMS, offsetof(voodoo_params_t, dZdX));
+        if (state->xdir > 0)
+                addlong(ARM64_ADD_W(8, 8, 9, SHIFT_LSL, 0));
+        else
+                addlong(ARM64_SUB_W(8, 8, 9));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, z));
+
+        for (c = 0; c < (voodoo->dual_tmus ? 2 : 1); c++)
+        {
+                block_pos = codegen_add_offset(code_block, block_pos, REG_ADDR, REG_STATE, c ? offsetof(voodoo_state_t, tmu1_s) : offsetof(voodoo_state_t, tmu0_s));
+                block_pos = codegen_add_offset(code_block, block_pos, 9, REG_PARAMS, offsetof(voodoo_params_t, tmu[c].dSdX));
+                addlong(ARM64_LD1_V2D(5, REG_ADDR));
+                addlong(ARM64_LD1_V2D(6, 9));
+                if (state->xdir > 0)
+                        addlong(ARM64_ADD_V2D(5, 5, 6));
+                else
+                        addlong(ARM64_SUB_V2D(5, 5, 6));
+                addlong(ARM64_ST1_V2D(5, REG_ADDR));
+
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, c ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 9, REG_PARAMS, offsetof(voodoo_params_t, tmu[c].dWdX));
+                if (state->xdir > 0)
+                        addlong(ARM64_ADD_X(8, 8, 9, SHIFT_LSL, 0));
+                else
+                        addlong(ARM64_SUB_X(8, 8, 9));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_X, 8, REG_STATE, c ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w));
+        }
+
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 8, REG_STATE, offsetof(voodoo_state_t, w));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_X, 9, REG_PARAMS, offsetof(voodoo_params_t, dWdX));
+        if (state->xdir > 0)
+                addlong(ARM64_ADD_X(8, 8, 9, SHIFT_LSL, 0));
+        else
+                addlong(ARM64_SUB_X(8, 8, 9));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_STR_X, 8, REG_STATE, offsetof(voodoo_state_t, w));
+
+        block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, pixel_count));
+        addlong(ARM64_ADD_IMM_W(8, 8, 1));
+        block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, pixel_count));
+
+        if (texture)
+        {
+                block_pos = codegen_ldst(code_block, block_pos, LDST_LDR_W, 8, REG_STATE, offsetof(voodoo_state_t, texel_count));
+                if ((params->textureMode[0] & TEXTUREMODE_MASK) == TEXTUREMODE_PASSTHROUGH ||
+                    (params->textureMode[0] & TEXTUREMODE_LOCAL_MASK) == TEXTUREMODE_LOCAL)
+                        addlong(ARM64_ADD_IMM_W(8, 8, 1));
+                else
+                        addlong(ARM64_ADD_IMM_W(8, 8, 2));
+                block_pos = codegen_ldst(code_block, block_pos, LDST_STR_W, 8, REG_STATE, offsetof(voodoo_state_t, texel_count));
+        }
+
+        addlong(ARM64_CMP_W(REG_X, REG_X2));
+        if (state->xdir > 0)
+                addlong(ARM64_ADD_IMM_W(REG_X, REG_X, 1));
+        else
+                addlong(ARM64_SUB_IMM_W(REG_X, REG_X, 1));
+        c = loop_pos - block_pos;
+        addlong(ARM64_BCOND(COND_NE, c));
+
+        addlong(ARM64_LDP_POSTIDX_X(19, 20, REG_SP, 16));
+        addlong(ARM64_LDP_POSTIDX_X(21, 22, REG_SP, 16));
+        addlong(ARM64_LDP_POSTIDX_X(23, 24, REG_SP, 16));
+        addlong(ARM64_RET);
+}
+
+int voodoo_recomp = 0;
+static inline void *voodoo_get_block(voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int odd_even)
+{
+        int c;
+        int b = last_block[odd_even];
+        voodoo_arm64_data_t *voodoo_arm64_data = voodoo->codegen_data;
+        voodoo_arm64_data_t *data;
+
+        for (c = 0; c < 8; c++)
+        {
+                data = &voodoo_arm64_data[odd_even + c*VOODOO_MAX_RENDER_THREADS];
+
+                if (state->xdir == data->xdir &&
+                    params->alphaMode == data->alphaMode &&
+                    params->fbzMode == data->fbzMode &&
+                    params->fogMode == data->fogMode &&
+                    params->fbzColorPath == data->fbzColorPath &&
+                    (voodoo->trexInit1[0] & (1 << 18)) == data->trexInit1 &&
+                    params->textureMode[0] == data->textureMode[0] &&
+                    params->textureMode[1] == data->textureMode[1] &&
+                    (params->tLOD[0] & LOD_MASK) == data->tLOD[0] &&
+                    (params->tLOD[1] & LOD_MASK) == data->tLOD[1] &&
+                    ((params->col_tiled || params->aux_tiled) ? 1 : 0) == data->is_tiled)
+                {
+                        last_block[odd_even] = b;
+                        return data->code_block;
+                }
+
+                b = (b + 1) & 7;
+        }
+voodoo_recomp++;
+        data = &voodoo_arm64_data[odd_even + next_block_to_write[odd_even]*VOODOO_MAX_RENDER_THREADS];
+
+#if defined(__APPLE__) && defined(MAP_JIT)
+        pthread_jit_write_protect_np(0);
+#endif
+        voodoo_generate(data->code_block, voodoo, params, state, depth_op);
+#if defined(__APPLE__) && defined(MAP_JIT)
+        pthread_jit_write_protect_np(1);
+#endif
+#if _WIN32
+        FlushInstructionCache(GetCurrentProcess(), data->code_block, sizeof(data->code_block));
+#else
+        __builtin___clear_cache((char *)data->code_block, (char *)&data->code_block[BLOCK_SIZE / 4]);
+#endif
+
+        data->xdir = state->xdir;
+        data->alphaMode = params->alphaMode;
+        data->fbzMode = params->fbzMode;
+        data->fogMode = params->fogMode;
+        data->fbzColorPath = params->fbzColorPath;
+        data->trexInit1 = voodoo->trexInit1[0] & (1 << 18);
+        data->textureMode[0] = params->textureMode[0];
+        data->textureMode[1] = params->textureMode[1];
+        data->tLOD[0] = params->tLOD[0] & LOD_MASK;
+        data->tLOD[1] = params->tLOD[1] & LOD_MASK;
+        data->is_tiled = (params->col_tiled || params->aux_tiled) ? 1 : 0;
+
+        next_block_to_write[odd_even] = (next_block_to_write[odd_even] + 1) & 7;
+
+        return data->code_block;
+}
+
+void voodoo_codegen_init(voodoo_t *voodoo)
+{
+#if _WIN32
+        voodoo->codegen_data = VirtualAlloc(NULL, sizeof(voodoo_arm64_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+#elif defined(__APPLE__) && defined(MAP_JIT)
+        voodoo->codegen_data = mmap(0, sizeof(voodoo_arm64_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_ANON|MAP_PRIVATE|MAP_JIT, -1, 0);
+#else
+        voodoo->codegen_data = mmap(0, sizeof(voodoo_arm64_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_ANON|MAP_PRIVATE, -1, 0);
+#endif
+}
+
+void voodoo_codegen_close(voodoo_t *voodoo)
+{
+#if _WIN32
+        VirtualFree(voodoo->codegen_data, 0, MEM_RELEASE);
+#else
+        munmap(voodoo->codegen_data, sizeof(voodoo_arm64_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS);
+#endif
+}
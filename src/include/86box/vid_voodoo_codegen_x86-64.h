@@ -39,8 +39,8 @@ typedef struct voodoo_x86_data_t
 
 //static voodoo_x86_data_t voodoo_x86_data[2][BLOCK_NUM];
 
-static int last_block[4] = {0, 0};
-static int next_block_to_write[4] = {0, 0};
+static int last_block[VOODOO_MAX_RENDER_THREADS];
+static int next_block_to_write[VOODOO_MAX_RENDER_THREADS];
 
 #define addbyte(val)                                            \
         do {                                                    \
@@ -88,31 +88,42 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
 {
         if (params->textureMode[tmu] & 1)
         {
-                addbyte(0x48); /*MOV RBX, state->tmu0_s*/
+                /*_w = (1 << 48) / w, unsigned, and 0 if w is 0*/
+                addbyte(0x31); /*XOR EAX, EAX*/
+                addbyte(0xc0);
+                addbyte(0x31); /*XOR EDX, EDX*/
+                addbyte(0xd2);
+                addbyte(0x48); /*MOV RCX, state->tmu_w*/
                 addbyte(0x8b);
-                addbyte(0x9f);
-                addlong(tmu ? offsetof(voodoo_state_t, tmu1_s) : offsetof(voodoo_state_t, tmu0_s));
+                addbyte(0x8f);
+                addlong(tmu ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w));
+                addbyte(0x48); /*TEST RCX, RCX*/
+                addbyte(0x85);
+                addbyte(0xc9);
+                addbyte(0x74); /*JZ +*/
+                addbyte(13);
                 addbyte(0x48); /*MOV RAX, (1 << 48)*/
                 addbyte(0xb8);
                 addquad(1ULL << 48);
-                addbyte(0x48); /*XOR RDX, RDX*/
-                addbyte(0x31);
-                addbyte(0xd2);
+                addbyte(0x48); /*DIV RCX*/
+                addbyte(0xf7);
+                addbyte(0xf1);
+                addbyte(0x48); /*MOV RBX, state->tmu0_s*/
+                addbyte(0x8b);
+                addbyte(0x9f);
+                addlong(tmu ? offsetof(voodoo_state_t, tmu1_s) : offsetof(voodoo_state_t, tmu0_s));
                 addbyte(0x48); /*MOV RCX, state->tmu0_t*/
                 addbyte(0x8b);
                 addbyte(0x8f);
                 addlong(tmu ? offsetof(voodoo_state_t, tmu1_t) : offsetof(voodoo_state_t, tmu0_t));
-                addbyte(0x48); /*CMP state->tmu_w, 0*/
-                addbyte(0x83);
-                addbyte(0xbf);
-                addlong(tmu ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w));
-                addbyte(0);
-                addbyte(0x74); /*JZ +*/
-                addbyte(7);
-                addbyte(0x48); /*IDIV state->tmu_w*/
-                addbyte(0xf7);
-                addbyte(0xbf);
-                addlong(tmu ? offsetof(voodoo_state_t, tmu1_w) : offsetof(voodoo_state_t, tmu0_w));
+                addbyte(0x48); /*ADD RBX, 1 << 13*/
+                addbyte(0x81);
+                addbyte(0xc3);
+                addlong(1 << 13);
+                addbyte(0x48); /*ADD RCX, 1 << 13*/
+                addbyte(0x81);
+                addbyte(0xc1);
+                addlong(1 << 13);
                 addbyte(0x48); /*SAR RBX, 14*/
                 addbyte(0xc1);
                 addbyte(0xfb);
@@ -129,6 +140,14 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0x0f);
                 addbyte(0xaf);
                 addbyte(0xc8);
+                addbyte(0x48); /*ADD RBX, 1 << 29*/
+                addbyte(0x81);
+                addbyte(0xc3);
+                addlong(1 << 29);
+                addbyte(0x48); /*ADD RCX, 1 << 29*/
+                addbyte(0x81);
+                addbyte(0xc1);
+                addlong(1 << 29);
                 addbyte(0x48); /*SAR RBX, 30*/
                 addbyte(0xc1);
                 addbyte(0xfb);
@@ -137,6 +156,16 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0xc1);
                 addbyte(0xf9);
                 addbyte(30);
+                addbyte(0x89); /*MOV state->tex_s, EBX*/
+                addbyte(0x9f);
+                addlong(offsetof(voodoo_state_t, tex_s));
+                addbyte(0x89); /*MOV state->tex_t, ECX*/
+                addbyte(0x8f);
+                addlong(offsetof(voodoo_state_t, tex_t));
+                /*EAX = fastlog(_w) - (19 << 8)*/
+                addbyte(0x48); /*MOV RBX, RAX*/
+                addbyte(0x89);
+                addbyte(0xc3);
                 addbyte(0x48); /*BSR EDX, RAX*/
                 addbyte(0x0f);
                 addbyte(0xbd);
@@ -145,9 +174,6 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0xc1);
                 addbyte(0xe0);
                 addbyte(8);
-                addbyte(0x89); /*MOV state->tex_t, ECX*/
-                addbyte(0x8f);
-                addlong(offsetof(voodoo_state_t, tex_t));
                 addbyte(0x89); /*MOV ECX, EDX*/
                 addbyte(0xd1);
                 addbyte(0x83); /*SUB EDX, 19*/
@@ -161,9 +187,6 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(8);
                 addbyte(0x25); /*AND EAX, 0xff*/
                 addlong(0xff);
-                addbyte(0x89); /*MOV state->tex_s, EBX*/
-                addbyte(0x9f);
-                addlong(offsetof(voodoo_state_t, tex_s));
                 addbyte(0x41); /*MOVZX EAX, R9(logtable)[RAX]*/
                 addbyte(0x0f);
                 addbyte(0xb6);
@@ -171,29 +194,17 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0x01);
                 addbyte(0x09); /*OR EAX, EDX*/
                 addbyte(0xd0);
+                addbyte(0x48); /*TEST RBX, RBX*/
+                addbyte(0x85);
+                addbyte(0xdb);
+                addbyte(0xba); /*MOV EDX, fastlog(0) - (19 << 8)*/
+                addlong(0x80000000 - (19 << 8));
+                addbyte(0x0f); /*CMOVZ EAX, EDX*/
+                addbyte(0x44);
+                addbyte(0xc2);
                 addbyte(0x03); /*ADD EAX, state->lod*/
                 addbyte(0x87);
                 addlong(offsetof(voodoo_state_t, tmu[tmu].lod));
-                addbyte(0x3b); /*CMP EAX, state->lod_min*/
-                addbyte(0x87);
-                addlong(offsetof(voodoo_state_t, lod_min[tmu]));
-                addbyte(0x0f); /*CMOVL EAX, state->lod_min*/
-                addbyte(0x4c);
-                addbyte(0x87);
-                addlong(offsetof(voodoo_state_t, lod_min[tmu]));
-                addbyte(0x3b); /*CMP EAX, state->lod_max*/
-                addbyte(0x87);
-                addlong(offsetof(voodoo_state_t, lod_max[tmu]));
-                addbyte(0x0f); /*CMOVNL EAX, state->lod_max*/
-                addbyte(0x4d);
-                addbyte(0x87);
-                addlong(offsetof(voodoo_state_t, lod_max[tmu]));
-                addbyte(0xc1); /*SHR EAX, 8*/
-                addbyte(0xe8);
-                addbyte(8);        
-                addbyte(0x89); /*MOV state->lod, EAX*/
-                addbyte(0x87);
-                addlong(offsetof(voodoo_state_t, lod));
         }
         else
         {
@@ -209,9 +220,6 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0xc1);
                 addbyte(0xe8);
                 addbyte(28);
-                addbyte(0x8b); /*MOV EBX, state->lod_min*/
-                addbyte(0x9f);
-                addlong(offsetof(voodoo_state_t, lod_min[tmu]));
                 addbyte(0x48); /*SHR RCX, 28*/
                 addbyte(0xc1);
                 addbyte(0xe9);
@@ -220,27 +228,58 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 addbyte(0x89);
                 addbyte(0x87);
                 addlong(offsetof(voodoo_state_t, tex_s));
-                addbyte(0xc1); /*SHR EBX, 8*/
-                addbyte(0xeb);
-                addbyte(8);        
                 addbyte(0x48); /*MOV state->tex_t, RCX*/
                 addbyte(0x89);
                 addbyte(0x8f);
                 addlong(offsetof(voodoo_state_t, tex_t));
-                addbyte(0x89); /*MOV state->lod, EBX*/
-                addbyte(0x9f);
-                addlong(offsetof(voodoo_state_t, lod));
+                addbyte(0x8b); /*MOV EAX, state->lod*/
+                addbyte(0x87);
+                addlong(offsetof(voodoo_state_t, tmu[tmu].lod));
         }
-
+        /*Clamp LOD to [lod_min, lod_max], checking lod_min first, and
+          split it into integer and fraction*/
+        addbyte(0x89); /*MOV EBX, EAX*/
+        addbyte(0xc3);
+        addbyte(0x3b); /*CMP EAX, state->lod_max*/
+        addbyte(0x87);
+        addlong(offsetof(voodoo_state_t, lod_max[tmu]));
+        addbyte(0x0f); /*CMOVG EAX, state->lod_max*/
+        addbyte(0x4f);
+        addbyte(0x87);
+        addlong(offsetof(voodoo_state_t, lod_max[tmu]));
+        addbyte(0x3b); /*CMP EBX, state->lod_min*/
+        addbyte(0x9f);
+        addlong(offsetof(voodoo_state_t, lod_min[tmu]));
+        addbyte(0x0f); /*CMOVL EAX, state->lod_min*/
+        addbyte(0x4c);
+        addbyte(0x87);
+        addlong(offsetof(voodoo_state_t, lod_min[tmu]));
+        addbyte(0x0f); /*MOVZX EBX, AL*/
+        addbyte(0xb6);
+        addbyte(0xd8);
+        addbyte(0xc1); /*SHR EAX, 8*/
+        addbyte(0xe8);
+        addbyte(8);
+        addbyte(0x89); /*MOV state->lod_frac[tmu], EBX*/
+        addbyte(0x9f);
+        addlong(offsetof(voodoo_state_t, lod_frac[tmu]));
+        addbyte(0x89); /*MOV state->lod, EAX*/
+        addbyte(0x87);
+        addlong(offsetof(voodoo_state_t, lod));
+        /*EAX = state->lod*/
         if (params->fbzColorPath & FBZCP_TEXTURE_ENABLED)
         {
                 if (voodoo->bilinear_enabled && (params->textureMode[tmu] & 6))
                 {
+                        addbyte(0x48); /*MOV RCX, state->tex_lod[tmu]*/
+                        addbyte(0x8b);
+                        addbyte(0x8f);
+                        addlong(offsetof(voodoo_state_t, tex_lod[tmu]));
                         addbyte(0xb2); /*MOV DL, 8*/
                         addbyte(8);
-                        addbyte(0x8b); /*MOV ECX, state->lod[RDI]*/
-                        addbyte(0x8f);
-                        addlong(offsetof(voodoo_state_t, lod));
+                        addbyte(0x8b); /*MOV ECX, [RCX+RAX*4]*/
+                        addbyte(0x0c);
+                        addbyte(0x81);
                         addbyte(0xbd); /*MOV EBP, 1*/
                         addlong(1);
                         addbyte(0x28); /*SUB DL, CL*/
@@ -567,16 +606,24 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                 }
                 else
                 {
+                        addbyte(0x48); /*MOV RCX, state->tex_lod[tmu]*/
+                        addbyte(0x8b);
+                        addbyte(0x8f);
+                        addlong(offsetof(voodoo_state_t, tex_lod[tmu]));
                         addbyte(0xb2); /*MOV DL, 8*/
                         addbyte(8);
-                        addbyte(0x8b); /*MOV ECX, state->lod[RDI]*/
-                        addbyte(0x8f);
-                        addlong(offsetof(voodoo_state_t, lod));
-                        addbyte(0x48); /*MOV RBP, state->tex[RDI+RCX*8]*/
+                        addbyte(0x48); /*MOV RBP, state->tex[RDI+RAX*8]*/
                         addbyte(0x8b);
                         addbyte(0xac);
-                        addbyte(0xcf);
+                        addbyte(0xc7);
                         addlong(offsetof(voodoo_state_t, tex[tmu]));
+                        addbyte(0x8b); /*MOV ECX, [RCX+RAX*4]*/
+                        addbyte(0x0c);
+                        addbyte(0x81);
+                        addbyte(0x4c); /*LEA R8, [RSI+RAX*4]*/
+                        addbyte(0x8d);
+                        addbyte(0x04);
+                        addbyte(0x86);
                         addbyte(0x28); /*SUB DL, CL*/
                         addbyte(0xca);
                         addbyte(0x80); /*ADD CL, 4*/
@@ -607,10 +654,10 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                                 addbyte(0xf7); /*NOT EBX*/
                                 addbyte(0xd3);
                         }
-                        addbyte(0xd3); /*SHR EAX, CL*/
-                        addbyte(0xe8);
-                        addbyte(0xd3); /*SHR EBX, CL*/
-                        addbyte(0xeb);
+                        addbyte(0xd3); /*SAR EAX, CL*/
+                        addbyte(0xf8);
+                        addbyte(0xd3); /*SAR EBX, CL*/
+                        addbyte(0xfb);
                         if (state->clamp_s[tmu])
                         {
                                 addbyte(0x85); /*TEST EAX, EAX*/
@@ -619,23 +666,23 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                                 addbyte(0x0f);
                                 addbyte(0x48);
                                 addbyte(0x02);
-                                addbyte(0x3b); /*CMP EAX, params->tex_w_mask[ESI+ECX*4]*/
-                                addbyte(0x84);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]) - 0x10);
-                                addbyte(0x0f); /*CMOVAE EAX, params->tex_w_mask[ESI+ECX*4]*/
+                                addbyte(0x41); /*CMP EAX, params->tex_w_mask[R8]*/
+                                addbyte(0x3b);
+                                addbyte(0x80);
+                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]));
+                                addbyte(0x41); /*CMOVAE EAX, params->tex_w_mask[R8]*/
+                                addbyte(0x0f);
                                 addbyte(0x43);
-                                addbyte(0x84);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]) - 0x10);
+                                addbyte(0x80);
+                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]));
 
                         }
                         else
                         {
-                                addbyte(0x23); /*AND EAX, params->tex_w_mask-0x10[ESI+ECX*4]*/
-                                addbyte(0x84);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]) - 0x10);
+                                addbyte(0x41); /*AND EAX, params->tex_w_mask[R8]*/
+                                addbyte(0x23);
+                                addbyte(0x80);
+                                addlong(offsetof(voodoo_params_t, tex_w_mask[tmu]));
                         }
                         if (state->clamp_t[tmu])
                         {
@@ -645,22 +692,22 @@ static inline int codegen_texture_fetch(uint8_t *code_block, voodoo_t *voodoo, v
                                 addbyte(0x0f);
                                 addbyte(0x48);
                                 addbyte(0x1a);
-                                addbyte(0x3b); /*CMP EBX, params->tex_h_mask[ESI+ECX*4]*/
-                                addbyte(0x9c);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]) - 0x10);
-                                addbyte(0x0f); /*CMOVAE EBX, params->tex_h_mask[ESI+ECX*4]*/
+                                addbyte(0x41); /*CMP EBX, params->tex_h_mask[R8]*/
+                                addbyte(0x3b);
+                                addbyte(0x98);
+                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]));
+                                addbyte(0x41); /*CMOVAE EBX, params->tex_h_mask[R8]*/
+                                addbyte(0x0f);
                                 addbyte(0x43);
-                                addbyte(0x9c);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]) - 0x10);
+                                addbyte(0x98);
+                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]));
                         }
                         else
                         {
-                                addbyte(0x23); /*AND EBX, params->tex_h_mask-0x10[ESI+ECX*4]*/
-                                addbyte(0x9c);
-                                addbyte(0x8e);
-                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]) - 0x10);
+                                addbyte(0x41); /*AND EBX, params->tex_h_mask[R8]*/
+                                addbyte(0x23);
+                                addbyte(0x98);
+                                addlong(offsetof(voodoo_params_t, tex_h_mask[tmu]));
                         }
                         addbyte(0x88); /*MOV CL, DL*/
                         addbyte(0xd1);
@@ -915,11 +962,27 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
 
         if (params->fbzMode & FBZ_DEPTH_BIAS)
         {
-                addbyte(0x03); /*ADD EAX, params->zaColor[ESI]*/
-                addbyte(0x86);
-                addlong(offsetof(voodoo_params_t, zaColor));                
-                addbyte(0x25); /*AND EAX, 0xffff*/
-                addlong(0xffff);
+                addbyte(0x0f); /*MOVSX EDX, params->zaColor[ESI]*/
+                addbyte(0xbf);
+                addbyte(0x96);
+                addlong(offsetof(voodoo_params_t, zaColor));
+                if (params->fbzMode & FBZ_W_BUFFER)
+                {
+                        addbyte(0xbb); /*MOV EBX, 0xffff*/
+                        addlong(0xffff);
+                        addbyte(0x31); /*XOR ECX, ECX*/
+                        addbyte(0xc9);
+                }
+                addbyte(0x01); /*ADD EAX, EDX*/
+                addbyte(0xd0);
+                addbyte(0x0f); /*CMOVS EAX, ECX*/
+                addbyte(0x48);
+                addbyte(0xc1);
+                addbyte(0x39); /*CMP EAX, EBX*/
+                addbyte(0xd8);
+                addbyte(0x0f); /*CMOVA EAX, EBX*/
+                addbyte(0x47);
+                addbyte(0xc3);
         }
 
         addbyte(0x89); /*MOV state->new_depth[EDI], EAX*/
@@ -998,7 +1061,9 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
         }
         else if ((params->fbzMode & FBZ_DEPTH_ENABLE) && (depthop == DEPTHOP_NEVER))
         {
-                addbyte(0xC3); /*RET*/
+                addbyte(0xe9); /*JMP skip*/
+                z_skip_pos = block_pos;
+                addlong(0);
         }
 
         /*XMM0 = colour*/
@@ -1046,7 +1111,7 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 addbyte(0x0f);
                 addbyte(0x6e);
                 addbyte(0xd8);
-                if ((params->textureMode[1] & TEXTUREMODE_TRILINEAR) && tc_sub_clocal_1)
+                if ((params->textureMode[1] & TEXTUREMODE_TRILINEAR) && (tc_sub_clocal_1 || tca_sub_clocal_1))
                 {
                         addbyte(0x8b); /*MOV EAX, state->lod*/
                         addbyte(0x87);
@@ -1177,22 +1242,27 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0x0f);
                         addbyte(0xfd);
                         addbyte(0xc0);
+                        /*Negate before multiplying, so the shift rounds down*/
                         addbyte(0xf3); /*MOVQ XMM1, XMM2*/
                         addbyte(0x0f);
                         addbyte(0x7e);
                         addbyte(0xca);
+                        addbyte(0x66); /*PSUBW XMM1, XMM3*/
+                        addbyte(0x0f);
+                        addbyte(0xf9);
+                        addbyte(0xcb);
                         addbyte(0xf3); /*MOVQ XMM5, XMM0*/
                         addbyte(0x0f);
                         addbyte(0x7e);
                         addbyte(0xe8);
-                        addbyte(0x66); /*PMULLW XMM0, XMM3*/
+                        addbyte(0x66); /*PMULLW XMM0, XMM1*/
                         addbyte(0x0f);
                         addbyte(0xd5);
-                        addbyte(0xc3);
-                        addbyte(0x66); /*PMULHW XMM5, XMM3*/
+                        addbyte(0xc1);
+                        addbyte(0x66); /*PMULHW XMM5, XMM1*/
                         addbyte(0x0f);
                         addbyte(0xe5);
-                        addbyte(0xeb);
+                        addbyte(0xe9);
                         addbyte(0x66); /*PUNPCKLWD XMM0, XMM5*/
                         addbyte(0x0f);
                         addbyte(0x61);
@@ -1206,9 +1276,9 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0x0f);
                         addbyte(0x6b);
                         addbyte(0xc0);
-                        addbyte(0x66); /*PSUBW XMM1, XMM0*/
+                        addbyte(0xf3); /*MOVQ XMM1, XMM0*/
                         addbyte(0x0f);
-                        addbyte(0xf9);
+                        addbyte(0x7e);
                         addbyte(0xc8);
                         if (tc_add_clocal_1)
                         {
@@ -1229,28 +1299,37 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 addbyte(0xfd);
                                 addbyte(0xc8);
                         }
-                        addbyte(0x66); /*PACKUSWB XMM3, XMM1*/
+                        addbyte(0x66); /*PEXTRW EAX, XMM3, 3*/
+                        addbyte(0x0f);
+                        addbyte(0xc5);
+                        addbyte(0xc3);
+                        addbyte(3);
+                        addbyte(0x66); /*PINSRW XMM1, EAX, 3*/
+                        addbyte(0x0f);
+                        addbyte(0xc4);
+                        addbyte(0xc8);
+                        addbyte(3);
+                        addbyte(0x66); /*PACKUSWB XMM1, XMM1*/
                         addbyte(0x0f);
                         addbyte(0x67);
-                        addbyte(0xd9);
-                        if (tca_sub_clocal_1)
-                        {
-                                addbyte(0x66); /*MOVD EBX, XMM3*/
-                                addbyte(0x0f);
-                                addbyte(0x7e);
-                                addbyte(0xdb);
-                        }
-                        addbyte(0x66); /*PUNPCKLBW XMM3, XMM2*/
+                        addbyte(0xc9);
+                        addbyte(0x66); /*PUNPCKLBW XMM1, XMM2*/
                         addbyte(0x0f);
                         addbyte(0x60);
-                        addbyte(0xda);
+                        addbyte(0xca);
+                        addbyte(0xf3); /*MOVQ XMM3, XMM1*/
+                        addbyte(0x0f);
+                        addbyte(0x7e);
+                        addbyte(0xd9);
                 }
 
                 if (tca_sub_clocal_1)
                 {
-                        addbyte(0xc1); /*SHR EBX, 24*/
-                        addbyte(0xeb);
-                        addbyte(24);
+                        addbyte(0x66); /*PEXTRW EBX, XMM3, 3*/
+                        addbyte(0x0f);
+                        addbyte(0xc5);
+                        addbyte(0xdb);
+                        addbyte(3);
                         switch (tca_mselect_1)
                         {
                                 case TCA_MSELECT_ZERO:
@@ -1300,19 +1379,19 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 addbyte(0x8d);
                                 addbyte(0);
                         }
-                        else if (!tc_reverse_blend_1)
+                        else if (!tca_reverse_blend_1)
                         {
                                 addbyte(0x35); /*XOR EAX, 0xff*/
                                 addlong(0xff);
                         }
-                        addbyte(0x8e); /*ADD EAX, 1*/
+                        addbyte(0x83); /*ADD EAX, 1*/
                         addbyte(0xc0);
                         addbyte(1);
                         addbyte(0x0f); /*IMUL EAX, EBX*/
                         addbyte(0xaf);
                         addbyte(0xc3);
-                        addbyte(0xb9); /*MOV ECX, 0xff*/
-                        addlong(0xff);
+                        addbyte(0x31); /*XOR EDX, EDX*/
+                        addbyte(0xd2);
                         addbyte(0xf7); /*NEG EAX*/
                         addbyte(0xd8);
                         addbyte(0xc1); /*SAR EAX, 8*/
@@ -1323,11 +1402,16 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 addbyte(0x01); /*ADD EAX, EBX*/
                                 addbyte(0xd8);
                         }
-                        addbyte(0x39); /*CMP ECX, EAX*/
-                        addbyte(0xc1);
-                        addbyte(0x0f); /*CMOVA ECX, EAX*/
+                        addbyte(0x0f); /*CMOVS EAX, EDX*/
+                        addbyte(0x48);
+                        addbyte(0xc2);
+                        addbyte(0xba); /*MOV EDX, 0xff*/
+                        addlong(0xff);
+                        addbyte(0x3d); /*CMP EAX, 0xff*/
+                        addlong(0xff);
+                        addbyte(0x0f); /*CMOVA EAX, EDX*/
                         addbyte(0x47);
-                        addbyte(0xc8);
+                        addbyte(0xc2);
                         addbyte(0x66); /*PINSRW 3, XMM3, XMM0*/
                         addbyte(0x0f);
                         addbyte(0xc4);
@@ -1559,17 +1643,9 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0xff);
                         addbyte(0x66); /*PADDW XMM1, XMM4*/
                         addbyte(0x0f);
-                        addbyte(0xfc);
+                        addbyte(0xfd);
                         addbyte(0xcc);
                 }
-                if (tc_invert_output)
-                {
-                        addbyte(0x66); /*PXOR XMM1, XMM9(xmm_ff_w)*/
-                        addbyte(0x41);
-                        addbyte(0x0f);
-                        addbyte(0xef);
-                        addbyte(0xc9);
-                }
         
                 addbyte(0x66); /*PACKUSWB XMM0, XMM0*/
                 addbyte(0x0f);
@@ -1583,6 +1659,14 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 addbyte(0x0f);
                 addbyte(0x67);
                 addbyte(0xc9);
+                if (tc_invert_output)
+                {
+                        addbyte(0x66); /*PXOR XMM1, XMM10(xmm_ff_b)*/
+                        addbyte(0x41);
+                        addbyte(0x0f);
+                        addbyte(0xef);
+                        addbyte(0xca);
+                }
         
                 if (tca_zero_other)
                 {
@@ -1638,16 +1722,16 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(24);
                         break;
                         case TCA_MSELECT_DETAIL:
-                        addbyte(0xbb); /*MOV EBX, params->detail_bias[1]*/
-                        addlong(params->detail_bias[1]);
+                        addbyte(0xbb); /*MOV EBX, params->detail_bias[0]*/
+                        addlong(params->detail_bias[0]);
                         addbyte(0x2b); /*SUB EBX, state->lod*/
                         addbyte(0x9f);
                         addlong(offsetof(voodoo_state_t, lod));
-                        addbyte(0xba); /*MOV EDX, params->detail_max[1]*/
-                        addlong(params->detail_max[1]);
-                        addbyte(0xc1); /*SHL EBX, params->detail_scale[1]*/
+                        addbyte(0xba); /*MOV EDX, params->detail_max[0]*/
+                        addlong(params->detail_max[0]);
+                        addbyte(0xc1); /*SHL EBX, params->detail_scale[0]*/
                         addbyte(0xe3);
-                        addbyte(params->detail_scale[1]);
+                        addbyte(params->detail_scale[0]);
                         addbyte(0x39); /*CMP EBX, EDX*/
                         addbyte(0xd3);
                         addbyte(0x0f); /*CMOVNL EBX, EDX*/
@@ -1723,13 +1807,6 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 addbyte(0x7e);
                 addbyte(0xc1);
         }
-        if (cc_mselect == CC_MSELECT_TEXRGB)
-        {
-                addbyte(0xf3); /*MOVD XMM4, XMM0*/
-                addbyte(0x0f);
-                addbyte(0x7e);
-                addbyte(0xe0);
-        }
 
         if ((params->fbzMode & FBZ_CHROMAKEY))
         {
@@ -1761,7 +1838,15 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 addbyte(0xc0);
         }
 
-        if (params->alphaMode & ((1 << 0) | (1 << 4)))
+        if (cc_mselect == CC_MSELECT_TEXRGB)
+        {
+                addbyte(0xf3); /*MOVD XMM4, XMM0*/
+                addbyte(0x0f);
+                addbyte(0x7e);
+                addbyte(0xe0);
+        }
+
+        if ((params->alphaMode & ((1 << 0) | (1 << 4))) || (!(cc_mselect == 0 && cc_reverse_blend == 0) && (cc_mselect == CC_MSELECT_AOTHER || cc_mselect == CC_MSELECT_ALOCAL)) || cc_add == CC_ADD_ALOCAL)
         {
                 /*EBX = a_other*/
                 switch (a_sel)
@@ -1926,7 +2011,6 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 {
                         addbyte(0xf6); /*TEST state->tex_a, 0x80*/
                         addbyte(0x87);
-                        addbyte(0x23);
                         addlong(offsetof(voodoo_state_t, tex_a));
                         addbyte(0x80);
                         addbyte(0x74);/*JZ !cc_localselect*/
@@ -2085,8 +2169,8 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0x0f); /*IMUL EDX, EAX*/
                         addbyte(0xaf);
                         addbyte(0xd0);
-                        addbyte(0xc1); /*SHR EDX, 8*/
-                        addbyte(0xea);
+                        addbyte(0xc1); /*SAR EDX, 8*/
+                        addbyte(0xfa);
                         addbyte(8);
                 }
         }
@@ -2099,11 +2183,11 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
         
         if (!(cc_mselect == 0 && cc_reverse_blend == 0) && cc_mselect == CC_MSELECT_AOTHER)
         {
-                /*Copy a_other to XMM3 before it gets modified*/
-                addbyte(0x66); /*MOVD XMM3, EDX*/
+                /*Copy a_other to XMM3*/
+                addbyte(0x66); /*MOVD XMM3, EBX*/
                 addbyte(0x0f);
                 addbyte(0x6e);
-                addbyte(0xda);
+                addbyte(0xdb);
                 addbyte(0xf2); /*PSHUFLW XMM3, XMM3, 0*/
                 addbyte(0x0f);
                 addbyte(0x70);
@@ -2254,6 +2338,22 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                 addbyte(0xfd);
                 addbyte(0xc1);
         }
+        else if (cc_add == CC_ADD_ALOCAL)
+        {
+                addbyte(0x66); /*MOVD XMM3, ECX*/
+                addbyte(0x0f);
+                addbyte(0x6e);
+                addbyte(0xd9);
+                addbyte(0xf2); /*PSHUFLW XMM3, XMM3, 0*/
+                addbyte(0x0f);
+                addbyte(0x70);
+                addbyte(0xdb);
+                addbyte(0x00);
+                addbyte(0x66); /*PADDW XMM0, XMM3*/
+                addbyte(0x0f);
+                addbyte(0xfd);
+                addbyte(0xc3);
+        }
 
         addbyte(0x66); /*PACKUSWB XMM0, XMM0*/
         addbyte(0x0f);
@@ -2318,13 +2418,6 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 addbyte(0xd8);
                         }
 
-                        /*Divide by 2 to prevent overflow on multiply*/
-                        addbyte(0x66); /*PSRAW XMM3, 1*/
-                        addbyte(0x0f);
-                        addbyte(0x71);
-                        addbyte(0xe3);
-                        addbyte(1);
-
                         switch (params->fogMode & (FOG_Z|FOG_ALPHA))
                         {
                                 case 0:
@@ -2368,9 +2461,9 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 addbyte(0x8b); /*MOV EAX, state->z[EDI]*/
                                 addbyte(0x87);
                                 addlong(offsetof(voodoo_state_t, z));
-                                addbyte(0xc1); /*SHR EAX, 12*/
+                                addbyte(0xc1); /*SHR EAX, 20*/
                                 addbyte(0xe8);
-                                addbyte(12);
+                                addbyte(20);
                                 addbyte(0x25); /*AND EAX, 0xff*/
                                 addlong(0xff);
 //                                fog_a = (z >> 20) & 0xff;
@@ -2399,41 +2492,52 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                                 break;
                                 
                                 case FOG_W:
-                                addbyte(0x8b); /*MOV EAX, state->w[EDI]+4*/
+                                addbyte(0x0f); /*MOVZX EAX, state->w[EDI]+4*/
+                                addbyte(0xb6);
                                 addbyte(0x87);
                                 addlong(offsetof(voodoo_state_t, w)+4);
-                                addbyte(0x31); /*XOR EBX, EBX*/
-                                addbyte(0xdb);
-                                addbyte(0x09); /*OR EAX, EAX*/
-                                addbyte(0xc0);
-                                addbyte(0x0f); /*CMOVS EAX, EBX*/
-                                addbyte(0x48);
-                                addbyte(0xc3);
-                                addbyte(0xbb); /*MOV EBX, 0xff*/
-                                addlong(0xff);
-                                addbyte(0x3d); /*CMP EAX, 0xff*/
-                                addlong(0xff);
-                                addbyte(0x0f); /*CMOVAE EAX, EBX*/
-                                addbyte(0x43);
-                                addbyte(0xc3);
-//                                fog_a = CLAMP(w >> 32);
+//                                fog_a = CLAMP((w >> 32) & 0xff);
                                 break;
                         }
-                        addbyte(0x01); /*ADD EAX, EAX*/
+                        addbyte(0x83); /*ADD EAX, 1*/
                         addbyte(0xc0);
+                        addbyte(1);
+//                        fog_a++;
 
-                        addbyte(0x66); /*PMULLW XMM3, alookup+4[EAX*8]*/
-                        addbyte(0x41);
+                        addbyte(0x66); /*MOVD XMM5, EAX*/
+                        addbyte(0x0f);
+                        addbyte(0x6e);
+                        addbyte(0xe8);
+                        addbyte(0xf2); /*PSHUFLW XMM5, XMM5, 0*/
+                        addbyte(0x0f);
+                        addbyte(0x70);
+                        addbyte(0xed);
+                        addbyte(0);
+                        addbyte(0xf3); /*MOVQ XMM4, XMM3*/
+                        addbyte(0x0f);
+                        addbyte(0x7e);
+                        addbyte(0xe3);
+                        addbyte(0x66); /*PMULLW XMM3, XMM5*/
                         addbyte(0x0f);
                         addbyte(0xd5);
-                        addbyte(0x5c);
-                        addbyte(0xc2);
-                        addbyte(16);
-                        addbyte(0x66); /*PSRAW XMM3, 7*/
+                        addbyte(0xdd);
+                        addbyte(0x66); /*PMULHW XMM4, XMM5*/
                         addbyte(0x0f);
-                        addbyte(0x71);
+                        addbyte(0xe5);
+                        addbyte(0xe5);
+                        addbyte(0x66); /*PUNPCKLWD XMM3, XMM4*/
+                        addbyte(0x0f);
+                        addbyte(0x61);
+                        addbyte(0xdc);
+                        addbyte(0x66); /*PSRAD XMM3, 8*/
+                        addbyte(0x0f);
+                        addbyte(0x72);
                         addbyte(0xe3);
-                        addbyte(7);
+                        addbyte(8);
+                        addbyte(0x66); /*PACKSSDW XMM3, XMM3*/
+                        addbyte(0x0f);
+                        addbyte(0x6b);
+                        addbyte(0xdb);
 
                         if (params->fogMode & FOG_MULT)
                         {
@@ -2507,7 +2611,9 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
         }
         else if ((params->alphaMode & 1) && (alpha_func == AFUNC_NEVER))
         {
-                addbyte(0xC3); /*RET*/
+                addbyte(0xe9); /*JMP skip*/
+                a_skip_pos = block_pos;
+                addlong(0);
         }
         
         if (params->alphaMode & (1 << 4))
@@ -2703,15 +2809,24 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0xe4);
                         break;
                         case AFUNC_ASATURATE:
+                        /*dest * -254 / 255, worked out unsigned as it overflows a signed word*/
                         addbyte(0x66); /*PMULLW XMM4, XMM11(minus_254)*/
                         addbyte(0x41);
                         addbyte(0x0f);
                         addbyte(0xd5);
                         addbyte(0xe3);
-                        addbyte(0xf3); /*MOVQ XMM5, XMM4*/
+                        addbyte(0xf3); /*MOVQ XMM5, XMM2*/
                         addbyte(0x0f);
                         addbyte(0x7e);
+                        addbyte(0xea);
+                        addbyte(0x66); /*PSUBW XMM5, XMM4*/
+                        addbyte(0x0f);
+                        addbyte(0xf9);
                         addbyte(0xec);
+                        addbyte(0xf3); /*MOVQ XMM4, XMM5*/
+                        addbyte(0x0f);
+                        addbyte(0x7e);
+                        addbyte(0xe5);
                         addbyte(0x66); /*PADDW XMM4, alookup[1*8]*/
                         addbyte(0x41);
                         addbyte(0x0f);
@@ -2732,6 +2847,18 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
                         addbyte(0x71);
                         addbyte(0xd4);
                         addbyte(8);
+                        addbyte(0xf3); /*MOVQ XMM5, XMM2*/
+                        addbyte(0x0f);
+                        addbyte(0x7e);
+                        addbyte(0xea);
+                        addbyte(0x66); /*PSUBW XMM5, XMM4*/
+                        addbyte(0x0f);
+                        addbyte(0xf9);
+                        addbyte(0xec);
+                        addbyte(0xf3); /*MOVQ XMM4, XMM5*/
+                        addbyte(0x0f);
+                        addbyte(0x7e);
+                        addbyte(0xe5);
                 }
 
                 switch (src_afunc)
@@ -3347,7 +3474,7 @@ static inline void *voodoo_get_block(voodoo_t *voodoo, voodoo_params_t *params,
         
         for (c = 0; c < 8; c++)
         {
-                data = &voodoo_x86_data[odd_even + c*4]; //&voodoo_x86_data[odd_even][b];
+                data = &voodoo_x86_data[odd_even + c*VOODOO_MAX_RENDER_THREADS]; //&voodoo_x86_data[odd_even][b];
                 
                 if (state->xdir == data->xdir &&
                     params->alphaMode == data->alphaMode &&
@@ -3368,7 +3495,7 @@ static inline void *voodoo_get_block(voodoo_t *voodoo, voodoo_params_t *params,
                 b = (b + 1) & 7;
         }
 voodoo_recomp++;
-        data = &voodoo_x86_data[odd_even + next_block_to_write[odd_even]*4];
+        data = &voodoo_x86_data[odd_even + next_block_to_write[odd_even]*VOODOO_MAX_RENDER_THREADS];
 //        code_block = data->code_block;
         
         voodoo_generate(data->code_block, voodoo, params, state, depth_op);
@@ -3395,9 +3522,9 @@ void voodoo_codegen_init(voodoo_t *voodoo)
         int c;
 
 #if WIN64
-        voodoo->codegen_data = VirtualAlloc(NULL, sizeof(voodoo_x86_data_t) * BLOCK_NUM * 4, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+        voodoo->codegen_data = VirtualAlloc(NULL, sizeof(voodoo_x86_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
 #else
-        voodoo->codegen_data = mmap(0, sizeof(voodoo_x86_data_t) * BLOCK_NUM*4, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_ANON|MAP_PRIVATE, 0, 0);
+        voodoo->codegen_data = mmap(0, sizeof(voodoo_x86_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_ANON|MAP_PRIVATE, 0, 0);
 #endif
 
         for (c = 0; c < 256; c++)
@@ -3427,7 +3554,7 @@ void voodoo_codegen_close(voodoo_t *voodoo)
 #if WIN64
         VirtualFree(voodoo->codegen_data, 0, MEM_RELEASE);
 #else
-        munmap(voodoo->codegen_data, sizeof(voodoo_x86_data_t) * BLOCK_NUM*4);
+        munmap(voodoo->codegen_data, sizeof(voodoo_x86_data_t) * BLOCK_NUM*VOODOO_MAX_RENDER_THREADS);
 #endif
 }
 
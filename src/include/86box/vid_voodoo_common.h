@@ -28,7 +28,16 @@
 
 #define TEX_DIRTY_SHIFT 10
 
-#define TEX_CACHE_MAX 64
+#define TEX_CACHE_MAX 512 /*Largest selectable texture cache, must be a multiple of 64*/
+#define TEX_CACHE_DATA_SIZE ((256*256 + 256*256 + 128*128 + 64*64 + 32*32 + 16*16 + 8*8 + 4*4 + 2*2) * 4)
+
+#define TEX_HASH_BITS 10
+#define TEX_HASH_SIZE (1 << TEX_HASH_BITS)
+
+/*Texture memory is split into 64kb regions, each with a bitmap of the cache
+  entries that overlap it, so a write only has to check those entries*/
+#define TEX_REGION_SHIFT 16
+#define TEX_REGIONS (1 << (24 - TEX_REGION_SHIFT))
 
 enum
 {
@@ -93,6 +102,8 @@ enum
 #define PARAM_FULL(x)    ((voodoo->params_write_idx - voodoo->params_read_idx[x]) >= PARAM_SIZE)
 #define PARAM_EMPTY(x)   (voodoo->params_read_idx[x] == voodoo->params_write_idx)
 
+#define VOODOO_MAX_RENDER_THREADS 32
+
 typedef struct
 {
         uint32_t addr_type;
@@ -178,11 +189,12 @@ typedef struct texture_t
 {
         uint32_t base;
         uint32_t tLOD;
-        volatile int refcount, refcount_r[4];
+        volatile int refcount, refcount_r[VOODOO_MAX_RENDER_THREADS];
         int is16;
         uint32_t palette_checksum;
         uint32_t addr_start[4], addr_end[4];
         uint32_t *data;
+        int hash_next;
 } texture_t;
 
 typedef struct vert_t
@@ -200,6 +212,12 @@ typedef struct clip_t
         int y_min, y_max;
 } clip_t;
 
+typedef struct voodoo_render_thread_t
+{
+        struct voodoo_t *voodoo;
+        int odd_even;
+} voodoo_render_thread_t;
+
 typedef struct voodoo_t
 {
         mem_mapping_t mapping;
@@ -273,21 +291,22 @@ typedef struct voodoo_t
         int ncc_dirty[2];
 
         thread_t *fifo_thread;
-        thread_t *render_thread[4];
+        thread_t *render_thread[VOODOO_MAX_RENDER_THREADS];
         event_t *wake_fifo_thread;
         event_t *wake_main_thread;
         event_t *fifo_not_full_event;
-        event_t *render_not_full_event[4];
-        event_t *wake_render_thread[4];
+        event_t *render_not_full_event[VOODOO_MAX_RENDER_THREADS];
+        event_t *wake_render_thread[VOODOO_MAX_RENDER_THREADS];
 
         int voodoo_busy;
-        int render_voodoo_busy[4];
+        int render_voodoo_busy[VOODOO_MAX_RENDER_THREADS];
 
         int render_threads;
-        int odd_even_mask;
+        int render_band_shift; /*Each render thread owns every render_threads'th band of (1 << render_band_shift) lines*/
+        voodoo_render_thread_t render_thread_data[VOODOO_MAX_RENDER_THREADS];
 
-        int pixel_count[4], texel_count[4], tri_count, frame_count;
-        int pixel_count_old[4], texel_count_old[4];
+        int pixel_count[VOODOO_MAX_RENDER_THREADS], texel_count[VOODOO_MAX_RENDER_THREADS], tri_count, frame_count;
+        int pixel_count_old[VOODOO_MAX_RENDER_THREADS], texel_count_old[VOODOO_MAX_RENDER_THREADS];
         int wr_count, rd_count, tex_count;
 
         int retrace_count;
@@ -311,7 +330,7 @@ typedef struct voodoo_t
         volatile int cmd_read, cmd_written, cmd_written_fifo;
 
         voodoo_params_t params_buffer[PARAM_SIZE];
-        volatile int params_read_idx[4], params_write_idx;
+        volatile int params_read_idx[VOODOO_MAX_RENDER_THREADS], params_write_idx;
 
         uint32_t cmdfifo_base, cmdfifo_end, cmdfifo_size;
         int cmdfifo_rp;
@@ -473,15 +492,17 @@ typedef struct voodoo_t
         uint8_t thefilterb[256][256];
         uint16_t purpleline[256][3];
 
-        texture_t texture_cache[2][TEX_CACHE_MAX];
-        uint8_t texture_present[2][16384];
+        texture_t *texture_cache[2];
+        int texture_cache_size;
+        int texture_hash[2][TEX_HASH_SIZE];
+        uint16_t texture_present[2][16384]; /*Number of cache entries using each 1kb page*/
+        uint64_t texture_region[2][TEX_REGIONS][TEX_CACHE_MAX / 64];
         int texture_last_removed;
 
         uint32_t palette_checksum[2];
-        int palette_dirty[2];
 
         uint64_t time;
-        int render_time[4];
+        int render_time[VOODOO_MAX_RENDER_THREADS];
 
         int use_recompiler;
         void *codegen_data;
@@ -1,4 +1,4 @@
-#if !(defined i386 || defined __i386 || defined __i386__ || defined _X86_ || defined WIN32 || defined _WIN32 || defined _WIN32) && !(defined __amd64__)
+#if !(defined i386 || defined __i386 || defined __i386__ || defined _X86_ || defined WIN32 || defined _WIN32 || defined _WIN32) && !(defined __amd64__) && !(defined __aarch64__)
 #define NO_CODEGEN
 #endif
 
@@ -297,10 +297,7 @@ void voodoo_codegen_close(voodoo_t *voodoo);
 
 
 
-void voodoo_render_thread_1(void *param);
-void voodoo_render_thread_2(void *param);
-void voodoo_render_thread_3(void *param);
-void voodoo_render_thread_4(void *param);
+void voodoo_render_thread(void *param);
 void voodoo_queue_triangle(voodoo_t *voodoo, voodoo_params_t *params);
 
 extern int voodoo_recomp;
@@ -308,31 +305,27 @@ extern int tris;
 
 static __inline void voodoo_wake_render_thread(voodoo_t *voodoo)
 {
-        thread_set_event(voodoo->wake_render_thread[0]); /*Wake up render thread if moving from idle*/
-        if (voodoo->render_threads >= 2)
-                thread_set_event(voodoo->wake_render_thread[1]); /*Wake up render thread if moving from idle*/
-        if (voodoo->render_threads == 4)
-        {
-                thread_set_event(voodoo->wake_render_thread[2]); /*Wake up render thread if moving from idle*/
-                thread_set_event(voodoo->wake_render_thread[3]); /*Wake up render thread if moving from idle*/
-        }
+        int c;
+
+        for (c = 0; c < voodoo->render_threads; c++)
+                thread_set_event(voodoo->wake_render_thread[c]); /*Wake up render thread if moving from idle*/
+}
+
+static __inline int voodoo_render_thread_busy(voodoo_t *voodoo, int odd_even)
+{
+        return !PARAM_EMPTY(odd_even) || voodoo->render_voodoo_busy[odd_even];
 }
 
 static __inline void voodoo_wait_for_render_thread_idle(voodoo_t *voodoo)
 {
-        while (!PARAM_EMPTY(0) || (voodoo->render_threads >= 2 && !PARAM_EMPTY(1)) ||
-                (voodoo->render_threads == 4 && (!PARAM_EMPTY(2) || !PARAM_EMPTY(3))) ||
-                voodoo->render_voodoo_busy[0] || (voodoo->render_threads >= 2 && voodoo->render_voodoo_busy[1]) ||
-                (voodoo->render_threads == 4 && (voodoo->render_voodoo_busy[2] || voodoo->render_voodoo_busy[3])))
+        int c;
+
+        for (c = 0; c < voodoo->render_threads; c++)
         {
-                voodoo_wake_render_thread(voodoo);
-                if (!PARAM_EMPTY(0) || voodoo->render_voodoo_busy[0])
-                        thread_wait_event(voodoo->render_not_full_event[0], 1);
-                if (voodoo->render_threads >= 2 && (!PARAM_EMPTY(1) || voodoo->render_voodoo_busy[1]))
-                        thread_wait_event(voodoo->render_not_full_event[1], 1);
-                if (voodoo->render_threads == 4 && (!PARAM_EMPTY(2) || voodoo->render_voodoo_busy[2]))
-                        thread_wait_event(voodoo->render_not_full_event[2], 1);
-                if (voodoo->render_threads == 4 && (!PARAM_EMPTY(3) || voodoo->render_voodoo_busy[3]))
-                        thread_wait_event(voodoo->render_not_full_event[3], 1);
+                while (voodoo_render_thread_busy(voodoo, c))
+                {
+                        voodoo_wake_render_thread(voodoo);
+                        thread_wait_event(voodoo->render_not_full_event[c], 1);
+                }
         }
 }
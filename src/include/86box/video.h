@@ -130,6 +130,13 @@ extern double	cpuclock;
 extern int	emu_fps,
 		frames;
 extern int	readflash;
+extern uint64_t	voodoo_tex_hits,
+		voodoo_tex_misses,
+		voodoo_tex_decode_time;
+extern uint64_t	video_blit_lines,
+		video_frames_presented,
+		video_frames_dropped,
+		video_present_latency;
 
 
 /* Function handler pointers. */
@@ -366,6 +373,7 @@ extern const device_t voodoo_banshee_device;
 extern const device_t creative_voodoo_banshee_device;
 extern const device_t voodoo_3_2000_device;
 extern const device_t voodoo_3_3000_device;
+extern int voodoo_render_test(void);
 
 /* Wyse 700 */
 extern const device_t wy700_device;
@@ -58,6 +58,13 @@
 
 #define G_SPAWN_SEARCH_PATH 0
 
+#ifndef FALSE
+# define FALSE 0
+#endif
+#ifndef TRUE
+# define TRUE 1
+#endif
+
 #if defined(__LP64__) || defined(__LLP64__)
 # define GLIB_SIZEOF_VOID_P 8
 #else
@@ -122,6 +129,7 @@ static GString	*g_string_new(gchar *base) __attribute__((__unused__));
 static gchar	*g_string_free(GString *string, gboolean free_segment) __attribute__((__unused__));
 static gchar	*g_strstr_len(const gchar *haystack, gssize haystack_len, const gchar *needle) __attribute__((__unused__));
 static guint	g_strv_length(gchar **str_array) __attribute__((__unused__));
+static gsize	g_strlcpy(gchar *dest, const gchar *src, gsize dest_size) __attribute__((__unused__));
 #endif
 
 /* Must be a function, as libslirp redefines it as a macro. */
@@ -203,6 +211,23 @@ g_strv_length(gchar **str_array)
 }
 
 
+/* Only used for UNIX socket paths, which Windows builds do not reach. */
+static gsize
+g_strlcpy(gchar *dest, const gchar *src, gsize dest_size)
+{
+    gsize len = strlen(src);
+
+    if (dest_size) {
+	if (len >= dest_size) {
+		memcpy(dest, src, dest_size - 1);
+		dest[dest_size - 1] = '\0';
+	} else
+		memcpy(dest, src, len + 1);
+    }
+    return len;
+}
+
+
 /* Macros */
 
 #define tinyglib_pclog(f, s, ...) pclog("TinyGLib " f "(): " s "\n", ##__VA_ARGS__)
@@ -34,6 +34,8 @@
 #include <86box/io.h>
 #include <86box/mem.h>
 #include <86box/rom.h>
+#include <86box/timer.h>
+#include <86box/snapshot.h>
 #ifdef USE_DYNAREC
 # include "codegen_public.h"
 #else
@@ -95,6 +97,10 @@ int			readlnum = 0,
 			writelnum = 0;
 int			cachesize = 256;
 
+uint64_t		mmu_tlb_hits = 0,	/* second-level TLB statistics */
+			mmu_tlb_misses = 0,
+			mmu_tlb_flushes = 0;
+
 uint32_t		get_phys_virt,
 			get_phys_phys;
 
@@ -107,6 +113,10 @@ int			mmu_perm = 4;
 
 uint64_t		*byte_dirty_mask;
 uint64_t		*byte_code_present_mask;
+#ifdef USE_NEW_DYNAREC
+static uint64_t		page_ff_dirty_mask[64],
+			page_ff_code_present_mask[64];
+#endif
 
 uint32_t		purgable_page_list_head = 0;
 int			purgeable_page_count = 0;
@@ -173,6 +183,8 @@ resetreadlookup(void)
     readlnext = 0;
     writelnext = 0;
     pccache = 0xffffffff;
+
+    mmu_tlb_flush();
 }
 
 
@@ -197,6 +209,8 @@ flushmmucache(void)
     pccache = (uint32_t)0xffffffff;
     pccache2 = (uint8_t *)0xffffffff;
 
+    mmu_tlb_flush();
+
 #ifdef USE_DYNAREC
     codegen_flush();
 #endif
@@ -219,6 +233,12 @@ flushmmucache_nopc(void)
 		writelookup[c] = 0xffffffff;
 	}
     }
+
+    mmu_tlb_flush();
+
+#if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+    codegen_flush();
+#endif
 }
 
 
@@ -238,6 +258,67 @@ flushmmucache_cr3(void)
 		writelookup[c] = 0xffffffff;
 	}
     }
+
+#if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+    codegen_flush();
+#endif
+}
+
+
+/* On a CR3 load. Global pages stay, and the second-level TLB is tagged
+   with CR3 so it does not need flushing at all. */
+void
+flushmmucache_noglobal(void)
+{
+    int c;
+
+    for (c = 0; c < 256; c++) {
+	if ((readlookup[c] != (int) 0xffffffff) && !(readlookupp[c] & MMU_PERM_GLOBAL)) {
+		readlookup2[readlookup[c]] = LOOKUP_INV;
+		readlookup[c] = 0xffffffff;
+	}
+	if ((writelookup[c] != (int) 0xffffffff) && !(writelookupp[c] & MMU_PERM_GLOBAL)) {
+		page_lookup[writelookup[c]] = NULL;
+		writelookup2[writelookup[c]] = LOOKUP_INV;
+		writelookup[c] = 0xffffffff;
+	}
+    }
+    mmuflush++;
+
+    pccache = (uint32_t)0xffffffff;
+    pccache2 = (uint8_t *)0xffffffff;
+
+#ifdef USE_DYNAREC
+    codegen_flush();
+#endif
+}
+
+
+/* On entering CPL 3. The lookup tables do not check permissions, so
+   drop whatever was added for pages the user may not read or write. */
+void
+flushmmucache_user(void)
+{
+    int c;
+
+    if (cr0 >> 31) {
+	for (c = 0; c < 256; c++) {
+		if ((readlookup[c] != (int) 0xffffffff) && !(readlookupp[c] & MMU_PERM_USER)) {
+			readlookup2[readlookup[c]] = LOOKUP_INV;
+			readlookup[c] = 0xffffffff;
+		}
+		if ((writelookup[c] != (int) 0xffffffff) &&
+		    ((writelookupp[c] & (MMU_PERM_USER | MMU_PERM_WRITE)) != (MMU_PERM_USER | MMU_PERM_WRITE))) {
+			page_lookup[writelookup[c]] = NULL;
+			writelookup2[writelookup[c]] = LOOKUP_INV;
+			writelookup[c] = 0xffffffff;
+		}
+	}
+    }
+
+#if defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC)
+    codegen_flush();
+#endif
 }
 
 
@@ -268,6 +349,223 @@ mem_flush_write_page(uint32_t addr, uint32_t virt)
 }
 
 
+/*
+ * Second-level TLB.
+ *
+ * The readlookup2/writelookup2 tables are indexed directly by the
+ * recompiled code and carry no tags, so they have to be flushed on
+ * every CR3 load. Behind them sits a set-associative TLB of page walk
+ * results, tagged with the CR3 they were made under, so that switching
+ * back to an address space finds its translations again. Entries made
+ * from global pages (with CR4.PGE set) match under any CR3.
+ *
+ * The guest does not flush translations of inactive address spaces, so
+ * each entry remembers the page directory and page table pages it was
+ * walked through, along with their generation counts. Writes to these
+ * pages go through the page_lookup path like writes to code pages do,
+ * and bump the generation, which retires every entry made from them.
+ */
+#define MMU_TLB_SETS		256
+#define MMU_TLB_WAYS		4
+#define MMU_TLB_MAX_PT		4096	/* tracked pages before a full flush */
+
+#define MMU_TLB_VALID		0x01
+#define MMU_TLB_DIRTY		0x02
+#define MMU_TLB_GLOBAL		0x04
+#define MMU_TLB_LARGE		0x08
+
+#define MMU_GLOBAL(e)		((((e) & 0x100) && (cr4 & CR4_PGE)) ? MMU_PERM_GLOBAL : 0)
+
+
+typedef struct {
+    uint32_t	vpn, cr3,
+		phys;			/* physical page number */
+    uint32_t	src[3], gen[3];		/* paging structures walked */
+    uint8_t	flags, perm;
+} mmu_tlb_entry_t;
+
+
+static mmu_tlb_entry_t	mmu_tlb[MMU_TLB_SETS][MMU_TLB_WAYS];
+static uint8_t		mmu_tlb_next[MMU_TLB_SETS];
+static int		mmu_tlb_large;
+
+static uint8_t		*mmu_pt_page;		/* page holds paging structures */
+static uint32_t		*mmu_pt_gen;		/* one more for unused slots */
+static uint32_t		mmu_pt_pages, mmu_pt_tracked;
+
+/* The paging structures and flags of the last successful page walk. */
+static struct {
+    int		nsrc;
+    uint32_t	src[3];
+    uint8_t	flags;
+} mmu_walk;
+
+
+void
+mmu_tlb_flush(void)
+{
+    memset(mmu_tlb, 0x00, sizeof(mmu_tlb));
+    mmu_tlb_large = 0;
+
+    if (mmu_pt_page != NULL)
+	memset(mmu_pt_page, 0x00, mmu_pt_pages);
+    mmu_pt_tracked = 0;
+
+    mmu_tlb_flushes++;
+}
+
+
+/* Called on every RAM page write; the address passed to the write_*
+   handlers may be linear, so the physical page comes from the page_t. */
+static __inline void
+mmu_pt_write(page_t *p)
+{
+    uint32_t page = (uint32_t) (p - pages);
+
+    if ((page < mmu_pt_pages) && mmu_pt_page[page])
+	mmu_pt_gen[page]++;
+}
+
+
+#define mmu_pt_tracked_page(phys)	(((phys) >> 12) < mmu_pt_pages && mmu_pt_page[(phys) >> 12])
+
+
+/* Makes writes to a physical page take the page_lookup path, so that
+   they are seen by mmu_pt_write(). */
+static void
+mmu_pt_track(uint32_t page)
+{
+    uintptr_t target, host;
+    int c;
+
+    mmu_pt_page[page] = 1;
+    mmu_pt_tracked++;
+
+    /* RAM above 1 GB lives in a separate allocation, see addwritelookup(). */
+    if ((page << 12) >= (1 << 30))
+	host = (uintptr_t) &ram2[(page << 12) - (1 << 30)];
+    else
+	host = (uintptr_t) &ram[page << 12];
+
+    for (c = 0; c < 256; c++) {
+	if ((writelookup[c] == (int) 0xffffffff) || (writelookup2[writelookup[c]] == (uintptr_t) LOOKUP_INV))
+		continue;
+
+	target = writelookup2[writelookup[c]] + ((uintptr_t) writelookup[c] << 12);
+	if (target == host) {
+		writelookup2[writelookup[c]] = LOOKUP_INV;
+		page_lookup[writelookup[c]] = NULL;
+		writelookup[c] = 0xffffffff;
+	}
+    }
+}
+
+
+static __inline mmu_tlb_entry_t *
+mmu_tlb_find(uint32_t addr)
+{
+    uint32_t vpn = addr >> 12;
+    mmu_tlb_entry_t *e = mmu_tlb[vpn & (MMU_TLB_SETS - 1)];
+    int c;
+
+    for (c = 0; c < MMU_TLB_WAYS; c++, e++) {
+	if ((e->vpn != vpn) || !(e->flags & MMU_TLB_VALID) ||
+	    ((e->cr3 != cr3) && !(e->flags & MMU_TLB_GLOBAL)))
+		continue;
+
+	if ((mmu_pt_gen[e->src[0]] == e->gen[0]) && (mmu_pt_gen[e->src[1]] == e->gen[1]) &&
+	    (mmu_pt_gen[e->src[2]] == e->gen[2]))
+		return e;
+
+	/* The paging structures were written to since. */
+	e->flags = 0;
+	break;
+    }
+
+    return NULL;
+}
+
+
+static void
+mmu_tlb_fill(uint32_t addr, uint64_t phys)
+{
+    uint32_t vpn = addr >> 12;
+    uint32_t set = vpn & (MMU_TLB_SETS - 1);
+    mmu_tlb_entry_t *e = NULL;
+    int c;
+
+    /* Only walks through RAM can be tracked. */
+    for (c = 0; c < mmu_walk.nsrc; c++) {
+	if (mmu_walk.src[c] >= mmu_pt_pages)
+		return;
+    }
+
+    if ((mmu_pt_tracked + mmu_walk.nsrc) > MMU_TLB_MAX_PT)
+	mmu_tlb_flush();
+
+    /* Replace a stale entry for the page, then a free way, then round robin. */
+    for (c = 0; c < MMU_TLB_WAYS; c++) {
+	if ((mmu_tlb[set][c].vpn == vpn) && (mmu_tlb[set][c].cr3 == cr3)) {
+		e = &mmu_tlb[set][c];
+		break;
+	}
+    }
+    for (c = 0; (e == NULL) && (c < MMU_TLB_WAYS); c++) {
+	if (!(mmu_tlb[set][c].flags & MMU_TLB_VALID))
+		e = &mmu_tlb[set][c];
+    }
+    if (e == NULL) {
+	e = &mmu_tlb[set][mmu_tlb_next[set]];
+	mmu_tlb_next[set] = (mmu_tlb_next[set] + 1) & (MMU_TLB_WAYS - 1);
+    }
+
+    e->vpn = vpn;
+    e->cr3 = cr3;
+    e->phys = (uint32_t) (phys >> 12);
+    e->perm = mmu_perm & (MMU_PERM_USER | MMU_PERM_WRITE);
+    e->flags = MMU_TLB_VALID | mmu_walk.flags;
+    if (mmu_perm & MMU_PERM_GLOBAL)
+	e->flags |= MMU_TLB_GLOBAL;
+    if (e->flags & MMU_TLB_LARGE)
+	mmu_tlb_large = 1;
+
+    for (c = 0; c < 3; c++) {
+	if (c < mmu_walk.nsrc) {
+		if (!mmu_pt_page[mmu_walk.src[c]])
+			mmu_pt_track(mmu_walk.src[c]);
+		e->src[c] = mmu_walk.src[c];
+	} else
+		e->src[c] = mmu_pt_pages;
+	e->gen[c] = mmu_pt_gen[e->src[c]];
+    }
+}
+
+
+/* INVLPG also drops the page from the second-level TLB, in case the
+   paging structures were changed in a way that was not tracked. */
+static void
+mmu_tlb_invalidate(uint32_t addr)
+{
+    uint32_t vpn = addr >> 12;
+    int c, d;
+
+    for (c = 0; c < MMU_TLB_WAYS; c++) {
+	if (mmu_tlb[vpn & (MMU_TLB_SETS - 1)][c].vpn == vpn)
+		mmu_tlb[vpn & (MMU_TLB_SETS - 1)][c].flags = 0;
+    }
+
+    /* Large pages are entered as 4k pages, so look for all of them. */
+    if (mmu_tlb_large) {
+	for (c = 0; c < MMU_TLB_SETS; c++) {
+		for (d = 0; d < MMU_TLB_WAYS; d++) {
+			if ((mmu_tlb[c][d].flags & MMU_TLB_LARGE) && !((mmu_tlb[c][d].vpn ^ vpn) & ~0x3ff))
+				mmu_tlb[c][d].flags = 0;
+		}
+	}
+    }
+}
+
+
 #define mmutranslate_read(addr) mmutranslatereal(addr,0)
 #define mmutranslate_write(addr) mmutranslatereal(addr,1)
 #define rammap(x)	((uint32_t *)(_mem_exec[(x) >> MEM_GRANULARITY_BITS]))[((x) >> 2) & MEM_GRANULARITY_QMASK]
@@ -309,9 +607,13 @@ mmutranslatereal_normal(uint32_t addr, int rw)
 		return 0xffffffffffffffffULL;
 	}
 
-	mmu_perm = temp & 4;
+	mmu_perm = (temp & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
 	rammap(addr2) |= 0x20;
 
+	mmu_walk.nsrc = 1;
+	mmu_walk.src[0] = addr2 >> 12;
+	mmu_walk.flags = MMU_TLB_LARGE | MMU_TLB_DIRTY;
+
 	return (temp & ~0x3fffff) + (addr & 0x3fffff);
     }
 
@@ -327,10 +629,15 @@ mmutranslatereal_normal(uint32_t addr, int rw)
 	return 0xffffffffffffffffULL;
     }
 
-    mmu_perm = temp & 4;
+    mmu_perm = (temp3 & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
     rammap(addr2) |= 0x20;
     rammap((temp2 & ~0xfff) + ((addr >> 10) & 0xffc)) |= (rw?0x60:0x20);
 
+    mmu_walk.nsrc = 2;
+    mmu_walk.src[0] = addr2 >> 12;
+    mmu_walk.src[1] = temp2 >> 12;
+    mmu_walk.flags = (rw || (temp & 0x40)) ? MMU_TLB_DIRTY : 0;
+
     return (uint64_t) ((temp&~0xfff)+(addr&0xfff));
 }
 
@@ -383,9 +690,14 @@ mmutranslatereal_pae(uint32_t addr, int rw)
 
 		return 0xffffffffffffffffULL;
 	}
-	mmu_perm = temp & 4;
+	mmu_perm = (temp & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
 	rammap64(addr3) |= 0x20;
 
+	mmu_walk.nsrc = 2;
+	mmu_walk.src[0] = (uint32_t) (addr2 >> 12);
+	mmu_walk.src[1] = (uint32_t) (addr3 >> 12);
+	mmu_walk.flags = MMU_TLB_LARGE | MMU_TLB_DIRTY;
+
 	return ((temp & ~0x1fffffULL) + (addr & 0x1fffffULL)) & 0x000000ffffffffffULL;
     }
 
@@ -402,10 +714,16 @@ mmutranslatereal_pae(uint32_t addr, int rw)
 	return 0xffffffffffffffffULL;
     }
 
-    mmu_perm = temp & 4;
+    mmu_perm = (temp3 & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
     rammap64(addr3) |= 0x20;
     rammap64(addr4) |= (rw? 0x60 : 0x20);
 
+    mmu_walk.nsrc = 3;
+    mmu_walk.src[0] = (uint32_t) (addr2 >> 12);
+    mmu_walk.src[1] = (uint32_t) (addr3 >> 12);
+    mmu_walk.src[2] = (uint32_t) (addr4 >> 12);
+    mmu_walk.flags = (rw || (temp & 0x40)) ? MMU_TLB_DIRTY : 0;
+
     return ((temp & ~0xfffULL) + ((uint64_t) (addr & 0xfff))) & 0x000000ffffffffffULL;
 }
 
@@ -413,10 +731,34 @@ mmutranslatereal_pae(uint32_t addr, int rw)
 uint64_t
 mmutranslatereal(uint32_t addr, int rw)
 {
+    mmu_tlb_entry_t *e;
+    uint64_t ret;
+
+    if (cpu_state.abrt)
+	return 0xffffffffffffffffULL;
+
+    /* Anything that would fault or has to set the dirty bit takes a walk. */
+    e = mmu_tlb_find(addr);
+    if ((e != NULL) && (!rw || (e->flags & MMU_TLB_DIRTY)) &&
+	!(((CPL == 3) && !(e->perm & MMU_PERM_USER) && !cpl_override) ||
+	  (rw && !(e->perm & MMU_PERM_WRITE) && (((CPL == 3) && !cpl_override) || (cr0 & WP_FLAG))))) {
+	mmu_tlb_hits++;
+	mmu_perm = e->perm | ((e->flags & MMU_TLB_GLOBAL) ? MMU_PERM_GLOBAL : 0);
+	return ((uint64_t) e->phys << 12) | (addr & 0xfff);
+    }
+
+    mmu_tlb_misses++;
+    mmu_walk.nsrc = 0;
+
     if (cr4 & CR4_PAE)
-	return mmutranslatereal_pae(addr, rw);
+	ret = mmutranslatereal_pae(addr, rw);
     else
-	return mmutranslatereal_normal(addr, rw);
+	ret = mmutranslatereal_normal(addr, rw);
+
+    if (!cpu_state.abrt && mmu_walk.nsrc)
+	mmu_tlb_fill(addr, ret);
+
+    return ret;
 }
 
 
@@ -448,6 +790,8 @@ mmutranslate_noabrt_normal(uint32_t addr, int rw)
 	if (((CPL == 3) && !(temp & 4) && !cpl_override) || (rw && !(temp & 2) && ((CPL == 3) || (cr0 & WP_FLAG))))
 		return 0xffffffffffffffffULL;
 
+	mmu_perm = (temp & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
+
 	return (temp & ~0x3fffff) + (addr & 0x3fffff);
     }
 
@@ -457,6 +801,8 @@ mmutranslate_noabrt_normal(uint32_t addr, int rw)
     if (!(temp & 1) || ((CPL == 3) && !(temp3 & 4) && !cpl_override) || (rw && !(temp3 & 2) && ((CPL == 3) || (cr0 & WP_FLAG))))
 	return 0xffffffffffffffffULL;
 
+    mmu_perm = (temp3 & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
+
     return (uint64_t) ((temp & ~0xfff) + (addr & 0xfff));
 }
 
@@ -488,6 +834,8 @@ mmutranslate_noabrt_pae(uint32_t addr, int rw)
 	if (((CPL == 3) && !(temp & 4) && !cpl_override) || (rw && !(temp & 2) && ((CPL == 3) || (cr0 & WP_FLAG))))
 		return 0xffffffffffffffffULL;
 
+	mmu_perm = (temp & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
+
 	return ((temp & ~0x1fffffULL) + (addr & 0x1fffff)) & 0x000000ffffffffffULL;
     }
 
@@ -498,6 +846,8 @@ mmutranslate_noabrt_pae(uint32_t addr, int rw)
     if (!(temp&1) || ((CPL == 3) && !(temp3 & 4) && !cpl_override) || (rw && !(temp3 & 2) && ((CPL == 3) || (cr0 & WP_FLAG))))
 	return 0xffffffffffffffffULL;
 
+    mmu_perm = (temp3 & (MMU_PERM_USER | MMU_PERM_WRITE)) | MMU_GLOBAL(temp);
+
     return ((temp & ~0xfffULL) + ((uint64_t) (addr & 0xfff))) & 0x000000ffffffffffULL;
 }
 
@@ -505,6 +855,19 @@ mmutranslate_noabrt_pae(uint32_t addr, int rw)
 uint64_t
 mmutranslate_noabrt(uint32_t addr, int rw)
 {
+    mmu_tlb_entry_t *e;
+
+    if (cpu_state.abrt)
+	return 0xffffffffffffffffULL;
+
+    e = mmu_tlb_find(addr);
+    if ((e != NULL) &&
+	!(((CPL == 3) && !(e->perm & MMU_PERM_USER) && !cpl_override) ||
+	  (rw && !(e->perm & MMU_PERM_WRITE) && ((CPL == 3) || (cr0 & WP_FLAG))))) {
+	mmu_perm = e->perm | ((e->flags & MMU_TLB_GLOBAL) ? MMU_PERM_GLOBAL : 0);
+	return ((uint64_t) e->phys << 12) | (addr & 0xfff);
+    }
+
     if (cr4 & CR4_PAE)
 	return mmutranslate_noabrt_pae(addr, rw);
     else
@@ -516,6 +879,8 @@ void
 mmu_invalidate(uint32_t addr)
 {
     flushmmucache_cr3();
+
+    mmu_tlb_invalidate(addr);
 }
 
 
@@ -595,15 +960,15 @@ addwritelookup(uint32_t virt, uint32_t phys)
 
 #ifdef USE_NEW_DYNAREC
 #ifdef USE_DYNAREC
-    if (pages[phys >> 12].block || (phys & ~0xfff) == recomp_page)
+    if (pages[phys >> 12].block || (phys & ~0xfff) == recomp_page || mmu_pt_tracked_page(phys))
 #else
-    if (pages[phys >> 12].block)
+    if (pages[phys >> 12].block || mmu_pt_tracked_page(phys))
 #endif
 #else
 #ifdef USE_DYNAREC
-    if (pages[phys >> 12].block[0] || pages[phys >> 12].block[1] || pages[phys >> 12].block[2] || pages[phys >> 12].block[3] || (phys & ~0xfff) == recomp_page)
+    if (pages[phys >> 12].block[0] || pages[phys >> 12].block[1] || pages[phys >> 12].block[2] || pages[phys >> 12].block[3] || (phys & ~0xfff) == recomp_page || mmu_pt_tracked_page(phys))
 #else
-    if (pages[phys >> 12].block[0] || pages[phys >> 12].block[1] || pages[phys >> 12].block[2] || pages[phys >> 12].block[3])
+    if (pages[phys >> 12].block[0] || pages[phys >> 12].block[1] || pages[phys >> 12].block[2] || pages[phys >> 12].block[3] || mmu_pt_tracked_page(phys))
 #endif
 #endif
 	page_lookup[virt >> 12] = &pages[phys >> 12];
@@ -660,6 +1025,19 @@ getpccache(uint32_t a)
 }
 
 
+/* Returns a pointer to the code at a physical address, or NULL if it can not be executed from. */
+uint8_t *
+mem_get_exec_ptr(uint32_t addr)
+{
+    addr &= rammask;
+
+    if (_mem_exec[addr >> MEM_GRANULARITY_BITS])
+	return &_mem_exec[addr >> MEM_GRANULARITY_BITS][addr & MEM_GRANULARITY_MASK];
+
+    return NULL;
+}
+
+
 uint8_t
 read_mem_b(uint32_t addr)
 {
@@ -1751,6 +2129,7 @@ mem_write_ramb_page(uint32_t addr, uint8_t val, page_t *p)
 	int byte_offset = (addr >> PAGE_BYTE_MASK_SHIFT) & PAGE_BYTE_MASK_OFFSET_MASK;
 	uint64_t byte_mask = (uint64_t)1 << (addr & PAGE_BYTE_MASK_MASK);
 
+	mmu_pt_write(p);
 	p->mem[addr & 0xfff] = val;
 	p->dirty_mask |= mask;
 	if ((p->code_present_mask & mask) && !page_in_evict_list(p))
@@ -1779,6 +2158,7 @@ mem_write_ramw_page(uint32_t addr, uint16_t val, page_t *p)
 
 	if ((addr & 0xf) == 0xf)
 		mask |= (mask << 1);
+	mmu_pt_write(p);
 	*(uint16_t *)&p->mem[addr & 0xfff] = val;
 	p->dirty_mask |= mask;
 	if ((p->code_present_mask & mask) && !page_in_evict_list(p))
@@ -1815,6 +2195,7 @@ mem_write_raml_page(uint32_t addr, uint32_t val, page_t *p)
 
 	if ((addr & 0xf) >= 0xd)
 		mask |= (mask << 1);
+	mmu_pt_write(p);
 	*(uint32_t *)&p->mem[addr & 0xfff] = val;
 	p->dirty_mask |= mask;
 	p->byte_dirty_mask[byte_offset] |= byte_mask;
@@ -1843,6 +2224,7 @@ mem_write_ramb_page(uint32_t addr, uint8_t val, page_t *p)
 #endif
 	uint64_t mask = (uint64_t)1 << ((addr >> PAGE_MASK_SHIFT) & PAGE_MASK_MASK);
 	p->dirty_mask[(addr >> PAGE_MASK_INDEX_SHIFT) & PAGE_MASK_INDEX_MASK] |= mask;
+	mmu_pt_write(p);
 	p->mem[addr & 0xfff] = val;
     }
 }
@@ -1863,6 +2245,7 @@ mem_write_ramw_page(uint32_t addr, uint16_t val, page_t *p)
 	if ((addr & 0xf) == 0xf)
 		mask |= (mask << 1);
 	p->dirty_mask[(addr >> PAGE_MASK_INDEX_SHIFT) & PAGE_MASK_INDEX_MASK] |= mask;
+	mmu_pt_write(p);
 	*(uint16_t *)&p->mem[addr & 0xfff] = val;
     }
 }
@@ -1883,6 +2266,7 @@ mem_write_raml_page(uint32_t addr, uint32_t val, page_t *p)
 	if ((addr & 0xf) >= 0xd)
 		mask |= (mask << 1);
 	p->dirty_mask[(addr >> PAGE_MASK_INDEX_SHIFT) & PAGE_MASK_INDEX_MASK] |= mask;
+	mmu_pt_write(p);
 	*(uint32_t *)&p->mem[addr & 0xfff] = val;
     }
 }
@@ -1934,6 +2318,172 @@ mem_write_raml(uint32_t addr, uint32_t val, void *priv)
 }
 
 
+/* Bulk copy into a RAM page, marking the dynarec dirty masks the same way
+   the per-unit mem_write_ram*_page() functions do, but once per granule. */
+#ifdef USE_NEW_DYNAREC
+static void
+mem_write_ram_span_page(uint32_t addr, const uint8_t *src, uint32_t len, page_t *p)
+{
+    uint32_t off = addr & 0xfff, end = off + len, next, o;
+    uint64_t mask, byte_mask;
+    int byte_offset;
+
+    for (; off < end; src += (next - off), off = next) {
+	next = (off | PAGE_BYTE_MASK_MASK) + 1;
+	if (next > end)
+		next = end;
+
+#ifdef USE_DYNAREC
+	if (!codegen_in_recompile && !memcmp(&p->mem[off], src, next - off))
+#else
+	if (!memcmp(&p->mem[off], src, next - off))
+#endif
+		continue;
+
+	byte_mask = 0;
+	for (o = off; o < next; o++) {
+#ifdef USE_DYNAREC
+		if ((p->mem[o] != src[o - off]) || codegen_in_recompile)
+#else
+		if (p->mem[o] != src[o - off])
+#endif
+			byte_mask |= (uint64_t)1 << (o & PAGE_BYTE_MASK_MASK);
+	}
+
+	mask = (uint64_t)1 << ((off >> PAGE_MASK_SHIFT) & PAGE_MASK_MASK);
+	byte_offset = (off >> PAGE_BYTE_MASK_SHIFT) & PAGE_BYTE_MASK_OFFSET_MASK;
+
+	mmu_pt_write(p);
+	memcpy(&p->mem[off], src, next - off);
+	p->dirty_mask |= mask;
+	p->byte_dirty_mask[byte_offset] |= byte_mask;
+	if (!page_in_evict_list(p) && ((p->code_present_mask & mask) || (p->byte_code_present_mask[byte_offset] & byte_mask)))
+		page_add_to_evict_list(p);
+    }
+}
+#else
+static void
+mem_write_ram_span_page(uint32_t addr, const uint8_t *src, uint32_t len, page_t *p)
+{
+    uint32_t off = addr & 0xfff, end = off + len, next;
+
+    for (; off < end; src += (next - off), off = next) {
+	next = (off | ((1 << PAGE_MASK_SHIFT) - 1)) + 1;
+	if (next > end)
+		next = end;
+
+#ifdef USE_DYNAREC
+	if (!codegen_in_recompile && !memcmp(&p->mem[off], src, next - off))
+#else
+	if (!memcmp(&p->mem[off], src, next - off))
+#endif
+		continue;
+
+	p->dirty_mask[(off >> PAGE_MASK_INDEX_SHIFT) & PAGE_MASK_INDEX_MASK] |= (uint64_t)1 << ((off >> PAGE_MASK_SHIFT) & PAGE_MASK_MASK);
+	mmu_pt_write(p);
+	memcpy(&p->mem[off], src, next - off);
+    }
+}
+#endif
+
+
+/* Returns a host pointer to addr if the chunk it is in reads as plain RAM,
+   NULL if it has to go through the mapping's handlers. */
+static uint8_t *
+mem_span_read_ptr(uint32_t addr)
+{
+    mem_mapping_t *map = read_mapping[addr >> MEM_GRANULARITY_BITS];
+
+    if (use_phys_exec && _mem_exec[addr >> MEM_GRANULARITY_BITS])
+	return &(_mem_exec[addr >> MEM_GRANULARITY_BITS][addr & MEM_GRANULARITY_MASK]);
+    else if (map == NULL)
+	return NULL;
+    else if (map->read_b == mem_read_ram)
+	return &(ram[addr]);
+    else if (map->read_b == mem_read_ram_2gb)
+	return &(ram2[addr - (1 << 30)]);
+
+    return NULL;
+}
+
+
+/* Bus master transfers of len bytes, len being a multiple of transfer_size.
+   Each MEM_GRANULARITY_SIZE chunk is resolved once; plain RAM is copied
+   directly, anything else goes through the per-unit handlers. */
+void
+mem_read_phys_span(void *dest, uint32_t addr, uint32_t len, int transfer_size)
+{
+    uint8_t *d = (uint8_t *) dest, *p;
+    uint32_t i, chunk;
+
+    while (len) {
+	chunk = MEM_GRANULARITY_SIZE - (addr & MEM_GRANULARITY_MASK);
+	if (chunk > len)
+		chunk = len;
+	chunk &= ~(transfer_size - 1);
+
+	p = chunk ? mem_span_read_ptr(addr) : NULL;
+	if (p != NULL)
+		memcpy(d, p, chunk);
+	else {
+		/* A unit straddling two chunks is done on its own. */
+		if (!chunk)
+			chunk = transfer_size;
+		for (i = 0; i < chunk; i += transfer_size)
+			mem_read_phys(d + i, addr + i, transfer_size);
+	}
+
+	d += chunk;
+	addr += chunk;
+	len -= chunk;
+    }
+}
+
+
+void
+mem_write_phys_span(const void *src, uint32_t addr, uint32_t len, int transfer_size)
+{
+    const uint8_t *s = (const uint8_t *) src;
+    mem_mapping_t *map;
+    page_t *p;
+    uint32_t i, chunk, n;
+
+    while (len) {
+	chunk = MEM_GRANULARITY_SIZE - (addr & MEM_GRANULARITY_MASK);
+	if (chunk > len)
+		chunk = len;
+	chunk &= ~(transfer_size - 1);
+
+	map = write_mapping[addr >> MEM_GRANULARITY_BITS];
+
+	if (chunk && use_phys_exec && _mem_exec[addr >> MEM_GRANULARITY_BITS])
+		memcpy(&(_mem_exec[addr >> MEM_GRANULARITY_BITS][addr & MEM_GRANULARITY_MASK]), s, chunk);
+	else if (chunk && map && (map->write_b == mem_write_ram)) {
+		if (AT) {
+			for (i = 0; i < chunk; i += n) {
+				n = 0x1000 - ((addr + i) & 0xfff);
+				if (n > (chunk - i))
+					n = chunk - i;
+				p = &pages[(addr + i) >> 12];
+				if (p->mem != page_ff)
+					mem_write_ram_span_page(addr + i, s + i, n, p);
+			}
+		} else
+			memcpy(&(ram[addr]), s, chunk);
+	} else {
+		if (!chunk)
+			chunk = transfer_size;
+		for (i = 0; i < chunk; i += transfer_size)
+			mem_write_phys((void *) (s + i), addr + i, transfer_size);
+	}
+
+	s += chunk;
+	addr += chunk;
+	len -= chunk;
+    }
+}
+
+
 static uint8_t
 mem_read_remapped(uint32_t addr, void *priv)
 {
@@ -2612,10 +3162,29 @@ mem_reset(void)
     }
     byte_code_present_mask = malloc((mem_size * 1024) / 8);
     memset(byte_code_present_mask, 0, (mem_size * 1024) / 8);
+
+    memset(page_ff_dirty_mask, 0, sizeof(page_ff_dirty_mask));
+    memset(page_ff_code_present_mask, 0, sizeof(page_ff_code_present_mask));
 #endif
 
+    /* Paging structures are only tracked while they are in RAM. */
+    if (mmu_pt_page) {
+	free(mmu_pt_page);
+	mmu_pt_page = NULL;
+    }
+    if (mmu_pt_gen) {
+	free(mmu_pt_gen);
+	mmu_pt_gen = NULL;
+    }
+    mmu_pt_pages = mem_size >> 2;
+    if (mmu_pt_pages > pages_sz)
+	mmu_pt_pages = pages_sz;
+    mmu_pt_page = (uint8_t *) calloc(mmu_pt_pages, sizeof(uint8_t));
+    mmu_pt_gen = (uint32_t *) calloc(mmu_pt_pages + 1, sizeof(uint32_t));
+    mmu_tlb_flush();
+
     for (c = 0; c < pages_sz; c++) {
-	if ((c << 12) >= (mem_size << 10))
+	if (c >= (mem_size >> 2))
 		pages[c].mem = page_ff;
 	else {
 	        if (mem_size > 1048576) {
@@ -2639,8 +3208,14 @@ mem_reset(void)
 	}
 #ifdef USE_NEW_DYNAREC
 	pages[c].evict_prev = EVICT_NOT_IN_LIST;
-	pages[c].byte_dirty_mask = &byte_dirty_mask[c * 64];
-	pages[c].byte_code_present_mask = &byte_code_present_mask[c * 64];
+	/* The masks only cover RAM, pages above it share a spare set. */
+	if (c >= (mem_size >> 2)) {
+		pages[c].byte_dirty_mask = page_ff_dirty_mask;
+		pages[c].byte_code_present_mask = page_ff_code_present_mask;
+	} else {
+		pages[c].byte_dirty_mask = &byte_dirty_mask[c * 64];
+		pages[c].byte_code_present_mask = &byte_code_present_mask[c * 64];
+	}
 #endif
     }
 
@@ -2828,3 +3403,67 @@ mem_a20_recalc(void)
 
     mem_a20_state = state;
 }
+
+
+void
+mem_save_state(snapshot_t *s)
+{
+    mem_mapping_t *map;
+    uint32_t count = 0;
+
+    snapshot_put(s, rammask);
+    snapshot_put(s, mem_a20_key);
+    snapshot_put(s, mem_a20_alt);
+    snapshot_put(s, mem_a20_state);
+    snapshot_put(s, shadowbios);
+    snapshot_put(s, shadowbios_write);
+    snapshot_put(s, _mem_state);
+
+    for (map = base_mapping; map != NULL; map = map->next)
+	count++;
+    snapshot_put(s, count);
+
+    for (map = base_mapping; map != NULL; map = map->next) {
+	snapshot_put(s, map->enable);
+	snapshot_put(s, map->base);
+	snapshot_put(s, map->size);
+    }
+}
+
+
+int
+mem_load_state(snapshot_t *s)
+{
+    mem_mapping_t *map;
+    uint32_t count = 0, saved_count;
+
+    snapshot_get(s, rammask);
+    snapshot_get(s, mem_a20_key);
+    snapshot_get(s, mem_a20_alt);
+    snapshot_get(s, mem_a20_state);
+    snapshot_get(s, shadowbios);
+    snapshot_get(s, shadowbios_write);
+    snapshot_get(s, _mem_state);
+
+    /* The mappings were all added by the freshly created devices, in the
+       same order as when the snapshot was taken. */
+    for (map = base_mapping; map != NULL; map = map->next)
+	count++;
+    snapshot_get(s, saved_count);
+    if (saved_count != count) {
+	mem_log("MEM: snapshot has %i mappings, machine has %i\n", saved_count, count);
+	return -1;
+    }
+
+    for (map = base_mapping; map != NULL; map = map->next) {
+	snapshot_get(s, map->enable);
+	snapshot_get(s, map->base);
+	snapshot_get(s, map->size);
+    }
+
+    mem_mapping_recalc(0ULL, 0x100000000ULL);
+    flushmmucache();
+
+    return 0;
+}
+
@@ -50,6 +50,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <wchar.h>
+#ifndef _WIN32
+# include <sys/time.h>
+#endif
 #define HAVE_STDARG_H
 #include <86box/86box.h>
 #include <86box/device.h>
@@ -81,10 +84,12 @@ struct bpf_program {
 
 typedef struct pcap_if	pcap_if_t; 
 
+#ifdef _WIN32
 typedef struct timeval {
     long		tv_sec;
     long		tv_usec;
 } timeval;
+#endif
 
 #define PCAP_ERRBUF_SIZE	256
 
@@ -26,6 +26,7 @@
 
 #include <tinyglib.h>
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
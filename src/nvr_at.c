@@ -237,6 +237,7 @@
 #include <86box/rom.h>
 #include <86box/device.h>
 #include <86box/nvr.h>
+#include <86box/snapshot.h>
 
 
 /* RTC registers and bit definitions. */
@@ -900,6 +901,58 @@ nvr_lock_set(int base, int size, int lock, nvr_t *nvr)
 }
 
 
+static void
+nvr_at_save_state(void *priv, snapshot_t *s)
+{
+    nvr_t *nvr = (nvr_t *) priv;
+    local_t *local = (local_t *) nvr->data;
+
+    snapshot_write(s, nvr->regs, nvr->size);
+    snapshot_put(s, nvr->onesec_cnt);
+    snapshot_write_timer(s, &nvr->onesec_time);
+
+    snapshot_put(s, local->stat);
+    snapshot_put(s, local->read_addr);
+    snapshot_put(s, local->addr);
+    snapshot_put(s, local->wp);
+    snapshot_put(s, local->bank);
+    snapshot_write(s, local->lock, nvr->size);
+    snapshot_put(s, local->count);
+    snapshot_put(s, local->state);
+    snapshot_put(s, local->ecount);
+    snapshot_put(s, local->rtc_time);
+    snapshot_write_timer(s, &local->update_timer);
+    snapshot_write_timer(s, &local->rtc_timer);
+}
+
+
+static int
+nvr_at_load_state(void *priv, snapshot_t *s)
+{
+    nvr_t *nvr = (nvr_t *) priv;
+    local_t *local = (local_t *) nvr->data;
+
+    snapshot_read(s, nvr->regs, nvr->size);
+    snapshot_get(s, nvr->onesec_cnt);
+    snapshot_read_timer(s, &nvr->onesec_time);
+
+    snapshot_get(s, local->stat);
+    snapshot_get(s, local->read_addr);
+    snapshot_get(s, local->addr);
+    snapshot_get(s, local->wp);
+    snapshot_get(s, local->bank);
+    snapshot_read(s, local->lock, nvr->size);
+    snapshot_get(s, local->count);
+    snapshot_get(s, local->state);
+    snapshot_get(s, local->ecount);
+    snapshot_get(s, local->rtc_time);
+    snapshot_read_timer(s, &local->update_timer);
+    snapshot_read_timer(s, &local->rtc_timer);
+
+    return 0;
+}
+
+
 static void *
 nvr_at_init(const device_t *info)
 {
@@ -1029,7 +1082,8 @@ const device_t at_nvr_old_device = {
     0,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t at_nvr_device = {
@@ -1038,7 +1092,8 @@ const device_t at_nvr_device = {
     1,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t ps_nvr_device = {
@@ -1047,7 +1102,8 @@ const device_t ps_nvr_device = {
     2,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t amstrad_nvr_device = {
@@ -1056,7 +1112,8 @@ const device_t amstrad_nvr_device = {
     3,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t ibmat_nvr_device = {
@@ -1065,7 +1122,8 @@ const device_t ibmat_nvr_device = {
     4,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t piix4_nvr_device = {
@@ -1074,7 +1132,8 @@ const device_t piix4_nvr_device = {
     9,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t ls486e_nvr_device = {
@@ -1083,7 +1142,8 @@ const device_t ls486e_nvr_device = {
     13,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t ami_apollo_nvr_device = {
@@ -1092,7 +1152,8 @@ const device_t ami_apollo_nvr_device = {
     14,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
 
 const device_t via_nvr_device = {
@@ -1101,5 +1162,6 @@ const device_t via_nvr_device = {
     15,
     nvr_at_init, nvr_at_close, NULL,
     { NULL }, nvr_at_speed_changed,
-    NULL
+    NULL, NULL,
+    nvr_at_save_state, nvr_at_load_state
 };
@@ -47,6 +47,7 @@
 #include <86box/random.h>
 #include <86box/timer.h>
 #include <86box/nvr.h>
+#include <86box/snapshot.h>
 #include <86box/machine.h>
 #include <86box/bugger.h>
 #include <86box/postcard.h>
@@ -75,6 +76,9 @@
 #include <86box/midi.h>
 #include <86box/snd_speaker.h>
 #include <86box/video.h>
+#include <86box/vid_svga.h>
+#include <86box/vid_svga_render.h>
+#include <86box/capture.h>
 #include <86box/ui.h>
 #include <86box/plat.h>
 #include <86box/plat_midi.h>
@@ -102,6 +106,9 @@ int	video_fps = RENDER_FPS;			/* (O) render speed in fps */
 #endif
 int	settings_only = 0;			/* (O) show only the settings dialog */
 int	confirm_exit_cmdl = 1;			/* (O) do not ask for confirmation on quit if set to 0 */
+int	benchmark_secs = 0;			/* (O) benchmark for N emulated seconds */
+int	selftest = 0;				/* (O) run the self tests and exit */
+int	turbo_mode = 0;				/* (O) run as fast as the host allows */
 #ifdef _WIN32
 uint64_t	unique_id = 0;
 uint64_t	source_hwnd = 0;
@@ -140,6 +147,9 @@ int	cpu_use_dynarec = 0,			/* (C) cpu uses/needs Dyna */
 	cpu = 0,				/* (C) cpu type */
 	fpu_type = 0;				/* (C) fpu type */
 int	time_sync = 0;				/* (C) enable time sync */
+int	cpu_hlt_fastfwd = 0;			/* (C) skip idle time in HLT */
+int	cpu_dynarec_cache = 0;			/* (C) dynarec code cache limit, MB */
+int	cpu_dynarec_persist = 0;		/* (C) keep dynarec translations on disk */
 int	confirm_reset = 1,			/* (C) enable reset confirmation */
 	confirm_exit = 1;			/* (C) enable exit confirmation */
 #ifdef USE_DISCORD
@@ -147,6 +157,12 @@ int	enable_discord = 0;			/* (C) enable Discord integration */
 #endif
 int	enable_crashdump = 0;			/* (C) enable crash dump */
 
+/* Machine snapshots, only handled by the emulation thread. */
+static wchar_t	snapshot_path[1024];
+static wchar_t	capture_path[1024] = { L'\0' };	/* (O) record display and sound */
+static volatile int snapshot_load_pending = 0,
+		    snapshot_save_pending = 0;
+
 /* Statistics. */
 extern int
 	mmuflush,
@@ -372,6 +388,11 @@ usage:
 		printf("-H or --hwnd id,hwnd - sends back the main dialog's hwnd\n");
 #endif
 		printf("-R or --crashdump    - enables crashdump on exception\n");
+		printf("-Z or --snapshot path - restore snapshot 'path' at startup\n");
+		printf("-B or --benchmark secs - run for 'secs' emulated seconds and report\n");
+		printf("-X or --selftest     - run the self tests and exit\n");
+		printf("-T or --turbo        - start in turbo mode (unthrottled)\n");
+		printf("-A or --capture path - record display and sound to 'path'\n");
 		printf("\nA config file can be specified. If none is, the default file will be used.\n");
 		return(0);
 	} else if (!wcscasecmp(argv[c], L"--dumpcfg") ||
@@ -401,6 +422,29 @@ usage:
 	} else if (!wcscasecmp(argv[c], L"--noconfirm") ||
 		   !wcscasecmp(argv[c], L"-N")) {
 		confirm_exit_cmdl = 0;
+	} else if (!wcscasecmp(argv[c], L"--snapshot") ||
+		   !wcscasecmp(argv[c], L"-Z")) {
+		if ((c+1) == argc) goto usage;
+
+		wcscpy(snapshot_path, argv[++c]);
+		snapshot_load_pending = 1;
+	} else if (!wcscasecmp(argv[c], L"--benchmark") ||
+		   !wcscasecmp(argv[c], L"-B")) {
+		if ((c+1) == argc) goto usage;
+
+		benchmark_secs = wcstol(argv[++c], NULL, 10);
+		if (benchmark_secs <= 0) goto usage;
+	} else if (!wcscasecmp(argv[c], L"--selftest") ||
+		   !wcscasecmp(argv[c], L"-X")) {
+		selftest = 1;
+	} else if (!wcscasecmp(argv[c], L"--turbo") ||
+		   !wcscasecmp(argv[c], L"-T")) {
+		turbo_mode = 1;
+	} else if (!wcscasecmp(argv[c], L"--capture") ||
+		   !wcscasecmp(argv[c], L"-A")) {
+		if ((c+1) == argc) goto usage;
+
+		wcscpy(capture_path, argv[++c]);
 	} else if (!wcscasecmp(argv[c], L"--crashdump") ||
 		   !wcscasecmp(argv[c], L"-R")) {
 		enable_crashdump = 1;
@@ -642,6 +686,9 @@ pc_init_modules(void)
 
     video_reset_close();
 
+    if (capture_path[0] != L'\0')
+	capture_start(capture_path);
+
     return(1);
 }
 
@@ -895,6 +942,8 @@ pc_close(thread_t *ptr)
 	dumpregs(0);
 #endif
 
+    capture_stop();
+
     video_close();
 
     device_close_all();
@@ -914,6 +963,33 @@ pc_close(thread_t *ptr)
     mo_close();
 
     scsi_disk_close();
+
+    hdd_async_close();
+}
+
+
+/* Run one 10 ms frame of emulated time. */
+static void
+pc_run(void)
+{
+    clockrate = cpu_s->rspeed;
+
+    if (is386) {
+#ifdef USE_DYNAREC
+	if (cpu_use_dynarec)
+		exec386_dynarec(clockrate/100);
+	  else
+#endif
+		exec386(clockrate/100);
+    } else if (cpu_s->cpu_type >= CPU_286) {
+	exec386(clockrate/100);
+    } else {
+	execx86(clockrate/100);
+    }
+
+    mouse_process();
+
+    joystick_process();
 }
 
 
@@ -947,6 +1023,12 @@ pc_thread(void *param)
 	new_time = plat_get_ticks();
 	drawits += (new_time - old_time);
 	old_time = new_time;
+
+	/* In turbo mode, frames run back to back. Guest time only advances
+	   with the cycles executed, so it stays consistent and simply gets
+	   ahead of the host's clock. */
+	if (turbo_mode)
+		drawits = 10;
 	if (drawits > 0 && !dopause) {
 		/* Yes, so do one frame now. */
 		start_time = plat_timer_read();
@@ -956,27 +1038,23 @@ pc_thread(void *param)
 
 		/* Run a block of code. */
 		startblit();
-		clockrate = cpu_s->rspeed;
 
-		if (is386) {
-#ifdef USE_DYNAREC
-			if (cpu_use_dynarec)
-				exec386_dynarec(clockrate/100);
-			  else
-#endif
-				exec386(clockrate/100);
-		} else if (cpu_s->cpu_type >= CPU_286) {
-			exec386(clockrate/100);
-		} else {
-			execx86(clockrate/100);
+		/* Restore a snapshot before the first frame runs. */
+		if (snapshot_load_pending) {
+			snapshot_load_pending = 0;
+			if (snapshot_load(snapshot_path) != 0)
+				pc_reset_hard();
 		}
 
-		mouse_process();
-
-		joystick_process();
+		pc_run();
 
 		endblit();
 
+		if (snapshot_save_pending) {
+			snapshot_save_pending = 0;
+			snapshot_save(snapshot_path);
+		}
+
 		/* Done with this frame, update statistics. */
 		framecount++;
 		if (++framecountx >= 100) {
@@ -1021,8 +1099,13 @@ pc_thread(void *param)
 		end_time = plat_timer_read();
 		main_time += (end_time - start_time);
 	} else {
-		/* Just so we dont overload the host OS. */
-		plat_delay_ms(1);
+		/* Just so we dont overload the host OS. With HLT fast-forward,
+		   an idle guest finishes its frame early, so sleep through the
+		   rest of it in one go. */
+		if (cpu_hlt_fastfwd && (drawits < -1))
+			plat_delay_ms(-drawits);
+		else
+			plat_delay_ms(1);
 	}
 
 	/* If needed, handle a screen resize. */
@@ -1037,6 +1120,158 @@ pc_thread(void *param)
 }
 
 
+/*
+ * Check the optimised code paths against the reference code they stand
+ * in for, on the host the emulator is running on. Returns the number of
+ * failed tests; the details are printed as they are found.
+ */
+int
+pc_selftest(void)
+{
+    int failed = 0;
+
+    failed += svga_render_test();
+    failed += voodoo_render_test();
+#if (defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC))
+    failed += codegen_ir_opt_test();
+#endif
+
+    printf("Self test:       %s\n", failed ? "FAILED" : "passed");
+    fflush(stdout);
+
+    return failed;
+}
+
+
+/*
+ * Run the machine for the number of emulated seconds given on the
+ * command line, as fast as the host allows, and report how it went.
+ * This is meant for comparing the performance of builds, so there is
+ * no frame pacing, and nothing else should be running the machine.
+ */
+void
+pc_benchmark(void)
+{
+    uint64_t start_time, end_time;
+    uint64_t start_ins, start_blocks, start_hlt, ins;
+    uint64_t start_hits, start_misses, start_flushes;
+    uint64_t start_tex_hits, start_tex_misses, start_tex_time;
+    uint64_t start_blit_lines, start_presented, start_dropped, start_latency, presented;
+#if (defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC))
+    uint64_t start_uops, start_dead, start_folded, start_cse, start_forwarded, start_removed, start_flags, uops;
+    uint64_t start_traces, start_rebuilt, start_evicted;
+    uint64_t start_loaded, start_saved;
+#endif
+    int start_frames, c;
+    double emu_secs, host_secs;
+
+    pc_log("PC: running benchmark for %i seconds...\n", benchmark_secs);
+
+    if (snapshot_load_pending) {
+	snapshot_load_pending = 0;
+	if (snapshot_load(snapshot_path) != 0)
+		pc_reset_hard();
+    }
+
+    start_ins = cpu_ins_count;
+    start_blocks = cpu_recomp_blocks;
+    start_hlt = cpu_hlt_skipped;
+#if (defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC))
+    start_uops = codegen_ir_uops_in;
+    start_dead = codegen_ir_uops_dead;
+    start_folded = codegen_ir_uops_folded;
+    start_cse = codegen_ir_uops_cse;
+    start_forwarded = codegen_ir_uops_forwarded;
+    start_removed = codegen_ir_uops_removed;
+    start_flags = codegen_ir_flags_removed;
+    start_traces = codegen_traces_formed;
+    start_rebuilt = codegen_traces_dropped;
+    start_evicted = codegen_blocks_evicted;
+    start_loaded = codegen_cache_loaded;
+    start_saved = codegen_cache_saved;
+#endif
+    start_hits = mmu_tlb_hits;
+    start_misses = mmu_tlb_misses;
+    start_flushes = mmu_tlb_flushes;
+    start_tex_hits = voodoo_tex_hits;
+    start_tex_misses = voodoo_tex_misses;
+    start_tex_time = voodoo_tex_decode_time;
+    start_blit_lines = video_blit_lines;
+    start_presented = video_frames_presented;
+    start_dropped = video_frames_dropped;
+    start_latency = video_present_latency;
+    start_frames = frames;
+    timer_trace_start();
+    start_time = plat_timer_read();
+
+    /* The guest may power the machine off before the time is up. */
+    for (c = 0; (c < (benchmark_secs * 100)) && !quited; c++) {
+	startblit();
+	pc_run();
+	endblit();
+    }
+
+    end_time = plat_timer_read();
+
+    emu_secs = (double) c / 100.0;
+    host_secs = (double) (end_time - start_time) / (double) timer_freq;
+    ins = cpu_ins_count - start_ins;
+
+    printf("Machine:         %s, %s\n", machine_getname(), cpu_s->name);
+    printf("Emulated time:   %.2f s\n", emu_secs);
+    printf("Host time:       %.3f s (%.1f%% speed)\n", host_secs,
+	   (host_secs > 0.0) ? ((100.0 * emu_secs) / host_secs) : 0.0);
+    printf("Instructions:    %" PRIu64 " (%.2f emulated MIPS, %.2f host MIPS)\n", ins,
+	   (emu_secs > 0.0) ? ((double) ins / (emu_secs * 1000000.0)) : 0.0,
+	   (host_secs > 0.0) ? ((double) ins / (host_secs * 1000000.0)) : 0.0);
+    printf("Halted:          %" PRIu64 " cycles skipped (%.1f%% of emulated time)\n", cpu_hlt_skipped - start_hlt,
+	   (emu_secs > 0.0) ? ((100.0 * (double) (cpu_hlt_skipped - start_hlt)) / (emu_secs * (double) cpu_s->rspeed)) : 0.0);
+    printf("Video frames:    %i (%" PRIu64 " lines blitted)\n", frames - start_frames,
+	   video_blit_lines - start_blit_lines);
+    presented = video_frames_presented - start_presented;
+    printf("Presented:       %" PRIu64 " frames, %" PRIu64 " dropped, %.2f ms average latency\n",
+	   presented, video_frames_dropped - start_dropped,
+	   presented ? ((double) (video_present_latency - start_latency) * 1000.0 /
+			((double) timer_freq * (double) presented)) : 0.0);
+    printf("Blocks compiled: %" PRIu64 "\n", cpu_recomp_blocks - start_blocks);
+#if (defined(USE_DYNAREC) && defined(USE_NEW_DYNAREC))
+    uops = codegen_ir_uops_in - start_uops;
+    printf("IR uOPs:         %" PRIu64 " generated, %" PRIu64 " dead, %" PRIu64 " removed by the optimiser, %" PRIu64 " emitted\n",
+	   uops, codegen_ir_uops_dead - start_dead, codegen_ir_uops_removed - start_removed,
+	   uops - (codegen_ir_uops_dead - start_dead) - (codegen_ir_uops_removed - start_removed));
+    printf("IR passes:       %" PRIu64 " folded, %" PRIu64 " common subexpressions, %" PRIu64 " reads forwarded, %" PRIu64 " flag operands dropped\n",
+	   codegen_ir_uops_folded - start_folded, codegen_ir_uops_cse - start_cse,
+	   codegen_ir_uops_forwarded - start_forwarded, codegen_ir_flags_removed - start_flags);
+    printf("Traces:          %" PRIu64 " branches followed, %" PRIu64 " blocks rebuilt\n",
+	   codegen_traces_formed - start_traces, codegen_traces_dropped - start_rebuilt);
+    printf("Code cache:      %i kB committed, %" PRIu64 " blocks evicted\n",
+	   codegen_allocator_size, codegen_blocks_evicted - start_evicted);
+    printf("Block cache:     %" PRIu64 " loaded, %" PRIu64 " saved\n",
+	   codegen_cache_loaded - start_loaded, codegen_cache_saved - start_saved);
+#endif
+    printf("TLB:             %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " flushes\n",
+	   mmu_tlb_hits - start_hits, mmu_tlb_misses - start_misses,
+	   mmu_tlb_flushes - start_flushes);
+    printf("Voodoo textures: %" PRIu64 " hits, %" PRIu64 " misses, %.1f ms decoding\n",
+	   voodoo_tex_hits - start_tex_hits, voodoo_tex_misses - start_tex_misses,
+	   (double) (voodoo_tex_decode_time - start_tex_time) * 1000.0 / (double) timer_freq);
+    timer_trace_replay();
+    fflush(stdout);
+}
+
+
+/* Have the emulation thread save a snapshot once the current frame is done. */
+void
+pc_snapshot_save(void)
+{
+    if (snapshot_load_pending)
+	return;
+
+    plat_append_filename(snapshot_path, usr_path, L"snapshot.86s");
+    snapshot_save_pending = 1;
+}
+
+
 /* Handler for the 1-second timer to refresh the window title. */
 void
 pc_onesec(void)
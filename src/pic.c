@@ -16,6 +16,7 @@
  *		Copyright 2016-2020 Miran Grca.
  */
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +32,7 @@
 #include <86box/pic.h>
 #include <86box/timer.h>
 #include <86box/pit.h>
+#include <86box/snapshot.h>
 
 
 enum
@@ -656,3 +658,29 @@ picinterrupt()
 
     return ret;
 }
+
+
+/* Everything up to the slave pointers is plain register state. */
+void
+pic_save_state(snapshot_t *s)
+{
+    snapshot_write(s, &pic, offsetof(pic_t, slaves));
+    snapshot_write(s, &pic2, offsetof(pic_t, slaves));
+    snapshot_put(s, shadow);
+    snapshot_put(s, latched);
+    snapshot_write_timer(s, &pic_timer);
+}
+
+
+int
+pic_load_state(snapshot_t *s)
+{
+    snapshot_read(s, &pic, offsetof(pic_t, slaves));
+    snapshot_read(s, &pic2, offsetof(pic_t, slaves));
+    snapshot_get(s, shadow);
+    snapshot_get(s, latched);
+    snapshot_read_timer(s, &pic_timer);
+
+    return 0;
+}
+
@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -38,6 +39,7 @@
 #include <86box/sound.h>
 #include <86box/snd_speaker.h>
 #include <86box/video.h>
+#include <86box/snapshot.h>
 
 
 pit_t		*pit, *pit2;
@@ -837,6 +839,36 @@ pit_close(void *priv)
 }
 
 
+/* The counters' handlers are set up by the machine, only save everything
+   before them. */
+static void
+pit_save_state(void *priv, snapshot_t *s)
+{
+    pit_t *dev = (pit_t *) priv;
+    int i;
+
+    snapshot_put(s, dev->ctrl);
+    for (i = 0; i < 3; i++)
+	snapshot_write(s, &dev->counters[i], offsetof(ctr_t, load_func));
+    snapshot_write_timer(s, &dev->callback_timer);
+}
+
+
+static int
+pit_load_state(void *priv, snapshot_t *s)
+{
+    pit_t *dev = (pit_t *) priv;
+    int i;
+
+    snapshot_get(s, dev->ctrl);
+    for (i = 0; i < 3; i++)
+	snapshot_read(s, &dev->counters[i], offsetof(ctr_t, load_func));
+    snapshot_read_timer(s, &dev->callback_timer);
+
+    return 0;
+}
+
+
 static void *
 pit_init(const device_t *info)
 {
@@ -864,7 +896,8 @@ const device_t i8253_device =
 	PIT_8253,
         pit_init, pit_close, NULL,
         { NULL }, NULL, NULL,
-	NULL
+	NULL,
+	pit_save_state, pit_load_state
 };
 
 
@@ -875,7 +908,8 @@ const device_t i8254_device =
 	PIT_8254,
         pit_init, pit_close, NULL,
         { NULL }, NULL, NULL,
-	NULL
+	NULL,
+	pit_save_state, pit_load_state
 };
 
 
@@ -886,7 +920,8 @@ const device_t i8254_ext_io_device =
 	PIT_8254 | PIT_EXT_IO,
         pit_init, pit_close, NULL,
         { NULL }, NULL, NULL,
-	NULL
+	NULL,
+	pit_save_state, pit_load_state
 };
 
 
@@ -897,7 +932,8 @@ const device_t i8254_ps2_device =
 	PIT_8254 | PIT_PS2 | PIT_EXT_IO,
         pit_init, pit_close, NULL,
         { NULL }, NULL, NULL,
-	NULL
+	NULL,
+	pit_save_state, pit_load_state
 };
 
 
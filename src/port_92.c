@@ -29,6 +29,7 @@
 #include <86box/mem.h>
 #include <86box/pit.h>
 #include <86box/port_92.h>
+#include <86box/snapshot.h>
 
 
 #define	 PORT_92_INV	1
@@ -169,6 +170,35 @@ port_92_remove(void *priv)
 }
 
 
+/* A20 is restored with the memory state, the reset line belongs to us. */
+static void
+port_92_save_state(void *priv, snapshot_t *s)
+{
+    port_92_t *dev = (port_92_t *) priv;
+
+    snapshot_put(s, dev->reg);
+    snapshot_put(s, dev->flags);
+    snapshot_put(s, dev->pulse_period);
+    snapshot_put(s, cpu_alt_reset);
+    snapshot_write_timer(s, &dev->pulse_timer);
+}
+
+
+static int
+port_92_load_state(void *priv, snapshot_t *s)
+{
+    port_92_t *dev = (port_92_t *) priv;
+
+    snapshot_get(s, dev->reg);
+    snapshot_get(s, dev->flags);
+    snapshot_get(s, dev->pulse_period);
+    snapshot_get(s, cpu_alt_reset);
+    snapshot_read_timer(s, &dev->pulse_timer);
+
+    return 0;
+}
+
+
 static void
 port_92_close(void *priv)
 {
@@ -214,7 +244,8 @@ const device_t port_92_device = {
     0,
     port_92_init, port_92_close, NULL,
     { NULL }, NULL, NULL,
-    NULL
+    NULL,
+    port_92_save_state, port_92_load_state
 };
 
 
@@ -224,7 +255,8 @@ const device_t port_92_inv_device = {
     PORT_92_INV,
     port_92_init, port_92_close, NULL,
     { NULL }, NULL, NULL,
-    NULL
+    NULL,
+    port_92_save_state, port_92_load_state
 };
 
 
@@ -234,7 +266,8 @@ const device_t port_92_word_device = {
     PORT_92_WORD,
     port_92_init, port_92_close, NULL,
     { NULL }, NULL, NULL,
-    NULL
+    NULL,
+    port_92_save_state, port_92_load_state
 };
 
 
@@ -244,5 +277,6 @@ const device_t port_92_pci_device = {
     PORT_92_PCI,
     port_92_init, port_92_close, NULL,
     { NULL }, NULL, NULL,
-    NULL
+    NULL,
+    port_92_save_state, port_92_load_state
 };
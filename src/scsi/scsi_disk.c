@@ -423,6 +423,17 @@ scsi_disk_invalid_field_pl(scsi_disk_t *dev)
 }
 
 
+/* The image could not be read, or an earlier write to it failed. */
+static void
+scsi_disk_medium_error(scsi_disk_t *dev)
+{
+    scsi_disk_sense_key = SENSE_MEDIUM_ERROR;
+    scsi_disk_asc = ASC_UNRECOVERED_READ_ERROR;
+    scsi_disk_ascq = 0;
+    scsi_disk_cmd_error(dev);
+}
+
+
 static void
 scsi_disk_data_phase_error(scsi_disk_t *dev)
 {
@@ -567,7 +578,7 @@ scsi_disk_command(scsi_common_t *sc, uint8_t *cdb)
     int pos = 0;
     int idx = 0;
     unsigned size_idx, preamble_len;
-    uint32_t last_sector = 0;
+    uint32_t last_sector = 0, ticket;
     char device_identify[9] = { '8', '6', 'B', '_', 'H', 'D', '0', '0', 0 };
     char device_identify_ex[15] = { '8', '6', 'B', '_', 'H', 'D', '0', '0', ' ', 'v', '1', '.', '0', '0', 0 };
     int block_desc = 0;
@@ -709,10 +720,17 @@ scsi_disk_command(scsi_common_t *sc, uint8_t *cdb)
 		scsi_disk_set_phase(dev, SCSI_PHASE_DATA_IN);
 
 		if ((dev->requested_blocks > 0) && (*BufLen > 0)) {
+			/* The data is needed right away, but going through the worker
+			   lets sequential reads hit its read-ahead. */
 			if (dev->packet_len > (uint32_t) *BufLen)
-				hdd_image_read(dev->id, dev->sector_pos, *BufLen >> 9, dev->temp_buffer);
+				ticket = hdd_async_read(dev->id, dev->sector_pos, *BufLen >> 9, dev->temp_buffer);
 			else
-				hdd_image_read(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
+				ticket = hdd_async_read(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
+
+			if (hdd_async_wait(dev->id, ticket)) {
+				scsi_disk_medium_error(dev);
+				return;
+			}
 		}
 
 		if (dev->requested_blocks > 1)
@@ -1098,9 +1116,9 @@ scsi_disk_phase_data_out(scsi_common_t *sc)
 	case GPCMD_WRITE_AND_VERIFY_12:
 		if ((dev->requested_blocks > 0) && (*BufLen > 0)) {
 			if (dev->packet_len > (uint32_t) *BufLen)
-				hdd_image_write(dev->id, dev->sector_pos, *BufLen >> 9, dev->temp_buffer);
+				hdd_async_write(dev->id, dev->sector_pos, *BufLen >> 9, dev->temp_buffer);
 			else
-				hdd_image_write(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
+				hdd_async_write(dev->id, dev->sector_pos, dev->requested_blocks, dev->temp_buffer);
 		}
 		break;
 	case GPCMD_WRITE_SAME_10:
@@ -1128,7 +1146,7 @@ scsi_disk_phase_data_out(scsi_common_t *sc)
 				dev->temp_buffer[6] = (s >> 8) & 0xff;
 				dev->temp_buffer[7] = s & 0xff;
 			}
-			hdd_image_write(dev->id, i, 1, dev->temp_buffer);
+			hdd_async_write(dev->id, i, 1, dev->temp_buffer);
 		}
 		break;
 	case GPCMD_MODE_SELECT_6:
@@ -0,0 +1,638 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Implementation of the machine state snapshots.
+ *
+ *		The CPU and RAM sections are handled here, everything else
+ *		is delegated to the module or device owning the state. RAM
+ *		is stored as a bitmap of the non-zero 4K pages, followed by
+ *		a single deflate stream of just those pages.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <zlib.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include "cpu.h"
+#include "x86.h"
+#include "x87.h"
+#include <86box/timer.h>
+#include <86box/mem.h>
+#include <86box/nmi.h>
+#include <86box/machine.h>
+#include <86box/plat.h>
+#include <86box/snapshot.h>
+
+
+#define SNAPSHOT_PAGE_SIZE	4096
+#define SNAPSHOT_ZBUF_SIZE	65536
+
+
+struct _snapshot_ {
+    FILE	*f;
+
+    /* The section currently being written or read. */
+    uint8_t	*buf;
+    uint32_t	size, len, pos;
+    char	name[SNAPSHOT_NAME_LEN];
+
+    int		error;
+};
+
+typedef struct {
+    char	magic[8];
+    uint32_t	version;
+    uint32_t	cpu_state_size;
+    char	machine[SNAPSHOT_NAME_LEN];
+    char	cpu_family[SNAPSHOT_NAME_LEN];
+    int32_t	cpu;
+    uint32_t	mem_size;
+} snapshot_header_t;
+
+typedef struct {
+    char	name[SNAPSHOT_NAME_LEN];
+    uint32_t	len;
+} snapshot_section_t;
+
+
+#ifdef ENABLE_SNAPSHOT_LOG
+int snapshot_do_log = ENABLE_SNAPSHOT_LOG;
+
+
+static void
+snapshot_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (snapshot_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define snapshot_log(fmt, ...)
+#endif
+
+
+static void
+snapshot_reserve(snapshot_t *s, uint32_t len)
+{
+    if ((s->len + len) <= s->size)
+	return;
+
+    while ((s->len + len) > s->size)
+	s->size = s->size ? (s->size * 2) : 65536;
+
+    s->buf = (uint8_t *) realloc(s->buf, s->size);
+    if (s->buf == NULL)
+	fatal("snapshot_reserve(): out of memory\n");
+}
+
+
+void
+snapshot_write(snapshot_t *s, const void *data, uint32_t len)
+{
+    snapshot_reserve(s, len);
+    memcpy(s->buf + s->len, data, len);
+    s->len += len;
+}
+
+
+void
+snapshot_read(snapshot_t *s, void *data, uint32_t len)
+{
+    if ((s->pos + len) > s->len) {
+	snapshot_log("SNAPSHOT: section '%s' is too short\n", s->name);
+	memset(data, 0x00, len);
+	s->pos = s->len;
+	s->error = 1;
+	return;
+    }
+
+    memcpy(data, s->buf + s->pos, len);
+    s->pos += len;
+}
+
+
+int
+snapshot_error(snapshot_t *s)
+{
+    return s->error;
+}
+
+
+/* For state handlers that find their device in a state they can not save. */
+void
+snapshot_unsupported(snapshot_t *s, const char *what)
+{
+    pclog("SNAPSHOT: %s has no snapshot support, not saving\n", what);
+    s->error = 1;
+}
+
+
+/* Timers are stored relative to the TSC, so that they can be put back in
+   the queue no matter what state it is in at restore time. */
+void
+snapshot_write_timer(snapshot_t *s, pc_timer_t *timer)
+{
+    uint8_t enabled = timer_is_enabled(timer);
+    int64_t delta = (int64_t) (timer->ts.ts64 - (tsc << 32));
+    int32_t split = !!(timer->flags & TIMER_SPLIT);
+
+    snapshot_put(s, enabled);
+    snapshot_put(s, delta);
+    snapshot_put(s, split);
+    snapshot_put(s, timer->period);
+}
+
+
+void
+snapshot_read_timer(snapshot_t *s, pc_timer_t *timer)
+{
+    uint8_t enabled;
+    int64_t delta;
+    int32_t split;
+
+    snapshot_get(s, enabled);
+    snapshot_get(s, delta);
+    snapshot_get(s, split);
+    snapshot_get(s, timer->period);
+
+    timer_disable(timer);
+
+    if (split)
+	timer->flags |= TIMER_SPLIT;
+    else
+	timer->flags &= ~TIMER_SPLIT;
+
+    if (enabled) {
+	timer->ts.ts64 = (tsc << 32) + delta;
+	timer_enable(timer);
+    }
+}
+
+
+void
+snapshot_section_begin(snapshot_t *s, const char *name)
+{
+    memset(s->name, 0x00, sizeof(s->name));
+    strncpy(s->name, name, sizeof(s->name) - 1);
+    s->len = 0;
+}
+
+
+void
+snapshot_section_end(snapshot_t *s)
+{
+    snapshot_section_t sec;
+
+    memcpy(sec.name, s->name, sizeof(sec.name));
+    sec.len = s->len;
+
+    if ((fwrite(&sec, 1, sizeof(sec), s->f) != sizeof(sec)) ||
+	(s->len && (fwrite(s->buf, 1, s->len, s->f) != s->len)))
+	s->error = 1;
+}
+
+
+static int
+snapshot_section_next(snapshot_t *s)
+{
+    snapshot_section_t sec;
+
+    if (fread(&sec, 1, sizeof(sec), s->f) != sizeof(sec))
+	return 0;
+
+    sec.name[SNAPSHOT_NAME_LEN - 1] = '\0';
+    memcpy(s->name, sec.name, sizeof(s->name));
+    s->len = 0;
+    s->pos = 0;
+    snapshot_reserve(s, sec.len);
+    if (fread(s->buf, 1, sec.len, s->f) != sec.len)
+	return 0;
+    s->len = sec.len;
+
+    return 1;
+}
+
+
+static void
+snapshot_header_fill(snapshot_header_t *hdr)
+{
+    memset(hdr, 0x00, sizeof(snapshot_header_t));
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->cpu_state_size = sizeof(cpu_state_t);
+    strncpy(hdr->machine, machine_get_internal_name(), SNAPSHOT_NAME_LEN - 1);
+    strncpy(hdr->cpu_family, cpu_f->internal_name, SNAPSHOT_NAME_LEN - 1);
+    hdr->cpu = cpu;
+    hdr->mem_size = mem_size;
+}
+
+
+static void
+cpu_save_state(snapshot_t *s)
+{
+    snapshot_put(s, tsc);
+    snapshot_put(s, cpu_state);
+    snapshot_put(s, cr2);
+    snapshot_put(s, cr3);
+    snapshot_put(s, cr4);
+    snapshot_put(s, dr);
+    snapshot_put(s, gdt);
+    snapshot_put(s, ldt);
+    snapshot_put(s, idt);
+    snapshot_put(s, tr);
+    snapshot_put(s, msr);
+    snapshot_put(s, cpu_cur_status);
+    snapshot_put(s, use32);
+    snapshot_put(s, stack32);
+    snapshot_put(s, oldcpl);
+    snapshot_put(s, in_smm);
+    snapshot_put(s, smi_latched);
+    snapshot_put(s, smm_in_hlt);
+    snapshot_put(s, smbase);
+    snapshot_put(s, amd_efer);
+    snapshot_put(s, star);
+    snapshot_put(s, cs_msr);
+    snapshot_put(s, esp_msr);
+    snapshot_put(s, eip_msr);
+    snapshot_put(s, x87_pc_off);
+    snapshot_put(s, x87_op_off);
+    snapshot_put(s, x87_pc_seg);
+    snapshot_put(s, x87_op_seg);
+    snapshot_put(s, nmi);
+    snapshot_put(s, nmi_mask);
+    snapshot_put(s, nmi_enable);
+    snapshot_put(s, cpu_fast_off_count);
+    snapshot_put(s, cpu_fast_off_val);
+    snapshot_put(s, cpu_fast_off_flags);
+#ifdef USE_DYNAREC
+    snapshot_put(s, codegen_flat_ds);
+    snapshot_put(s, codegen_flat_ss);
+#endif
+}
+
+
+static int
+cpu_load_state(snapshot_t *s)
+{
+    cpu_state_t host_state;
+    uint64_t old_tsc = tsc;
+    uint32_t delta;
+    int c;
+
+    snapshot_get(s, tsc);
+
+    /* Timers that nobody restores keep their distance to the TSC. */
+    delta = (uint32_t) (tsc - old_tsc);
+    for (c = 0; c < timer_heap_count; c++)
+	timer_heap[c]->ts.ts32.integer += delta;
+    if (timer_heap_count)
+	timer_target = timer_heap[0]->ts.ts32.integer;
+
+    /* Keep the host side of the state. */
+    memcpy(&host_state, &cpu_state, sizeof(cpu_state_t));
+    snapshot_get(s, cpu_state);
+    cpu_state.ea_seg = &cpu_state.seg_ds;
+#ifdef USE_NEW_DYNAREC
+    cpu_state.old_fp_control = host_state.old_fp_control;
+#if defined i386 || defined __i386 || defined __i386__ || defined _X86_ || defined _M_IX86
+    cpu_state.old_fp_control2 = host_state.old_fp_control2;
+#endif
+#endif
+
+    snapshot_get(s, cr2);
+    snapshot_get(s, cr3);
+    snapshot_get(s, cr4);
+    snapshot_get(s, dr);
+    snapshot_get(s, gdt);
+    snapshot_get(s, ldt);
+    snapshot_get(s, idt);
+    snapshot_get(s, tr);
+    snapshot_get(s, msr);
+    snapshot_get(s, cpu_cur_status);
+    snapshot_get(s, use32);
+    snapshot_get(s, stack32);
+    snapshot_get(s, oldcpl);
+    snapshot_get(s, in_smm);
+    snapshot_get(s, smi_latched);
+    snapshot_get(s, smm_in_hlt);
+    snapshot_get(s, smbase);
+    snapshot_get(s, amd_efer);
+    snapshot_get(s, star);
+    snapshot_get(s, cs_msr);
+    snapshot_get(s, esp_msr);
+    snapshot_get(s, eip_msr);
+    snapshot_get(s, x87_pc_off);
+    snapshot_get(s, x87_op_off);
+    snapshot_get(s, x87_pc_seg);
+    snapshot_get(s, x87_op_seg);
+    snapshot_get(s, nmi);
+    snapshot_get(s, nmi_mask);
+    snapshot_get(s, nmi_enable);
+    snapshot_get(s, cpu_fast_off_count);
+    snapshot_get(s, cpu_fast_off_val);
+    snapshot_get(s, cpu_fast_off_flags);
+#ifdef USE_DYNAREC
+    snapshot_get(s, codegen_flat_ds);
+    snapshot_get(s, codegen_flat_ss);
+#endif
+
+    return 0;
+}
+
+
+static uint8_t *
+ram_page(uint32_t page)
+{
+    uint32_t addr = page * SNAPSHOT_PAGE_SIZE;
+
+    if (addr >= (1 << 30))
+	return &ram2[addr - (1 << 30)];
+
+    return &ram[addr];
+}
+
+
+static int
+ram_page_is_zero(uint8_t *p)
+{
+    uint64_t *q = (uint64_t *) p;
+    int c;
+
+    for (c = 0; c < (SNAPSHOT_PAGE_SIZE / 8); c++) {
+	if (q[c])
+		return 0;
+    }
+
+    return 1;
+}
+
+
+static void
+ram_save_state(snapshot_t *s)
+{
+    uint32_t pages = (mem_size * 1024) / SNAPSHOT_PAGE_SIZE;
+    uint32_t map_len = (pages + 7) >> 3;
+    uint8_t *map, *zbuf;
+    z_stream zs;
+    uint32_t c;
+    int flush;
+
+    map = (uint8_t *) malloc(map_len);
+    zbuf = (uint8_t *) malloc(SNAPSHOT_ZBUF_SIZE);
+    memset(map, 0x00, map_len);
+
+    for (c = 0; c < pages; c++) {
+	if (!ram_page_is_zero(ram_page(c)))
+		map[c >> 3] |= (1 << (c & 7));
+    }
+
+    snapshot_put(s, pages);
+    snapshot_write(s, map, map_len);
+
+    memset(&zs, 0x00, sizeof(z_stream));
+    deflateInit(&zs, Z_BEST_SPEED);
+
+    for (c = 0; c <= pages; c++) {
+	if (c == pages) {
+		zs.next_in = NULL;
+		zs.avail_in = 0;
+		flush = Z_FINISH;
+	} else if (map[c >> 3] & (1 << (c & 7))) {
+		zs.next_in = ram_page(c);
+		zs.avail_in = SNAPSHOT_PAGE_SIZE;
+		flush = Z_NO_FLUSH;
+	} else
+		continue;
+
+	do {
+		zs.next_out = zbuf;
+		zs.avail_out = SNAPSHOT_ZBUF_SIZE;
+		deflate(&zs, flush);
+		snapshot_write(s, zbuf, SNAPSHOT_ZBUF_SIZE - zs.avail_out);
+	} while (zs.avail_out == 0);
+    }
+
+    deflateEnd(&zs);
+
+    free(zbuf);
+    free(map);
+}
+
+
+static int
+ram_load_state(snapshot_t *s)
+{
+    uint32_t pages, map_len, c;
+    uint8_t *map;
+    z_stream zs;
+    int ret = 0;
+
+    snapshot_get(s, pages);
+    if (pages != ((mem_size * 1024) / SNAPSHOT_PAGE_SIZE))
+	return -1;
+
+    map_len = (pages + 7) >> 3;
+    map = (uint8_t *) malloc(map_len);
+    snapshot_read(s, map, map_len);
+    if (s->error) {
+	free(map);
+	return -1;
+    }
+
+    memset(&zs, 0x00, sizeof(z_stream));
+    inflateInit(&zs);
+    zs.next_in = s->buf + s->pos;
+    zs.avail_in = s->len - s->pos;
+
+    for (c = 0; c < pages; c++) {
+	if (!(map[c >> 3] & (1 << (c & 7)))) {
+		memset(ram_page(c), 0x00, SNAPSHOT_PAGE_SIZE);
+		continue;
+	}
+
+	zs.next_out = ram_page(c);
+	zs.avail_out = SNAPSHOT_PAGE_SIZE;
+	inflate(&zs, Z_SYNC_FLUSH);
+	if (zs.avail_out != 0) {
+		snapshot_log("SNAPSHOT: RAM data is truncated at page %08X\n", c);
+		ret = -1;
+		break;
+	}
+    }
+
+    s->pos = s->len - zs.avail_in;
+    inflateEnd(&zs);
+
+    free(map);
+
+    return ret;
+}
+
+
+int
+snapshot_save(wchar_t *fn)
+{
+    snapshot_header_t hdr;
+    snapshot_t s;
+    const char *dev;
+
+    dev = device_state_unsupported();
+    if (dev != NULL) {
+	pclog("SNAPSHOT: device '%s' has no snapshot support, not saving\n", dev);
+	return -1;
+    }
+
+    memset(&s, 0x00, sizeof(snapshot_t));
+
+    s.f = plat_fopen(fn, L"wb");
+    if (s.f == NULL) {
+	snapshot_log("SNAPSHOT: unable to create '%ls'\n", fn);
+	return -1;
+    }
+
+    snapshot_header_fill(&hdr);
+    if (fwrite(&hdr, 1, sizeof(hdr), s.f) != sizeof(hdr))
+	s.error = 1;
+
+    snapshot_section_begin(&s, "cpu");
+    cpu_save_state(&s);
+    snapshot_section_end(&s);
+
+    snapshot_section_begin(&s, "ram");
+    ram_save_state(&s);
+    snapshot_section_end(&s);
+
+    snapshot_section_begin(&s, "mem");
+    mem_save_state(&s);
+    snapshot_section_end(&s);
+
+    snapshot_section_begin(&s, "pic");
+    pic_save_state(&s);
+    snapshot_section_end(&s);
+
+    snapshot_section_begin(&s, "dma");
+    dma_save_state(&s);
+    snapshot_section_end(&s);
+
+    device_save_state(&s);
+
+    snapshot_section_begin(&s, "end");
+    snapshot_section_end(&s);
+
+    fclose(s.f);
+    if (s.buf != NULL)
+	free(s.buf);
+
+    /* Never leave an incomplete snapshot around. */
+    if (s.error) {
+	pclog("SNAPSHOT: unable to save '%ls'\n", fn);
+	plat_remove(fn);
+	return -1;
+    }
+
+    pclog("SNAPSHOT: saved '%ls'\n", fn);
+
+    return 0;
+}
+
+
+int
+snapshot_load(wchar_t *fn)
+{
+    snapshot_header_t hdr, cur;
+    snapshot_t s;
+    const char *dev;
+    int ret = 0;
+
+    /* The state of such a device would be left as it is now. */
+    dev = device_state_unsupported();
+    if (dev != NULL) {
+	pclog("SNAPSHOT: device '%s' has no snapshot support, not restoring\n", dev);
+	return -1;
+    }
+
+    memset(&s, 0x00, sizeof(snapshot_t));
+
+    s.f = plat_fopen(fn, L"rb");
+    if (s.f == NULL) {
+	pclog("SNAPSHOT: unable to open '%ls'\n", fn);
+	return -1;
+    }
+
+    /* Only restore onto the exact same machine. */
+    snapshot_header_fill(&cur);
+    if ((fread(&hdr, 1, sizeof(hdr), s.f) != sizeof(hdr)) ||
+	memcmp(hdr.magic, cur.magic, sizeof(hdr.magic)) ||
+	(hdr.version != cur.version) || (hdr.cpu_state_size != cur.cpu_state_size)) {
+	pclog("SNAPSHOT: '%ls' is not a valid snapshot for this build\n", fn);
+	fclose(s.f);
+	return -1;
+    }
+    hdr.machine[SNAPSHOT_NAME_LEN - 1] = hdr.cpu_family[SNAPSHOT_NAME_LEN - 1] = '\0';
+    if (strcmp(hdr.machine, cur.machine) || strcmp(hdr.cpu_family, cur.cpu_family) ||
+	(hdr.cpu != cur.cpu) || (hdr.mem_size != cur.mem_size)) {
+	pclog("SNAPSHOT: '%ls' was taken with a different configuration\n", fn);
+	fclose(s.f);
+	return -1;
+    }
+
+    while (ret == 0) {
+	if (!snapshot_section_next(&s)) {
+		pclog("SNAPSHOT: '%ls' is truncated\n", fn);
+		ret = -1;
+		break;
+	}
+
+	snapshot_log("SNAPSHOT: section '%s', %i bytes\n", s.name, s.len);
+
+	if (!strcmp(s.name, "end"))
+		break;
+	else if (!strcmp(s.name, "cpu"))
+		ret = cpu_load_state(&s);
+	else if (!strcmp(s.name, "ram"))
+		ret = ram_load_state(&s);
+	else if (!strcmp(s.name, "mem"))
+		ret = mem_load_state(&s);
+	else if (!strcmp(s.name, "pic"))
+		ret = pic_load_state(&s);
+	else if (!strcmp(s.name, "dma"))
+		ret = dma_load_state(&s);
+	else if (!strncmp(s.name, "dev:", 4))
+		ret = device_load_state(&s, s.name);
+	else
+		pclog("SNAPSHOT: skipping unknown section '%s'\n", s.name);
+
+	if (s.error)
+		ret = -1;
+	if (ret)
+		pclog("SNAPSHOT: unable to restore section '%s'\n", s.name);
+    }
+
+    fclose(s.f);
+    if (s.buf != NULL)
+	free(s.buf);
+
+    /* Nothing cached from before the restore is valid anymore. */
+    flushmmucache();
+#ifdef USE_DYNAREC
+    codegen_reset();
+#endif
+
+    if (ret == 0)
+	pclog("SNAPSHOT: restored '%ls'\n", fn);
+
+    return ret;
+}
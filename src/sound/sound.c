@@ -38,6 +38,7 @@
 #include <86box/snd_sb_dsp.h>
 #include <86box/snd_azt2316a.h>
 #include <86box/filters.h>
+#include <86box/capture.h>
 
 
 typedef struct {
@@ -306,10 +307,12 @@ sound_cd_thread(void *param)
 		}
 	}
 
-	if (sound_is_float)
-		givealbuffer_cd(cd_out_buffer);
-	else
-		givealbuffer_cd(cd_out_buffer_int16);
+	if (!turbo_mode) {
+		if (sound_is_float)
+			givealbuffer_cd(cd_out_buffer);
+		else
+			givealbuffer_cd(cd_out_buffer_int16);
+	}
     }
 }
 
@@ -400,6 +403,10 @@ sound_poll(void *priv)
 	for (c = 0; c < sound_handlers_num; c++)
 		sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
 
+	/* Captured even in turbo mode, the file keeps time with the guest. */
+	if (capture_on)
+		capture_audio(outbuffer, SOUNDBUFLEN);
+
 	for (c = 0; c < SOUNDBUFLEN * 2; c++) {
 		if (sound_is_float)
 			outbuffer_ex[c] = ((float) outbuffer[c]) / 32768.0;
@@ -413,10 +420,13 @@ sound_poll(void *priv)
 		}
 	}
 
-	if (sound_is_float)
-		givealbuffer(outbuffer_ex);
-	else
-		givealbuffer(outbuffer_ex_int16);
+	/* Turbo mode makes sound faster than it can be played, drop it. */
+	if (!turbo_mode) {
+		if (sound_is_float)
+			givealbuffer(outbuffer_ex);
+		else
+			givealbuffer(outbuffer_ex_int16);
+	}
 
 	if (cd_thread_enable) {
                 cd_buf_update--;
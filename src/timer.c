@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
 #include <86box/86box.h>
@@ -9,64 +10,127 @@
 uint64_t TIMER_USEC;
 uint32_t timer_target;
 
-/*Enabled timers are stored in a linked list, with the first timer to expire at
-  the head.*/
-pc_timer_t *timer_head = NULL;
+/*Enabled timers are stored in a 4-ary min-heap ordered by timestamp, with the
+  first timer to expire at timer_heap[0]. Each timer records its own position in
+  the heap, so arming and disarming a timer are both O(log n).*/
+pc_timer_t **timer_heap = NULL;
+int timer_heap_count = 0;
+static int timer_heap_size = 0;
+
+#define TIMER_HEAP_PARENT(pos)	(((pos) - 1) >> 2)
+#define TIMER_HEAP_CHILD(pos)	(((pos) << 2) + 1)
 
 /* Are we initialized? */
 int timer_inited = 0;
 
 
+static int
+timer_in_heap(pc_timer_t *timer)
+{
+    return (timer->heap_pos < timer_heap_count) && (timer_heap[timer->heap_pos] == timer);
+}
+
+
+static void
+timer_heap_place(pc_timer_t *timer, int pos)
+{
+    timer_heap[pos] = timer;
+    timer->heap_pos = pos;
+}
+
+
+static void
+timer_heap_sift_up(pc_timer_t *timer, int pos)
+{
+    int parent;
+
+    while (pos > 0) {
+	parent = TIMER_HEAP_PARENT(pos);
+	if (TIMER_LESS_THAN(timer_heap[parent], timer))
+		break;
+
+	timer_heap_place(timer_heap[parent], pos);
+	pos = parent;
+    }
+
+    timer_heap_place(timer, pos);
+}
+
+
+static void
+timer_heap_sift_down(pc_timer_t *timer, int pos)
+{
+    int c, child, first, last;
+
+    while (1) {
+	first = TIMER_HEAP_CHILD(pos);
+	if (first >= timer_heap_count)
+		break;
+
+	last = first + 4;
+	if (last > timer_heap_count)
+		last = timer_heap_count;
+
+	/*Find the earliest of up to four children*/
+	child = first;
+	for (c = first + 1; c < last; c++) {
+		if (!TIMER_LESS_THAN(timer_heap[child], timer_heap[c]))
+			child = c;
+	}
+
+	if (TIMER_LESS_THAN(timer, timer_heap[child]))
+		break;
+
+	timer_heap_place(timer_heap[child], pos);
+	pos = child;
+    }
+
+    timer_heap_place(timer, pos);
+}
+
+
+static void
+timer_heap_remove(int pos)
+{
+    pc_timer_t *last;
+
+    last = timer_heap[--timer_heap_count];
+    timer_heap[timer_heap_count] = NULL;
+    if (pos == timer_heap_count)
+	return;
+
+    /*Move the last timer into the hole, then restore heap order from there*/
+    if ((pos > 0) && !TIMER_LESS_THAN(timer_heap[TIMER_HEAP_PARENT(pos)], last))
+	timer_heap_sift_up(last, pos);
+    else
+	timer_heap_sift_down(last, pos);
+}
+
+
 void
 timer_enable(pc_timer_t *timer)
 {
-    pc_timer_t *timer_node = timer_head;
-
     if (!timer_inited || (timer == NULL))
 	return;
 
     if (timer->flags & TIMER_ENABLED)
 	timer_disable(timer);
 
-    if (timer->next || timer->prev)
-	fatal("timer_enable - timer->next\n");
+    if (timer_tracing)
+	timer_trace_add(timer, 1);
 
-    timer->flags |= TIMER_ENABLED;
-
-    /*List currently empty - add to head*/
-    if (!timer_head) {
-	timer_head = timer;
-	timer->next = timer->prev = NULL;
-	timer_target = timer_head->ts.ts32.integer;
-	return;
+    if (timer_heap_count == timer_heap_size) {
+	timer_heap_size = timer_heap_size ? (timer_heap_size * 2) : 64;
+	timer_heap = (pc_timer_t **) realloc(timer_heap, timer_heap_size * sizeof(pc_timer_t *));
+	if (timer_heap == NULL)
+		fatal("timer_enable - out of memory\n");
     }
 
-    timer_node = timer_head;
-
-    while(1) {
-	/*Timer expires before timer_node. Add to list in front of timer_node*/
-	if (TIMER_LESS_THAN(timer, timer_node)) {
-		timer->next = timer_node;
-		timer->prev = timer_node->prev;
-		timer_node->prev = timer;
-		if (timer->prev)
-			timer->prev->next = timer;
-		else {
-			timer_head = timer;
-			timer_target = timer_head->ts.ts32.integer;
-		}
-		return;
-	}
+    timer->flags |= TIMER_ENABLED;
 
-	/*timer_node is last in the list. Add timer to end of list*/
-	if (!timer_node->next) {
-		timer_node->next = timer;
-		timer->prev = timer_node;
-		return;
-	}
+    timer_heap_sift_up(timer, timer_heap_count++);
 
-	timer_node = timer_node->next;
-    }
+    timer_target = timer_heap[0]->ts.ts32.integer;
 }
 
 
@@ -76,18 +140,19 @@ timer_disable(pc_timer_t *timer)
     if (!timer_inited || (timer == NULL) || !(timer->flags & TIMER_ENABLED))
 	return;
 
-    if (!timer->next && !timer->prev && timer != timer_head)
-	fatal("timer_disable - !timer->next\n");
+    if (timer_tracing)
+	timer_trace_add(timer, 0);
 
     timer->flags &= ~TIMER_ENABLED;
 
-    if (timer->prev)
-	timer->prev->next = timer->next;
-    else
-	timer_head = timer->next;
-    if (timer->next)
-	timer->next->prev = timer->prev;
-    timer->prev = timer->next = NULL;
+    /*Timers left enabled over a timer_close() are no longer in the heap*/
+    if (!timer_in_heap(timer))
+	return;
+
+    timer_heap_remove(timer->heap_pos);
+
+    if (timer_heap_count)
+	timer_target = timer_heap[0]->ts.ts32.integer;
 }
 
 
@@ -99,14 +164,9 @@ timer_remove_head(void)
     if (!timer_inited)
 	return;
 
-    if (timer_head) {
-	timer = timer_head;
-	timer_head = timer->next;
-	if (timer_head) {
-		timer_head->prev = NULL;
-		timer->next->prev = NULL;
-	}
-	timer->next = timer->prev = NULL;
+    if (timer_heap_count) {
+	timer = timer_heap[0];
+	timer_heap_remove(0);
 	timer->flags &= ~TIMER_ENABLED;
     }
 }
@@ -117,11 +177,11 @@ timer_process(void)
 {
     pc_timer_t *timer;
 
-    if (!timer_inited || !timer_head)
+    if (!timer_inited || !timer_heap_count)
 	return;
 
-    while(1) {
-	timer = timer_head;
+    while (timer_heap_count) {
+	timer = timer_heap[0];
 
 	if (!TIMER_LESS_THAN_VAL(timer, (uint32_t)tsc))
 		break;
@@ -134,25 +194,18 @@ timer_process(void)
 		timer->callback(timer->p);
     }
 
-    timer_target = timer_head->ts.ts32.integer;
+    if (timer_heap_count)
+	timer_target = timer_heap[0]->ts.ts32.integer;
 }
 
 
 void
 timer_close(void)
 {
-    pc_timer_t *t = timer_head, *r;
-
-    /* Set all timers' prev and next to NULL so it is assured that
-       timers that are not in malloc'd structs don't keep pointing
-       to timers that may be in malloc'd structs. */
-    while (t != NULL) {
-	r = t;
-	r->prev = r->next = NULL;
-	t = r->next;
-    }
-
-    timer_head = NULL;
+    /* Just forget about the enabled timers, some of them may be in malloc'd
+       structs which have already been freed. Their stale TIMER_ENABLED flag
+       is caught by timer_in_heap(). */
+    timer_heap_count = 0;
 
     timer_inited = 0;
 }
@@ -176,7 +229,6 @@ timer_add(pc_timer_t *timer, void (*callback)(void *p), void *p, int start_timer
     timer->callback = callback;
     timer->p = p;
     timer->flags = 0;
-    timer->prev = timer->next = NULL;
     if (start_timer)
 	timer_set_delay_u64(timer, 0);
 }
@@ -0,0 +1,338 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Timer queue microbenchmark.
+ *
+ *		While the benchmark mode runs, every arm and disarm of a
+ *		timer is recorded along with the TSC at the time. The trace
+ *		is then replayed through the timer heap in timer.c and
+ *		through the sorted linked list it replaced, kept here in its
+ *		original form, so that the two can be compared on the same
+ *		workload. Timers are processed during the replay whenever the
+ *		TSC passes timer_target, as the CPU loops do.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/timer.h>
+#include <86box/plat.h>
+
+
+/* Enough for a few seconds of a busy machine. */
+#define TIMER_TRACE_MAX		(1 << 21)
+#define TIMER_REPLAY_PASSES	8
+
+enum {
+    TIMER_TRACE_ENABLE = 0,
+    TIMER_TRACE_DISABLE
+};
+
+typedef struct {
+    uint64_t	ts;
+    uintptr_t	timer;
+    uint32_t	tsc;
+    uint32_t	op;
+} timer_trace_t;
+
+/* A timer in the old list, which only needs the fields the list used. */
+typedef struct list_timer_t {
+    ts_t	ts;
+    int		flags;
+
+    struct list_timer_t *prev, *next;
+} list_timer_t;
+
+
+int		timer_tracing = 0;
+
+static timer_trace_t	*timer_trace;
+static int		timer_trace_count;
+
+static list_timer_t	*list_head;
+static uint32_t		list_target;
+
+
+void
+timer_trace_start(void)
+{
+    if (timer_trace == NULL)
+	timer_trace = (timer_trace_t *) malloc(TIMER_TRACE_MAX * sizeof(timer_trace_t));
+
+    timer_trace_count = 0;
+    timer_tracing = (timer_trace != NULL);
+}
+
+
+void
+timer_trace_add(pc_timer_t *timer, int enable)
+{
+    timer_trace_t *ev;
+
+    if (timer_trace_count == TIMER_TRACE_MAX) {
+	timer_tracing = 0;
+	return;
+    }
+
+    ev = &timer_trace[timer_trace_count++];
+    ev->ts = timer->ts.ts64;
+    ev->timer = (uintptr_t) timer;
+    ev->tsc = (uint32_t) tsc;
+    ev->op = enable ? TIMER_TRACE_ENABLE : TIMER_TRACE_DISABLE;
+}
+
+
+/* The sorted list, as timer.c had it before the heap. */
+static void list_disable(list_timer_t *timer);
+
+
+static void
+list_enable(list_timer_t *timer)
+{
+    list_timer_t *timer_node;
+
+    if (timer->flags & TIMER_ENABLED)
+	list_disable(timer);
+
+    timer->flags |= TIMER_ENABLED;
+
+    /*List currently empty - add to head*/
+    if (!list_head) {
+	list_head = timer;
+	timer->next = timer->prev = NULL;
+	list_target = list_head->ts.ts32.integer;
+	return;
+    }
+
+    timer_node = list_head;
+
+    while(1) {
+	/*Timer expires before timer_node. Add to list in front of timer_node*/
+	if (TIMER_LESS_THAN(timer, timer_node)) {
+		timer->next = timer_node;
+		timer->prev = timer_node->prev;
+		timer_node->prev = timer;
+		if (timer->prev)
+			timer->prev->next = timer;
+		else {
+			list_head = timer;
+			list_target = list_head->ts.ts32.integer;
+		}
+		return;
+	}
+
+	/*timer_node is last in the list. Add timer to end of list*/
+	if (!timer_node->next) {
+		timer_node->next = timer;
+		timer->prev = timer_node;
+		return;
+	}
+
+	timer_node = timer_node->next;
+    }
+}
+
+
+static void
+list_disable(list_timer_t *timer)
+{
+    if (!(timer->flags & TIMER_ENABLED))
+	return;
+
+    timer->flags &= ~TIMER_ENABLED;
+
+    if (timer->prev)
+	timer->prev->next = timer->next;
+    else
+	list_head = timer->next;
+    if (timer->next)
+	timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+
+static int
+list_process(void)
+{
+    list_timer_t *timer;
+    int fired = 0;
+
+    while (list_head) {
+	timer = list_head;
+
+	if (!TIMER_LESS_THAN_VAL(timer, (uint32_t)tsc))
+		break;
+
+	list_head = timer->next;
+	if (list_head)
+		list_head->prev = NULL;
+	timer->next = timer->prev = NULL;
+	timer->flags &= ~TIMER_ENABLED;
+	fired++;
+    }
+
+    if (list_head)
+	list_target = list_head->ts.ts32.integer;
+
+    return fired;
+}
+
+
+static int
+timer_trace_cmp(const void *a, const void *b)
+{
+    uintptr_t pa = *(const uintptr_t *) a, pb = *(const uintptr_t *) b;
+
+    return (pa > pb) - (pa < pb);
+}
+
+
+/* Number the traced timers densely, so the replays can use arrays. */
+static int
+timer_trace_number(uint32_t *nr)
+{
+    uintptr_t *ptrs, *p;
+    int c, n = 0;
+
+    ptrs = (uintptr_t *) malloc((uint32_t) timer_trace_count * sizeof(uintptr_t));
+    for (c = 0; c < timer_trace_count; c++)
+	ptrs[c] = timer_trace[c].timer;
+    qsort(ptrs, timer_trace_count, sizeof(uintptr_t), timer_trace_cmp);
+    for (c = 0; c < timer_trace_count; c++) {
+	if (!n || (ptrs[c] != ptrs[n - 1]))
+		ptrs[n++] = ptrs[c];
+    }
+
+    for (c = 0; c < timer_trace_count; c++) {
+	p = (uintptr_t *) bsearch(&timer_trace[c].timer, ptrs, n, sizeof(uintptr_t), timer_trace_cmp);
+	nr[c] = (uint32_t) (p - ptrs);
+    }
+
+    free(ptrs);
+
+    return n;
+}
+
+
+static uint64_t
+timer_replay_heap(uint32_t *nr, int n, int *fired)
+{
+    pc_timer_t *timers;
+    uint64_t start;
+    int c, pass;
+
+    timers = (pc_timer_t *) calloc(n, sizeof(pc_timer_t));
+    *fired = 0;
+
+    start = plat_timer_read();
+    for (pass = 0; pass < TIMER_REPLAY_PASSES; pass++) {
+	timer_close();
+	timer_init();
+	memset(timers, 0, n * sizeof(pc_timer_t));
+
+	for (c = 0; c < timer_trace_count; c++) {
+		tsc = timer_trace[c].tsc;
+		if (timer_heap_count && TIMER_VAL_LESS_THAN_VAL(timer_target, (uint32_t)tsc)) {
+			/* The callbacks are NULL, so nothing is rearmed. */
+			*fired += timer_heap_count;
+			timer_process();
+			*fired -= timer_heap_count;
+		}
+
+		if (timer_trace[c].op == TIMER_TRACE_ENABLE) {
+			timers[nr[c]].ts.ts64 = timer_trace[c].ts;
+			timer_enable(&timers[nr[c]]);
+		} else
+			timer_disable(&timers[nr[c]]);
+	}
+    }
+    start = plat_timer_read() - start;
+
+    timer_close();
+    free(timers);
+
+    return start;
+}
+
+
+static uint64_t
+timer_replay_list(uint32_t *nr, int n, int *fired)
+{
+    list_timer_t *timers;
+    uint64_t start;
+    int c, pass;
+
+    timers = (list_timer_t *) calloc(n, sizeof(list_timer_t));
+    *fired = 0;
+
+    start = plat_timer_read();
+    for (pass = 0; pass < TIMER_REPLAY_PASSES; pass++) {
+	list_head = NULL;
+	list_target = 0;
+	memset(timers, 0, n * sizeof(list_timer_t));
+
+	for (c = 0; c < timer_trace_count; c++) {
+		tsc = timer_trace[c].tsc;
+		if (list_head && TIMER_VAL_LESS_THAN_VAL(list_target, (uint32_t)tsc))
+			*fired += list_process();
+
+		if (timer_trace[c].op == TIMER_TRACE_ENABLE) {
+			timers[nr[c]].ts.ts64 = timer_trace[c].ts;
+			list_enable(&timers[nr[c]]);
+		} else
+			list_disable(&timers[nr[c]]);
+	}
+    }
+    start = plat_timer_read() - start;
+
+    free(timers);
+
+    return start;
+}
+
+
+/* Replay the trace through both queues and report the cost per arm or
+   disarm. This resets the timer system, so the machine can not be run
+   afterwards. */
+void
+timer_trace_replay(void)
+{
+    uint64_t heap_time, list_time, saved_tsc = tsc;
+    int c, n, heap_fired, list_fired, arms = 0;
+    double ops;
+    uint32_t *nr;
+
+    timer_tracing = 0;
+    if (!timer_trace_count)
+	return;
+
+    for (c = 0; c < timer_trace_count; c++) {
+	if (timer_trace[c].op == TIMER_TRACE_ENABLE)
+		arms++;
+    }
+
+    nr = (uint32_t *) malloc((uint32_t) timer_trace_count * sizeof(uint32_t));
+    n = timer_trace_number(nr);
+
+    heap_time = timer_replay_heap(nr, n, &heap_fired);
+    list_time = timer_replay_list(nr, n, &list_fired);
+
+    free(nr);
+    tsc = saved_tsc;
+
+    ops = (double) timer_trace_count * TIMER_REPLAY_PASSES;
+    printf("Timer queue:     %i timers, %i arms, %i disarms%s\n", n, arms, timer_trace_count - arms,
+	   (timer_trace_count == TIMER_TRACE_MAX) ? " (trace full)" : "");
+    printf("Timer replay:    heap %.1f ns, list %.1f ns per operation%s\n",
+	   (double) heap_time * 1000000000.0 / ((double) timer_freq * ops),
+	   (double) list_time * 1000000000.0 / ((double) timer_freq * ops),
+	   (heap_fired != list_fired) ? " (the queues fired timers differently)" : "");
+}
@@ -0,0 +1,599 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Platform main support module for headless POSIX hosts.
+ *
+ *		There is no window, renderer or audio device: the machine
+ *		runs until it is powered off or the process is interrupted,
+ *		or for a fixed time when a benchmark was requested on the
+ *		command line. The self tests run before the machine starts.
+ *		SIGUSR1 saves a snapshot of the running machine to the VM
+ *		directory, to be restored with -Z on the next start.
+ */
+#include <errno.h>
+#include <locale.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include "cpu.h"
+#include <86box/config.h>
+#include <86box/device.h>
+#include <86box/timer.h>
+#include <86box/nvr.h>
+#include <86box/video.h>
+#define GLOBAL
+#include <86box/plat.h>
+#include <86box/ui.h>
+#include <86box/version.h>
+
+
+/* Local data. */
+static thread_t		*thMain;
+static mutex_t		*blitmx;
+static volatile sig_atomic_t	stop_requested = 0,
+				snapshot_requested = 0;
+static wchar_t		empty_string[] = L"";
+
+
+#ifdef ENABLE_UNIX_LOG
+int unix_do_log = ENABLE_UNIX_LOG;
+
+
+static void
+unix_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (unix_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define unix_log(fmt, ...)
+#endif
+
+
+/* Convert a pathname for the host C library. */
+static void
+unix_path(char *dest, const wchar_t *path, int size)
+{
+    size_t len = wcstombs(dest, path, size - 1);
+
+    if (len == (size_t) -1)
+	len = 0;
+    dest[len] = '\0';
+}
+
+
+/* There is no string table; messages only use the IDs. */
+void
+set_language(int id)
+{
+}
+
+
+wchar_t *
+plat_get_string(int i)
+{
+    return(empty_string);
+}
+
+
+/* Frames are dropped once the video module is done with them. */
+static void
+unix_blit(int x, int y, int y1, int y2, int w, int h)
+{
+    video_blit_complete();
+}
+
+
+static void
+unix_signal(int sig)
+{
+    stop_requested = 1;
+}
+
+
+static void
+unix_snapshot_signal(int sig)
+{
+    snapshot_requested = 1;
+}
+
+
+/* For POSIX platforms, this is the start of the application. */
+int
+main(int argc, char *argv[])
+{
+    struct sigaction sa;
+    wchar_t **argw;
+    size_t len;
+    int c;
+
+    setlocale(LC_CTYPE, "");
+
+    /* Set the application version ID string. */
+    sprintf(emu_version, "%s v%s", EMU_NAME, EMU_VERSION);
+
+    /* The high-precision timer counts nanoseconds. */
+    timer_freq = 1000000000ULL;
+
+    /* Convert the command line to wide strings. */
+    argw = (wchar_t **)malloc(sizeof(wchar_t *) * (argc + 1));
+    for (c = 0; c < argc; c++) {
+	len = strlen(argv[c]) + 1;
+	argw[c] = (wchar_t *)malloc(sizeof(wchar_t) * len);
+	if (mbstowcs(argw[c], argv[c], len) == (size_t) -1)
+		argw[c][0] = L'\0';
+    }
+    argw[argc] = NULL;
+
+    blitmx = thread_create_mutex();
+
+    /* Pre-initialize the system, this loads the config file. */
+    if (! pc_init(argc, argw))
+	return(1);
+
+    if (! pc_init_modules()) {
+	ui_msgbox(MBX_ERROR | MBX_FATAL | MBX_ANSI, "No usable ROM images found");
+	return(6);
+    }
+
+    video_setblit(unix_blit);
+
+    if (selftest) {
+	c = pc_selftest();
+
+	pc_close(NULL);
+	return(c ? 1 : 0);
+    }
+
+    /* Fire up the machine. */
+    pc_reset_hard_init();
+
+    if (benchmark_secs) {
+	pc_benchmark();
+
+	pc_close(NULL);
+	return(0);
+    }
+
+    memset(&sa, 0x00, sizeof(sa));
+    sa.sa_handler = unix_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sa.sa_handler = unix_snapshot_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    do_start();
+
+    while (!stop_requested && !quited) {
+	if (snapshot_requested) {
+		snapshot_requested = 0;
+		pc_snapshot_save();
+	}
+	plat_delay_ms(100);
+    }
+
+    do_stop();
+
+    return(0);
+}
+
+
+void
+do_start(void)
+{
+    /* We have not stopped yet. */
+    quited = 0;
+
+    unix_log("Main timer precision: %llu\n", timer_freq);
+
+    /* Start the emulator, really. */
+    thMain = thread_create(pc_thread, &quited);
+}
+
+
+/* Cleanly stop the emulator. */
+void
+do_stop(void)
+{
+    quited = 1;
+
+    plat_delay_ms(100);
+
+    pc_close(thMain);
+
+    thMain = NULL;
+}
+
+
+void
+plat_power_off(void)
+{
+    confirm_exit = 0;
+    nvr_save();
+    config_save();
+
+    /* Deduct a sufficiently large number of cycles that no instructions will
+       run before the main thread is terminated */
+    cycles -= 99999999;
+
+    /* The main thread notices this and shuts everything down. */
+    quited = 1;
+}
+
+
+void
+plat_get_exe_name(wchar_t *s, int size)
+{
+    char temp[2048];
+    ssize_t len;
+
+    len = readlink("/proc/self/exe", temp, sizeof(temp) - 1);
+    if (len < 0)
+	len = 0;
+    temp[len] = '\0';
+
+    mbstowcs(s, temp, size);
+}
+
+
+void
+plat_tempfile(wchar_t *bufp, wchar_t *prefix, wchar_t *suffix)
+{
+    struct timeval tv;
+    struct tm *info;
+    char temp[1024];
+
+    if (prefix != NULL)
+	sprintf(temp, "%ls-", prefix);
+      else
+	strcpy(temp, "");
+
+    gettimeofday(&tv, NULL);
+    info = localtime(&tv.tv_sec);
+    sprintf(&temp[strlen(temp)], "%d%02d%02d-%02d%02d%02d-%03d%ls",
+	info->tm_year + 1900, info->tm_mon + 1, info->tm_mday,
+	info->tm_hour, info->tm_min, info->tm_sec,
+	(int) (tv.tv_usec / 1000),
+	suffix);
+    mbstowcs(bufp, temp, strlen(temp)+1);
+}
+
+
+int
+plat_getcwd(wchar_t *bufp, int max)
+{
+    char temp[2048];
+
+    if (getcwd(temp, sizeof(temp)) == NULL)
+	strcpy(temp, ".");
+
+    mbstowcs(bufp, temp, max);
+
+    return(0);
+}
+
+
+int
+plat_chdir(wchar_t *path)
+{
+    char temp[2048];
+
+    unix_path(temp, path, sizeof(temp));
+
+    return(chdir(temp));
+}
+
+
+FILE *
+plat_fopen(wchar_t *path, wchar_t *mode)
+{
+    char temp[2048], tmode[16];
+
+    unix_path(temp, path, sizeof(temp));
+    unix_path(tmode, mode, sizeof(tmode));
+
+    return(fopen(temp, tmode));
+}
+
+
+/* Open a file, using Unicode pathname, with 64bit pointers. */
+FILE *
+plat_fopen64(const wchar_t *path, const wchar_t *mode)
+{
+    return(plat_fopen((wchar_t *) path, (wchar_t *) mode));
+}
+
+
+void
+plat_remove(wchar_t *path)
+{
+    char temp[2048];
+
+    unix_path(temp, path, sizeof(temp));
+
+    remove(temp);
+}
+
+
+/* Make sure a path ends with a trailing slash. */
+void
+plat_path_slash(wchar_t *path)
+{
+    if (path[wcslen(path)-1] != L'/')
+	wcscat(path, L"/");
+}
+
+
+/* Check if the given path is absolute or not. */
+int
+plat_path_abs(wchar_t *path)
+{
+    return(path[0] == L'/');
+}
+
+
+/* Return the last element of a pathname. */
+wchar_t *
+plat_get_basename(const wchar_t *path)
+{
+    int c = (int)wcslen(path);
+
+    while (c > 0) {
+	if (path[c] == L'/')
+	   return((wchar_t *)&path[c]);
+       c--;
+    }
+
+    return((wchar_t *)path);
+}
+
+
+/* Return the 'directory' element of a pathname. */
+void
+plat_get_dirname(wchar_t *dest, const wchar_t *path)
+{
+    int c = (int)wcslen(path);
+    wchar_t *ptr;
+
+    ptr = (wchar_t *)path;
+
+    while (c > 0) {
+	if (path[c] == L'/') {
+		ptr = (wchar_t *)&path[c];
+		break;
+	}
+ 	c--;
+    }
+
+    /* Copy to destination. */
+    while (path < ptr)
+	*dest++ = *path++;
+    *dest = L'\0';
+}
+
+
+wchar_t *
+plat_get_filename(wchar_t *s)
+{
+    int c = wcslen(s) - 1;
+
+    while (c > 0) {
+	if (s[c] == L'/')
+	   return(&s[c+1]);
+       c--;
+    }
+
+    return(s);
+}
+
+
+wchar_t *
+plat_get_extension(wchar_t *s)
+{
+    int c = wcslen(s) - 1;
+
+    if (c <= 0)
+	return(s);
+
+    while (c && s[c] != L'.')
+		c--;
+
+    if (!c)
+	return(&s[wcslen(s)]);
+
+    return(&s[c+1]);
+}
+
+
+void
+plat_append_filename(wchar_t *dest, wchar_t *s1, wchar_t *s2)
+{
+    wcscat(dest, s1);
+    plat_path_slash(dest);
+    wcscat(dest, s2);
+}
+
+
+void
+plat_put_backslash(wchar_t *s)
+{
+    int c = wcslen(s) - 1;
+
+    if (s[c] != L'/')
+	   s[c] = L'/';
+}
+
+
+int
+plat_dir_check(wchar_t *path)
+{
+    struct stat st;
+    char temp[2048];
+
+    unix_path(temp, path, sizeof(temp));
+
+    if (stat(temp, &st))
+	return(0);
+
+    return(S_ISDIR(st.st_mode) ? 1 : 0);
+}
+
+
+int
+plat_dir_create(wchar_t *path)
+{
+    char temp[2048];
+
+    unix_path(temp, path, sizeof(temp));
+
+    return(mkdir(temp, 0777));
+}
+
+
+uint64_t
+plat_timer_read(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return(((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec);
+}
+
+
+uint32_t
+plat_get_ticks(void)
+{
+    return((uint32_t) (plat_timer_read() / 1000000ULL));
+}
+
+
+void
+plat_delay_ms(uint32_t count)
+{
+    struct timespec ts;
+
+    ts.tv_sec = count / 1000;
+    ts.tv_nsec = (count % 1000) * 1000000;
+
+    while (nanosleep(&ts, &ts) && (errno == EINTR))
+	;
+}
+
+
+/* Return the number of logical processors on the host. */
+int
+plat_get_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return((n > 0) ? (int) n : 1);
+}
+
+
+/* There is only the one (invisible) renderer. */
+int
+plat_vidapi(char *name)
+{
+    return(0);
+}
+
+
+char *
+plat_vidapi_name(int api)
+{
+    return("default");
+}
+
+
+int
+plat_setvid(int api)
+{
+    vid_api = api;
+
+    return(1);
+}
+
+
+void
+plat_vidsize(int x, int y)
+{
+}
+
+
+void
+plat_vidapi_enable(int enable)
+{
+}
+
+
+void
+plat_setfullscreen(int on)
+{
+}
+
+
+void
+plat_resize(int x, int y)
+{
+}
+
+
+void
+plat_pause(int p)
+{
+    dopause = p;
+}
+
+
+void
+plat_mouse_capture(int on)
+{
+    mouse_capture = 0;
+}
+
+
+void
+take_screenshot(void)
+{
+    startblit();
+    screenshots++;
+    endblit();
+    device_force_redraw();
+}
+
+
+void	/* plat_ */
+startblit(void)
+{
+    thread_wait_mutex(blitmx);
+}
+
+
+void	/* plat_ */
+endblit(void)
+{
+    thread_release_mutex(blitmx);
+}
@@ -0,0 +1,129 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Sound and MIDI output for headless POSIX hosts.
+ *
+ *		There is no audio device, so the buffers handed over by
+ *		the sound module are dropped, and there are no host MIDI
+ *		ports. The emulated sound hardware still runs normally.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/sound.h>
+#include <86box/plat.h>
+#include <86box/plat_midi.h>
+
+
+void
+al_set_midi(int freq, int buf_size)
+{
+}
+
+
+void
+closeal(void)
+{
+}
+
+
+void
+inital(void)
+{
+}
+
+
+void
+givealbuffer(void *buf)
+{
+}
+
+
+void
+givealbuffer_cd(void *buf)
+{
+}
+
+
+void
+givealbuffer_midi(void *buf, uint32_t size)
+{
+}
+
+
+void
+plat_midi_init(void)
+{
+}
+
+
+void
+plat_midi_close(void)
+{
+}
+
+
+int
+plat_midi_get_num_devs(void)
+{
+    return(0);
+}
+
+
+void
+plat_midi_get_dev_name(int num, char *s)
+{
+    strcpy(s, "");
+}
+
+
+void
+plat_midi_play_msg(uint8_t *msg)
+{
+}
+
+
+void
+plat_midi_play_sysex(uint8_t *sysex, unsigned int len)
+{
+}
+
+
+int
+plat_midi_write(uint8_t val)
+{
+    return(0);
+}
+
+
+void
+plat_midi_input_init(void)
+{
+}
+
+
+void
+plat_midi_input_close(void)
+{
+}
+
+
+int
+plat_midi_in_get_num_devs(void)
+{
+    return(0);
+}
+
+
+void
+plat_midi_in_get_dev_name(int num, char *s)
+{
+    strcpy(s, "");
+}
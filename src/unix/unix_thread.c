@@ -0,0 +1,212 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Implement threads and mutexes for POSIX platforms.
+ *
+ *		Events behave like auto-reset Win32 events: setting one
+ *		releases a single waiter, or the next thread to wait if
+ *		nobody is waiting yet. Mutexes are recursive, like their
+ *		Win32 counterparts.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/plat.h>
+
+
+typedef struct {
+    pthread_t		thread;
+} unix_thread_t;
+
+typedef struct {
+    pthread_mutex_t	mutex;
+    pthread_cond_t	cond;
+    int			state;
+} unix_event_t;
+
+
+thread_t *
+thread_create(void (*func)(void *param), void *param)
+{
+    unix_thread_t *t = malloc(sizeof(unix_thread_t));
+
+    if (pthread_create(&t->thread, NULL, (void *(*)(void *)) func, param)) {
+	free(t);
+	return(NULL);
+    }
+
+    return((thread_t *)t);
+}
+
+
+void
+thread_kill(void *arg)
+{
+    unix_thread_t *t = (unix_thread_t *)arg;
+
+    if (arg == NULL) return;
+
+    pthread_cancel(t->thread);
+    pthread_detach(t->thread);
+    free(t);
+}
+
+
+int
+thread_wait(thread_t *arg, int timeout)
+{
+    unix_thread_t *t = (unix_thread_t *)arg;
+
+    if (arg == NULL) return(0);
+
+    /* Joining cannot time out; only waiting forever is supported. */
+    if (pthread_join(t->thread, NULL)) return(1);
+
+    free(t);
+
+    return(0);
+}
+
+
+event_t *
+thread_create_event(void)
+{
+    unix_event_t *ev = malloc(sizeof(unix_event_t));
+
+    pthread_mutex_init(&ev->mutex, NULL);
+    pthread_cond_init(&ev->cond, NULL);
+    ev->state = 0;
+
+    return((event_t *)ev);
+}
+
+
+void
+thread_set_event(event_t *arg)
+{
+    unix_event_t *ev = (unix_event_t *)arg;
+
+    if (arg == NULL) return;
+
+    pthread_mutex_lock(&ev->mutex);
+    ev->state = 1;
+    pthread_cond_signal(&ev->cond);
+    pthread_mutex_unlock(&ev->mutex);
+}
+
+
+void
+thread_reset_event(event_t *arg)
+{
+    unix_event_t *ev = (unix_event_t *)arg;
+
+    if (arg == NULL) return;
+
+    pthread_mutex_lock(&ev->mutex);
+    ev->state = 0;
+    pthread_mutex_unlock(&ev->mutex);
+}
+
+
+int
+thread_wait_event(event_t *arg, int timeout)
+{
+    unix_event_t *ev = (unix_event_t *)arg;
+    struct timespec abstime;
+    int ret = 0;
+
+    if (arg == NULL) return(0);
+
+    if (timeout != -1) {
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += timeout / 1000;
+	abstime.tv_nsec += (timeout % 1000) * 1000000;
+	if (abstime.tv_nsec >= 1000000000) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000;
+	}
+    }
+
+    pthread_mutex_lock(&ev->mutex);
+    while (!ev->state && !ret) {
+	if (timeout == -1)
+		pthread_cond_wait(&ev->cond, &ev->mutex);
+	  else if (pthread_cond_timedwait(&ev->cond, &ev->mutex, &abstime) == ETIMEDOUT)
+		ret = 1;
+    }
+    if (ev->state)
+	ret = 0;
+    ev->state = 0;
+    pthread_mutex_unlock(&ev->mutex);
+
+    return(ret);
+}
+
+
+void
+thread_destroy_event(event_t *arg)
+{
+    unix_event_t *ev = (unix_event_t *)arg;
+
+    if (arg == NULL) return;
+
+    pthread_cond_destroy(&ev->cond);
+    pthread_mutex_destroy(&ev->mutex);
+
+    free(ev);
+}
+
+
+mutex_t *
+thread_create_mutex(void)
+{
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return((mutex_t*)mutex);
+}
+
+
+void
+thread_close_mutex(mutex_t *mutex)
+{
+    if (mutex == NULL) return;
+
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+
+    free(mutex);
+}
+
+
+int
+thread_wait_mutex(mutex_t *mutex)
+{
+    if (mutex == NULL) return(0);
+
+    return(!pthread_mutex_lock((pthread_mutex_t *)mutex));
+}
+
+
+int
+thread_release_mutex(mutex_t *mutex)
+{
+    if (mutex == NULL) return(0);
+
+    return(!pthread_mutex_unlock((pthread_mutex_t *)mutex));
+}
@@ -0,0 +1,193 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		User interface and host input for headless POSIX hosts.
+ *
+ *		Message boxes are written to the console and answered
+ *		with their default button. There is no status bar, mouse
+ *		or joystick on the host side.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/gameport.h>
+#include <86box/mouse.h>
+#include <86box/plat.h>
+#include <86box/ui.h>
+
+
+/* Resource IDs are passed as small numbers in place of strings. */
+#define IS_RESOURCE(s)	(((uintptr_t) (s)) < ((uintptr_t) 65636))
+
+
+int		infocus = 1;
+int		rctrl_is_lalt = 0;
+int		update_icons = 1;
+int		mouse_capture = 0;
+
+plat_joystick_t	plat_joystick_state[MAX_PLAT_JOYSTICKS];
+joystick_t	joystick_state[MAX_JOYSTICKS];
+int		joysticks_present = 0;
+
+static wchar_t	wTitle[512];
+
+
+static void
+ui_print(FILE *f, int flags, void *s)
+{
+    if (s == NULL)
+	return;
+
+    if (IS_RESOURCE(s))
+	fprintf(f, "(message #%i)", (int) (uintptr_t) s);
+    else if (flags & MBX_ANSI)
+	fprintf(f, "%s", (char *) s);
+    else
+	fprintf(f, "%ls", (wchar_t *) s);
+}
+
+
+int
+ui_msgbox(int flags, void *message)
+{
+    return ui_msgbox_ex(flags, NULL, message, NULL, NULL, NULL);
+}
+
+
+int
+ui_msgbox_header(int flags, void *header, void *message)
+{
+    return ui_msgbox_ex(flags, header, message, NULL, NULL, NULL);
+}
+
+
+/* Nobody is there to answer, so every question gets the first button. */
+int
+ui_msgbox_ex(int flags, void *header, void *message, void *btn1, void *btn2, void *btn3)
+{
+    switch(flags & 0x1f) {
+	case MBX_ERROR:
+		fprintf(stderr, (flags & MBX_FATAL) ? "Fatal error: " : "Error: ");
+		break;
+
+	default:
+		break;
+    }
+
+    if (header != NULL) {
+	ui_print(stderr, flags & ~MBX_ANSI, header);
+	fprintf(stderr, ": ");
+    }
+    ui_print(stderr, flags, message);
+    fprintf(stderr, "\n");
+
+    return(0);
+}
+
+
+void
+ui_check_menu_item(int id, int checked)
+{
+}
+
+
+wchar_t *
+ui_window_title(wchar_t *s)
+{
+    if (s != NULL)
+	wcsncpy(wTitle, s, sizeof_w(wTitle) - 1);
+      else
+	s = wTitle;
+
+    return(s);
+}
+
+
+void
+ui_sb_timer_callback(int pane)
+{
+}
+
+
+void
+ui_sb_update_icon(int tag, int active)
+{
+}
+
+
+void
+ui_sb_update_icon_state(int tag, int state)
+{
+}
+
+
+void
+ui_sb_update_tip(int meaning)
+{
+}
+
+
+void
+ui_sb_set_ready(int ready)
+{
+}
+
+
+void
+ui_sb_update_panes(void)
+{
+}
+
+
+void
+ui_sb_set_text_w(wchar_t *wstr)
+{
+}
+
+
+void
+ui_sb_set_text(char *str)
+{
+}
+
+
+/* Used by the ISA bugger card. */
+void
+ui_sb_bugui(char *str)
+{
+    fprintf(stderr, "%s\n", str);
+}
+
+
+void
+mouse_poll(void)
+{
+}
+
+
+void
+joystick_init(void)
+{
+    joysticks_present = 0;
+}
+
+
+void
+joystick_close(void)
+{
+}
+
+
+void
+joystick_process(void)
+{
+}
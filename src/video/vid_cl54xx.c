@@ -32,6 +32,7 @@
 #include <86box/rom.h>
 #include <86box/device.h>
 #include <86box/timer.h>
+#include <86box/plat.h>
 #include <86box/video.h>
 #include <86box/vid_svga.h>
 #include <86box/vid_svga_render.h>
@@ -143,6 +144,24 @@
 #define CL_GD543X_SYSTEM_BUS_VESA 6
 #define CL_GD543X_SYSTEM_BUS_ISA  7
 
+#define FIFO_SIZE 16
+#define FIFO_MASK (FIFO_SIZE - 1)
+
+#define FIFO_ENTRIES (gd54xx->fifo_write_idx - gd54xx->fifo_read_idx)
+#define FIFO_FULL    ((gd54xx->fifo_write_idx - gd54xx->fifo_read_idx) >= FIFO_SIZE)
+#define FIFO_EMPTY   (gd54xx->fifo_read_idx == gd54xx->fifo_write_idx)
+
+enum
+{
+	FIFO_INVALID = 0,
+	FIFO_BLIT
+};
+
+typedef struct
+{
+	uint32_t type;
+} fifo_entry_t;
+
 typedef struct gd54xx_t
 {
     mem_mapping_t	mmio_mapping;
@@ -208,6 +227,16 @@ typedef struct gd54xx_t
 
     uint32_t		extpallook[256];
     PALETTE		extpal;
+
+    fifo_entry_t	fifo[FIFO_SIZE];
+    volatile int	fifo_read_idx, fifo_write_idx;
+
+    thread_t		*fifo_thread;
+    event_t		*wake_fifo_thread;
+    event_t		*fifo_not_full_event;
+    event_t		*fifo_idle_event;
+
+    uint32_t		blit_lo, blit_hi;	/* video memory the queued blits touch */
 } gd54xx_t;
 
 
@@ -241,6 +270,68 @@ static void
 gd54xx_reset_blit(gd54xx_t *gd54xx);
 static void 
 gd54xx_start_blit(uint32_t cpu_dat, uint32_t count, gd54xx_t *gd54xx, svga_t *svga);
+static void
+gd54xx_queue_blit(gd54xx_t *gd54xx, svga_t *svga);
+
+
+static __inline void
+wake_fifo_thread(gd54xx_t *gd54xx)
+{
+    thread_set_event(gd54xx->wake_fifo_thread); /*Wake up FIFO thread if moving from idle*/
+}
+
+
+/* The guest may only touch the blitter registers while the blitter is idle,
+   so wait for anything queued to finish first. The FIFO thread signals the
+   idle event once it has drained the queue. */
+static __inline void
+gd54xx_wait_fifo_idle(gd54xx_t *gd54xx)
+{
+    while (!FIFO_EMPTY) {
+	thread_reset_event(gd54xx->fifo_idle_event);
+	if (FIFO_EMPTY)
+		break;
+	thread_wait_event(gd54xx->fifo_idle_event, -1);
+    }
+}
+
+
+/* Video memory accesses only wait for queued blits that touch the same
+   bytes. This is only worked out for the packed pixel modes the blitter is
+   used in, where the CPU address is the video memory address, anything
+   else waits for the blitter to go idle. So do the accesses feeding or
+   draining a system memory blit. */
+static __inline void
+gd54xx_wait_vram(gd54xx_t *gd54xx, uint32_t addr)
+{
+    svga_t *svga = &gd54xx->svga;
+
+    if (FIFO_EMPTY)
+	return;
+
+    if (!gd54xx->countminusone && (svga->chain4 || svga->fb_only) &&
+	(svga->writemode < 4) && !(svga->adv_flags & FLAG_ADDR_BY8)) {
+	addr = (addr & ~3) & svga->vram_mask;
+	if ((addr >= gd54xx->blit_hi) || ((addr + 8) <= gd54xx->blit_lo))
+		return;
+    }
+
+    gd54xx_wait_fifo_idle(gd54xx);
+}
+
+
+/* The banked window only maps straight onto video memory in the extended
+   modes. */
+static __inline void
+gd54xx_wait_bank(gd54xx_t *gd54xx, uint32_t addr)
+{
+    svga_t *svga = &gd54xx->svga;
+
+    if (svga->seqregs[0x07] & 0x01)
+	gd54xx_wait_vram(gd54xx, (addr & 0x7fff) + svga->extra_banks[(addr >> 15) & 1]);
+    else
+	gd54xx_wait_fifo_idle(gd54xx);
+}
 
 
 /* Returns 1 if the card is a 5422+ */
@@ -1341,6 +1432,8 @@ gd54xx_write(uint32_t addr, uint8_t val, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     svga_t *svga = &gd54xx->svga;	
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest &&
 	!(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	gd54xx_mem_sys_src_write(gd54xx, val);
@@ -1364,6 +1457,8 @@ gd54xx_writew(uint32_t addr, uint16_t val, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     svga_t *svga = &gd54xx->svga;
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest &&
 	!(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	gd54xx_write(addr, val, gd54xx);
@@ -1393,6 +1488,8 @@ gd54xx_writel(uint32_t addr, uint32_t val, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     svga_t *svga = &gd54xx->svga;
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest &&
 	!(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	gd54xx_write(addr, val, gd54xx);
@@ -1509,6 +1606,9 @@ gd54xx_readb_linear(uint32_t addr, void *p)
     svga_t *svga = &gd54xx->svga;
 
     uint8_t ap = gd54xx_get_aperture(addr);
+
+    gd54xx_wait_vram(gd54xx, addr);
+
     addr &= 0x003fffff;	/* 4 MB mask */
 
     if ((svga->seqregs[0x07] & 0x01) == 0)
@@ -1553,6 +1653,8 @@ gd54xx_readw_linear(uint32_t addr, void *p)
     uint8_t ap = gd54xx_get_aperture(addr);
     uint16_t temp;
 
+    gd54xx_wait_vram(gd54xx, addr);
+
     addr &= 0x003fffff;	/* 4 MB mask */
 
     if ((svga->seqregs[0x07] & 0x01) == 0)
@@ -1603,6 +1705,8 @@ gd54xx_readl_linear(uint32_t addr, void *p)
     uint8_t ap = gd54xx_get_aperture(addr);
     uint32_t temp;
 
+    gd54xx_wait_vram(gd54xx, addr);
+
     addr &= 0x003fffff;	/* 4 MB mask */
 
     if ((svga->seqregs[0x07] & 0x01) == 0)
@@ -1660,6 +1764,8 @@ gd5436_aperture2_readb(uint32_t addr, void *p)
 {
     gd54xx_t *gd54xx = (gd54xx_t *)p;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && gd54xx->blt.ms_is_dest &&
 	gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED))
 	return gd54xx_mem_sys_dest_read(gd54xx);
@@ -1674,6 +1780,8 @@ gd5436_aperture2_readw(uint32_t addr, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     uint16_t ret = 0xffff;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && gd54xx->blt.ms_is_dest &&
 	gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	ret = gd5436_aperture2_readb(addr, p);
@@ -1691,6 +1799,8 @@ gd5436_aperture2_readl(uint32_t addr, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     uint32_t ret = 0xffffffff;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && gd54xx->blt.ms_is_dest &&
 	gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	ret = gd5436_aperture2_readb(addr, p);
@@ -1709,6 +1819,8 @@ gd5436_aperture2_writeb(uint32_t addr, uint8_t val, void *p)
 {
     gd54xx_t *gd54xx = (gd54xx_t *)p;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest
 	&& gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED))
 	gd54xx_mem_sys_src_write(gd54xx, val);
@@ -1720,6 +1832,8 @@ gd5436_aperture2_writew(uint32_t addr, uint16_t val, void *p)
 {
     gd54xx_t *gd54xx = (gd54xx_t *)p;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest
 	&& gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	gd5436_aperture2_writeb(addr, val, gd54xx);
@@ -1733,6 +1847,8 @@ gd5436_aperture2_writel(uint32_t addr, uint32_t val, void *p)
 {
     gd54xx_t *gd54xx = (gd54xx_t *)p;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     if (gd54xx->countminusone && !gd54xx->blt.ms_is_dest
 	&& gd54xx_aperture2_enabled(gd54xx) && !(gd54xx->blt.status & CIRRUS_BLT_PAUSED)) {
 	gd5436_aperture2_writeb(addr, val, gd54xx);
@@ -1751,6 +1867,8 @@ gd54xx_writeb_linear(uint32_t addr, uint8_t val, void *p)
 
     uint8_t ap = gd54xx_get_aperture(addr);
 
+    gd54xx_wait_vram(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0) {
 	svga_write_linear(addr, val, svga);
 	return;
@@ -1800,6 +1918,8 @@ gd54xx_writew_linear(uint32_t addr, uint16_t val, void *p)
 
     uint8_t ap = gd54xx_get_aperture(addr);
 
+    gd54xx_wait_vram(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0) {
 	svga_writew_linear(addr, val, svga);
 	return;
@@ -1866,6 +1986,8 @@ gd54xx_writel_linear(uint32_t addr, uint32_t val, void *p)
 
     uint8_t ap = gd54xx_get_aperture(addr);
 
+    gd54xx_wait_vram(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0) {
 	svga_writel_linear(addr, val, svga);
 	return;
@@ -1943,6 +2065,8 @@ gd54xx_read(uint32_t addr, void *p)
     gd54xx_t *gd54xx = (gd54xx_t *)p;
     svga_t *svga = &gd54xx->svga;
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0)
 	return svga_read(addr, svga);
 
@@ -1962,6 +2086,8 @@ gd54xx_readw(uint32_t addr, void *p)
     svga_t *svga = &gd54xx->svga;
     uint16_t ret;
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0)
 	return svga_readw(addr, svga);
 
@@ -1984,6 +2110,8 @@ gd54xx_readl(uint32_t addr, void *p)
     svga_t *svga = &gd54xx->svga;
     uint32_t ret;
 
+    gd54xx_wait_bank(gd54xx, addr);
+
     if ((svga->seqregs[0x07] & 0x01) == 0)
 	return svga_readl(addr, svga);
 
@@ -2019,6 +2147,8 @@ gd543x_mmio_write(uint32_t addr, uint8_t val, void *p)
     uint8_t old;
 
     if (gd543x_do_mmio(svga, addr)) {
+	gd54xx_wait_fifo_idle(gd54xx);
+
 	switch (addr & 0xff) {
 		case 0x00:
 			if (gd54xx_is_5434(svga))
@@ -2113,7 +2243,7 @@ gd543x_mmio_write(uint32_t addr, uint8_t val, void *p)
 			if ((svga->crtc[0x27] >= CIRRUS_ID_CLGD5436) && (gd54xx->blt.status & CIRRUS_BLT_AUTOSTART) &&
 			    !(gd54xx->blt.status & CIRRUS_BLT_BUSY)) {
 				gd54xx->blt.status |= CIRRUS_BLT_BUSY;
-				gd54xx_start_blit(0, 0xffffffff, gd54xx, svga);
+				gd54xx_queue_blit(gd54xx, svga);
 			}
 			break;
 
@@ -2170,7 +2300,7 @@ gd543x_mmio_write(uint32_t addr, uint8_t val, void *p)
 				gd54xx_reset_blit(gd54xx);
 			else if (!(old & CIRRUS_BLT_START) && (gd54xx->blt.status & CIRRUS_BLT_START)) {
 				gd54xx->blt.status |= CIRRUS_BLT_BUSY;
-				gd54xx_start_blit(0, 0xffffffff, gd54xx, svga);
+				gd54xx_queue_blit(gd54xx, svga);
 			}
 			break;
 	}
@@ -2253,6 +2383,10 @@ gd543x_mmio_read(uint32_t addr, void *p)
     uint8_t ret = 0xff;
 
     if (gd543x_do_mmio(svga, addr)) {
+	/* The status can be polled while the blitter is running. */
+	if ((addr & 0xff) != 0x40)
+		gd54xx_wait_fifo_idle(gd54xx);
+
 	switch (addr & 0xff) {
 		case 0x00:
 			ret = gd54xx->blt.bg_col & 0xff;
@@ -2432,6 +2566,117 @@ gd543x_mmio_readl(uint32_t addr, void *p)
 }
 
 
+static void
+gd54xx_fifo_thread(void *param)
+{
+    gd54xx_t *gd54xx = (gd54xx_t *)param;
+    fifo_entry_t *fifo;
+
+    while (1) {
+	thread_set_event(gd54xx->fifo_not_full_event);
+	thread_wait_event(gd54xx->wake_fifo_thread, -1);
+	thread_reset_event(gd54xx->wake_fifo_thread);
+	while (!FIFO_EMPTY) {
+		fifo = &gd54xx->fifo[gd54xx->fifo_read_idx & FIFO_MASK];
+
+		switch (fifo->type) {
+			case FIFO_BLIT:
+				gd54xx_start_blit(0, 0xffffffff, gd54xx, &gd54xx->svga);
+				break;
+		}
+
+		fifo->type = FIFO_INVALID;
+		gd54xx->fifo_read_idx++;
+	}
+	thread_set_event(gd54xx->fifo_idle_event);
+    }
+}
+
+
+static void
+gd54xx_queue(gd54xx_t *gd54xx, uint32_t type)
+{
+    fifo_entry_t *fifo = &gd54xx->fifo[gd54xx->fifo_write_idx & FIFO_MASK];
+
+    if (FIFO_FULL) {
+	thread_reset_event(gd54xx->fifo_not_full_event);
+	if (FIFO_FULL)
+		thread_wait_event(gd54xx->fifo_not_full_event, -1); /*Wait for room in ringbuffer*/
+    }
+
+    fifo->type = type;
+
+    gd54xx->fifo_write_idx++;
+
+    wake_fifo_thread(gd54xx);
+}
+
+
+/* Adds len bytes of video memory from addr, going down if dir is negative,
+   to the span the queued blits touch. */
+static void
+gd54xx_blit_span(gd54xx_t *gd54xx, uint32_t addr, uint32_t len, int dir)
+{
+    svga_t *svga = &gd54xx->svga;
+    uint32_t lo, hi;
+
+    if (dir < 0)
+	addr -= (len - 1);
+
+    lo = addr & svga->vram_mask;
+    hi = lo + len;
+
+    /* The blitter wraps around the end of video memory. */
+    if (hi > (svga->vram_mask + 1)) {
+	lo = 0;
+	hi = svga->vram_mask + 1;
+    }
+
+    if (lo < gd54xx->blit_lo)
+	gd54xx->blit_lo = lo;
+    if (hi > gd54xx->blit_hi)
+	gd54xx->blit_hi = hi;
+}
+
+
+/* Screen to screen and pattern blits run on the FIFO thread, the guest
+   polls the busy bit until they are done. Blits from or to system memory
+   are fed by the CPU a dword at a time, so they stay on the CPU thread. */
+static void
+gd54xx_queue_blit(gd54xx_t *gd54xx, svga_t *svga)
+{
+    int dir;
+
+    if (gd54xx->blt.mode & (CIRRUS_BLTMODE_MEMSYSSRC | CIRRUS_BLTMODE_MEMSYSDEST)) {
+	gd54xx_start_blit(0, 0xffffffff, gd54xx, svga);
+	return;
+    }
+
+    /* Same direction as gd54xx_start_blit() will pick. */
+    if ((gd54xx->blt.mode & CIRRUS_BLTMODE_BACKWARDS) &&
+	!(gd54xx->blt.mode & (CIRRUS_BLTMODE_PATTERNCOPY|CIRRUS_BLTMODE_COLOREXPAND)) &&
+	!(gd54xx->blt.mode & CIRRUS_BLTMODE_TRANSPARENTCOMP))
+	dir = -1;
+    else
+	dir = 1;
+
+    if (FIFO_EMPTY) {
+	gd54xx->blit_lo = 0xffffffff;
+	gd54xx->blit_hi = 0;
+    }
+
+    gd54xx_blit_span(gd54xx, gd54xx->blt.dst_addr,
+		     (gd54xx->blt.height * gd54xx->blt.dst_pitch) + gd54xx->blt.width + 1, dir);
+    if (gd54xx->blt.mode & CIRRUS_BLTMODE_PATTERNCOPY)
+	gd54xx_blit_span(gd54xx, gd54xx->blt.src_addr & ~0x07, 256, 1);
+    else
+	gd54xx_blit_span(gd54xx, gd54xx->blt.src_addr,
+			 (gd54xx->blt.height * gd54xx->blt.src_pitch) + gd54xx->blt.width + 1, dir);
+
+    gd54xx_queue(gd54xx, FIFO_BLIT);
+}
+
+
 static uint8_t
 gd54xx_color_expand(gd54xx_t *gd54xx, int mask, int shift)
 {
@@ -3252,6 +3497,11 @@ static void
 	mca_add(gd5428_mca_read, gd5428_mca_write, gd5428_mca_feedb, NULL, gd54xx);
     }
 
+    gd54xx->wake_fifo_thread = thread_create_event();
+    gd54xx->fifo_not_full_event = thread_create_event();
+    gd54xx->fifo_idle_event = thread_create_event();
+    gd54xx->fifo_thread = thread_create(gd54xx_fifo_thread, gd54xx);
+
     return gd54xx;
 }
 
@@ -3358,7 +3608,14 @@ gd54xx_close(void *p)
 {
     gd54xx_t *gd54xx = (gd54xx_t *)p;
 
+    gd54xx_wait_fifo_idle(gd54xx);
+
     svga_close(&gd54xx->svga);
+
+    thread_kill(gd54xx->fifo_thread);
+    thread_destroy_event(gd54xx->wake_fifo_thread);
+    thread_destroy_event(gd54xx->fifo_not_full_event);
+    thread_destroy_event(gd54xx->fifo_idle_event);
     
     free(gd54xx);
 }
@@ -717,7 +717,9 @@ ega_doblit(int y1, int y2, int wx, int wy, ega_t *ega)
 	}
     }
 
-    video_blit_memtoscreen(x_start, y_start, y1, y2 + y_add, xsize + x_add, ysize + y_add);
+    /* Smooth scrolling can move drawn lines above y1, so damage from the top. */
+    video_blit_memtoscreen(x_start, y_start, 0, fullchange ? (ysize + y_add) : (y2 + y_add),
+			   xsize + x_add, ysize + y_add);
 
     if (ega->vres)
 	ega->y_add >>= 1;
@@ -574,6 +574,14 @@ svga_do_render(svga_t *svga)
     if (!svga->override) {
 	svga->render(svga);
 
+	/* The renderers skip unchanged lines; note the buffer rows they did draw. */
+	if ((svga->firstline_draw != 2000) && (svga->lastline_draw == svga->displine)) {
+		if ((svga->displine + svga->y_add) < svga->damage_y1)
+			svga->damage_y1 = svga->displine + svga->y_add;
+		if ((svga->displine + svga->y_add) >= svga->damage_y2)
+			svga->damage_y2 = svga->displine + svga->y_add + 1;
+	}
+
 	svga->x_add = (overscan_x >> 1);
 	svga_render_overscan_left(svga);
 	svga_render_overscan_right(svga);
@@ -791,21 +799,24 @@ svga_poll(void *p)
 		wx = x;
 
 		if (!svga->override) {
-			if (svga->vertical_linedbl) {
+			if (svga->vertical_linedbl)
 				wy = (svga->lastline - svga->firstline) << 1;
-				svga_doblit(svga->firstline_draw << 1, (svga->lastline_draw + 1) << 1, wx, wy, svga);
-			} else {
+			else
 				wy = svga->lastline - svga->firstline;
-				svga_doblit(svga->firstline_draw, svga->lastline_draw + 1, wx, wy, svga);
-			}
+			svga_doblit(svga->damage_y1, svga->damage_y2, wx, wy, svga);
 		}
 
+		frames++;
+
 		svga->firstline = 2000;
 		svga->lastline = 0;
 
 		svga->firstline_draw = 2000;
 		svga->lastline_draw = 0;
 
+		svga->damage_y1 = 2000;
+		svga->damage_y2 = 0;
+
 		svga->oddeven ^= 1;
 
 		changeframecount = svga->interlace ? 3 : 2;
@@ -895,6 +906,8 @@ svga_init(const device_t *info, svga_t *svga, void *p, int memsize,
     overscan_y = 32;
     svga->x_add = 8;
     svga->y_add = 16;
+    svga->damage_y1 = 2000;
+    svga->damage_y2 = 0;
 
     svga->crtc[0] = 63;
     svga->crtc[6] = 255;
@@ -1340,7 +1353,21 @@ svga_doblit(int y1, int y2, int wx, int wy, svga_t *svga)
 	}
     }
 
-    video_blit_memtoscreen(x_start, y_start, y1, y2 + y_add, xsize + x_add, ysize + y_add);
+    /*
+     * y1 and y2 are the buffer32 rows that were redrawn. The overscan is
+     * repainted every frame, so it only counts as damage when its colour
+     * changed or a full redraw is pending.
+     */
+    if (svga->fullchange || (svga->overscan_color != svga->overscan_color_blit)) {
+	svga->overscan_color_blit = svga->overscan_color;
+	y1 = 0;
+	y2 = ysize + y_add;
+    } else {
+	y1 -= y_start;
+	y2 -= y_start;
+    }
+
+    video_blit_memtoscreen(x_start, y_start, y1, y2, xsize + x_add, ysize + y_add);
 
     if (svga->vertical_linedbl)
 	svga->vertical_linedbl >>= 1;
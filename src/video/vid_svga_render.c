@@ -682,10 +682,18 @@ svga_render_8bpp_lowres(svga_t *svga)
 }
 
 
+/* Returns 1 if a span of bytes starting at addr does not wrap around the display mask. */
+static __inline int
+svga_render_linear(svga_t *svga, uint32_t addr, int bytes)
+{
+    return ((addr & svga->vram_display_mask) + bytes) <= (svga->vram_display_mask + 1);
+}
+
+
 void
 svga_render_8bpp_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -699,7 +707,14 @@ svga_render_8bpp_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp/* + svga->scrollcache*/); x += 8) {
+	count = ((svga->hdisp/* + svga->scrollcache*/) / 8 + 1) * 8;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count)) {
+		svga_render_line_8bpp(p, &svga->vram[svga->ma & svga->vram_display_mask], count, svga->map8);
+		svga->ma += count;
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp/* + svga->scrollcache*/); x += 8) {
 		if (svga->crtc[0x17] & 0x80) {
 			dat = *(uint32_t *)(&svga->vram[svga->ma & svga->vram_display_mask]);
 			p[0] = svga->map8[dat & 0xff];
@@ -763,7 +778,7 @@ svga_render_15bpp_lowres(svga_t *svga)
 void
 svga_render_15bpp_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -777,7 +792,13 @@ svga_render_15bpp_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x += 8) {
+	count = ((svga->hdisp + svga->scrollcache) / 8 + 1) * 8;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count << 1)) {
+		svga_render_line_15bpp(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x += 8) {
 		if (svga->crtc[0x17] & 0x80) {
 			dat = *(uint32_t *)(&svga->vram[(svga->ma + (x << 1)) & svga->vram_display_mask]);
 			p[x]     = video_15to32[dat & 0xffff];
@@ -927,7 +948,7 @@ svga_render_16bpp_lowres(svga_t *svga)
 void
 svga_render_16bpp_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
 
     if ((svga->displine + svga->y_add) < 0)
@@ -940,7 +961,13 @@ svga_render_16bpp_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x += 8) {
+	count = ((svga->hdisp + svga->scrollcache) / 8 + 1) * 8;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count << 1)) {
+		svga_render_line_16bpp(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x += 8) {
 		if (svga->crtc[0x17] & 0x80) {
 			uint32_t dat = *(uint32_t *)(&svga->vram[(svga->ma + (x << 1)) & svga->vram_display_mask]);
 			p[x]     = video_16to32[dat & 0xffff];
@@ -997,7 +1024,7 @@ svga_render_24bpp_lowres(svga_t *svga)
 void
 svga_render_24bpp_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -1011,7 +1038,14 @@ svga_render_24bpp_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x += 4) {
+	count = ((svga->hdisp + svga->scrollcache) / 4 + 1) * 4;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count * 3)) {
+		svga_render_line_24bpp(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		svga->ma += count * 3;
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x += 4) {
 		if (svga->crtc[0x17] & 0x80) {
 			dat = *(uint32_t *)(&svga->vram[svga->ma & svga->vram_display_mask]);
 			p[x] = dat & 0xffffff;
@@ -1065,7 +1099,7 @@ svga_render_32bpp_lowres(svga_t *svga)
 void
 svga_render_32bpp_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -1079,7 +1113,13 @@ svga_render_32bpp_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x++) {
+	count = svga->hdisp + svga->scrollcache + 1;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count << 2)) {
+		svga_render_line_32bpp(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x++) {
 		if (svga->crtc[0x17] & 0x80)
 			dat = *(uint32_t *)(&svga->vram[(svga->ma + (x << 2)) & svga->vram_display_mask]);
 		else
@@ -1095,7 +1135,7 @@ svga_render_32bpp_highres(svga_t *svga)
 void
 svga_render_ABGR8888_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -1109,7 +1149,13 @@ svga_render_ABGR8888_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x++) {
+	count = svga->hdisp + svga->scrollcache + 1;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count << 2)) {
+		svga_render_line_ABGR8888(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x++) {
 		if (svga->crtc[0x17] & 0x80)
 			dat = *(uint32_t *)(&svga->vram[(svga->ma + (x << 2)) & svga->vram_display_mask]);
 		else
@@ -1125,7 +1171,7 @@ svga_render_ABGR8888_highres(svga_t *svga)
 void
 svga_render_RGBA8888_highres(svga_t *svga)
 {
-    int x;
+    int x = 0, count;
     uint32_t *p;
     uint32_t dat;
 
@@ -1139,7 +1185,13 @@ svga_render_RGBA8888_highres(svga_t *svga)
 		svga->firstline_draw = svga->displine;
 	svga->lastline_draw = svga->displine;
 
-	for (x = 0; x <= (svga->hdisp + svga->scrollcache); x++) {
+	count = svga->hdisp + svga->scrollcache + 1;
+	if ((svga->crtc[0x17] & 0x80) && svga_render_linear(svga, svga->ma, count << 2)) {
+		svga_render_line_RGBA8888(p, &svga->vram[svga->ma & svga->vram_display_mask], count);
+		x = count;
+	}
+
+	for (; x <= (svga->hdisp + svga->scrollcache); x++) {
 		if (svga->crtc[0x17] & 0x80)
 			dat = *(uint32_t *)(&svga->vram[(svga->ma + (x << 2)) & svga->vram_display_mask]);
 		else
@@ -0,0 +1,739 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Scanline conversion kernels for the SVGA renderers.
+ *
+ *		Each kernel converts a run of pixels that is contiguous in
+ *		VRAM to 32-bit RGB. The renderers only call them when the
+ *		scanline does not wrap around the display mask, otherwise
+ *		they fall back to their own per-pixel loops.
+ *
+ *		The plain C kernels are always available. SSE2 and NEON
+ *		versions are used when the compiler targets them, and AVX2
+ *		versions are picked at run time on hosts that support it.
+ *		The 15 and 16 bpp kernels compute the colour expansion
+ *		rather than looking it up; the constants used give the same
+ *		results as video_15to32[] and video_16to32[] for every input.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/mem.h>
+#include <86box/timer.h>
+#include <86box/video.h>
+#include <86box/vid_svga.h>
+#include <86box/vid_svga_render.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# define SVGA_RENDER_SSE2
+# include <emmintrin.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define SVGA_RENDER_AVX2
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+# define SVGA_RENDER_NEON
+# include <arm_neon.h>
+#endif
+
+
+void	(*svga_render_line_8bpp)(uint32_t *p, const uint8_t *src, int count, const uint32_t *pal);
+void	(*svga_render_line_15bpp)(uint32_t *p, const uint8_t *src, int count);
+void	(*svga_render_line_16bpp)(uint32_t *p, const uint8_t *src, int count);
+void	(*svga_render_line_24bpp)(uint32_t *p, const uint8_t *src, int count);
+void	(*svga_render_line_32bpp)(uint32_t *p, const uint8_t *src, int count);
+void	(*svga_render_line_ABGR8888)(uint32_t *p, const uint8_t *src, int count);
+void	(*svga_render_line_RGBA8888)(uint32_t *p, const uint8_t *src, int count);
+
+
+static void
+line_8bpp_c(uint32_t *p, const uint8_t *src, int count, const uint32_t *pal)
+{
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = pal[src[x]];
+}
+
+
+static void
+line_15bpp_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16_t *s = (const uint16_t *) src;
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = video_15to32[s[x]];
+}
+
+
+static void
+line_16bpp_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16_t *s = (const uint16_t *) src;
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = video_16to32[s[x]];
+}
+
+
+static void
+line_24bpp_c(uint32_t *p, const uint8_t *src, int count)
+{
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = src[x * 3] | (src[(x * 3) + 1] << 8) | (src[(x * 3) + 2] << 16);
+}
+
+
+static void
+line_32bpp_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint32_t *s = (const uint32_t *) src;
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = s[x] & 0xffffff;
+}
+
+
+static void
+line_ABGR8888_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint32_t *s = (const uint32_t *) src;
+    uint32_t dat;
+    int x;
+
+    for (x = 0; x < count; x++) {
+	dat = s[x];
+	p[x] = ((dat & 0xff0000) >> 16) | (dat & 0x00ff00) | ((dat & 0x0000ff) << 16);
+    }
+}
+
+
+static void
+line_RGBA8888_c(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint32_t *s = (const uint32_t *) src;
+    int x;
+
+    for (x = 0; x < count; x++)
+	p[x] = s[x] >> 8;
+}
+
+
+#ifdef SVGA_RENDER_SSE2
+/*
+ * Expand 5 and 6 bit channels to 8 bits. (v * 1053) >> 7 and
+ * (v * 259 + 3) >> 6 match the truncated v * 255 / 31 and v * 255 / 63
+ * that video.c uses to build its tables.
+ */
+static __inline __m128i
+sse2_rgb_to_32(__m128i r, __m128i g, __m128i b, int g6, __m128i *hi)
+{
+    r = _mm_srli_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(1053)), 7);
+    b = _mm_srli_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(1053)), 7);
+    if (g6)
+	g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(259)), _mm_set1_epi16(3)), 6);
+    else
+	g = _mm_srli_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(1053)), 7);
+
+    b = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    *hi = _mm_unpackhi_epi16(b, r);
+    return _mm_unpacklo_epi16(b, r);
+}
+
+
+static void
+line_15bpp_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i mask = _mm_set1_epi16(0x1f);
+    __m128i dat, lo, hi;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = _mm_loadu_si128((const __m128i *) &src[x << 1]);
+	lo = sse2_rgb_to_32(_mm_and_si128(_mm_srli_epi16(dat, 10), mask),
+			    _mm_and_si128(_mm_srli_epi16(dat, 5), mask),
+			    _mm_and_si128(dat, mask), 0, &hi);
+	_mm_storeu_si128((__m128i *) &p[x], lo);
+	_mm_storeu_si128((__m128i *) &p[x + 4], hi);
+    }
+
+    line_15bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static void
+line_16bpp_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i mask = _mm_set1_epi16(0x1f);
+    __m128i dat, lo, hi;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = _mm_loadu_si128((const __m128i *) &src[x << 1]);
+	lo = sse2_rgb_to_32(_mm_srli_epi16(dat, 11),
+			    _mm_and_si128(_mm_srli_epi16(dat, 5), _mm_set1_epi16(0x3f)),
+			    _mm_and_si128(dat, mask), 1, &hi);
+	_mm_storeu_si128((__m128i *) &p[x], lo);
+	_mm_storeu_si128((__m128i *) &p[x + 4], hi);
+    }
+
+    line_16bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static void
+line_32bpp_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m128i mask = _mm_set1_epi32(0xffffff);
+    __m128i dat;
+    int x;
+
+    for (x = 0; x <= (count - 4); x += 4) {
+	dat = _mm_loadu_si128((const __m128i *) &src[x << 2]);
+	_mm_storeu_si128((__m128i *) &p[x], _mm_and_si128(dat, mask));
+    }
+
+    line_32bpp_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static void
+line_ABGR8888_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    __m128i dat;
+    int x;
+
+    for (x = 0; x <= (count - 4); x += 4) {
+	dat = _mm_loadu_si128((const __m128i *) &src[x << 2]);
+	dat = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(dat, 16), _mm_set1_epi32(0x0000ff)),
+					_mm_and_si128(dat, _mm_set1_epi32(0x00ff00))),
+			   _mm_and_si128(_mm_slli_epi32(dat, 16), _mm_set1_epi32(0xff0000)));
+	_mm_storeu_si128((__m128i *) &p[x], dat);
+    }
+
+    line_ABGR8888_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static void
+line_RGBA8888_sse2(uint32_t *p, const uint8_t *src, int count)
+{
+    __m128i dat;
+    int x;
+
+    for (x = 0; x <= (count - 4); x += 4) {
+	dat = _mm_loadu_si128((const __m128i *) &src[x << 2]);
+	_mm_storeu_si128((__m128i *) &p[x], _mm_srli_epi32(dat, 8));
+    }
+
+    line_RGBA8888_c(&p[x], &src[x << 2], count - x);
+}
+#endif
+
+
+#ifdef SVGA_RENDER_AVX2
+# define AVX2_TARGET __attribute__((target("avx2")))
+
+static __inline AVX2_TARGET void
+avx2_store_rgb(uint32_t *p, __m256i r, __m256i g, __m256i b, int g6)
+{
+    __m256i lo, hi;
+
+    r = _mm256_srli_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(1053)), 7);
+    b = _mm256_srli_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(1053)), 7);
+    if (g6)
+	g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(259)), _mm256_set1_epi16(3)), 6);
+    else
+	g = _mm256_srli_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(1053)), 7);
+
+    b = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    /* The unpacks work within each 128-bit lane, so put the halves back in order. */
+    lo = _mm256_unpacklo_epi16(b, r);
+    hi = _mm256_unpackhi_epi16(b, r);
+    _mm256_storeu_si256((__m256i *) p, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *) &p[8], _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+
+static AVX2_TARGET void
+line_8bpp_avx2(uint32_t *p, const uint8_t *src, int count, const uint32_t *pal)
+{
+    __m256i idx;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &src[x]));
+	_mm256_storeu_si256((__m256i *) &p[x], _mm256_i32gather_epi32((const int *) pal, idx, 4));
+    }
+
+    line_8bpp_c(&p[x], &src[x], count - x, pal);
+}
+
+
+static AVX2_TARGET void
+line_15bpp_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m256i mask = _mm256_set1_epi16(0x1f);
+    __m256i dat;
+    int x;
+
+    for (x = 0; x <= (count - 16); x += 16) {
+	dat = _mm256_loadu_si256((const __m256i *) &src[x << 1]);
+	avx2_store_rgb(&p[x], _mm256_and_si256(_mm256_srli_epi16(dat, 10), mask),
+		       _mm256_and_si256(_mm256_srli_epi16(dat, 5), mask),
+		       _mm256_and_si256(dat, mask), 0);
+    }
+
+    line_15bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static AVX2_TARGET void
+line_16bpp_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m256i mask = _mm256_set1_epi16(0x1f);
+    __m256i dat;
+    int x;
+
+    for (x = 0; x <= (count - 16); x += 16) {
+	dat = _mm256_loadu_si256((const __m256i *) &src[x << 1]);
+	avx2_store_rgb(&p[x], _mm256_srli_epi16(dat, 11),
+		       _mm256_and_si256(_mm256_srli_epi16(dat, 5), _mm256_set1_epi16(0x3f)),
+		       _mm256_and_si256(dat, mask), 1);
+    }
+
+    line_16bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static AVX2_TARGET void
+line_24bpp_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m256i shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+					  0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i dat;
+    int x;
+
+    /* Each half loads 16 bytes for 4 pixels, so stop two pixels early. */
+    for (x = 0; x <= (count - 10); x += 8) {
+	dat = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) &src[x * 3])),
+				      _mm_loadu_si128((const __m128i *) &src[(x * 3) + 12]), 1);
+	_mm256_storeu_si256((__m256i *) &p[x], _mm256_shuffle_epi8(dat, shuf));
+    }
+
+    line_24bpp_c(&p[x], &src[x * 3], count - x);
+}
+
+
+static AVX2_TARGET void
+line_32bpp_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m256i mask = _mm256_set1_epi32(0xffffff);
+    __m256i dat;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = _mm256_loadu_si256((const __m256i *) &src[x << 2]);
+	_mm256_storeu_si256((__m256i *) &p[x], _mm256_and_si256(dat, mask));
+    }
+
+    line_32bpp_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static AVX2_TARGET void
+line_ABGR8888_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+					  2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+    __m256i dat;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = _mm256_loadu_si256((const __m256i *) &src[x << 2]);
+	_mm256_storeu_si256((__m256i *) &p[x], _mm256_shuffle_epi8(dat, shuf));
+    }
+
+    line_ABGR8888_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static AVX2_TARGET void
+line_RGBA8888_avx2(uint32_t *p, const uint8_t *src, int count)
+{
+    __m256i dat;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = _mm256_loadu_si256((const __m256i *) &src[x << 2]);
+	_mm256_storeu_si256((__m256i *) &p[x], _mm256_srli_epi32(dat, 8));
+    }
+
+    line_RGBA8888_c(&p[x], &src[x << 2], count - x);
+}
+#endif
+
+
+#ifdef SVGA_RENDER_NEON
+static __inline void
+neon_store_rgb(uint32_t *p, uint16x8_t r, uint16x8_t g, uint16x8_t b, int g6)
+{
+    uint16x8x2_t out;
+
+    r = vshrq_n_u16(vmulq_n_u16(r, 1053), 7);
+    b = vshrq_n_u16(vmulq_n_u16(b, 1053), 7);
+    if (g6)
+	g = vshrq_n_u16(vaddq_u16(vmulq_n_u16(g, 259), vdupq_n_u16(3)), 6);
+    else
+	g = vshrq_n_u16(vmulq_n_u16(g, 1053), 7);
+
+    out = vzipq_u16(vorrq_u16(b, vshlq_n_u16(g, 8)), r);
+    vst1q_u32(p, vreinterpretq_u32_u16(out.val[0]));
+    vst1q_u32(&p[4], vreinterpretq_u32_u16(out.val[1]));
+}
+
+
+static void
+line_15bpp_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint16x8_t mask = vdupq_n_u16(0x1f);
+    uint16x8_t dat;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = vld1q_u16((const uint16_t *) &src[x << 1]);
+	neon_store_rgb(&p[x], vandq_u16(vshrq_n_u16(dat, 10), mask),
+		       vandq_u16(vshrq_n_u16(dat, 5), mask),
+		       vandq_u16(dat, mask), 0);
+    }
+
+    line_15bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static void
+line_16bpp_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    uint16x8_t dat;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = vld1q_u16((const uint16_t *) &src[x << 1]);
+	neon_store_rgb(&p[x], vshrq_n_u16(dat, 11),
+		       vandq_u16(vshrq_n_u16(dat, 5), vdupq_n_u16(0x3f)),
+		       vandq_u16(dat, vdupq_n_u16(0x1f)), 1);
+    }
+
+    line_16bpp_c(&p[x], &src[x << 1], count - x);
+}
+
+
+static void
+line_24bpp_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    uint8x8x3_t dat;
+    uint8x8x4_t out;
+    int x;
+
+    out.val[3] = vdup_n_u8(0);
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = vld3_u8(&src[x * 3]);
+	out.val[0] = dat.val[0];
+	out.val[1] = dat.val[1];
+	out.val[2] = dat.val[2];
+	vst4_u8((uint8_t *) &p[x], out);
+    }
+
+    line_24bpp_c(&p[x], &src[x * 3], count - x);
+}
+
+
+static void
+line_32bpp_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    const uint32x4_t mask = vdupq_n_u32(0xffffff);
+    int x;
+
+    for (x = 0; x <= (count - 4); x += 4)
+	vst1q_u32(&p[x], vandq_u32(vld1q_u32((const uint32_t *) &src[x << 2]), mask));
+
+    line_32bpp_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static void
+line_ABGR8888_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    uint8x8x4_t dat;
+    uint8x8_t tmp;
+    int x;
+
+    for (x = 0; x <= (count - 8); x += 8) {
+	dat = vld4_u8(&src[x << 2]);
+	tmp = dat.val[0];
+	dat.val[0] = dat.val[2];
+	dat.val[2] = tmp;
+	dat.val[3] = vdup_n_u8(0);
+	vst4_u8((uint8_t *) &p[x], dat);
+    }
+
+    line_ABGR8888_c(&p[x], &src[x << 2], count - x);
+}
+
+
+static void
+line_RGBA8888_neon(uint32_t *p, const uint8_t *src, int count)
+{
+    int x;
+
+    for (x = 0; x <= (count - 4); x += 4)
+	vst1q_u32(&p[x], vshrq_n_u32(vld1q_u32((const uint32_t *) &src[x << 2]), 8));
+
+    line_RGBA8888_c(&p[x], &src[x << 2], count - x);
+}
+#endif
+
+
+/* Pick the best kernels for the host. Called once from video_init(). */
+void
+svga_render_init(void)
+{
+    svga_render_line_8bpp = line_8bpp_c;
+    svga_render_line_15bpp = line_15bpp_c;
+    svga_render_line_16bpp = line_16bpp_c;
+    svga_render_line_24bpp = line_24bpp_c;
+    svga_render_line_32bpp = line_32bpp_c;
+    svga_render_line_ABGR8888 = line_ABGR8888_c;
+    svga_render_line_RGBA8888 = line_RGBA8888_c;
+
+#ifdef SVGA_RENDER_SSE2
+    svga_render_line_15bpp = line_15bpp_sse2;
+    svga_render_line_16bpp = line_16bpp_sse2;
+    svga_render_line_32bpp = line_32bpp_sse2;
+    svga_render_line_ABGR8888 = line_ABGR8888_sse2;
+    svga_render_line_RGBA8888 = line_RGBA8888_sse2;
+#endif
+
+#ifdef SVGA_RENDER_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+	svga_render_line_8bpp = line_8bpp_avx2;
+	svga_render_line_15bpp = line_15bpp_avx2;
+	svga_render_line_16bpp = line_16bpp_avx2;
+	svga_render_line_24bpp = line_24bpp_avx2;
+	svga_render_line_32bpp = line_32bpp_avx2;
+	svga_render_line_ABGR8888 = line_ABGR8888_avx2;
+	svga_render_line_RGBA8888 = line_RGBA8888_avx2;
+    }
+#endif
+
+#ifdef SVGA_RENDER_NEON
+    svga_render_line_15bpp = line_15bpp_neon;
+    svga_render_line_16bpp = line_16bpp_neon;
+    svga_render_line_24bpp = line_24bpp_neon;
+    svga_render_line_32bpp = line_32bpp_neon;
+    svga_render_line_ABGR8888 = line_ABGR8888_neon;
+    svga_render_line_RGBA8888 = line_RGBA8888_neon;
+#endif
+}
+
+
+/* Self test: run every SIMD kernel the host can execute against the C
+   kernel for the same format, over every width up to a few vectors long
+   (so every tail length is covered), a few full scanline widths and
+   every source alignment, and compare the output pixel for pixel. The
+   15 and 16 bpp kernels are also fed all 65536 input values. Returns
+   the number of kernels that failed. */
+#define TEST_MAX_WIDTH	2048
+#define TEST_GUARD	16
+#define TEST_SENTINEL	0xdeadbeef
+
+typedef struct {
+    const char	*name;
+    int		bpp;
+    void	(*ref)(uint32_t *p, const uint8_t *src, int count);
+    void	(*simd)(uint32_t *p, const uint8_t *src, int count);
+} svga_render_test_t;
+
+
+static uint32_t test_seed;
+
+
+static uint32_t
+test_rand(void)
+{
+    test_seed = (test_seed * 1103515245) + 12345;
+
+    return test_seed >> 8;
+}
+
+
+static int
+test_compare(const char *name, int width, int offset, const uint32_t *got, const uint32_t *exp)
+{
+    int x;
+
+    for (x = 0; x < (width + TEST_GUARD); x++) {
+	if (got[x] != exp[x]) {
+		printf("SVGA render: %s kernel, width %i, offset %i: pixel %i is %08x, expected %08x%s\n",
+		       name, width, offset, x, got[x], exp[x], (x >= width) ? " (overrun)" : "");
+		return 1;
+	}
+    }
+
+    return 0;
+}
+
+
+static int
+test_kernel(const svga_render_test_t *t, uint8_t *src, uint32_t *got, uint32_t *exp)
+{
+    static const int wide[] = { 320, 640, 720, 800, 1024, 1280, 1600, TEST_MAX_WIDTH };
+    int c, w, offset, width;
+
+    for (w = 0; w < (100 + (int) (sizeof(wide) / sizeof(wide[0]))); w++) {
+	width = (w < 100) ? w : wide[w - 100];
+
+	for (offset = 0; offset < 4; offset++) {
+		for (c = 0; c < ((width + 1) * t->bpp); c++)
+			src[offset + c] = test_rand() & 0xff;
+		for (c = 0; c < (width + TEST_GUARD); c++)
+			got[c] = exp[c] = TEST_SENTINEL;
+
+		t->ref(exp, &src[offset], width);
+		t->simd(got, &src[offset], width);
+		if (test_compare(t->name, width, offset, got, exp))
+			return 1;
+	}
+    }
+
+    /* Every possible input pixel for the 16-bit formats. */
+    if (t->bpp == 2) {
+	for (c = 0; c < 65536; c++) {
+		src[c * 2] = c & 0xff;
+		src[(c * 2) + 1] = c >> 8;
+	}
+
+	for (offset = 0; offset < 65536; offset += TEST_MAX_WIDTH) {
+		for (c = 0; c < (TEST_MAX_WIDTH + TEST_GUARD); c++)
+			got[c] = exp[c] = TEST_SENTINEL;
+
+		t->ref(exp, &src[offset * 2], TEST_MAX_WIDTH);
+		t->simd(got, &src[offset * 2], TEST_MAX_WIDTH);
+		if (test_compare(t->name, TEST_MAX_WIDTH, offset * 2, got, exp))
+			return 1;
+	}
+    }
+
+    return 0;
+}
+
+
+#ifdef SVGA_RENDER_AVX2
+static int
+test_8bpp(void (*simd)(uint32_t *p, const uint8_t *src, int count, const uint32_t *pal),
+	  const char *name, uint8_t *src, uint32_t *got, uint32_t *exp)
+{
+    uint32_t pal[256];
+    int c, w, offset, width;
+
+    for (c = 0; c < 256; c++)
+	pal[c] = test_rand() & 0xffffff;
+
+    for (w = 0; w < 100; w++) {
+	width = (w < 99) ? w : TEST_MAX_WIDTH;
+
+	for (offset = 0; offset < 4; offset++) {
+		for (c = 0; c < (width + 1); c++)
+			src[offset + c] = test_rand() & 0xff;
+		for (c = 0; c < (width + TEST_GUARD); c++)
+			got[c] = exp[c] = TEST_SENTINEL;
+
+		line_8bpp_c(exp, &src[offset], width, pal);
+		simd(got, &src[offset], width, pal);
+		if (test_compare(name, width, offset, got, exp))
+			return 1;
+	}
+    }
+
+    return 0;
+}
+#endif
+
+
+int
+svga_render_test(void)
+{
+    static const svga_render_test_t tests[] = {
+#ifdef SVGA_RENDER_SSE2
+	{ "SSE2 15bpp",		2, line_15bpp_c,	line_15bpp_sse2		},
+	{ "SSE2 16bpp",		2, line_16bpp_c,	line_16bpp_sse2		},
+	{ "SSE2 32bpp",		4, line_32bpp_c,	line_32bpp_sse2		},
+	{ "SSE2 ABGR8888",	4, line_ABGR8888_c,	line_ABGR8888_sse2	},
+	{ "SSE2 RGBA8888",	4, line_RGBA8888_c,	line_RGBA8888_sse2	},
+#endif
+#ifdef SVGA_RENDER_AVX2
+	{ "AVX2 15bpp",		2, line_15bpp_c,	line_15bpp_avx2		},
+	{ "AVX2 16bpp",		2, line_16bpp_c,	line_16bpp_avx2		},
+	{ "AVX2 24bpp",		3, line_24bpp_c,	line_24bpp_avx2		},
+	{ "AVX2 32bpp",		4, line_32bpp_c,	line_32bpp_avx2		},
+	{ "AVX2 ABGR8888",	4, line_ABGR8888_c,	line_ABGR8888_avx2	},
+	{ "AVX2 RGBA8888",	4, line_RGBA8888_c,	line_RGBA8888_avx2	},
+#endif
+#ifdef SVGA_RENDER_NEON
+	{ "NEON 15bpp",		2, line_15bpp_c,	line_15bpp_neon		},
+	{ "NEON 16bpp",		2, line_16bpp_c,	line_16bpp_neon		},
+	{ "NEON 24bpp",		3, line_24bpp_c,	line_24bpp_neon		},
+	{ "NEON 32bpp",		4, line_32bpp_c,	line_32bpp_neon		},
+	{ "NEON ABGR8888",	4, line_ABGR8888_c,	line_ABGR8888_neon	},
+	{ "NEON RGBA8888",	4, line_RGBA8888_c,	line_RGBA8888_neon	},
+#endif
+	{ NULL,			0, NULL,		NULL			}
+    };
+    uint32_t *got, *exp;
+    uint8_t *src;
+    int c, run = 0, failed = 0;
+
+    src = (uint8_t *) malloc(65536 * 2);
+    got = (uint32_t *) malloc((TEST_MAX_WIDTH + TEST_GUARD) * sizeof(uint32_t));
+    exp = (uint32_t *) malloc((TEST_MAX_WIDTH + TEST_GUARD) * sizeof(uint32_t));
+    test_seed = 1;
+
+    for (c = 0; tests[c].name != NULL; c++) {
+#ifdef SVGA_RENDER_AVX2
+	if (!strncmp(tests[c].name, "AVX2", 4) && !__builtin_cpu_supports("avx2"))
+		continue;
+#endif
+	failed += test_kernel(&tests[c], src, got, exp);
+	run++;
+    }
+
+#ifdef SVGA_RENDER_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+	failed += test_8bpp(line_8bpp_avx2, "AVX2 8bpp", src, got, exp);
+	run++;
+    }
+#endif
+
+    free(exp);
+    free(got);
+    free(src);
+
+    printf("SVGA render:     %i SIMD kernels tested, %i failed\n", run, failed);
+
+    return failed;
+}
@@ -790,10 +790,15 @@ static uint32_t banshee_status(banshee_t *banshee)
         int swap_count = voodoo->swap_count;
         int written = voodoo->cmd_written + voodoo->cmd_written_fifo;
         int busy = (written - voodoo->cmd_read) || (voodoo->cmdfifo_depth_rd != voodoo->cmdfifo_depth_wr) ||
-                voodoo->render_voodoo_busy[0] || voodoo->render_voodoo_busy[1] ||
-                voodoo->render_voodoo_busy[2] || voodoo->render_voodoo_busy[3] ||
                 voodoo->voodoo_busy;
         uint32_t ret;
+        int c;
+
+        for (c = 0; c < voodoo->render_threads; c++)
+        {
+                if (voodoo->render_voodoo_busy[c])
+                        busy = 1;
+        }
 
         ret = 0;
         if (fifo_size < 0x20)
@@ -2470,6 +2475,34 @@ static const device_config_t banshee_sgram_config[] =
                 .type = CONFIG_BINARY,
                 .default_int = 0
         },
+        {
+                .name = "texture_cache",
+                .description = "Texture cache entries",
+                .type = CONFIG_SELECTION,
+                .selection =
+                {
+                        {
+                                .description = "64",
+                                .value = 64
+                        },
+                        {
+                                .description = "128",
+                                .value = 128
+                        },
+                        {
+                                .description = "256",
+                                .value = 256
+                        },
+                        {
+                                .description = "512",
+                                .value = 512
+                        },
+                        {
+                                .description = ""
+                        }
+                },
+                .default_int = 64
+        },
         {
                 .name = "render_threads",
                 .description = "Render threads",
@@ -2488,6 +2521,22 @@ static const device_config_t banshee_sgram_config[] =
                                 .description = "4",
                                 .value = 4
                         },
+                        {
+                                .description = "8",
+                                .value = 8
+                        },
+                        {
+                                .description = "16",
+                                .value = 16
+                        },
+                        {
+                                .description = "32",
+                                .value = 32
+                        },
+                        {
+                                .description = "Auto",
+                                .value = 0
+                        },
                         {
                                 .description = ""
                         }
@@ -2521,6 +2570,34 @@ static const device_config_t banshee_sdram_config[] =
                 .type = CONFIG_BINARY,
                 .default_int = 0
         },
+        {
+                .name = "texture_cache",
+                .description = "Texture cache entries",
+                .type = CONFIG_SELECTION,
+                .selection =
+                {
+                        {
+                                .description = "64",
+                                .value = 64
+                        },
+                        {
+                                .description = "128",
+                                .value = 128
+                        },
+                        {
+                                .description = "256",
+                                .value = 256
+                        },
+                        {
+                                .description = "512",
+                                .value = 512
+                        },
+                        {
+                                .description = ""
+                        }
+                },
+                .default_int = 64
+        },
         {
                 .name = "render_threads",
                 .description = "Render threads",
@@ -2539,6 +2616,22 @@ static const device_config_t banshee_sdram_config[] =
                                 .description = "4",
                                 .value = 4
                         },
+                        {
+                                .description = "8",
+                                .value = 8
+                        },
+                        {
+                                .description = "16",
+                                .value = 16
+                        },
+                        {
+                                .description = "32",
+                                .value = 32
+                        },
+                        {
+                                .description = "Auto",
+                                .value = 0
+                        },
                         {
                                 .description = ""
                         }
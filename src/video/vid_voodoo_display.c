@@ -640,7 +640,7 @@ skip_draw:
                 if (voodoo->line == voodoo->v_disp)
                 {
                         if (voodoo->dirty_line_high > voodoo->dirty_line_low)
-                                svga_doblit(0, voodoo->v_disp, voodoo->h_disp, voodoo->v_disp-1, voodoo->svga);
+                                svga_doblit(voodoo->dirty_line_low + 8, voodoo->dirty_line_high + 9, voodoo->h_disp, voodoo->v_disp-1, voodoo->svga);
                         if (voodoo->clutData_dirty)
                         {
                                 voodoo->clutData_dirty = 0;
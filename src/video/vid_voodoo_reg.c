@@ -70,6 +70,16 @@ voodoo_reg_log(const char *fmt, ...)
 #endif
 
 
+/*The palette checksum is updated as entries are written, so texture cache
+  lookups don't have to rescan the palette. Each entry is mixed with its
+  index, so reordered palettes give different checksums.*/
+static void voodoo_palette_write(voodoo_t *voodoo, int tmu, int p, uint32_t val)
+{
+        voodoo->palette_checksum[tmu] ^= (voodoo->palette[tmu][p].u + p) * 0x9e3779b1;
+        voodoo->palette[tmu][p].u = val;
+        voodoo->palette_checksum[tmu] ^= (val + p) * 0x9e3779b1;
+}
+
 void voodoo_reg_writel(uint32_t addr, uint32_t val, void *p)
 {
         voodoo_t *voodoo = (voodoo_t *)p;
@@ -1121,13 +1131,11 @@ void voodoo_reg_writel(uint32_t addr, uint32_t val, void *p)
                         int p = (val >> 23) & 0xfe;
                         if (chip & CHIP_TREX0)
                         {
-                                voodoo->palette[0][p].u = val | 0xff000000;
-                                voodoo->palette_dirty[0] = 1;
+                                voodoo_palette_write(voodoo, 0, p, val | 0xff000000);
                         }
                         if (chip & CHIP_TREX1)
                         {
-                                voodoo->palette[1][p].u = val | 0xff000000;
-                                voodoo->palette_dirty[1] = 1;
+                                voodoo_palette_write(voodoo, 1, p, val | 0xff000000);
                         }
                 }
                 break;
@@ -1197,13 +1205,11 @@ void voodoo_reg_writel(uint32_t addr, uint32_t val, void *p)
                         int p = ((val >> 23) & 0xfe) | 0x01;
                         if (chip & CHIP_TREX0)
                         {
-                                voodoo->palette[0][p].u = val | 0xff000000;
-                                voodoo->palette_dirty[0] = 1;
+                                voodoo_palette_write(voodoo, 0, p, val | 0xff000000);
                         }
                         if (chip & CHIP_TREX1)
                         {
-                                voodoo->palette[1][p].u = val | 0xff000000;
-                                voodoo->palette_dirty[1] = 1;
+                                voodoo_palette_write(voodoo, 1, p, val | 0xff000000);
                         }
                 }
                 break;
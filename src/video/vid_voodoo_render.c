@@ -453,13 +453,13 @@ static inline void voodoo_tmu_fetch_and_blend(voodoo_t *voodoo, voodoo_params_t
 
         if ((params->textureMode[1] & TEXTUREMODE_TRILINEAR) && (state->lod & 1))
         {
-                c_reverse = tc_reverse_blend;
-                a_reverse = tca_reverse_blend;
+                c_reverse = tc_reverse_blend_1;
+                a_reverse = tca_reverse_blend_1;
         }
         else
         {
-                c_reverse = !tc_reverse_blend;
-                a_reverse = !tca_reverse_blend;
+                c_reverse = !tc_reverse_blend_1;
+                a_reverse = !tca_reverse_blend_1;
         }
 /*        c_reverse1 = c_reverse;
         a_reverse1 = a_reverse;*/
@@ -544,7 +544,7 @@ static inline void voodoo_tmu_fetch_and_blend(voodoo_t *voodoo, voodoo_params_t
                         factor_a = state->lod_frac[1];
                         break;
                 }
-                if (!a_reverse)
+                if (a_reverse)
                         a = (-state->tex_a[1] * ((factor_a ^ 0xff) + 1)) >> 8;
                 else
                         a = (-state->tex_a[1] * (factor_a + 1)) >> 8;
@@ -684,14 +684,65 @@ static inline void voodoo_tmu_fetch_and_blend(voodoo_t *voodoo, voodoo_params_t
                 state->tex_a[0] ^= 0xff;
 }
 
-#if (defined i386 || defined __i386 || defined __i386__ || defined _X86_ || defined WIN32 || defined _WIN32 || defined _WIN32) && !(defined __amd64__)
+#if (defined i386 || defined __i386 || defined __i386__ || defined _X86_ || defined WIN32 || defined _WIN32 || defined _WIN32) && !(defined __amd64__) && !(defined __aarch64__)
 #include <86box/vid_voodoo_codegen_x86.h>
 #elif (defined __amd64__)
 #include <86box/vid_voodoo_codegen_x86-64.h>
+#elif (defined __aarch64__)
+#include <86box/vid_voodoo_codegen_arm64.h>
 #else
 int voodoo_recomp = 0;
 #endif
 
+/*Scanlines are dealt out to the render threads in bands of (1 << render_band_shift)
+  lines, round-robin. Every thread walks the whole params ring in order, so
+  each pixel is still written in submission order.*/
+static __inline int voodoo_band_owner(voodoo_t *voodoo, int band)
+{
+        return (unsigned)band % (unsigned)voodoo->render_threads;
+}
+
+/*Returns non-zero if any of lines ystart to yend-1 belong to this render thread.
+  This lets a thread skip set up of triangles that fall entirely in other bands.*/
+static int voodoo_half_triangle_visible(voodoo_t *voodoo, voodoo_params_t *params, int ystart, int yend, int odd_even)
+{
+        int band_start, band_end, band;
+
+        if (ystart >= yend)
+                return 0;
+        if (voodoo->render_threads == 1)
+                return 1;
+
+        if (params->fbzMode & (1 << 17))
+        {
+                band_start = (voodoo->v_disp-1) - (yend-1);
+                band_end = (voodoo->v_disp-1) - ystart;
+        }
+        else
+        {
+                band_start = ystart;
+                band_end = yend-1;
+        }
+        if (SLI_ENABLED)
+        {
+                band_start >>= 1;
+                band_end >>= 1;
+        }
+        band_start >>= voodoo->render_band_shift;
+        band_end >>= voodoo->render_band_shift;
+
+        if ((band_end - band_start) >= (voodoo->render_threads - 1))
+                return 1;
+
+        for (band = band_start; band <= band_end; band++)
+        {
+                if (voodoo_band_owner(voodoo, band) == odd_even)
+                        return 1;
+        }
+
+        return 0;
+}
+
 static void voodoo_half_triangle(voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int ystart, int yend, int odd_even)
 {
 /*        int rgb_sel                 = params->fbzColorPath & 3;
@@ -813,6 +864,10 @@ static void voodoo_half_triangle(voodoo_t *voodoo, voodoo_params_t *params, vood
                         state->xend += state->dx2;
                 }
         }
+
+        if (!voodoo_half_triangle_visible(voodoo, params, state->y, yend, odd_even))
+                goto skip_triangle;
+
 #ifndef NO_CODEGEN
         if (voodoo->use_recompiler)
                 voodoo_draw = voodoo_get_block(voodoo, params, state, odd_even);
@@ -858,12 +913,12 @@ static void voodoo_half_triangle(voodoo_t *voodoo, voodoo_params_t *params, vood
 
                 if (SLI_ENABLED)
                 {
-                        if (((real_y >> 1) & voodoo->odd_even_mask) != odd_even)
+                        if (voodoo_band_owner(voodoo, (real_y >> 1) >> voodoo->render_band_shift) != odd_even)
                                 goto next_line;
                 }
                 else
                 {
-                        if ((real_y & voodoo->odd_even_mask) != odd_even)
+                        if (voodoo_band_owner(voodoo, real_y >> voodoo->render_band_shift) != odd_even)
                                 goto next_line;
                 }
 
@@ -1030,7 +1085,7 @@ static void voodoo_half_triangle(voodoo_t *voodoo, voodoo_params_t *params, vood
                                 {
                                         uint16_t old_depth = voodoo->params.aux_tiled ? aux_mem[x_tiled] : aux_mem[x];
 
-                                        DEPTH_TEST((params->fbzMode & FBZ_DEPTH_SOURCE) ? (params->zaColor & 0xffff) : new_depth);
+                                        DEPTH_TEST(((params->fbzMode & FBZ_DEPTH_SOURCE) ? (params->zaColor & 0xffff) : new_depth));
                                 }
 
                                 dat = voodoo->params.col_tiled ? fb_mem[x_tiled] : fb_mem[x];
@@ -1435,6 +1490,7 @@ next_line:
                 state->xend += state->dx2;
         }
 
+skip_triangle:
         voodoo->texture_cache[0][params->tex_entry[0]].refcount_r[odd_even]++;
         voodoo->texture_cache[1][params->tex_entry[1]].refcount_r[odd_even]++;
 }
@@ -1587,9 +1643,11 @@ void voodoo_triangle(voodoo_t *voodoo, voodoo_params_t *params, int odd_even)
 }
 
 
-static void render_thread(void *param, int odd_even)
+void voodoo_render_thread(void *param)
 {
-        voodoo_t *voodoo = (voodoo_t *)param;
+        voodoo_render_thread_t *render_thread = (voodoo_render_thread_t *)param;
+        voodoo_t *voodoo = render_thread->voodoo;
+        int odd_even = render_thread->odd_even;
 
         while (1)
         {
@@ -1619,46 +1677,32 @@ static void render_thread(void *param, int odd_even)
         }
 }
 
-void voodoo_render_thread_1(void *param)
-{
-        render_thread(param, 0);
-}
-void voodoo_render_thread_2(void *param)
-{
-        render_thread(param, 1);
-}
-void voodoo_render_thread_3(void *param)
+static int voodoo_params_full(voodoo_t *voodoo)
 {
-        render_thread(param, 2);
-}
-void voodoo_render_thread_4(void *param)
-{
-        render_thread(param, 3);
+        int c;
+
+        for (c = 0; c < voodoo->render_threads; c++)
+        {
+                if (PARAM_FULL(c))
+                        return 1;
+        }
+        return 0;
 }
 
 void voodoo_queue_triangle(voodoo_t *voodoo, voodoo_params_t *params)
 {
         voodoo_params_t *params_new = &voodoo->params_buffer[voodoo->params_write_idx & PARAM_MASK];
+        int c;
 
-        while (PARAM_FULL(0) || (voodoo->render_threads >= 2 && PARAM_FULL(1)) ||
-                (voodoo->render_threads == 4 && (PARAM_FULL(2) || PARAM_FULL(3))))
+        while (voodoo_params_full(voodoo))
         {
-                thread_reset_event(voodoo->render_not_full_event[0]);
-                if (voodoo->render_threads >= 2)
-                        thread_reset_event(voodoo->render_not_full_event[1]);
-                if (voodoo->render_threads == 4)
+                for (c = 0; c < voodoo->render_threads; c++)
+                        thread_reset_event(voodoo->render_not_full_event[c]);
+                for (c = 0; c < voodoo->render_threads; c++)
                 {
-                        thread_reset_event(voodoo->render_not_full_event[2]);
-                        thread_reset_event(voodoo->render_not_full_event[3]);
+                        if (PARAM_FULL(c))
+                                thread_wait_event(voodoo->render_not_full_event[c], -1); /*Wait for room in ringbuffer*/
                 }
-                if (PARAM_FULL(0))
-                        thread_wait_event(voodoo->render_not_full_event[0], -1); /*Wait for room in ringbuffer*/
-                if (voodoo->render_threads >= 2 && PARAM_FULL(1))
-                        thread_wait_event(voodoo->render_not_full_event[1], -1); /*Wait for room in ringbuffer*/
-                if (voodoo->render_threads == 4 && PARAM_FULL(2))
-                        thread_wait_event(voodoo->render_not_full_event[2], -1); /*Wait for room in ringbuffer*/
-                if (voodoo->render_threads == 4 && PARAM_FULL(3))
-                        thread_wait_event(voodoo->render_not_full_event[3], -1); /*Wait for room in ringbuffer*/
         }
 
         voodoo_use_texture(voodoo, params, 0);
@@ -1669,7 +1713,314 @@ void voodoo_queue_triangle(voodoo_t *voodoo, voodoo_params_t *params)
 
         voodoo->params_write_idx++;
 
-        if (PARAM_ENTRIES(0) < 4 || (voodoo->render_threads >= 2 && PARAM_ENTRIES(1) < 4) ||
-                        (voodoo->render_threads == 4 && (PARAM_ENTRIES(2) < 4 || PARAM_ENTRIES(3) < 4)))
-                voodoo_wake_render_thread(voodoo);
+        for (c = 0; c < voodoo->render_threads; c++)
+        {
+                if (PARAM_ENTRIES(c) < 4)
+                {
+                        voodoo_wake_render_thread(voodoo);
+                        break;
+                }
+        }
+}
+
+
+/*Self test: draw random triangles with random render modes through both the
+  recompiled span code for this host and the C span loop, starting from the
+  same frame and depth buffer contents, and compare the results pixel for
+  pixel. A first round runs with two TMUs and bilinear filtering, a second
+  with one TMU and point sampling, as neither is part of the block key.
+  Returns the number of triangles that were drawn differently.*/
+#define TEST_TRIANGLES 1500
+#define TEST_W         256
+#define TEST_H         192
+#define TEST_FB_SIZE   (128 << 10)
+#define TEST_AUX       (1 << 20)
+
+static uint32_t voodoo_test_seed;
+
+static uint32_t voodoo_test_rand(void)
+{
+        voodoo_test_seed ^= voodoo_test_seed << 13;
+        voodoo_test_seed ^= voodoo_test_seed >> 17;
+        voodoo_test_seed ^= voodoo_test_seed << 5;
+        return voodoo_test_seed;
+}
+
+static int32_t voodoo_test_delta(int range)
+{
+        return (int32_t)(voodoo_test_rand() % (2 * range + 1)) - range;
+}
+
+static void voodoo_test_modes(voodoo_t *voodoo, voodoo_params_t *params)
+{
+        static const int afunc_dest[9] = { 0, 1, 2, 3, 4, 5, 6, 7, AFUNC_ASATURATE };
+        int tmu, c, tex;
+
+        /*The texture colour is undefined when texturing is off, so it is
+          only picked as an input when it is fetched*/
+        tex = voodoo_test_rand() & 1;
+        if (tex)
+                params->fbzColorPath = FBZCP_TEXTURE_ENABLED |
+                                       (voodoo_test_rand() % 3) |              /*rgb_sel*/
+                                       ((voodoo_test_rand() % 3) << 2) |       /*a_sel*/
+                                       ((voodoo_test_rand() % 6) << 10) |      /*cc_mselect*/
+                                       ((voodoo_test_rand() % 5) << 19) |      /*cca_mselect*/
+                                       (voodoo_test_rand() & (1 << 7));        /*cc_localselect_override*/
+        else
+                params->fbzColorPath = ((voodoo_test_rand() & 1) << 1) |       /*rgb_sel*/
+                                       ((voodoo_test_rand() & 1) << 3) |       /*a_sel*/
+                                       ((voodoo_test_rand() % 4) << 10) |      /*cc_mselect*/
+                                       ((voodoo_test_rand() % 4) << 19);       /*cca_mselect*/
+        params->fbzColorPath |= ((voodoo_test_rand() % 3) << 5) |       /*cca_localselect*/
+                                ((voodoo_test_rand() % 3) << 14) |      /*cc_add*/
+                                ((voodoo_test_rand() & 1) << 23) |      /*cca_add*/
+                                (voodoo_test_rand() & ((1 << 4) | (1 << 8) | (1 << 9) | (1 << 13) | (1 << 16) | (1 << 17) |
+                                                       (1 << 18) | (1 << 22) | (1 << 25) | FBZ_PARAM_ADJUST));
+        params->fbzMode = voodoo_test_rand() & (1 | FBZ_CHROMAKEY | FBZ_W_BUFFER | FBZ_DEPTH_ENABLE | (7 << 5) | FBZ_DITHER |
+                                                FBZ_RGB_WMASK | FBZ_DEPTH_WMASK | FBZ_DITHER_2x2 | FBZ_DEPTH_BIAS | (1 << 17) |
+                                                FBZ_DEPTH_SOURCE);
+        params->alphaMode = (voodoo_test_rand() & (1 | (7 << 1) | (1 << 4) | (0xff << 24))) |
+                            ((voodoo_test_rand() & 7) << 8) |
+                            (afunc_dest[voodoo_test_rand() % 9] << 12);
+        params->fogMode = voodoo_test_rand() & 0x3f;
+
+        for (tmu = 0; tmu < 2; tmu++)
+        {
+                params->textureMode[tmu] = (voodoo_test_rand() & (0xff | (0xf << 8) | (0x3 << 12) | (1 << 17) | (0x7 << 18) |
+                                                                  (0x3 << 21) | (0x7 << 26) | TEXTUREMODE_TRILINEAR)) |
+                                           ((voodoo_test_rand() % 6) << 14) |
+                                           ((voodoo_test_rand() % 6) << 23);
+                /*Sometimes use the pass-through and local-only set ups the renderer special cases*/
+                switch (voodoo_test_rand() & 7)
+                {
+                        case 0:
+                        params->textureMode[tmu] &= ~TEXTUREMODE_MASK;
+                        break;
+                        case 1:
+                        params->textureMode[tmu] = (params->textureMode[tmu] & ~TEXTUREMODE_LOCAL_MASK) | TEXTUREMODE_LOCAL;
+                        break;
+                }
+                /*LOD min and max are 4.2 fixed point and at most 8.0*/
+                params->tLOD[tmu] = (voodoo_test_rand() % 33) | ((voodoo_test_rand() % 33) << 6) |
+                                    (voodoo_test_rand() & ((0x3f << 12) | LOD_ODD | LOD_SPLIT | LOD_S_IS_WIDER | (3 << 21) |
+                                                           LOD_TMIRROR_S | LOD_TMIRROR_T));
+                params->tformat[tmu] = (params->textureMode[tmu] >> 8) & 0xf;
+                params->tex_entry[tmu] = 0;
+                params->detail_max[tmu] = voodoo_test_rand() & 0xff;
+                params->detail_bias[tmu] = voodoo_test_rand() & 0x3f;
+                params->detail_scale[tmu] = voodoo_test_rand() & 7;
+                params->texBaseAddr[tmu] = 0;
+        }
+
+        params->color0 = voodoo_test_rand();
+        params->color1 = voodoo_test_rand();
+        params->zaColor = voodoo_test_rand();
+        params->chromaKey = voodoo_test_rand() & 0xffffff;
+        params->chromaKey_r = (params->chromaKey >> 16) & 0xff;
+        params->chromaKey_g = (params->chromaKey >> 8) & 0xff;
+        params->chromaKey_b = params->chromaKey & 0xff;
+        params->fogColor.r = voodoo_test_rand() & 0xff;
+        params->fogColor.g = voodoo_test_rand() & 0xff;
+        params->fogColor.b = voodoo_test_rand() & 0xff;
+        for (c = 0; c < 64; c++)
+        {
+                params->fogTable[c].fog = voodoo_test_rand() & 0xff;
+                params->fogTable[c].dfog = voodoo_test_rand() & 0xff;
+        }
+
+        params->col_tiled = params->aux_tiled = !(voodoo_test_rand() & 3);
+        if (params->col_tiled)
+                params->row_width = params->aux_row_width = (TEST_W * 2 / 128) * 128*32;
+        else
+                params->row_width = params->aux_row_width = TEST_W * 2;
+        params->draw_offset = 0;
+        params->aux_offset = TEST_AUX;
+
+        params->clipLeft = voodoo_test_rand() % (TEST_W / 2);
+        params->clipRight = params->clipLeft + voodoo_test_rand() % (TEST_W - params->clipLeft + 1);
+        params->clipLowY = voodoo_test_rand() % (TEST_H / 2);
+        params->clipHighY = params->clipLowY + voodoo_test_rand() % (TEST_H - params->clipLowY + 1);
+
+        voodoo->trexInit1[0] = (voodoo_test_rand() & 15) ? 0 : (1 << 18);
+        voodoo->col_tiled = params->col_tiled;
+        voodoo->aux_tiled = params->aux_tiled;
+
+        memcpy(&voodoo->params, params, sizeof(voodoo_params_t));
+        voodoo_recalc_tex(voodoo, 0);
+        voodoo_recalc_tex(voodoo, 1);
+        memcpy(params, &voodoo->params, sizeof(voodoo_params_t));
+}
+
+static void voodoo_test_triangle(voodoo_params_t *params)
+{
+        int32_t x[3], y[3], t;
+        int c, d, tmu;
+
+        /*Vertices in 12.4 fixed point, sorted by Y*/
+        for (c = 0; c < 3; c++)
+        {
+                x[c] = voodoo_test_rand() % (TEST_W << 4);
+                y[c] = voodoo_test_rand() % (TEST_H << 4);
+        }
+        for (c = 0; c < 2; c++)
+        {
+                for (d = 0; d < 2 - c; d++)
+                {
+                        if (y[d] > y[d + 1])
+                        {
+                                t = y[d]; y[d] = y[d + 1]; y[d + 1] = t;
+                                t = x[d]; x[d] = x[d + 1]; x[d + 1] = t;
+                        }
+                }
+        }
+        params->vertexAx = x[0]; params->vertexAy = y[0];
+        params->vertexBx = x[1]; params->vertexBy = y[1];
+        params->vertexCx = x[2]; params->vertexCy = y[2];
+        /*Spans run right to left when B is left of the A-C edge*/
+        params->sign = ((int64_t)(x[1] - x[0]) * (y[2] - y[0]) < (int64_t)(x[2] - x[0]) * (y[1] - y[0]));
+
+        params->startR = voodoo_test_rand() & 0xfffff;
+        params->startG = voodoo_test_rand() & 0xfffff;
+        params->startB = voodoo_test_rand() & 0xfffff;
+        params->startA = voodoo_test_rand() & 0xfffff;
+        params->startZ = voodoo_test_rand();
+        params->dRdX = voodoo_test_delta(0x2000); params->dRdY = voodoo_test_delta(0x2000);
+        params->dGdX = voodoo_test_delta(0x2000); params->dGdY = voodoo_test_delta(0x2000);
+        params->dBdX = voodoo_test_delta(0x2000); params->dBdY = voodoo_test_delta(0x2000);
+        params->dAdX = voodoo_test_delta(0x2000); params->dAdY = voodoo_test_delta(0x2000);
+        params->dZdX = voodoo_test_delta(0x100000); params->dZdY = voodoo_test_delta(0x100000);
+        params->startW = voodoo_test_rand() >> (voodoo_test_rand() & 31);
+        params->dWdX = voodoo_test_delta(0x400000);
+        params->dWdY = voodoo_test_delta(0x400000);
+
+        for (tmu = 0; tmu < 2; tmu++)
+        {
+                /*S and T in texels << 32, W around 1.0 and kept positive*/
+                params->tmu[tmu].startS = (int64_t)(voodoo_test_rand() & 0xffffff) << 16;
+                params->tmu[tmu].startT = (int64_t)(voodoo_test_rand() & 0xffffff) << 16;
+                params->tmu[tmu].startW = (1ll << 32) + ((int64_t)voodoo_test_delta(0x10000) << 8);
+                params->tmu[tmu].dSdX = (int64_t)voodoo_test_delta(0x20000) << 16;
+                params->tmu[tmu].dTdX = (int64_t)voodoo_test_delta(0x20000) << 16;
+                params->tmu[tmu].dSdY = (int64_t)voodoo_test_delta(0x20000) << 16;
+                params->tmu[tmu].dTdY = (int64_t)voodoo_test_delta(0x20000) << 16;
+                params->tmu[tmu].dWdX = voodoo_test_delta(0x40000);
+                params->tmu[tmu].dWdY = voodoo_test_delta(0x40000);
+        }
+}
+
+static int voodoo_test_compare(voodoo_t *voodoo, uint8_t *ref, voodoo_params_t *params, int nr)
+{
+        int c;
+
+        for (c = 0; c < 2 * TEST_FB_SIZE; c += 2)
+        {
+                uint32_t addr = (c < TEST_FB_SIZE) ? c : (TEST_AUX + c - TEST_FB_SIZE);
+                uint16_t got = *(uint16_t *)&voodoo->fb_mem[addr];
+                uint16_t exp = *(uint16_t *)&ref[c];
+
+                if (got != exp)
+                {
+                        printf("Voodoo render: triangle %i, %s at %06x is %04x, expected %04x\n", nr,
+                               (c < TEST_FB_SIZE) ? "colour" : "depth", addr, got, exp);
+                        printf("Voodoo render: fbzMode=%08x fbzColorPath=%08x alphaMode=%08x fogMode=%08x\n",
+                               params->fbzMode, params->fbzColorPath, params->alphaMode, params->fogMode);
+                        printf("Voodoo render: textureMode=%08x,%08x tLOD=%08x,%08x tiled=%i dual_tmus=%i bilinear=%i\n",
+                               params->textureMode[0], params->textureMode[1], params->tLOD[0], params->tLOD[1],
+                               params->col_tiled, voodoo->dual_tmus, voodoo->bilinear_enabled);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+int voodoo_render_test(void)
+{
+#ifdef NO_CODEGEN
+        printf("Voodoo render:   no recompiler on this host, not tested\n");
+        return 0;
+#else
+        voodoo_t *voodoo = calloc(1, sizeof(voodoo_t));
+        voodoo_params_t params;
+        uint8_t *init, *ref;
+        int c, tmu, round, failed = 0;
+
+        voodoo->fb_mem = malloc(4 * 1024 * 1024);
+        voodoo->fb_mask = (4 << 20) - 1;
+        voodoo->render_threads = 1;
+        voodoo->v_disp = TEST_H;
+        voodoo_texture_cache_init(voodoo, 64);
+        init = malloc(2 * TEST_FB_SIZE);
+        ref = malloc(2 * TEST_FB_SIZE);
+        voodoo_test_seed = 1;
+
+        /*The recompiler reads the destination through rgb565[], which is
+          otherwise only filled in when a card is added*/
+        for (c = 0; c < 0x10000; c++)
+        {
+                rgb565[c].r = (c >> 8) & 0xf8;
+                rgb565[c].g = (c >> 3) & 0xfc;
+                rgb565[c].b = (c << 3) & 0xf8;
+                rgb565[c].r |= (rgb565[c].r >> 5);
+                rgb565[c].g |= (rgb565[c].g >> 6);
+                rgb565[c].b |= (rgb565[c].b >> 5);
+                rgb565[c].a = 0xff;
+        }
+
+        for (tmu = 0; tmu < 2; tmu++)
+        {
+                voodoo->texture_cache[tmu][0].data = malloc(TEX_CACHE_DATA_SIZE);
+                for (c = 0; c < (TEX_CACHE_DATA_SIZE / 4); c++)
+                        voodoo->texture_cache[tmu][0].data[c] = voodoo_test_rand();
+        }
+
+        for (round = 0; round < 2; round++)
+        {
+                voodoo->dual_tmus = voodoo->bilinear_enabled = !round;
+                /*tmuConfig is compiled into the blocks but is not part of
+                  the block key, as it does not change once a card is set up*/
+                voodoo->tmuConfig = voodoo_test_rand() & 0xff;
+                voodoo_codegen_init(voodoo);
+
+                for (c = 0; c < TEST_TRIANGLES; c++)
+                {
+                        int d;
+
+                        memset(&params, 0, sizeof(params));
+                        voodoo_test_modes(voodoo, &params);
+                        voodoo_test_triangle(&params);
+                        memcpy(&voodoo->params, &params, sizeof(voodoo_params_t));
+
+                        for (d = 0; d < 2 * TEST_FB_SIZE; d += 4)
+                                *(uint32_t *)&init[d] = voodoo_test_rand();
+
+                        memcpy(voodoo->fb_mem, init, TEST_FB_SIZE);
+                        memcpy(&voodoo->fb_mem[TEST_AUX], &init[TEST_FB_SIZE], TEST_FB_SIZE);
+                        voodoo->use_recompiler = 0;
+                        voodoo_triangle(voodoo, &voodoo->params, 0);
+                        memcpy(ref, voodoo->fb_mem, TEST_FB_SIZE);
+                        memcpy(&ref[TEST_FB_SIZE], &voodoo->fb_mem[TEST_AUX], TEST_FB_SIZE);
+
+                        memcpy(&voodoo->params, &params, sizeof(voodoo_params_t));
+                        memcpy(voodoo->fb_mem, init, TEST_FB_SIZE);
+                        memcpy(&voodoo->fb_mem[TEST_AUX], &init[TEST_FB_SIZE], TEST_FB_SIZE);
+                        voodoo->use_recompiler = 1;
+                        voodoo_triangle(voodoo, &voodoo->params, 0);
+
+                        failed += voodoo_test_compare(voodoo, ref, &params, (round * TEST_TRIANGLES) + c);
+                }
+
+                voodoo_codegen_close(voodoo);
+        }
+
+        printf("Voodoo render:   %i triangles tested, %i drawn differently by the recompiler\n", 2 * TEST_TRIANGLES, failed);
+
+        voodoo_texture_cache_close(voodoo);
+        free(ref);
+        free(init);
+        free(voodoo->fb_mem);
+        free(voodoo);
+
+        return failed;
+#endif
 }
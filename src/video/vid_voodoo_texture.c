@@ -56,6 +56,8 @@ voodoo_texture_log(const char *fmt, ...)
 #define voodoo_texture_log(fmt, ...)
 #endif
 
+uint64_t voodoo_tex_hits, voodoo_tex_misses, voodoo_tex_decode_time;
+
 
 void voodoo_recalc_tex(voodoo_t *voodoo, int tmu)
 {
@@ -158,32 +160,133 @@ void voodoo_recalc_tex(voodoo_t *voodoo, int tmu)
 
 #define makergba(r, g, b, a)  ((b) | ((g) << 8) | ((r) << 16) | ((a) << 24))
 
+static int voodoo_texture_in_use(voodoo_t *voodoo, int tmu, int c)
+{
+        int d;
+
+        for (d = 0; d < voodoo->render_threads; d++)
+        {
+                if (voodoo->texture_cache[tmu][c].refcount != voodoo->texture_cache[tmu][c].refcount_r[d])
+                        return 1;
+        }
+        return 0;
+}
+
+static __inline int voodoo_texture_hash(uint32_t base, uint32_t tLOD, uint32_t palette_checksum)
+{
+        uint32_t hash = (base >> 3) ^ (tLOD * 0x9e3779b1) ^ palette_checksum;
+
+        hash *= 0x85ebca6b;
+        return hash >> (32 - TEX_HASH_BITS);
+}
+
+/*Add or remove cache entry c to/from the page counts and region bitmaps
+  covering its texture memory*/
+static void voodoo_texture_index(voodoo_t *voodoo, int tmu, int c, int add)
+{
+        texture_t *texture = &voodoo->texture_cache[tmu][c];
+        uint32_t page_mask = voodoo->texture_mask >> TEX_DIRTY_SHIFT;
+        int d;
+
+        for (d = 0; d < 4; d++)
+        {
+                uint32_t page, page_end;
+
+                if (texture->addr_end[d] == 0 || texture->addr_end[d] < texture->addr_start[d])
+                        continue;
+
+                page = texture->addr_start[d] >> TEX_DIRTY_SHIFT;
+                page_end = texture->addr_end[d] >> TEX_DIRTY_SHIFT;
+                if ((page_end - page) > page_mask)
+                        page_end = page + page_mask;
+
+                for (; page <= page_end; page++)
+                {
+                        int region = (page & page_mask) >> (TEX_REGION_SHIFT - TEX_DIRTY_SHIFT);
+
+                        if (add)
+                        {
+                                voodoo->texture_present[tmu][page & page_mask]++;
+                                voodoo->texture_region[tmu][region][c >> 6] |= (1ull << (c & 63));
+                        }
+                        else
+                        {
+                                voodoo->texture_present[tmu][page & page_mask]--;
+                                voodoo->texture_region[tmu][region][c >> 6] &= ~(1ull << (c & 63));
+                        }
+                }
+        }
+}
+
+static void voodoo_texture_remove(voodoo_t *voodoo, int tmu, int c)
+{
+        texture_t *texture = &voodoo->texture_cache[tmu][c];
+        int *prev = &voodoo->texture_hash[tmu][voodoo_texture_hash(texture->base, texture->tLOD, texture->palette_checksum)];
+
+        while (*prev != c)
+                prev = &voodoo->texture_cache[tmu][*prev].hash_next;
+        *prev = texture->hash_next;
+
+        voodoo_texture_index(voodoo, tmu, c, 0);
+        texture->base = -1;
+}
+
+static void voodoo_texture_insert(voodoo_t *voodoo, int tmu, int c)
+{
+        texture_t *texture = &voodoo->texture_cache[tmu][c];
+        int hash = voodoo_texture_hash(texture->base, texture->tLOD, texture->palette_checksum);
+
+        texture->hash_next = voodoo->texture_hash[tmu][hash];
+        voodoo->texture_hash[tmu][hash] = c;
+
+        voodoo_texture_index(voodoo, tmu, c, 1);
+}
+
+void voodoo_texture_cache_init(voodoo_t *voodoo, int size)
+{
+        int tmu, c;
+
+        if (size < 64 || size > TEX_CACHE_MAX || (size & (size - 1)))
+                size = 64;
+        voodoo->texture_cache_size = size;
+
+        for (tmu = 0; tmu < 2; tmu++)
+        {
+                voodoo->texture_cache[tmu] = calloc(size, sizeof(texture_t));
+                for (c = 0; c < size; c++)
+                        voodoo->texture_cache[tmu][c].base = -1; /*invalid*/
+                for (c = 0; c < TEX_HASH_SIZE; c++)
+                        voodoo->texture_hash[tmu][c] = -1;
+        }
+}
+
+void voodoo_texture_cache_close(voodoo_t *voodoo)
+{
+        int tmu, c;
+
+        for (tmu = 0; tmu < 2; tmu++)
+        {
+                for (c = 0; c < voodoo->texture_cache_size; c++)
+                        free(voodoo->texture_cache[tmu][c].data);
+                free(voodoo->texture_cache[tmu]);
+        }
+}
+
 void voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
 {
-        int c, d;
+        int c;
         int lod;
         int lod_min, lod_max;
-        uint32_t addr = 0, addr_end;
+        uint32_t addr = 0;
         uint32_t palette_checksum;
+        uint32_t tLOD = params->tLOD[tmu] & 0xf00fff;
+        uint64_t start_time;
 
         lod_min = (params->tLOD[tmu] >> 2) & 15;
         lod_max = (params->tLOD[tmu] >> 8) & 15;
 
         if (params->tformat[tmu] == TEX_PAL8 || params->tformat[tmu] == TEX_APAL8 || params->tformat[tmu] == TEX_APAL88)
-        {
-                if (voodoo->palette_dirty[tmu])
-                {
-                        palette_checksum = 0;
-
-                        for (c = 0; c < 256; c++)
-                                palette_checksum ^= voodoo->palette[tmu][c].u;
-
-                        voodoo->palette_checksum[tmu] = palette_checksum;
-                        voodoo->palette_dirty[tmu] = 0;
-                }
-                else
-                        palette_checksum = voodoo->palette_checksum[tmu];
-        }
+                palette_checksum = voodoo->palette_checksum[tmu];
         else
                 palette_checksum = 0;
 
@@ -193,43 +296,49 @@ void voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
                 addr = params->texBaseAddr[tmu];
 
         /*Try to find texture in cache*/
-        for (c = 0; c < TEX_CACHE_MAX; c++)
+        for (c = voodoo->texture_hash[tmu][voodoo_texture_hash(addr, tLOD, palette_checksum)]; c != -1; c = voodoo->texture_cache[tmu][c].hash_next)
         {
                 if (voodoo->texture_cache[tmu][c].base == addr &&
-                    voodoo->texture_cache[tmu][c].tLOD == (params->tLOD[tmu] & 0xf00fff) &&
+                    voodoo->texture_cache[tmu][c].tLOD == tLOD &&
                     voodoo->texture_cache[tmu][c].palette_checksum == palette_checksum)
                 {
                         params->tex_entry[tmu] = c;
                         voodoo->texture_cache[tmu][c].refcount++;
+                        voodoo_tex_hits++;
                         return;
                 }
         }
-        
+
+        voodoo_tex_misses++;
+        start_time = plat_timer_read();
+
         /*Texture not found, search for unused texture*/
         do
         {
-                for (c = 0; c < TEX_CACHE_MAX; c++)
+                for (c = 0; c < voodoo->texture_cache_size; c++)
                 {
                         voodoo->texture_last_removed++;
-                        voodoo->texture_last_removed &= (TEX_CACHE_MAX-1);
-                        if (voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount == voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount_r[0] &&
-                            (voodoo->render_threads == 1 || voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount == voodoo->texture_cache[tmu][voodoo->texture_last_removed].refcount_r[1]))
+                        voodoo->texture_last_removed &= (voodoo->texture_cache_size-1);
+                        if (!voodoo_texture_in_use(voodoo, tmu, voodoo->texture_last_removed))
                                 break;
                 }
-                if (c == TEX_CACHE_MAX)
+                if (c == voodoo->texture_cache_size)
                         voodoo_wait_for_render_thread_idle(voodoo);
-        } while (c == TEX_CACHE_MAX);
-        if (c == TEX_CACHE_MAX)
-                fatal("Texture cache full!\n");
+        } while (c == voodoo->texture_cache_size);
 
         c = voodoo->texture_last_removed;
 
+        if (voodoo->texture_cache[tmu][c].base != -1)
+                voodoo_texture_remove(voodoo, tmu, c);
+        if (!voodoo->texture_cache[tmu][c].data)
+                voodoo->texture_cache[tmu][c].data = malloc(TEX_CACHE_DATA_SIZE);
+
 
         if ((voodoo->params.tLOD[tmu] & LOD_SPLIT) && (voodoo->params.tLOD[tmu] & LOD_ODD) && (voodoo->params.tLOD[tmu] & LOD_TMULTIBASEADDR))
                 voodoo->texture_cache[tmu][c].base = params->texBaseAddr1[tmu];
         else
                 voodoo->texture_cache[tmu][c].base = params->texBaseAddr[tmu];
-        voodoo->texture_cache[tmu][c].tLOD = params->tLOD[tmu] & 0xf00fff;
+        voodoo->texture_cache[tmu][c].tLOD = tLOD;
 
         lod_min = (params->tLOD[tmu] >> 2) & 15;
         lod_max = (params->tLOD[tmu] >> 8) & 15;
@@ -499,63 +608,52 @@ void voodoo_use_texture(voodoo_t *voodoo, voodoo_params_t *params, int tmu)
         else
                 voodoo->texture_cache[tmu][c].addr_start[3] = voodoo->texture_cache[tmu][c].addr_end[3] = 0;
 
-
-        for (d = 0; d < 4; d++)
-        {
-                addr = voodoo->texture_cache[tmu][c].addr_start[d];
-                addr_end = voodoo->texture_cache[tmu][c].addr_end[d];
-
-                if (addr_end != 0)
-                {
-                        for (; addr <= addr_end; addr += (1 << TEX_DIRTY_SHIFT))
-                                voodoo->texture_present[tmu][(addr & voodoo->texture_mask) >> TEX_DIRTY_SHIFT] = 1;
-                }
-        }
+        voodoo_texture_insert(voodoo, tmu, c);
 
         params->tex_entry[tmu] = c;
         voodoo->texture_cache[tmu][c].refcount++;
+
+        voodoo_tex_decode_time += plat_timer_read() - start_time;
 }
 
 void flush_texture_cache(voodoo_t *voodoo, uint32_t dirty_addr, int tmu)
 {
+        uint64_t *region = voodoo->texture_region[tmu][dirty_addr >> TEX_REGION_SHIFT];
         int wait_for_idle = 0;
-        int c;
+        int c, d;
 
-        memset(voodoo->texture_present[tmu], 0, sizeof(voodoo->texture_present[0]));
-//        voodoo_texture_log("Evict %08x %i\n", dirty_addr, sizeof(voodoo->texture_present));
-        for (c = 0; c < TEX_CACHE_MAX; c++)
+//        voodoo_texture_log("Evict %08x\n", dirty_addr);
+        for (c = 0; c < voodoo->texture_cache_size; c++)
         {
-                if (voodoo->texture_cache[tmu][c].base != -1)
+                if (!(c & 63) && !region[c >> 6])
                 {
-                        int d;
+                        c += 63;
+                        continue;
+                }
+                if (!(region[c >> 6] & (1ull << (c & 63))))
+                        continue;
 
-                        for (d = 0; d < 4; d++)
+                for (d = 0; d < 4; d++)
+                {
+                        int addr_start = voodoo->texture_cache[tmu][c].addr_start[d];
+                        int addr_end = voodoo->texture_cache[tmu][c].addr_end[d];
+
+                        if (addr_end != 0)
                         {
-                                int addr_start = voodoo->texture_cache[tmu][c].addr_start[d];
-                                int addr_end = voodoo->texture_cache[tmu][c].addr_end[d];
+                                int addr_start_masked = addr_start & voodoo->texture_mask & ~0x3ff;
+                                int addr_end_masked = ((addr_end & voodoo->texture_mask) + 0x3ff) & ~0x3ff;
 
-                                if (addr_end != 0)
+                                if (addr_end_masked < addr_start_masked)
+                                        addr_end_masked = voodoo->texture_mask+1;
+                                if (dirty_addr >= addr_start_masked && dirty_addr < addr_end_masked)
                                 {
-                                        int addr_start_masked = addr_start & voodoo->texture_mask & ~0x3ff;
-                                        int addr_end_masked = ((addr_end & voodoo->texture_mask) + 0x3ff) & ~0x3ff;
-
-                                        if (addr_end_masked < addr_start_masked)
-                                                addr_end_masked = voodoo->texture_mask+1;
-                                        if (dirty_addr >= addr_start_masked && dirty_addr < addr_end_masked)
-                                        {
-//                                voodoo_texture_log("  Evict texture %i %08x\n", c, voodoo->texture_cache[tmu][c].base);
-
-                                                if (voodoo->texture_cache[tmu][c].refcount != voodoo->texture_cache[tmu][c].refcount_r[0] ||
-                                                    (voodoo->render_threads == 2 && voodoo->texture_cache[tmu][c].refcount != voodoo->texture_cache[tmu][c].refcount_r[1]))
-                                                        wait_for_idle = 1;
-
-                                                voodoo->texture_cache[tmu][c].base = -1;
-                                        }
-                                        else
-                                        {
-                                                for (; addr_start <= addr_end; addr_start += (1 << TEX_DIRTY_SHIFT))
-                                                        voodoo->texture_present[tmu][(addr_start & voodoo->texture_mask) >> TEX_DIRTY_SHIFT] = 1;
-                                        }
+//                                        voodoo_texture_log("  Evict texture %i %08x\n", c, voodoo->texture_cache[tmu][c].base);
+
+                                        if (voodoo_texture_in_use(voodoo, tmu, c))
+                                                wait_for_idle = 1;
+
+                                        voodoo_texture_remove(voodoo, tmu, c);
+                                        break;
                                 }
                         }
                 }
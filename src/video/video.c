@@ -57,6 +57,9 @@
 #include <stdlib.h>
 #include <wchar.h>
 #include <math.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #define HAVE_STDARG_H
 #include <86box/86box.h>
 #include "cpu.h"
@@ -69,6 +72,8 @@
 #include <86box/plat.h>
 #include <86box/video.h>
 #include <86box/vid_svga.h>
+#include <86box/vid_svga_render.h>
+#include <86box/capture.h>
 
 
 volatile int	screenshots = 0;
@@ -111,6 +116,7 @@ int		video_res_x = 0,
 static int	video_force_resize;
 int		video_grayscale = 0;
 int		video_graytype = 0;
+uint64_t	video_blit_lines = 0;
 static int	vid_type;
 static const video_timings_t	*vid_timings;
 static uint32_t cga_2_table[16];
@@ -244,17 +250,65 @@ const uint32_t shade[5][256] =
 };
 
 
+/*
+ * Finished frames are handed to the blit thread through three buffers:
+ * the emulation thread fills the back one, the blit thread presents the
+ * front one, and the third is swapped between them with an atomic
+ * exchange. Neither side ever waits for the other; if the blit thread
+ * falls behind, the newest frame replaces the one it has not picked up.
+ */
+#define BLIT_FRAMES	3
+#define BLIT_FRESH	4		/* set in blit_data.middle when it holds a new frame */
+
+typedef struct {
+    bitmap_t	*bitmap;
+    int		x, y, y1, y2, w, h;	/* rectangle and the lines to present */
+    int		stale_y1, stale_y2;	/* lines that are behind buffer32 */
+    int		raw_y1, raw_y2;		/* lines still waiting for the colour transform */
+    int		grayscale, graytype, invert;
+    uint64_t	time;
+} blit_frame_t;
+
 static struct {
-    int		x, y, y1, y2, w, h;
-    int		busy;
-    int		buffer_in_use;
+    blit_frame_t frames[BLIT_FRAMES];
+    int		back, front, middle;
+    volatile int busy;
+
+    /* Lines changed since the blitter last picked up a frame. */
+    int		pend_y1, pend_y2;
+
+    /* What the buffers currently hold, so only damaged lines get copied. */
+    int		last_x, last_y, last_w, last_h,
+		last_transform, full;
 
     thread_t	*blit_thread;
     event_t	*wake_blit_thread;
     event_t	*blit_complete;
-    event_t	*buffer_not_in_use;
 }		blit_data;
 
+uint64_t	video_frames_presented = 0,
+		video_frames_dropped = 0,
+		video_present_latency = 0;
+
+/* Screenshots are encoded by their own thread from a copy of buffer32. */
+#define VIDEO_SHOT_QUEUE	8	/* must be a power of 2 */
+
+typedef struct {
+    wchar_t	path[1024];
+    uint32_t	*pixels;
+    int		w, h;
+    int		grayscale, graytype, invert;
+} video_shot_t;
+
+static struct {
+    thread_t	*thread;
+    event_t	*wake, *done;
+    mutex_t	*mutex;
+
+    uint32_t	head, tail;
+    video_shot_t queue[VIDEO_SHOT_QUEUE];
+}		shot_data;
+
 
 static void (*blit_func)(int x, int y, int y1, int y2, int w, int h);
 
@@ -279,19 +333,133 @@ video_log(const char *fmt, ...)
 #endif
 
 
+static __inline uint32_t
+video_transform_pixel(uint32_t color, int grayscale, int graytype, int invert)
+{
+    uint8_t *clr8 = (uint8_t *) &color;
+
+    if (grayscale) {
+	if (graytype) {
+		if (graytype == 1)
+			color = ((54 * (uint32_t)clr8[2]) + (183 * (uint32_t)clr8[1]) + (18 * (uint32_t)clr8[0])) / 255;
+		else
+			color = ((uint32_t)clr8[2] + (uint32_t)clr8[1] + (uint32_t)clr8[0]) / 3;
+	} else
+		color = ((76 * (uint32_t)clr8[2]) + (150 * (uint32_t)clr8[1]) + (29 * (uint32_t)clr8[0])) / 255;
+	switch (grayscale) {
+		case 2: case 3: case 4:
+			color = (uint32_t) shade[grayscale][color];
+			break;
+		default:
+			clr8[3] = 0;
+			clr8[0] = color;
+			clr8[1] = clr8[2] = clr8[0];
+			break;
+	}
+    }
+    if (invert)
+	color ^= 0x00ffffff;
+    return color;
+}
+
+
+/*
+ * Apply the grayscale and invert options to a line in place. The SSE2
+ * path does four pixels at a time; (x + 1 + (x >> 8)) >> 8 is x / 255
+ * and (x * 21846) >> 16 is x / 3 for the sums that can occur here.
+ */
+static void
+video_transform_line(uint32_t *p, int len, int grayscale, int graytype, int invert)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inv = _mm_set1_epi32(invert ? 0x00ffffff : 0);
+    __m128i coef, v, lo, hi, g;
+    uint32_t t[4];
+
+    if (grayscale) {
+	if (graytype == 1)
+		coef = _mm_set_epi16(0, 54, 183, 18, 0, 54, 183, 18);
+	else if (graytype)
+		coef = _mm_set_epi16(0, 1, 1, 1, 0, 1, 1, 1);
+	else
+		coef = _mm_set_epi16(0, 76, 150, 29, 0, 76, 150, 29);
+
+	for (; x <= (len - 4); x += 4) {
+		v = _mm_loadu_si128((__m128i *) &p[x]);
+		lo = _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), coef);
+		hi = _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), coef);
+		lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+		hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+		g = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+						    _MM_SHUFFLE(2, 0, 2, 0)));
+		if (graytype && (graytype != 1))
+			g = _mm_mulhi_epu16(g, _mm_set1_epi32(21846));
+		else
+			g = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(g, _mm_set1_epi32(1)), _mm_srli_epi32(g, 8)), 8);
+
+		if ((grayscale >= 2) && (grayscale <= 4)) {
+			_mm_storeu_si128((__m128i *) t, g);
+			v = _mm_setr_epi32(shade[grayscale][t[0]], shade[grayscale][t[1]],
+					   shade[grayscale][t[2]], shade[grayscale][t[3]]);
+		} else
+			v = _mm_or_si128(g, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(g, 16)));
+
+		_mm_storeu_si128((__m128i *) &p[x], _mm_xor_si128(v, inv));
+	}
+    } else if (invert) {
+	for (; x <= (len - 4); x += 4)
+		_mm_storeu_si128((__m128i *) &p[x], _mm_xor_si128(_mm_loadu_si128((__m128i *) &p[x]), inv));
+    }
+#endif
+
+    for (; x < len; x++)
+	p[x] = video_transform_pixel(p[x], grayscale, graytype, invert);
+}
+
+
 static
 void blit_thread(void *param)
 {
+    blit_frame_t *f;
+    int yy;
+
     while (1) {
 	thread_wait_event(blit_data.wake_blit_thread, -1);
 	thread_reset_event(blit_data.wake_blit_thread);
 
-	if (blit_func)
-		blit_func(blit_data.x, blit_data.y,
-			  blit_data.y1, blit_data.y2,
-			  blit_data.w, blit_data.h);
+	for (;;) {
+		while (__atomic_load_n(&blit_data.middle, __ATOMIC_ACQUIRE) & BLIT_FRESH) {
+			blit_data.front = __atomic_exchange_n(&blit_data.middle, blit_data.front,
+							      __ATOMIC_ACQ_REL) & ~BLIT_FRESH;
+			f = &blit_data.frames[blit_data.front];
+
+			video_present_latency += plat_timer_read() - f->time;
+			video_frames_presented++;
+
+			/* The colour transform is done here rather than on the emulation thread. */
+			if (f->grayscale || f->invert) {
+				for (yy = f->raw_y1; yy < f->raw_y2; yy++) {
+					if (((f->y + yy) >= 0) && ((f->y + yy) < f->bitmap->h))
+						video_transform_line(&(f->bitmap->line[f->y + yy][f->x]), f->w,
+								     f->grayscale, f->graytype, f->invert);
+				}
+			}
+			f->raw_y1 = f->raw_y2 = 0;
+
+			render_buffer = f->bitmap;
+			if (blit_func)
+				blit_func(f->x, f->y, f->y1, f->y2, f->w, f->h);
+		}
+
+		/* Recheck after going idle, in case a frame arrived meanwhile. */
+		blit_data.busy = 0;
+		if (!(__atomic_load_n(&blit_data.middle, __ATOMIC_ACQUIRE) & BLIT_FRESH))
+			break;
+		blit_data.busy = 1;
+	}
 
-	blit_data.busy = 0;
 	thread_set_event(blit_data.blit_complete);
     }
 }
@@ -301,15 +469,19 @@ void
 video_setblit(void(*blit)(int,int,int,int,int,int))
 {
     blit_func = blit;
+
+    /* A new blitter starts with an empty surface. */
+    blit_data.full = 1;
 }
 
 
+/*
+ * The blitter is done with render_buffer. It owns that frame until it
+ * picks up the next one, so there is nothing to release.
+ */
 void
 video_blit_complete(void)
 {
-    blit_data.buffer_in_use = 0;
-
-    thread_set_event(blit_data.buffer_not_in_use);
 }
 
 
@@ -322,12 +494,10 @@ video_wait_for_blit(void)
 }
 
 
+/* Frames are copied into a buffer the blitter is not using, so there is nothing to wait for. */
 void
 video_wait_for_buffer(void)
 {
-    while (blit_data.buffer_in_use)
-	thread_wait_event(blit_data.buffer_not_in_use, -1);
-    thread_reset_event(blit_data.buffer_not_in_use);
 }
 
 
@@ -336,17 +506,18 @@ static png_infop	info_ptr;
 
 
 static void
-video_take_screenshot(const wchar_t *fn, int startx, int starty, int w, int h)
+video_take_screenshot(video_shot_t *shot)
 {
     int i, x, y;
     png_bytep *b_rgb = NULL;
     FILE *fp = NULL;
     uint32_t temp = 0x00000000;
+    int w = shot->w, h = shot->h;
 
     /* create file */
-    fp = plat_fopen((wchar_t *) fn, (wchar_t *) L"wb");
+    fp = plat_fopen(shot->path, (wchar_t *) L"wb");
     if (!fp) {
-	video_log("[video_take_screenshot] File %ls could not be opened for writing", fn);
+	video_log("[video_take_screenshot] File %ls could not be opened for writing", shot->path);
 	return;
     }
 
@@ -380,9 +551,12 @@ video_take_screenshot(const wchar_t *fn, int startx, int starty, int w, int h)
     }
 
     for (y = 0; y < h; ++y) {
+	if (shot->grayscale || shot->invert)
+		video_transform_line(&shot->pixels[y * w], w, shot->grayscale, shot->graytype, shot->invert);
+
 	b_rgb[y] = (png_byte *) malloc(png_get_rowbytes(png_ptr, info_ptr));
     	for (x = 0; x < w; ++x) {
-		temp = render_buffer->line[y + starty][x + startx];
+		temp = shot->pixels[(y * w) + x];
 
 		b_rgb[y][(x) * 3 + 0] = (temp >> 16) & 0xff;
 		b_rgb[y][(x) * 3 + 1] = (temp >> 8) & 0xff;
@@ -403,66 +577,170 @@ video_take_screenshot(const wchar_t *fn, int startx, int starty, int w, int h)
     if (b_rgb) free(b_rgb);
 
     if (fp) fclose(fp);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
 }
 
 
+static void
+video_shot_thread(void *param)
+{
+    video_shot_t shot;
+
+    while (1) {
+	thread_wait_mutex(shot_data.mutex);
+	if (shot_data.head == shot_data.tail) {
+		thread_release_mutex(shot_data.mutex);
+		thread_wait_event(shot_data.wake, -1);
+		continue;
+	}
+	shot = shot_data.queue[shot_data.tail & (VIDEO_SHOT_QUEUE - 1)];
+	thread_release_mutex(shot_data.mutex);
+
+	video_take_screenshot(&shot);
+	free(shot.pixels);
+
+	thread_wait_mutex(shot_data.mutex);
+	shot_data.tail++;
+	thread_release_mutex(shot_data.mutex);
+
+	thread_set_event(shot_data.done);
+    }
+}
+
+
+/*
+ * Copy the rectangle out of buffer32 and queue it for the screenshot
+ * thread, which applies the colour transform and writes the PNG.
+ */
 static void
 video_screenshot(int x, int y, int w, int h)
 {
-    wchar_t path[1024], fn[128];
+    video_shot_t *shot;
+    wchar_t fn[128];
+    int yy;
+
+    if ((w <= 0) || (h <= 0))
+	return;
+
+    thread_wait_mutex(shot_data.mutex);
+    if ((shot_data.head - shot_data.tail) >= VIDEO_SHOT_QUEUE) {
+	thread_release_mutex(shot_data.mutex);
+	video_log("screenshot queue full, screenshot dropped\n");
+	return;
+    }
+    shot = &shot_data.queue[shot_data.head & (VIDEO_SHOT_QUEUE - 1)];
+    thread_release_mutex(shot_data.mutex);
 
     memset(fn, 0, sizeof(fn));
-    memset(path, 0, sizeof(path));
+    memset(shot->path, 0, sizeof(shot->path));
 
-    plat_append_filename(path, usr_path, SCREENSHOT_PATH);
+    plat_append_filename(shot->path, usr_path, SCREENSHOT_PATH);
 
-    if (! plat_dir_check(path))
-	plat_dir_create(path);
+    if (! plat_dir_check(shot->path))
+	plat_dir_create(shot->path);
 
-    wcscat(path, L"\\");
+    wcscat(shot->path, L"\\");
 
     plat_tempfile(fn, NULL, L".png");
-    wcscat(path, fn);
+    wcscat(shot->path, fn);
 
-    video_log("taking screenshot to: %S\n", path);
+    video_log("taking screenshot to: %S\n", shot->path);
 
-    video_take_screenshot((const wchar_t *) path, x, y, w, h);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
+    shot->pixels = (uint32_t *) malloc(w * h * sizeof(uint32_t));
+    for (yy = 0; yy < h; yy++) {
+	if (((y + yy) >= 0) && ((y + yy) < buffer32->h))
+		memcpy(&shot->pixels[yy * w], &(buffer32->line[y + yy][x]), w << 2);
+	else
+		memset(&shot->pixels[yy * w], 0x00, w << 2);
+    }
+    shot->w = w;
+    shot->h = h;
+    shot->grayscale = video_grayscale;
+    shot->graytype = video_graytype;
+    shot->invert = invert_display;
+
+    thread_wait_mutex(shot_data.mutex);
+    shot_data.head++;
+    thread_release_mutex(shot_data.mutex);
+
+    thread_set_event(shot_data.wake);
 }
 
 
 static void
-video_transform_copy(uint32_t *dst, uint32_t *src, int len)
+video_damage_add(int *y1, int *y2, int add_y1, int add_y2)
 {
-    int i;
+    if (add_y1 >= add_y2)
+	return;
 
-    for (i = 0; i < len; i++) {
-	*dst = video_color_transform(*src);
-	dst++;
-	src++;
+    if (*y1 >= *y2) {
+	*y1 = add_y1;
+	*y2 = add_y2;
+    } else {
+	if (add_y1 < *y1)
+		*y1 = add_y1;
+	if (add_y2 > *y2)
+		*y2 = add_y2;
     }
 }
 
 
+/*
+ * Lines y1 to y2 - 1 of the rectangle are the ones the video card has
+ * redrawn since the last call. Each frame buffer remembers which lines
+ * it is missing, so only those are copied out of buffer32, and the
+ * blitter is told about the lines changed since it last took a frame.
+ * Moving or resizing the rectangle, or changing the colour transform,
+ * damages all of it.
+ */
 void
 video_blit_memtoscreen(int x, int y, int y1, int y2, int w, int h)
 {
-    int yy;
+    blit_frame_t *f = &blit_data.frames[blit_data.back];
+    int yy, c, old, transform;
 
     if ((w > 0) && (h > 0)) {
-	for (yy = 0; yy < h; yy++) {
-		if (((y + yy) >= 0) && ((y + yy) < buffer32->h)) {
-			if (video_grayscale || invert_display)
-				video_transform_copy(&(render_buffer->line[y + yy][x]), &(buffer32->line[y + yy][x]), w);
-			else
-				memcpy(&(render_buffer->line[y + yy][x]), &(buffer32->line[y + yy][x]), w << 2);
-		}
+	transform = video_grayscale | (video_graytype << 4) | (invert_display << 8);
+
+	if (blit_data.full || (x != blit_data.last_x) || (y != blit_data.last_y) ||
+	    (w != blit_data.last_w) || (h != blit_data.last_h) ||
+	    (transform != blit_data.last_transform)) {
+		blit_data.full = 0;
+		blit_data.last_x = x;
+		blit_data.last_y = y;
+		blit_data.last_w = w;
+		blit_data.last_h = h;
+		blit_data.last_transform = transform;
+		y1 = 0;
+		y2 = h;
+	}
+
+	if (y1 < 0)
+		y1 = 0;
+	if (y2 > h)
+		y2 = h;
+	if (y2 < y1)
+		y2 = y1;
+
+	if (capture_on)
+		capture_video(x, y, y1, y2, w, h);
+
+	for (c = 0; c < BLIT_FRAMES; c++)
+		video_damage_add(&blit_data.frames[c].stale_y1, &blit_data.frames[c].stale_y2, y1, y2);
+
+	video_blit_lines += (f->stale_y2 - f->stale_y1);
+
+	for (yy = f->stale_y1; yy < f->stale_y2; yy++) {
+		if (((y + yy) >= 0) && ((y + yy) < buffer32->h))
+			memcpy(&(f->bitmap->line[y + yy][x]), &(buffer32->line[y + yy][x]), w << 2);
 	}
+	video_damage_add(&f->raw_y1, &f->raw_y2, f->stale_y1, f->stale_y2);
+	f->stale_y1 = f->stale_y2 = 0;
     }
 
     if (screenshots) {
-	if (render_buffer != NULL)
-		video_screenshot(x, y, w, h);
+	video_screenshot(x, y, w, h);
 	screenshots--;
 	video_log("screenshot taken, %i left\n", screenshots);
     }
@@ -470,17 +748,28 @@ video_blit_memtoscreen(int x, int y, int y1, int y2, int w, int h)
     if ((w <= 0) || (h <= 0))
 	return;
 
-    video_wait_for_blit();
+    /* Start over once the blitter has taken the previous frame, else add to it. */
+    if (!(__atomic_load_n(&blit_data.middle, __ATOMIC_ACQUIRE) & BLIT_FRESH))
+	blit_data.pend_y1 = blit_data.pend_y2 = 0;
+    video_damage_add(&blit_data.pend_y1, &blit_data.pend_y2, y1, y2);
+
+    f->x = x;
+    f->y = y;
+    f->y1 = blit_data.pend_y1;
+    f->y2 = blit_data.pend_y2;
+    f->w = w;
+    f->h = h;
+    f->grayscale = video_grayscale;
+    f->graytype = video_graytype;
+    f->invert = invert_display;
+    f->time = plat_timer_read();
+
+    old = __atomic_exchange_n(&blit_data.middle, blit_data.back | BLIT_FRESH, __ATOMIC_ACQ_REL);
+    if (old & BLIT_FRESH)
+	video_frames_dropped++;
+    blit_data.back = old & ~BLIT_FRESH;
 
     blit_data.busy = 1;
-    blit_data.buffer_in_use = 1;
-    blit_data.x = x;
-    blit_data.y = y;
-    blit_data.y1 = y1;
-    blit_data.y2 = y2;
-    blit_data.w = w;
-    blit_data.h = h;
-
     thread_set_event(blit_data.wake_blit_thread);
 }
 
@@ -820,7 +1109,13 @@ video_init(void)
 
     /* Account for overscan. */
     buffer32 = create_bitmap(2048 + 64, 2048 + 64);
-    render_buffer = create_bitmap(2048 + 64, 2048 + 64);
+    for (c = 0; c < BLIT_FRAMES; c++)
+	blit_data.frames[c].bitmap = create_bitmap(2048 + 64, 2048 + 64);
+    blit_data.front = 0;
+    blit_data.middle = 1;
+    blit_data.back = 2;
+    blit_data.full = 1;
+    render_buffer = blit_data.frames[blit_data.front].bitmap;
 
     for (c = 0; c < 64; c++) {
 	cgapal[c + 64].r = (((c & 4) ? 2 : 0) | ((c & 0x10) ? 1 : 0)) * 21;
@@ -865,9 +1160,15 @@ video_init(void)
     for (c = 0; c < 65536; c++)
 	video_16to32[c] = calc_16to32(c);
 
+    svga_render_init();
+
     blit_data.wake_blit_thread = thread_create_event();
     blit_data.blit_complete = thread_create_event();
-    blit_data.buffer_not_in_use = thread_create_event();
+
+    shot_data.mutex = thread_create_mutex();
+    shot_data.wake = thread_create_event();
+    shot_data.done = thread_create_event();
+    shot_data.thread = thread_create(video_shot_thread, NULL);
     blit_data.blit_thread = thread_create(blit_thread, NULL);
 }
 
@@ -875,8 +1176,22 @@ video_init(void)
 void
 video_close(void)
 {
+    int c;
+
+    /* Let any queued screenshots finish writing. */
+    thread_wait_mutex(shot_data.mutex);
+    while (shot_data.head != shot_data.tail) {
+	thread_release_mutex(shot_data.mutex);
+	thread_wait_event(shot_data.done, -1);
+	thread_wait_mutex(shot_data.mutex);
+    }
+    thread_release_mutex(shot_data.mutex);
+    thread_kill(shot_data.thread);
+    thread_close_mutex(shot_data.mutex);
+    thread_destroy_event(shot_data.done);
+    thread_destroy_event(shot_data.wake);
+
     thread_kill(blit_data.blit_thread);
-    thread_destroy_event(blit_data.buffer_not_in_use);
     thread_destroy_event(blit_data.blit_complete);
     thread_destroy_event(blit_data.wake_blit_thread);
 
@@ -886,7 +1201,9 @@ video_close(void)
     free(video_8togs);
     free(video_6to8);
 
-    destroy_bitmap(render_buffer);
+    for (c = 0; c < BLIT_FRAMES; c++)
+	destroy_bitmap(blit_data.frames[c].bitmap);
+    render_buffer = NULL;
     destroy_bitmap(buffer32);
 
     if (fontdatksc5601) {
@@ -1047,29 +1364,5 @@ loadfont(wchar_t *s, int format)
 uint32_t
 video_color_transform(uint32_t color)
 {
-    uint8_t *clr8 = (uint8_t *) &color;
-    /* if (!video_grayscale && !invert_display)
-	return color; */
-    if (video_grayscale) {
-	if (video_graytype) {
-		if (video_graytype == 1)
-			color = ((54 * (uint32_t)clr8[2]) + (183 * (uint32_t)clr8[1]) + (18 * (uint32_t)clr8[0])) / 255;
-		else
-			color = ((uint32_t)clr8[2] + (uint32_t)clr8[1] + (uint32_t)clr8[0]) / 3;
-	} else
-		color = ((76 * (uint32_t)clr8[2]) + (150 * (uint32_t)clr8[1]) + (29 * (uint32_t)clr8[0])) / 255;
-	switch (video_grayscale) {
-		case 2: case 3: case 4:
-			color = (uint32_t) shade[video_grayscale][color];
-			break;
-		default:
-			clr8[3] = 0;
-			clr8[0] = color;
-			clr8[1] = clr8[2] = clr8[0];
-			break;
-	}
-    }
-    if (invert_display)
-	color ^= 0x00ffffff;
-    return color;
+    return video_transform_pixel(color, video_grayscale, video_graytype, invert_display);
 }
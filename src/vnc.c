@@ -18,6 +18,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
@@ -38,6 +39,21 @@
 #define VNC_MIN_Y	200
 #define VNC_MAX_Y	2048
 
+/* Lines are compared against the framebuffer in tiles of this size. */
+#define VNC_TILE_W	64
+#define VNC_TILE_H	16
+
+#define VNC_STATS_INTERVAL	60	/* seconds between client reports */
+
+
+typedef struct {
+    uint64_t	connected,		/* when the client came in */
+		report,			/* when it was last reported */
+		start,			/* start of the update being sent */
+		busy;			/* time spent encoding and sending */
+    uint32_t	updates;
+} vnc_client_t;
+
 
 static rfbScreenInfoPtr	rfb = NULL;
 static int	clients;
@@ -45,6 +61,8 @@ static int	updatingSize;
 static int	allowedX,
 		allowedY;
 static int	ptr_x, ptr_y, ptr_but;
+static uint64_t	tiles_checked,
+		tiles_changed;
 
 
 #ifdef ENABLE_VNC_LOG
@@ -104,11 +122,39 @@ vnc_ptrevent(int but, int x, int y, rfbClientPtr cl)
 }
 
 
+/* Log what a client has cost us so far. */
+static void
+vnc_client_report(rfbClientPtr cl, uint64_t now)
+{
+    vnc_client_t *vc = (vnc_client_t *) cl->clientData;
+    double secs;
+
+    secs = (double) (now - vc->connected) / (double) timer_freq;
+    if (secs <= 0.0)
+	return;
+
+    pclog("VNC: %s: %u updates, %.1f KB/s (%.1f KB/s raw), %.1f%% busy encoding\n",
+	  cl->host, vc->updates,
+	  (double) rfbStatGetSentBytes(cl) / (secs * 1024.0),
+	  (double) rfbStatGetSentBytesIfRaw(cl) / (secs * 1024.0),
+	  ((double) vc->busy * 100.0) / ((double) timer_freq * secs));
+    pclog("VNC: %" PRIu64 " of %" PRIu64 " tiles changed\n", tiles_changed, tiles_checked);
+
+    vc->report = now;
+}
+
+
 static void
 vnc_clientgone(rfbClientPtr cl)
 {
     vnc_log("VNC: client disconnected: %s\n", cl->host);
 
+    if (cl->clientData != NULL) {
+	vnc_client_report(cl, plat_timer_read());
+	free(cl->clientData);
+	cl->clientData = NULL;
+    }
+
     if (clients > 0)
 	clients--;
     if (clients == 0) {
@@ -129,6 +175,10 @@ vnc_newclient(rfbClientPtr cl)
     /* Hook the ClientGone function so we know when they're gone. */
     cl->clientGoneHook = vnc_clientgone;
 
+    cl->clientData = calloc(1, sizeof(vnc_client_t));
+    ((vnc_client_t *) cl->clientData)->connected = plat_timer_read();
+    ((vnc_client_t *) cl->clientData)->report = ((vnc_client_t *) cl->clientData)->connected;
+
     vnc_log("VNC: new client: %s\n", cl->host);
     if (++clients == 1) {
 	/* Reset the mouse. */
@@ -151,9 +201,17 @@ vnc_newclient(rfbClientPtr cl)
 }
 
 
+/*
+ * Called on the client's own output thread before and after every
+ * update it is sent, so the time in between is what encoding (and
+ * writing) that client's updates costs.
+ */
 static void
 vnc_display(rfbClientPtr cl)
 {
+    if (cl->clientData != NULL)
+	((vnc_client_t *) cl->clientData)->start = plat_timer_read();
+
     /* Avoid race condition between resize and update. */
     if (!updatingSize && cl->newFBSizePending) {
 	updatingSize = 1;
@@ -167,22 +225,91 @@ vnc_display(rfbClientPtr cl)
 
 
 static void
-vnc_blit(int x, int y, int y1, int y2, int w, int h)
+vnc_display_finished(rfbClientPtr cl, int result)
+{
+    vnc_client_t *vc = (vnc_client_t *) cl->clientData;
+    uint64_t now;
+
+    if (vc == NULL)
+	return;
+
+    now = plat_timer_read();
+    vc->busy += now - vc->start;
+    vc->updates++;
+
+    if ((now - vc->report) >= (VNC_STATS_INTERVAL * timer_freq))
+	vnc_client_report(cl, now);
+}
+
+
+static void
+vnc_mark(int x1, int y1, int x2, int y2)
 {
-    uint32_t *p;
-    int yy;
+    if (updatingSize || (x1 >= allowedX) || (y1 >= allowedY))
+	return;
+
+    rfbMarkRectAsModified(rfb, x1, y1, (x2 < allowedX) ? x2 : allowedX,
+			  (y2 < allowedY) ? y2 : allowedY);
+}
 
-    for (yy=y1; yy<y2; yy++) {
-	p = (uint32_t *)&(((uint32_t *)rfb->frameBuffer)[yy*VNC_MAX_X]);
 
-	if ((y+yy) >= 0 && (y+yy) < VNC_MAX_Y)
-		memcpy(p, &(render_buffer->line[y+yy][x]), w*4);
+/*
+ * Copy the lines the video card redrew into the framebuffer, one
+ * tile at a time, and only mark the tiles whose contents actually
+ * changed. Runs of changed tiles on a tile row go out as one rect.
+ */
+static void
+vnc_blit(int x, int y, int y1, int y2, int w, int h)
+{
+    uint32_t *fb = (uint32_t *) rfb->frameBuffer;
+    uint32_t *src, *dst;
+    int tx, ty, ty1, ty2, tw;
+    int yy, run, changed;
+
+    if (w > VNC_MAX_X)
+	w = VNC_MAX_X;
+    if (y1 < 0)
+	y1 = 0;
+    if (y2 > VNC_MAX_Y)
+	y2 = VNC_MAX_Y;
+
+    for (ty = y1 - (y1 % VNC_TILE_H); ty < y2; ty += VNC_TILE_H) {
+	ty1 = (ty < y1) ? y1 : ty;
+	ty2 = ((ty + VNC_TILE_H) > y2) ? y2 : (ty + VNC_TILE_H);
+	run = -1;
+
+	for (tx = 0; tx < w; tx += VNC_TILE_W) {
+		tw = ((tx + VNC_TILE_W) > w) ? (w - tx) : VNC_TILE_W;
+		changed = 0;
+
+		for (yy = ty1; yy < ty2; yy++) {
+			if (((y + yy) < 0) || ((y + yy) >= render_buffer->h))
+				continue;
+
+			src = &(render_buffer->line[y + yy][x + tx]);
+			dst = &fb[(yy * VNC_MAX_X) + tx];
+			if (memcmp(dst, src, tw << 2)) {
+				memcpy(dst, src, tw << 2);
+				changed = 1;
+			}
+		}
+
+		tiles_checked++;
+		if (changed) {
+			tiles_changed++;
+			if (run < 0)
+				run = tx;
+		} else if (run >= 0) {
+			vnc_mark(run, ty1, tx, ty2);
+			run = -1;
+		}
+	}
+
+	if (run >= 0)
+		vnc_mark(run, ty1, w, ty2);
     }
- 
-    video_blit_complete();
 
-    if (! updatingSize)
-	rfbMarkRectAsModified(rfb, 0,0, allowedX,allowedY);
+    video_blit_complete();
 }
 
 
@@ -219,6 +346,7 @@ vnc_init(UNUSED(void *arg))
 	rfb->serverFormat = rpf;
 	rfb->alwaysShared = TRUE;
 	rfb->displayHook = vnc_display;
+	rfb->displayFinishedHook = vnc_display_finished;
 	rfb->ptrAddEvent = vnc_ptrevent;
 	rfb->kbdAddEvent = vnc_kbdevent;
 	rfb->newClientHook = vnc_newclient;
@@ -182,6 +182,7 @@ ResetAllMenus(void)
 #endif
 
     CheckMenuItem(menuMain, IDM_ACTION_RCTRL_IS_LALT, MF_UNCHECKED);
+    CheckMenuItem(menuMain, IDM_ACTION_TURBO, MF_UNCHECKED);
 
     CheckMenuItem(menuMain, IDM_UPDATE_ICONS, MF_UNCHECKED);
 
@@ -242,6 +243,7 @@ ResetAllMenus(void)
     CheckMenuItem(menuMain, IDM_VID_GRAY_RGB+4, MF_UNCHECKED);
 
     CheckMenuItem(menuMain, IDM_ACTION_RCTRL_IS_LALT, rctrl_is_lalt ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(menuMain, IDM_ACTION_TURBO, turbo_mode ? MF_CHECKED : MF_UNCHECKED);
 
     CheckMenuItem(menuMain, IDM_UPDATE_ICONS, update_icons ? MF_CHECKED : MF_UNCHECKED);
 
@@ -447,6 +449,15 @@ MainWindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 				pc_send_cae();
 				break;
 
+			case IDM_ACTION_SNAPSHOT:
+				pc_snapshot_save();
+				break;
+
+			case IDM_ACTION_TURBO:
+				turbo_mode ^= 1;
+				CheckMenuItem(hmenu, IDM_ACTION_TURBO, turbo_mode ? MF_CHECKED : MF_UNCHECKED);
+				break;
+
 			case IDM_ACTION_RCTRL_IS_LALT:
 				rctrl_is_lalt ^= 1;
 				CheckMenuItem(hmenu, IDM_ACTION_RCTRL_IS_LALT, rctrl_is_lalt ? MF_CHECKED : MF_UNCHECKED);